@@ -96,7 +96,9 @@ shutdown()
 ~~~
 
 Calling what() on a caught exception returns a string with the entire exception history (both nested and
-chained).
+chained). The string is formatted by the first call to what() and returned unchanged by later calls.
+The history is resolved once, when it is first needed, and kept with the exception, so formatting it again
+(with to_string() or in a later exception that remembers or nests this one) does not rethrow anything.
 
 */
 
@@ -132,9 +134,12 @@ protected:
     Exception(std::string const& name, std::string const& reason);
 
 private:
+    struct Chain;
+
     std::string name_;
     std::string reason_;
-    mutable std::string what_;
+    mutable std::shared_ptr<std::string const> what_;    // Set by the first call to what()
+    mutable std::shared_ptr<Chain const> chain_;         // Set when the history is first formatted
     std::exception_ptr earlier_;
 };
 
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_BACKGROUNDREAPER_H
+#define UNITY_UTIL_BACKGROUNDREAPER_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct BackgroundReaperPrivate;
+}
+
+/**
+\brief Runs deleters on a background thread.
+
+Some deleters can block for a long time, such as <code>close()</code> on a network file system,
+<code>munmap()</code> of a large mapping, or the last unref of a large object graph. BackgroundReaper
+takes such deleters off the calling thread: defer() queues a deleter and returns immediately, and a
+dedicated thread runs the queued deleters in the order they were queued.
+
+Queuing does not take a lock while the background thread is busy, so defer() can be called from any number
+of threads without contention. Only if the background thread is idle, defer() briefly takes a lock to wake it up.
+Exceptions thrown by a deleter are ignored (but counted).
+
+Usually, you do not call defer() directly, but use a DeferredDeleter as the deleter of a ResourcePtr.
+
+The destructor runs all deleters that are still queued before it returns. If the last reference to the reaper
+is dropped by one of its own deleters (for example, because a DeferredDeleter was captured by a deferred
+resource), the destructor cannot wait for the background thread. In that case, the background thread runs
+the remaining deleters and then exits by itself.
+*/
+
+class UNITY_API BackgroundReaper final
+{
+public:
+    /// @cond
+    NONCOPYABLE(BackgroundReaper);
+    UNITY_DEFINES_PTRS(BackgroundReaper);
+    /// @endcond
+
+    /**
+    \brief Counters describing the work done by the reaper.
+    */
+    struct Stats
+    {
+        size_t queue_depth;                         ///< Number of deleters that are queued or running.
+        size_t max_queue_depth;                     ///< Largest queue depth so far.
+        uint64_t completed;                         ///< Number of deleters that have run.
+        uint64_t failed;                            ///< Number of deleters that threw an exception.
+        std::chrono::nanoseconds total_delete_time; ///< Total time spent running deleters.
+        std::chrono::nanoseconds max_delete_time;   ///< Longest time taken by a single deleter.
+    };
+
+    /**
+    \brief Starts the background thread.
+    \throws ResourceException The thread could not be created.
+    */
+    BackgroundReaper();
+
+    /**
+    \brief Runs all queued deleters and stops the background thread.
+
+    If called from a deleter, returns immediately; the background thread runs the remaining deleters and then exits.
+    */
+    ~BackgroundReaper() noexcept;
+
+    /**
+    \brief Queues a deleter to run on the background thread.
+
+    If the deleter cannot be queued because memory is exhausted, it runs on the calling thread instead.
+    */
+    void defer(std::function<void()> deleter) noexcept;
+
+    /**
+    \brief Waits until all deleters queued before the call have run.
+
+    Call this at shutdown, or before an operation that relies on resources having been released.
+    \throws LogicException flush() was called from a deleter.
+    */
+    void flush();
+
+    /**
+    \brief Returns the current counters.
+    */
+    Stats stats() const noexcept;
+
+private:
+    std::unique_ptr<internal::BackgroundReaperPrivate> p_;
+};
+
+/**
+\brief Adaptor that makes a deleter run on a BackgroundReaper.
+
+DeferredDeleter wraps a deleter <code>D</code>. When called with a resource, it queues a copy of the
+deleter and the resource on the reaper instead of deallocating the resource immediately. Use it as the
+deleter of a ResourcePtr whose deleter may block:
+
+~~~
+auto reaper = std::make_shared<BackgroundReaper>();
+ResourcePtr<int, DeferredDeleter<decltype(&::close)>> fd(::open(path, O_RDONLY | O_CLOEXEC),
+                                                         make_deferred_deleter(reaper, ::close));
+~~~
+
+The deleter holds a reference to the reaper, so the reaper lives at least as long as any resource
+that is managed with it.
+
+\note The resource is copied into the queue, so <code>R</code> must be copyable, and it must remain valid
+when it is used from the reaper's thread.
+*/
+
+template<typename D>
+class DeferredDeleter
+{
+public:
+    /**
+    \brief Creates a deleter that runs <code>deleter</code> on <code>reaper</code>.
+    */
+    DeferredDeleter(BackgroundReaper::SPtr reaper, D deleter)
+        : reaper_(std::move(reaper))
+        , deleter_(std::move(deleter))
+    {
+    }
+
+    /**
+    \brief Queues the resource for deletion on the reaper.
+    */
+    template<typename R>
+    void operator()(R const& resource) const
+    {
+        D d = deleter_;
+        reaper_->defer([d, resource]() mutable { d(resource); });
+    }
+
+    /**
+    \return The reaper used by this deleter.
+    */
+    BackgroundReaper::SPtr const& reaper() const noexcept
+    {
+        return reaper_;
+    }
+
+private:
+    BackgroundReaper::SPtr reaper_;
+    D deleter_;
+};
+
+/**
+\brief Convenience function to create a DeferredDeleter, deducing the type of the deleter.
+*/
+
+template<typename D>
+DeferredDeleter<D> make_deferred_deleter(BackgroundReaper::SPtr reaper, D deleter)
+{
+    return DeferredDeleter<D>(std::move(reaper), std::move(deleter));
+}
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_COMPACTRESOURCEPTR_H
+#define UNITY_UTIL_COMPACTRESOURCEPTR_H
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <type_traits>
+#include <utility>
+
+namespace unity
+{
+
+namespace util
+{
+
+/**
+\brief Traits class that tells CompactResourcePtr which value of a resource means "no resource".
+
+For example, <code>ResourceTraits<int, -1></code> describes a file descriptor, and
+<code>ResourceTraits<DIR*, nullptr></code> describes a directory stream.
+
+You can use your own traits class instead. It must provide a static <code>invalid()</code> function
+that returns the sentinel value.
+*/
+
+template<typename R, R Invalid>
+struct ResourceTraits
+{
+    /**
+    \return The value that represents the "no resource allocated" state.
+    */
+    static constexpr R invalid() noexcept
+    {
+        return Invalid;
+    }
+};
+
+namespace internal
+{
+
+// Holds the deleter. An empty deleter is held as a base class, so it takes no space.
+
+template<typename D, bool = std::is_class<D>::value && std::is_empty<D>::value>
+class DeleterHolder
+{
+public:
+    DeleterHolder() = default;
+    explicit DeleterHolder(D d)
+        : d_(std::move(d))
+    {
+    }
+
+    D& deleter() noexcept
+    {
+        return d_;
+    }
+
+    D const& deleter() const noexcept
+    {
+        return d_;
+    }
+
+private:
+    D d_;
+};
+
+template<typename D>
+class DeleterHolder<D, true> : private D
+{
+public:
+    DeleterHolder() = default;
+    explicit DeleterHolder(D d)
+        : D(std::move(d))
+    {
+    }
+
+    D& deleter() noexcept
+    {
+        return *this;
+    }
+
+    D const& deleter() const noexcept
+    {
+        return *this;
+    }
+};
+
+} // namespace internal
+
+/**
+\brief A resource pointer that is no larger than the resource it manages.
+
+CompactResourcePtr is a lightweight alternative to ResourcePtr for resources that have a value
+that denotes "no resource allocated", such as -1 for a file descriptor or <code>nullptr</code> for a pointer.
+That value, provided by the traits class <code>T</code>, takes the place of the flag that ResourcePtr keeps.
+A deleter that is an empty class (such as a function object without data members or a lambda without captures)
+takes no space, and it is called directly rather than through a <code>std::function</code>, so the call is
+usually inlined.
+
+Unlike ResourcePtr, CompactResourcePtr is not thread-safe, and get() returns the invalid value rather
+than throwing if no resource is held. The deleter is never called with the invalid value.
+
+For the most common cases, use UniqueFd and UniqueDir:
+
+~~~
+UniqueFd fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+if (!fd)
+{
+    throw FileException("cannot open " + filename, errno);
+}
+read(fd.get(), ...);
+~~~
+
+\note An empty deleter is used as a base class, so it must not be declared <code>final</code>.
+*/
+
+template<typename R, typename D, typename T>
+class CompactResourcePtr final : private internal::DeleterHolder<D>
+{
+    typedef internal::DeleterHolder<D> Holder;
+
+
+public:
+    /** Deleted */
+    CompactResourcePtr(CompactResourcePtr const&) = delete;
+    /** Deleted */
+    CompactResourcePtr& operator=(CompactResourcePtr const&) = delete;
+
+    /**
+    \typedef element_type
+    The type of resource managed by this CompactResourcePtr.
+    */
+    typedef R element_type;
+
+    /**
+    \typedef deleter_type
+    The function object that is called to deallocate the resource.
+    */
+    typedef D deleter_type;
+
+    /**
+    \typedef traits_type
+    The traits class that provides the invalid value.
+    */
+    typedef T traits_type;
+
+    /**
+    Constructs a CompactResourcePtr that does not hold a resource, with a default-constructed deleter.
+    */
+    CompactResourcePtr() noexcept(std::is_nothrow_default_constructible<D>::value)
+        : CompactResourcePtr(T::invalid())
+    {
+    }
+
+    /**
+    Constructs a CompactResourcePtr for the specified resource, with a default-constructed deleter.
+    If <code>r</code> is the invalid value, no resource is held.
+    */
+    explicit CompactResourcePtr(R r) noexcept(std::is_nothrow_default_constructible<D>::value)
+        : Holder()
+        , resource_(r)
+    {
+    }
+
+    /**
+    Constructs a CompactResourcePtr for the specified resource and deleter.
+    If <code>r</code> is the invalid value, no resource is held.
+    */
+    CompactResourcePtr(R r, D d)
+        : Holder(std::move(d))
+        , resource_(r)
+    {
+    }
+
+    /**
+    Transfers ownership from <code>other</code> to <code>this</code>.
+    */
+    CompactResourcePtr(CompactResourcePtr&& other) noexcept(std::is_nothrow_move_constructible<D>::value)
+        : Holder(std::move(static_cast<Holder&>(other)))
+        , resource_(other.release())
+    {
+    }
+
+    /**
+    Deallocates the current resource (if any) and transfers ownership from <code>other</code> to <code>this</code>.
+    */
+    CompactResourcePtr& operator=(CompactResourcePtr&& other)
+    {
+        if (this != &other)
+        {
+            dealloc();
+            static_cast<Holder&>(*this) = std::move(static_cast<Holder&>(other));
+            resource_ = other.release();
+        }
+        return *this;
+    }
+
+    /**
+    Calls the deleter for the current resource (if any). Exceptions from the deleter are ignored.
+    */
+    ~CompactResourcePtr() noexcept
+    {
+        try
+        {
+            dealloc();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    /**
+    Deallocates the current resource (if any) and takes ownership of <code>r</code>. If the deleter
+    throws, the exception is propagated, and <code>this</code> holds <code>r</code>.
+    */
+    void reset(R r)
+    {
+        R old = resource_;
+        resource_ = r;
+        if (old != T::invalid())
+        {
+            this->deleter()(old);
+        }
+    }
+
+    /**
+    Releases ownership of the current resource without calling the deleter.
+    \return The current resource, or the invalid value if no resource is held.
+    */
+    R release() noexcept
+    {
+        R r = resource_;
+        resource_ = T::invalid();
+        return r;
+    }
+
+    /**
+    Calls the deleter for the current resource (if any). If the deleter throws, the exception is propagated,
+    and no resource is held.
+    */
+    void dealloc()
+    {
+        reset(T::invalid());
+    }
+
+    /**
+    \return The current resource, or the invalid value if no resource is held.
+    */
+    R get() const noexcept
+    {
+        return resource_;
+    }
+
+    /**
+    \return <code>true</code> if a resource is held, that is, the resource does not have the invalid value.
+    */
+    bool has_resource() const noexcept
+    {
+        return resource_ != T::invalid();
+    }
+
+    /**
+    Synonym for has_resource().
+    */
+    explicit operator bool() const noexcept
+    {
+        return has_resource();
+    }
+
+    /**
+    \return The deleter for the resource.
+    */
+    D& get_deleter() noexcept
+    {
+        return this->deleter();
+    }
+
+    /**
+    \return The deleter for the resource.
+    */
+    D const& get_deleter() const noexcept
+    {
+        return this->deleter();
+    }
+
+    /**
+    Swaps the resource and deleter of <code>this</code> with those of <code>other</code>.
+    */
+    void swap(CompactResourcePtr& other)
+    {
+        using std::swap;
+        swap(static_cast<Holder&>(*this), static_cast<Holder&>(other));
+        swap(resource_, other.resource_);
+    }
+
+    /** Compares the resources of <code>this</code> and <code>rhs</code>. */
+    bool operator==(CompactResourcePtr const& rhs) const
+    {
+        return resource_ == rhs.resource_;
+    }
+
+    /** Compares the resources of <code>this</code> and <code>rhs</code>. */
+    bool operator!=(CompactResourcePtr const& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    /** Compares the resources of <code>this</code> and <code>rhs</code>. */
+    bool operator<(CompactResourcePtr const& rhs) const
+    {
+        return resource_ < rhs.resource_;
+    }
+
+private:
+    R resource_;
+};
+
+/**
+Swaps the resource and deleter of <code>lhs</code> with those of <code>rhs</code>.
+*/
+
+template<typename R, typename D, typename T>
+void swap(CompactResourcePtr<R, D, T>& lhs, CompactResourcePtr<R, D, T>& rhs)
+{
+    lhs.swap(rhs);
+}
+
+namespace internal
+{
+
+struct FdCloser
+{
+    void operator()(int fd) const noexcept
+    {
+        ::close(fd);
+    }
+};
+
+struct DirCloser
+{
+    void operator()(DIR* dir) const noexcept
+    {
+        ::closedir(dir);
+    }
+};
+
+} // namespace internal
+
+/**
+\brief Owns a file descriptor and closes it on destruction. The size of a UniqueFd is the size of an <code>int</code>.
+*/
+
+typedef CompactResourcePtr<int, internal::FdCloser, ResourceTraits<int, -1>> UniqueFd;
+
+/**
+\brief Owns a directory stream and closes it on destruction. The size of a UniqueDir is the size of a pointer.
+*/
+
+typedef CompactResourcePtr<DIR*, internal::DirCloser, ResourceTraits<DIR*, nullptr>> UniqueDir;
+
+} // namespace util
+
+} // namespace unity
+
+#endif
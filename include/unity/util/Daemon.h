@@ -22,8 +22,14 @@
 #include <unity/util/DefinesPtrs.h>
 #include <unity/util/NonCopyable.h>
 
+#include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 
+#include <chrono>
+#include <functional>
+#include <vector>
+
 namespace unity
 {
 
@@ -47,7 +53,8 @@ and re-opened to <code>/dev/null</code>.
 
 By default, any file descriptors (other than the standard three) that are open in the process
 remain open to the same destinations in the daemon. If you want to have other descriptors closed, call
-close_fds() before calling daemonize_me(). This will close all file descriptors > 2.
+close_fds() before calling daemonize_me(). This will close all file descriptors > 2, except for
+those passed to keep_fd().
 
 By default, the signal disposition of the daemon is unchanged. To reset all signals to their
 default disposition, call reset_signals() before calling daemonize_me().
@@ -60,6 +67,24 @@ working directory, call set_working_dir() before calling daemonize_me(). Note th
 directory should be set to a path that is in the root file system. If the working directory
 is in any other file system, that file system cannot be unmounted while the daemon is running.
 
+For performance isolation, you can set resource limits, the nice value and I/O priority, the CPU
+affinity, and the OOM score adjustment of the daemon, and have the daemon lock its memory. These settings
+are applied by daemonize_me() in the forked child processes, never in the calling process. If any of them
+cannot be applied, daemonize_me() throws a SyscallException in the calling process, which is left unchanged.
+
+By default, the original process exits as soon as it has forked, before the daemon has done anything.
+A supervisor that starts the daemon therefore cannot tell when the daemon is ready to do its work. To have
+the original process wait until the daemon has initialized itself, call wait_for_ready() before calling
+daemonize_me(), and call notify_ready() in the daemon once it is ready. The original process then exits with the
+status passed to notify_ready(). If the daemon instead exits, or the timeout expires first, the original
+process exits with <code>EXIT_FAILURE</code>. notify_ready() also informs systemd if
+<code>NOTIFY_SOCKET</code> is set.
+
+To scale across several cores, a daemon can act as a supervisor for a number of worker processes.
+run_workers() forks the workers and restarts any worker that crashes or exits with a non-zero status,
+waiting longer after each consecutive failure (see set_restart_delay()). Call pin_workers() to pin
+each worker to one of the CPUs the process may run on.
+
 Note: This class is not async signal-safe. Do not call daemonize_me() from a a signal handler.
 */
 
@@ -83,6 +108,15 @@ public:
     */
     void close_fds() noexcept;
 
+    /**
+    \brief Causes daemonize_me() to leave the specified file descriptor open if close_fds() was called.
+
+    Use this for descriptors that the daemon must inherit, such as a listening socket or a log file.
+    \param fd The file descriptor to keep. Calling keep_fd() more than once for the same descriptor has no effect.
+    \throws InvalidArgumentException <code>fd</code> is one of the standard file descriptors or negative.
+    */
+    void keep_fd(int fd);
+
     /**
     \brief Causes daemonize_me() to reset all signals to their default behavior.
     */
@@ -104,6 +138,72 @@ public:
     */
     void set_working_directory(std::string const& working_directory);
 
+    /**
+    \brief Causes daemonize_me() to set a resource limit, such as <code>RLIMIT_NOFILE</code>,
+    <code>RLIMIT_MEMLOCK</code>, or <code>RLIMIT_CORE</code>.
+    \param resource The resource, as for <code>setrlimit()</code>.
+    \param soft The soft limit.
+    \param hard The hard limit. Raising the hard limit requires privileges.
+    \throws InvalidArgumentException The resource is invalid, or <code>soft</code> is greater than <code>hard</code>.
+    */
+    void set_rlimit(int resource, rlim_t soft, rlim_t hard);
+
+    /**
+    \brief Causes daemonize_me() to set the nice value of the daemon.
+    \param nice The nice value, in the range -20 (highest priority) to 19 (lowest priority).
+    Values lower than the current one require privileges.
+    \throws InvalidArgumentException The value is out of range.
+    */
+    void set_nice(int nice);
+
+    /**
+    \brief I/O scheduling classes for set_io_priority().
+    */
+    enum class IoPriorityClass
+    {
+        realtime = 1,       ///< Requires privileges
+        best_effort = 2,    ///< The default
+        idle = 3            ///< Only gets disk time when no other process needs it
+    };
+
+    /**
+    \brief Causes daemonize_me() to set the I/O priority of the daemon.
+    \param io_class The scheduling class.
+    \param level The priority within the class, from 0 (highest) to 7 (lowest). Ignored for the idle class.
+    \throws InvalidArgumentException The level is out of range.
+    */
+    void set_io_priority(IoPriorityClass io_class, int level = 4);
+
+    /**
+    \brief Causes daemonize_me() to restrict the daemon to the specified CPUs.
+    \throws InvalidArgumentException The set is empty or contains an invalid CPU number.
+    */
+    void set_cpu_affinity(std::vector<int> const& cpus);
+
+    /**
+    \brief Causes daemonize_me() to set the OOM score adjustment of the daemon.
+    \param adj The adjustment, from -1000 (never kill) to 1000 (kill first). Negative values require privileges.
+    \throws InvalidArgumentException The value is out of range.
+    */
+    void set_oom_score_adj(int adj);
+
+    /**
+    \brief Causes daemonize_me() to lock all current and future memory of the daemon with <code>mlockall()</code>.
+
+    This avoids page faults for latency-critical daemons. Locked memory is limited by <code>RLIMIT_MEMLOCK</code>
+    for unprivileged processes. Because memory locks are not inherited across <code>fork()</code>, the daemon
+    locks its memory itself and reports a failure back to the calling process.
+    */
+    void lock_memory() noexcept;
+
+    /**
+    \brief Causes the original process to wait in daemonize_me() until the daemon calls notify_ready().
+    \param timeout The maximum time to wait. If the timeout expires, the original process exits
+    with <code>EXIT_FAILURE</code>, but the daemon keeps running.
+    \throws InvalidArgumentException The timeout is not positive.
+    */
+    void wait_for_ready(std::chrono::milliseconds timeout);
+
     /**
     \brief Turns the calling process into a daemon.
 
@@ -116,9 +216,69 @@ public:
     for the calling process. However, daemonize_me() is not a cheap call because it calls <code>fork()</code>;
     the normal use pattern is to create a Daemon instance, select the desired settings, call daemonize_me(),
     and let the instance go out of scope.
+    \throws SyscallException The working directory or one of the resource settings could not be applied,
+    or <code>fork()</code> failed. The calling process is left unchanged.
     */
     void daemonize_me();
 
+    /**
+    \brief Reports that the daemon has finished initializing.
+
+    If wait_for_ready() was called before daemonize_me(), the original process exits with the
+    specified status. If the environment variable <code>NOTIFY_SOCKET</code> is set and the status is
+    <code>EXIT_SUCCESS</code>, <code>READY=1</code> is sent to that socket, in the same way as
+    <code>sd_notify()</code> does. Only the first call after daemonize_me() has an effect on the original process.
+    \param status The exit status for the original process.
+    */
+    void notify_ready(int status = EXIT_SUCCESS) noexcept;
+
+    /**
+    \brief The function run by each worker process.
+
+    The parameter is the index of the worker, in the range <code>0</code> to <code>count - 1</code>.
+    The return value is the exit status of the worker process.
+    */
+    typedef std::function<int(unsigned)> WorkerFunction;
+
+    /**
+    \brief Causes run_workers() to pin each worker to a single CPU.
+
+    Worker <code>i</code> runs on the <code>i</code>-th CPU (modulo the number of CPUs) that the calling
+    process is allowed to run on.
+    */
+    void pin_workers() noexcept;
+
+    /**
+    \brief Sets the delay before a failed worker is restarted by run_workers().
+
+    The delay doubles with each consecutive failure of the same worker, up to <code>max</code>.
+    Once a worker has run for longer than <code>max</code>, its delay starts again at <code>initial</code>.
+    The defaults are 100 milliseconds and 30 seconds.
+    \throws InvalidArgumentException <code>initial</code> is not positive, or <code>max</code> is less
+    than <code>initial</code>.
+    */
+    void set_restart_delay(std::chrono::milliseconds initial, std::chrono::milliseconds max);
+
+    /**
+    \brief Runs <code>count</code> worker processes and supervises them.
+
+    Each worker is a child process that calls <code>worker</code> with its index and exits with
+    the returned status. (If <code>worker</code> throws, the status is <code>EXIT_FAILURE</code>.)
+    A worker that exits with a non-zero status or is killed by a signal is restarted; a worker that
+    exits with status zero is not.
+
+    Child processes are reaped via a <code>signalfd</code>, so no signal handlers are installed.
+    On <code>SIGTERM</code> or <code>SIGINT</code>, the signal is forwarded as <code>SIGTERM</code> to
+    all workers; workers that have not exited after ten seconds are killed.
+
+    run_workers() returns once all workers have exited, either because they all returned zero
+    or because the supervisor was asked to terminate. Typically, it is called after daemonize_me()
+    (and notify_ready()), in a process that has no other threads.
+    \throws InvalidArgumentException <code>count</code> is zero or <code>worker</code> is empty.
+    \throws SyscallException The supervisor could not be set up.
+    */
+    void run_workers(unsigned count, WorkerFunction const& worker);
+
     ~Daemon() noexcept;
 
 private:
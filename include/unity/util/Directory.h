@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_DIRECTORY_H
+#define UNITY_UTIL_DIRECTORY_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct DirectoryPrivate;
+}
+
+/**
+\brief A handle for a directory that files can be accessed relative to.
+
+Each call to read_text_file() or read_binary_file() with an absolute path makes the kernel resolve every
+component of the path again. When many files are read from the same directory (such as
+<code>/usr/share/applications</code>), it is cheaper to open the directory once and to access the files
+relative to it: the methods of this class use <code>openat()</code> and <code>fstatat()</code> with the
+directory's file descriptor, so only the relative part of each name is resolved.
+
+The directory is opened with <code>O_PATH</code>, so it does not need to be readable (only searchable), and
+the handle remains valid if the directory is renamed. Names passed to the methods must be relative paths;
+they may contain several components, such as <code>"icons/hicolor/index.theme"</code>. (An absolute
+name is used as is, ignoring the directory.)
+
+A Directory can be passed to scan_directory() and FileCache::read_binary_file().
+
+All methods are thread-safe.
+*/
+
+class UNITY_API Directory final
+{
+public:
+    /// @cond
+    NONCOPYABLE(Directory);
+    UNITY_DEFINES_PTRS(Directory);
+    /// @endcond
+
+    /**
+    \brief Opens the specified directory.
+    \throws FileException The directory cannot be opened.
+    */
+    explicit Directory(std::string const& path);
+
+    ~Directory() noexcept;
+
+    /**
+    \brief Returns the path that was used to open the directory.
+    For a directory returned by open_directory(), this is the parent's path joined with the relative path.
+    */
+    std::string const& path() const noexcept;
+
+    /**
+    \brief Returns the file descriptor of the directory for use with <code>openat()</code> and similar.
+    The descriptor remains owned by the Directory.
+    */
+    int fd() const noexcept;
+
+    /**
+    \brief Opens a sub-directory.
+    \throws FileException The directory cannot be opened.
+    */
+    UPtr open_directory(std::string const& name) const;
+
+    /**
+    \brief Reads a file relative to the directory and returns its contents as a string.
+    \throws FileException The file cannot be read.
+    */
+    std::string read_text_file(std::string const& name) const;
+
+    /**
+    \brief Reads a file relative to the directory and returns its contents as bytes.
+    \throws FileException The file cannot be read.
+    */
+    std::vector<uint8_t> read_binary_file(std::string const& name) const;
+
+    /**
+    \brief Returns the status of a file relative to the directory.
+    \param follow_symlinks If <code>false</code>, the status of a symbolic link itself is returned.
+    \throws FileException The file does not exist or cannot be accessed.
+    */
+    struct stat stat(std::string const& name, bool follow_symlinks = true) const;
+
+    /**
+    \brief Returns the path of a file relative to the directory, for use in messages.
+    */
+    std::string path_of(std::string const& name) const;
+
+private:
+    Directory(int dirfd, std::string const& name, std::string const& path);
+
+    std::unique_ptr<internal::DirectoryPrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_DIRECTORYSCANNER_H
+#define UNITY_UTIL_DIRECTORYSCANNER_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/StringView.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+class Directory;
+
+namespace internal
+{
+struct DirectoryListingBuilder;
+}
+
+/**
+\brief Options for scan_directory().
+*/
+struct ScanOptions
+{
+    /**
+    \brief If non-empty, only entries whose name ends with one of these suffixes (such as ".desktop")
+    are returned. Directories are descended into regardless of their name.
+    */
+    std::vector<std::string> suffixes;
+
+    /**
+    \brief If <code>true</code>, sub-directories are scanned as well. Symbolic links to directories are not followed.
+    */
+    bool recursive = false;
+
+    /**
+    \brief If <code>true</code>, directories are included in the result (subject to <code>suffixes</code>).
+    */
+    bool include_directories = false;
+
+    /**
+    \brief The maximum number of directories that are read in parallel by a recursive scan.
+    Zero selects the number of hardware threads.
+    */
+    unsigned concurrency = 0;
+
+    /**
+    \brief The size of the buffer for each <code>getdents64()</code> call.
+    */
+    size_t buffer_size = 256 * 1024;
+};
+
+/**
+\brief The result of scan_directory().
+
+All paths are stored back-to-back in a single buffer, with a small fixed-size record per entry,
+so a listing of thousands of files needs only a handful of allocations.
+Paths are relative to the scanned directory; each path is followed by a NUL byte in the buffer,
+so <code>entry.path.data()</code> can be passed directly to system calls.
+*/
+class UNITY_API DirectoryListing final
+{
+public:
+    /**
+    \brief The type of a directory entry, as reported by the file system.
+    */
+    enum class Type : uint8_t
+    {
+        regular,        ///< Regular file
+        directory,      ///< Directory
+        symlink,        ///< Symbolic link (not followed)
+        other           ///< Device, socket, FIFO, or anything else
+    };
+
+    /**
+    \brief A single entry of the listing.
+    */
+    struct Entry
+    {
+        StringView path;    ///< Path relative to the scanned directory, such as "icons/app.png"
+        Type type;          ///< Type of the entry
+    };
+
+    /**
+    \brief Iterator over the entries.
+    */
+    class const_iterator
+    {
+    public:
+        /// @cond
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Entry value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Entry const* pointer;
+        typedef Entry reference;
+
+        const_iterator(DirectoryListing const* listing, size_t pos) noexcept
+            : listing_(listing)
+            , pos_(pos)
+        {
+        }
+
+        Entry operator*() const noexcept
+        {
+            return (*listing_)[pos_];
+        }
+
+        const_iterator& operator++() noexcept
+        {
+            ++pos_;
+            return *this;
+        }
+
+        const_iterator operator++(int) noexcept
+        {
+            const_iterator tmp(*this);
+            ++pos_;
+            return tmp;
+        }
+
+        bool operator==(const_iterator const& rhs) const noexcept
+        {
+            return pos_ == rhs.pos_;
+        }
+
+        bool operator!=(const_iterator const& rhs) const noexcept
+        {
+            return pos_ != rhs.pos_;
+        }
+        /// @endcond
+
+    private:
+        DirectoryListing const* listing_;
+        size_t pos_;
+    };
+
+    /**
+    \brief Constructs an empty listing.
+    */
+    DirectoryListing() = default;
+
+    /**
+    \brief Returns the number of entries.
+    */
+    size_t size() const noexcept
+    {
+        return slots_.size();
+    }
+
+    /**
+    \brief Returns <code>true</code> if the listing has no entries.
+    */
+    bool empty() const noexcept
+    {
+        return slots_.empty();
+    }
+
+    /**
+    \brief Returns the entry at the given index. No bounds checking is performed.
+    */
+    Entry operator[](size_t i) const noexcept
+    {
+        Slot const& s = slots_[i];
+        return Entry{ StringView(&names_[s.offset], s.length), s.type };
+    }
+
+    /**
+    \brief Returns an iterator to the first entry.
+    */
+    const_iterator begin() const noexcept
+    {
+        return const_iterator(this, 0);
+    }
+
+    /**
+    \brief Returns an iterator one past the last entry.
+    */
+    const_iterator end() const noexcept
+    {
+        return const_iterator(this, slots_.size());
+    }
+
+    /**
+    \brief Sorts the entries by path, using byte-wise comparison.
+    */
+    void sort();
+
+private:
+    struct Slot
+    {
+        size_t offset;
+        uint32_t length;
+        Type type;
+    };
+
+    std::vector<char> names_;
+    std::vector<Slot> slots_;
+
+    friend struct internal::DirectoryListingBuilder;
+};
+
+/**
+\brief Lists the contents of a directory.
+
+Entries are read with <code>getdents64()</code> into a large buffer, so each system call returns hundreds of
+entries. The entry type is taken from the directory entry itself; <code>fstatat()</code> is called only for file
+systems that do not provide it. Suffixes are compared in place, without copying the name of non-matching entries.
+
+For a recursive scan, sub-directories are read in parallel by a small pool of threads. Each thread collects
+its results separately, and the results are concatenated at the end.
+
+The order of the entries is unspecified; call DirectoryListing::sort() if you need a stable order.
+The entries "." and ".." are never returned. Sub-directories that cannot be read (for example, because
+they are removed during the scan or are not accessible) are skipped.
+
+\throws FileException The directory could not be opened or read.
+*/
+UNITY_API DirectoryListing scan_directory(std::string const& path, ScanOptions const& options = ScanOptions());
+
+/**
+\brief Lists the contents of a directory that is already open.
+
+This is the same as scan_directory(std::string const&, ScanOptions const&), but the directory's path is not
+resolved again.
+
+\throws FileException The directory could not be read.
+*/
+UNITY_API DirectoryListing scan_directory(Directory const& dir, ScanOptions const& options = ScanOptions());
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_FILECACHE_H
+#define UNITY_UTIL_FILECACHE_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+class Directory;
+
+namespace internal
+{
+struct FileCachePrivate;
+}
+
+/**
+\brief Content cache for small files that are read repeatedly.
+
+FileCache is an opt-in layer over read_binary_file(). It keeps the contents of files it has read
+in shared, immutable buffers that are keyed by path. Before returning a cached buffer, it calls
+<code>fstatat()</code> on the path and compares the device, inode, modification time, and size
+with the values that were current when the file was read. If any of these differ, the file is
+read again. A repeated read of an unchanged file therefore costs a single <code>stat</code> and
+does not copy the contents.
+
+The total size of the cached buffers is bounded by the <code>max_bytes</code> value passed to the
+constructor. When adding a file would exceed this limit, the least-recently used entries are evicted.
+Files that are larger than <code>max_bytes</code> are returned to the caller, but are not cached.
+
+Buffers returned by read_binary_file() remain valid for as long as the caller holds on to them,
+even if the corresponding entry is evicted or invalidated in the meantime.
+
+All methods are thread-safe.
+*/
+
+class UNITY_API FileCache final
+{
+public:
+    /// @cond
+    NONCOPYABLE(FileCache);
+    UNITY_DEFINES_PTRS(FileCache);
+    /// @endcond
+
+    /**
+    \brief Shared, immutable file contents as returned by read_binary_file().
+    */
+    typedef std::shared_ptr<std::vector<uint8_t> const> Buffer;
+
+    /**
+    \brief Counters describing the effectiveness of the cache.
+    */
+    struct Stats
+    {
+        uint64_t hits;          ///< Number of reads that were satisfied from the cache.
+        uint64_t misses;        ///< Number of reads that had to read the file.
+        uint64_t evictions;     ///< Number of entries that were evicted to stay within the size limit.
+        size_t entries;         ///< Number of entries currently in the cache.
+        size_t bytes;           ///< Total size of the buffers currently in the cache.
+    };
+
+    /**
+    \brief Creates a cache that holds at most <code>max_bytes</code> of file contents.
+    */
+    explicit FileCache(size_t max_bytes);
+    ~FileCache() noexcept;
+
+    /**
+    \brief Returns the contents of the specified file.
+
+    If the file is in the cache and has not changed since it was read, the cached buffer is returned.
+    Otherwise, the file is read with unity::util::read_binary_file() and the result is added to the cache.
+    \throws FileException The file could not be read.
+    */
+    Buffer read_binary_file(std::string const& filename);
+
+    /**
+    \brief Returns the contents of the file <code>name</code> relative to <code>dir</code>.
+
+    This avoids resolving the directory's path on every call. The entry is keyed by
+    <code>dir.path_of(name)</code>, so it is shared with reads of the same file by its full path.
+    \throws FileException The file could not be read.
+    */
+    Buffer read_binary_file(Directory const& dir, std::string const& name);
+
+    /**
+    \brief Removes the entry for the specified file (if any) from the cache.
+    */
+    void invalidate(std::string const& filename) noexcept;
+
+    /**
+    \brief Removes all entries from the cache. The counters are not reset.
+    */
+    void clear() noexcept;
+
+    /**
+    \brief Returns the maximum number of bytes held by the cache.
+    */
+    size_t max_bytes() const noexcept;
+
+    /**
+    \brief Returns the current counters.
+    */
+    Stats stats() const noexcept;
+
+private:
+    std::unique_ptr<internal::FileCachePrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
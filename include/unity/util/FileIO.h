@@ -21,6 +21,10 @@
 
 #include <unity/SymbolExport.h>
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -33,6 +37,175 @@ namespace util
 UNITY_API std::string read_text_file(std::string const& filename);
 UNITY_API std::vector<uint8_t> read_binary_file(std::string const& filename);
 
+/**
+\brief Tuning parameters for read_large_binary_file().
+*/
+struct LargeFileReadOptions
+{
+    /**
+    \brief The number of bytes read by each <code>pread()</code> call.
+    The value is rounded up to a multiple of the page size. Zero selects the default of 4 MB.
+    */
+    size_t chunk_size = 4 * 1024 * 1024;
+
+    /**
+    \brief The maximum number of concurrent reads.
+    Zero selects the number of hardware threads.
+    */
+    unsigned concurrency = 0;
+};
+
+/**
+\brief The contents of a file read by read_large_binary_file().
+
+The storage is allocated without being initialized, so the concurrent reads are the only pass over it.
+To get a <code>std::vector</code>, construct one from begin() and end().
+*/
+class LargeFileBuffer final
+{
+public:
+    LargeFileBuffer() noexcept
+        : size_(0)
+    {
+    }
+
+    LargeFileBuffer(std::unique_ptr<uint8_t[]> data, size_t size) noexcept
+        : data_(std::move(data))
+        , size_(size)
+    {
+    }
+
+    LargeFileBuffer(LargeFileBuffer&& other) noexcept
+        : data_(std::move(other.data_))
+        , size_(other.size_)
+    {
+        other.size_ = 0;
+    }
+
+    LargeFileBuffer& operator=(LargeFileBuffer&& other) noexcept
+    {
+        data_ = std::move(other.data_);
+        size_ = other.size_;
+        other.size_ = 0;
+        return *this;
+    }
+
+    uint8_t* data() noexcept
+    {
+        return data_.get();
+    }
+
+    uint8_t const* data() const noexcept
+    {
+        return data_.get();
+    }
+
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    uint8_t const* begin() const noexcept
+    {
+        return data_.get();
+    }
+
+    uint8_t const* end() const noexcept
+    {
+        return data_.get() + size_;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> data_;
+    size_t size_;
+};
+
+/**
+\brief Reads a large file with several concurrent positional reads.
+
+A single blocking <code>read()</code> does not keep enough requests in flight to saturate fast storage.
+This function splits the file into page-aligned chunks and reads them concurrently with <code>pread()</code>
+from a pool of worker threads into a single buffer that is allocated up-front.
+
+For small files, this function behaves like read_binary_file().
+
+\param options The chunk size and concurrency to use.
+\param chunk_checksums If non-null, the vector is set to the CRC-32 of each chunk, in file order.
+\return The contents of the file.
+\throws FileException The file could not be read.
+*/
+UNITY_API LargeFileBuffer read_large_binary_file(std::string const& filename,
+                                                      LargeFileReadOptions const& options = LargeFileReadOptions(),
+                                                      std::vector<uint32_t>* chunk_checksums = nullptr);
+
+/**
+\brief Reads a file that may be compressed and returns its uncompressed contents.
+
+Files compressed with gzip or zstd are recognized by their magic number and decompressed
+in a single streaming pass. Files in any other format are returned unchanged.
+Concatenated gzip members and zstd frames are decompressed in sequence.
+\throws FileException The file could not be read or contains invalid compressed data.
+*/
+UNITY_API std::string read_decompressed_text_file(std::string const& filename);
+
+/**
+\brief Reads a file that may be compressed and returns its uncompressed contents as bytes.
+\see read_decompressed_text_file()
+*/
+UNITY_API std::vector<uint8_t> read_decompressed_binary_file(std::string const& filename);
+
+/**
+\brief Appends the uncompressed contents of a file to <code>arena</code>.
+
+The compressed file is mapped into memory and decompressed directly into the arena, without
+any intermediate buffers. The arena is grown up-front to the uncompressed size recorded in
+the file, so it is normally reallocated at most once. This makes it possible to load several
+files into one buffer, or to reuse a buffer for a series of files (by clearing it in between).
+\return The number of bytes appended.
+\throws FileException The file could not be read or contains invalid compressed data.
+If an exception is thrown, the size of the arena is unchanged.
+*/
+UNITY_API size_t decompress_file_into(std::string const& filename, std::vector<uint8_t>& arena);
+
+/**
+\brief Copies the contents of <code>source</code> to <code>destination</code> without passing the data through user space.
+
+The destination is created (with the permission bits of the source) or truncated. If the file system supports it,
+the destination shares its blocks with the source (a "reflink" clone). Otherwise, the data is transferred
+with <code>copy_file_range()</code> or, if that is not supported, with <code>sendfile()</code>. If neither
+system call is available for the pair of files, the data is copied with a <code>read()</code>/<code>write()</code> loop.
+
+\param cancel If non-null, the copy checks this flag periodically and, if it is set, stops and throws
+       a FileException with error number <code>ECANCELED</code>.
+\return The number of bytes copied.
+\throws FileException The copy failed or was cancelled. In this case, the destination file is removed.
+*/
+UNITY_API uint64_t copy_file(std::string const& source,
+                             std::string const& destination,
+                             std::atomic<bool> const* cancel = nullptr);
+
+/**
+\brief Transfers data between two open file descriptors.
+
+Reads from the current offset of <code>from_fd</code> and writes at the current offset of <code>to_fd</code>
+until end-of-file is reached on <code>from_fd</code> or <code>max_bytes</code> have been transferred, using
+the same sequence of mechanisms as copy_file(). The descriptors are not closed.
+
+\param cancel If non-null, the transfer checks this flag periodically and, if it is set, stops and throws
+       a FileException with error number <code>ECANCELED</code>.
+\return The number of bytes transferred.
+\throws FileException The transfer failed or was cancelled.
+*/
+UNITY_API uint64_t transfer_fd(int from_fd,
+                               int to_fd,
+                               uint64_t max_bytes = std::numeric_limits<uint64_t>::max(),
+                               std::atomic<bool> const* cancel = nullptr);
+
 } // namespace util
 
 } // namespace unity
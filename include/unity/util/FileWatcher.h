@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_FILEWATCHER_H
+#define UNITY_UTIL_FILEWATCHER_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct FileWatcherState;
+}
+
+/**
+\brief Notifies the caller when watched files or directories change.
+
+All FileWatcher instances in a process share a single inotify file descriptor, which is monitored
+by a service thread. The thread is started when the first FileWatcher is created and stops when
+the last one is destroyed.
+
+A single logical change often causes a burst of inotify events. For example, an editor that saves
+a file by writing a temporary file, renaming it over the original, and restoring the permissions
+produces a create, a rename, and an attribute change for the same path. FileWatcher coalesces all events
+for a path that arrive within <code>coalesce_window</code> of the first one into a single notification,
+whose <code>events</code> field is the union of the events that were seen.
+
+Files are watched via their parent directory, so a file that is replaced by renaming another file over it
+remains watched. A file that does not exist yet can be watched as well, provided its directory exists.
+
+Notifications are passed to the executor, which must arrange for the function it is given to be called
+on a thread of the caller's choice (for example, by posting it to an event loop). Without an executor,
+the callback is invoked on the service thread; in that case, it should return quickly because it delays
+the notifications of all other watchers.
+
+Once the destructor has returned, the callback is no longer invoked, even if the executor still holds
+notifications. The destructor waits for a callback that is executing on another thread to return.
+It is safe to destroy a FileWatcher from within its own callback.
+*/
+
+class UNITY_API FileWatcher final
+{
+public:
+    /// @cond
+    NONCOPYABLE(FileWatcher);
+    UNITY_DEFINES_PTRS(FileWatcher);
+    /// @endcond
+
+    /**
+    \brief The kinds of change that are reported. A notification can combine several of these.
+    */
+    enum Event : unsigned
+    {
+        created = 1 << 0,       ///< The path was created or something was moved to it.
+        modified = 1 << 1,      ///< The contents were written.
+        removed = 1 << 2,       ///< The path was removed or moved elsewhere.
+        attributes = 1 << 3,    ///< The permissions, ownership, or timestamps changed.
+        overflow = 1 << 4       ///< Events were lost because the kernel queue overflowed. Rescan the path.
+    };
+
+    /**
+    \brief A coalesced notification for a single path.
+    */
+    struct Change
+    {
+        std::string path;       ///< The path that changed, starting with the path passed to add_file() or add_directory().
+        unsigned events;        ///< Bitwise OR of Event values.
+    };
+
+    /**
+    \brief The type of the notification callback.
+    */
+    typedef std::function<void(Change const& change)> Callback;
+
+    /**
+    \brief The type of the executor that runs notifications on the caller's thread.
+    */
+    typedef std::function<void(std::function<void()> const& task)> Executor;
+
+    /**
+    \brief Creates a watcher that does not watch anything yet.
+    \param callback Invoked once per path for each coalesced set of changes.
+    \param coalesce_window The time for which events for the same path are collected before they are reported.
+    \param executor If non-empty, called with each notification task. If empty, the callback is invoked on the
+           service thread.
+    \throws InvalidArgumentException The callback is empty.
+    \throws SyscallException The inotify descriptor or the service thread could not be created.
+    */
+    FileWatcher(Callback const& callback,
+                std::chrono::milliseconds coalesce_window = std::chrono::milliseconds(50),
+                Executor const& executor = Executor());
+
+    /**
+    \brief Stops watching and waits for a callback that is in progress on another thread to complete.
+    */
+    ~FileWatcher() noexcept;
+
+    /**
+    \brief Watches a single file.
+    \throws FileException The parent directory of the file cannot be watched.
+    */
+    void add_file(std::string const& path);
+
+    /**
+    \brief Watches a directory and the files in it.
+    \param recursive If <code>true</code>, sub-directories are watched as well, including any that are created
+           or moved into the directory later. Contents of a newly created sub-directory that appear before its
+           watch is in place are reported as <code>created</code>.
+    \throws FileException The directory cannot be watched.
+    */
+    void add_directory(std::string const& path, bool recursive = false);
+
+    /**
+    \brief Stops watching a path that was added with add_file() or add_directory().
+    Removing a path that is not watched has no effect.
+    */
+    void remove(std::string const& path) noexcept;
+
+private:
+    std::shared_ptr<internal::FileWatcherState> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_GDBUSCALLER_H
+#define UNITY_UTIL_GDBUSCALLER_H
+
+#include <gio/gio.h>
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/GioMemory.h>
+#include <unity/util/GlibExecutor.h>
+#include <unity/util/GlibMemory.h>
+#include <unity/util/NonCopyable.h>
+
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+/**
+ \brief Describes a D-Bus method call for GDBusCaller.
+ */
+struct GDBusMethodCall
+{
+    std::string bus_name;       ///< The destination, or empty on a peer-to-peer connection.
+    std::string object_path;    ///< The object to call the method on.
+    std::string interface_name; ///< The interface of the method.
+    std::string method_name;    ///< The method.
+    GVariantSPtr parameters;    ///< A tuple with the arguments, or null if the method has none.
+    std::string reply_type;     ///< The expected type of the reply, such as "(s)", or empty to accept any reply.
+};
+
+namespace internal
+{
+
+struct GDBusPendingCall
+{
+    std::promise<GVariantSPtr> promise;
+    std::string method;
+};
+
+inline void gdbus_call_done(GObject* source, GAsyncResult* result, gpointer user_data)
+{
+    std::unique_ptr<GDBusPendingCall> pending(static_cast<GDBusPendingCall*>(user_data));
+    GErrorUPtr error;
+    GVariant* reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, assign_glib(error));
+    if (!reply)
+    {
+        std::string msg = pending->method + ": " + (error ? error->message : "unknown error");
+        pending->promise.set_exception(std::make_exception_ptr(ResourceException(msg)));
+        return;
+    }
+    pending->promise.set_value(share_glib(reply));
+}
+
+}
+
+/**
+ \brief Issues asynchronous D-Bus method calls and returns their replies as futures.
+
+ Calling g_dbus_connection_call_sync() for each of a number of calls costs a full round trip
+ per call. GDBusCaller instead sends each call as soon as it is made, without waiting for the
+ replies to earlier calls, so many calls share the latency of a single round trip.
+
+ The calls are issued from a GlibExecutor, and their replies are received in the executor's main
+ context. This means that the futures can be waited for from any thread that is not the executor's
+ thread, including a thread that does not run a GLib main loop.
+
+ \code{.cpp}
+ GDBusCaller caller(bus, executor);
+ std::vector<GDBusMethodCall> calls;
+ for (auto const& name : names)
+ {
+     calls.push_back({ "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                       "GetNameOwner", share_glib(g_variant_ref_sink(g_variant_new("(s)", name.c_str()))), "(s)" });
+ }
+ auto replies = GDBusCaller::join(caller.call_all(calls));
+ \endcode
+
+ Destroying the GDBusCaller (or calling cancel()) cancels all calls that are still pending
+ through their GCancellable. Their futures receive a ResourceException once the cancellation
+ has been processed by the executor.
+
+ A reply that is a D-Bus error is returned as a ResourceException whose message contains the
+ method name and the error message.
+
+ \note The executor must outlive the pending calls, and the futures must not be waited for from a task on
+ the executor.
+ */
+class GDBusCaller final
+{
+public:
+    /// @cond
+    NONCOPYABLE(GDBusCaller);
+    /// @endcond
+
+    /**
+     \brief Creates a caller for the specified connection.
+     \param bus The connection to send the calls on.
+     \param executor The executor that issues the calls and receives the replies.
+     \param timeout_msec The timeout for each call, or -1 for the default timeout.
+     \throws InvalidArgumentException <code>bus</code> or <code>executor</code> is null.
+     */
+    GDBusCaller(GObjectSPtr<GDBusConnection> bus, GlibExecutor::SPtr executor, int timeout_msec = -1) :
+            bus_(std::move(bus)), executor_(std::move(executor)), timeout_msec_(timeout_msec),
+            cancellable_(share_gobject(g_cancellable_new()))
+    {
+        if (!bus_)
+        {
+            throw InvalidArgumentException("GDBusCaller(): bus must not be null");
+        }
+        if (!executor_)
+        {
+            throw InvalidArgumentException("GDBusCaller(): executor must not be null");
+        }
+    }
+
+    /**
+     \brief Cancels all pending calls.
+     */
+    ~GDBusCaller() noexcept
+    {
+        g_cancellable_cancel(cancellable_.get());
+    }
+
+    /**
+     \brief Sends a method call.
+     \return A future that receives the reply, which is a tuple of the method's out arguments.
+     \throws LogicException The executor has been shut down.
+     */
+    std::future<GVariantSPtr> call(GDBusMethodCall const& call)
+    {
+        return std::move(call_all({ call })[0]);
+    }
+
+    /**
+     \brief Sends a method call.
+
+     This is a convenience overload. If <code>parameters</code> is a floating reference, it is consumed.
+     \throws LogicException The executor has been shut down.
+     */
+    std::future<GVariantSPtr> call(std::string const& bus_name,
+                                   std::string const& object_path,
+                                   std::string const& interface_name,
+                                   std::string const& method_name,
+                                   GVariant* parameters = nullptr,
+                                   std::string const& reply_type = std::string())
+    {
+        GVariantSPtr p;
+        if (parameters)
+        {
+            p = share_glib(g_variant_ref_sink(parameters));
+        }
+        return call(GDBusMethodCall{ bus_name, object_path, interface_name, method_name, p, reply_type });
+    }
+
+    /**
+     \brief Sends a number of method calls back to back.
+
+     All calls are sent by a single task on the executor, without waiting for any replies.
+     \return The futures for the replies, in the same order as <code>calls</code>.
+     \throws LogicException The executor has been shut down.
+     */
+    std::vector<std::future<GVariantSPtr>> call_all(std::vector<GDBusMethodCall> const& calls)
+    {
+        typedef std::pair<GDBusMethodCall, std::unique_ptr<internal::GDBusPendingCall>> Request;
+
+        auto requests = std::make_shared<std::vector<Request>>();
+        std::vector<std::future<GVariantSPtr>> futures;
+        requests->reserve(calls.size());
+        futures.reserve(calls.size());
+        for (auto const& c : calls)
+        {
+            std::unique_ptr<internal::GDBusPendingCall> pending(new internal::GDBusPendingCall);
+            pending->method = c.interface_name + "." + c.method_name;
+            futures.push_back(pending->promise.get_future());
+            requests->emplace_back(c, std::move(pending));
+        }
+
+        auto bus = bus_;
+        auto timeout_msec = timeout_msec_;
+        GObjectSPtr<GCancellable> cancellable;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancellable = cancellable_;
+        }
+        executor_->post([requests, bus, timeout_msec, cancellable]
+        {
+            for (auto& r : *requests)
+            {
+                auto const& c = r.first;
+                g_dbus_connection_call(bus.get(),
+                                       c.bus_name.empty() ? nullptr : c.bus_name.c_str(),
+                                       c.object_path.c_str(),
+                                       c.interface_name.c_str(),
+                                       c.method_name.c_str(),
+                                       c.parameters.get(),
+                                       c.reply_type.empty() ? nullptr : G_VARIANT_TYPE(c.reply_type.c_str()),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       timeout_msec,
+                                       cancellable.get(),
+                                       internal::gdbus_call_done,
+                                       r.second.release());
+            }
+        });
+        return futures;
+    }
+
+    /**
+     \brief Cancels all pending calls. Calls made after this are not affected.
+     */
+    void cancel() noexcept
+    {
+        GObjectSPtr<GCancellable> old;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            old = cancellable_;
+            cancellable_ = share_gobject(g_cancellable_new());
+        }
+        g_cancellable_cancel(old.get());
+    }
+
+    /**
+     \brief Waits for all of the specified futures.
+
+     This waits for all calls to complete, even if some of them fail.
+     \return The replies, in the same order as <code>futures</code>.
+     \throws ResourceException One of the calls failed. The exception is the one for the first failed call.
+     */
+    static std::vector<GVariantSPtr> join(std::vector<std::future<GVariantSPtr>> futures)
+    {
+        std::vector<GVariantSPtr> replies;
+        replies.reserve(futures.size());
+        std::exception_ptr first_error;
+        for (auto& f : futures)
+        {
+            try
+            {
+                replies.push_back(f.get());
+            }
+            catch (...)
+            {
+                if (!first_error)
+                {
+                    first_error = std::current_exception();
+                }
+                replies.push_back(nullptr);
+            }
+        }
+        if (first_error)
+        {
+            std::rethrow_exception(first_error);
+        }
+        return replies;
+    }
+
+private:
+    GObjectSPtr<GDBusConnection> bus_;
+    GlibExecutor::SPtr executor_;
+    int timeout_msec_;
+    std::mutex mutex_;
+    GObjectSPtr<GCancellable> cancellable_;     // Protected by mutex_
+};
+
+}  // namespace util
+
+}  // namespace unity
+
+#endif
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_GDBUSSIGNALMANAGER_H
+#define UNITY_UTIL_GDBUSSIGNALMANAGER_H
+
+#include <gio/gio.h>
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/GioMemory.h>
+#include <unity/util/NonCopyable.h>
+#include <unity/util/ResourcePtr.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+/**
+ \brief Handler for signals received through a GDBusSignalManager.
+
+ The arguments are the object path and the name of the signal, and the signal's parameters.
+ */
+typedef std::function<void(const gchar* object_path, const gchar* signal_name, GVariant* parameters)> GDBusSignalHandler;
+
+namespace internal
+{
+
+struct GDBusSignalManagerState
+{
+    typedef std::pair<std::string, std::string> RuleKey;   // Sender, interface
+    typedef std::vector<std::pair<guint64, std::shared_ptr<GDBusSignalHandler>>> Handlers;
+
+    struct Rule
+    {
+        guint subscription_id;
+        size_t handler_count;
+    };
+
+    struct HandlerInfo
+    {
+        RuleKey rule_key;
+        std::string handler_key;
+    };
+
+    // Passed to g_dbus_connection_signal_subscribe() and owned by the subscription.
+    struct RuleData
+    {
+        std::weak_ptr<GDBusSignalManagerState> state;
+        std::string prefix;
+    };
+
+    // Handlers are found by "sender\0interface\0path\0member". An empty member matches all signals on the path.
+    static std::string handler_key(std::string const& prefix, const gchar* object_path, const gchar* member)
+    {
+        std::string key = prefix;
+        key += object_path;
+        key += '\0';
+        key += member;
+        return key;
+    }
+
+    static std::string rule_prefix(RuleKey const& rule_key)
+    {
+        std::string prefix = rule_key.first;
+        prefix += '\0';
+        prefix += rule_key.second;
+        prefix += '\0';
+        return prefix;
+    }
+
+    static void on_signal(GDBusConnection*, const gchar*, const gchar* object_path, const gchar*,
+                          const gchar* signal_name, GVariant* parameters, gpointer user_data)
+    {
+        auto rule_data = static_cast<RuleData*>(user_data);
+        auto state = rule_data->state.lock();
+        if (!state)
+        {
+            return;
+        }
+
+        // Copy the handlers, so a handler can unsubscribe (or subscribe) without invalidating the iteration.
+        std::vector<std::shared_ptr<GDBusSignalHandler>> matches;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            for (auto const& member : { signal_name, "" })
+            {
+                auto it = state->handlers.find(handler_key(rule_data->prefix, object_path, member));
+                if (it != state->handlers.end())
+                {
+                    for (auto const& h : it->second)
+                    {
+                        matches.push_back(h.second);
+                    }
+                }
+            }
+        }
+        for (auto const& h : matches)
+        {
+            (*h)(object_path, signal_name, parameters);
+        }
+    }
+
+    static void free_rule_data(gpointer user_data)
+    {
+        delete static_cast<RuleData*>(user_data);
+    }
+
+    void remove(guint64 id) noexcept
+    {
+        guint unsubscribe_id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto info = handler_info.find(id);
+            if (info == handler_info.end())
+            {
+                return;
+            }
+
+            auto h = handlers.find(info->second.handler_key);
+            auto& list = h->second;
+            for (auto it = list.begin(); it != list.end(); ++it)
+            {
+                if (it->first == id)
+                {
+                    list.erase(it);
+                    break;
+                }
+            }
+            if (list.empty())
+            {
+                handlers.erase(h);
+            }
+
+            auto rule = rules.find(info->second.rule_key);
+            if (--rule->second.handler_count == 0)
+            {
+                unsubscribe_id = rule->second.subscription_id;
+                rules.erase(rule);
+            }
+            handler_info.erase(info);
+        }
+        if (unsubscribe_id != 0)
+        {
+            g_dbus_connection_signal_unsubscribe(bus.get(), unsubscribe_id);
+        }
+    }
+
+    GObjectSPtr<GDBusConnection> bus;
+    std::mutex mutex;
+    std::map<RuleKey, Rule> rules;
+    std::unordered_map<std::string, Handlers> handlers;
+    std::unordered_map<guint64, HandlerInfo> handler_info;
+    guint64 next_id = 1;
+};
+
+struct GDBusSharedSignalUnsubscriber
+{
+    void operator()(guint64 id) noexcept
+    {
+        auto state = state_.lock();
+        if (id != 0 && state)
+        {
+            state->remove(id);
+        }
+    }
+
+    std::weak_ptr<GDBusSignalManagerState> state_;
+};
+
+}
+
+typedef ResourcePtr<guint64, internal::GDBusSharedSignalUnsubscriber> GDBusSharedSignalConnection;
+
+/**
+ \brief Shares D-Bus match rules among many signal subscriptions.
+
+ Each call to g_dbus_connection_signal_subscribe() adds a match rule to the bus daemon, and every
+ incoming signal is compared with every subscription. For components that watch hundreds of objects,
+ this costs CPU time in both the bus daemon and the client.
+
+ GDBusSignalManager adds a single match rule for each combination of sender and interface. Incoming
+ signals are passed to the handlers for their object path and signal name through a hash table.
+ When the last handler for a sender and interface is removed, the match rule is removed as well.
+
+ \code{.cpp}
+ GDBusSignalManager manager(bus);
+ for (auto const& path : application_paths)
+ {
+     connections.push_back(manager.subscribe("com.canonical.Apps", "com.canonical.App", path, "Changed",
+                                             [](const gchar* path, const gchar*, GVariant* params){ ... }));
+ }
+ \endcode
+
+ Each handler stays subscribed for as long as the returned GDBusSharedSignalConnection exists.
+ Handlers run in the thread-default main context of the thread that added the first subscription
+ for their sender and interface, so the manager is normally used from the thread that runs the main loop.
+ A connection can be released from any thread, and it can outlive its manager.
+ */
+class GDBusSignalManager final
+{
+public:
+    /// @cond
+    NONCOPYABLE(GDBusSignalManager);
+    /// @endcond
+
+    /**
+     \brief Creates a manager for the specified connection.
+     \throws InvalidArgumentException <code>bus</code> is null.
+     */
+    explicit GDBusSignalManager(GObjectSPtr<GDBusConnection> bus) :
+            state_(std::make_shared<internal::GDBusSignalManagerState>())
+    {
+        if (!bus)
+        {
+            throw InvalidArgumentException("GDBusSignalManager(): bus must not be null");
+        }
+        state_->bus = std::move(bus);
+    }
+
+    /**
+     \brief Removes all match rules. Connections that still exist are no longer called.
+     */
+    ~GDBusSignalManager() noexcept
+    {
+        std::map<internal::GDBusSignalManagerState::RuleKey, internal::GDBusSignalManagerState::Rule> rules;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            rules.swap(state_->rules);
+            state_->handlers.clear();
+            state_->handler_info.clear();
+        }
+        for (auto const& r : rules)
+        {
+            g_dbus_connection_signal_unsubscribe(state_->bus.get(), r.second.subscription_id);
+        }
+    }
+
+    /**
+     \brief Adds a handler for a signal.
+     \param sender The unique or well-known bus name of the sender, or empty to accept any sender.
+     \param interface_name The interface of the signal.
+     \param object_path The object that emits the signal.
+     \param signal_name The name of the signal, or empty to receive all signals of the interface from the object.
+     \param handler The handler to call.
+     \return The connection. The handler is removed when the connection is destroyed or dealloc'ed.
+     \throws InvalidArgumentException <code>interface_name</code> or <code>object_path</code> is empty,
+     or <code>handler</code> is empty.
+     */
+    GDBusSharedSignalConnection subscribe(std::string const& sender,
+                                          std::string const& interface_name,
+                                          std::string const& object_path,
+                                          std::string const& signal_name,
+                                          GDBusSignalHandler handler)
+    {
+        if (interface_name.empty() || object_path.empty())
+        {
+            throw InvalidArgumentException("GDBusSignalManager::subscribe(): interface and object path must not be empty");
+        }
+        if (!handler)
+        {
+            throw InvalidArgumentException("GDBusSignalManager::subscribe(): handler must not be empty");
+        }
+
+        typedef internal::GDBusSignalManagerState State;
+        State::RuleKey rule_key(sender, interface_name);
+        auto prefix = State::rule_prefix(rule_key);
+        auto key = State::handler_key(prefix, object_path.c_str(), signal_name.c_str());
+        auto h = std::make_shared<GDBusSignalHandler>(std::move(handler));
+
+        guint64 id;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            auto rule = state_->rules.find(rule_key);
+            if (rule == state_->rules.end())
+            {
+                auto rule_data = new State::RuleData{ state_, prefix };
+                guint subscription_id = g_dbus_connection_signal_subscribe(state_->bus.get(),
+                                                                           sender.empty() ? nullptr : sender.c_str(),
+                                                                           interface_name.c_str(),
+                                                                           nullptr,
+                                                                           nullptr,
+                                                                           nullptr,
+                                                                           G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                           State::on_signal,
+                                                                           rule_data,
+                                                                           State::free_rule_data);
+                rule = state_->rules.emplace(rule_key, State::Rule{ subscription_id, 0 }).first;
+            }
+            ++rule->second.handler_count;
+
+            id = state_->next_id++;
+            state_->handlers[key].emplace_back(id, std::move(h));
+            state_->handler_info.emplace(id, State::HandlerInfo{ rule_key, key });
+        }
+        return GDBusSharedSignalConnection(id, internal::GDBusSharedSignalUnsubscriber{ state_ });
+    }
+
+    /**
+     \brief Returns the number of match rules that are currently installed.
+     */
+    size_t rule_count() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->rules.size();
+    }
+
+    /**
+     \brief Returns the number of handlers that are currently subscribed.
+     */
+    size_t handler_count() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->handler_info.size();
+    }
+
+private:
+    std::shared_ptr<internal::GDBusSignalManagerState> state_;
+};
+
+}  // namespace util
+
+}  // namespace unity
+
+#endif
@@ -20,8 +20,11 @@
 #ifndef UNITY_UTIL_GOBJECTMEMORY_H
 #define UNITY_UTIL_GOBJECTMEMORY_H
 
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <stdexcept>
+#include <utility>
 #include <glib-object.h>
 
 #include <unity/util/ResourcePtr.h>
@@ -71,9 +74,187 @@ struct GObjectDeleter
 template<typename T> using GObjectSPtr = std::shared_ptr<T>;
 template<typename T> using GObjectUPtr = std::unique_ptr<T, GObjectDeleter>;
 
+/**
+ \brief Intrusive smart pointer for GObjects.
+
+ GObjectSPtr is a std::shared_ptr, so it allocates a control block for every object
+ and keeps a second reference count next to the one in the GObject. GObjectPtr instead
+ uses the GObject's own reference count: copying it calls g_object_ref() and destroying
+ it calls g_object_unref(). It is the size of a single pointer and never allocates.
+
+ The constructor that takes a pointer adopts the reference passed to it, as share_gobject()
+ does. Use intrusive_gobject() to also check that the reference is not floating.
+
+ Example:
+ \code{.cpp}
+ GObjectPtr<FooBar> obj = intrusive_gobject(foo_bar_new("name"));
+ GObjectPtr<FooBar> copy = obj; // Adds a reference.
+ \endcode
+ */
+template<typename T>
+class GObjectPtr
+{
+public:
+    typedef T element_type;
+
+    GObjectPtr() noexcept = default;
+
+    GObjectPtr(std::nullptr_t) noexcept
+    {
+    }
+
+    explicit GObjectPtr(T* ptr) noexcept:
+            ptr_(ptr)
+    {
+    }
+
+    GObjectPtr(const GObjectPtr& other) noexcept:
+            ptr_(other.ptr_)
+    {
+        if (ptr_)
+        {
+            g_object_ref(ptr_);
+        }
+    }
+
+    GObjectPtr(GObjectPtr&& other) noexcept:
+            ptr_(other.ptr_)
+    {
+        other.ptr_ = nullptr;
+    }
+
+    ~GObjectPtr() noexcept
+    {
+        if (ptr_)
+        {
+            g_object_unref(ptr_);
+        }
+    }
+
+    GObjectPtr& operator=(const GObjectPtr& other) noexcept
+    {
+        GObjectPtr(other).swap(*this);
+        return *this;
+    }
+
+    GObjectPtr& operator=(GObjectPtr&& other) noexcept
+    {
+        GObjectPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    GObjectPtr& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    /**
+     \brief Drops the current reference (if any) and adopts the reference passed in.
+     */
+    void reset(T* ptr = nullptr) noexcept
+    {
+        GObjectPtr(ptr).swap(*this);
+    }
+
+    /**
+     \brief Returns the pointer without dropping the reference. The caller must unref it.
+     */
+    T* release() noexcept
+    {
+        T* ptr = ptr_;
+        ptr_ = nullptr;
+        return ptr;
+    }
+
+    T* get() const noexcept
+    {
+        return ptr_;
+    }
+
+    T& operator*() const noexcept
+    {
+        return *ptr_;
+    }
+
+    T* operator->() const noexcept
+    {
+        return ptr_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ptr_ != nullptr;
+    }
+
+    void swap(GObjectPtr& other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+    }
+
+private:
+    T* ptr_ = nullptr;
+};
+
+template<typename T>
+inline void swap(GObjectPtr<T>& lhs, GObjectPtr<T>& rhs) noexcept
+{
+    lhs.swap(rhs);
+}
+
+template<typename T>
+inline bool operator==(const GObjectPtr<T>& lhs, const GObjectPtr<T>& rhs) noexcept
+{
+    return lhs.get() == rhs.get();
+}
+
+template<typename T>
+inline bool operator!=(const GObjectPtr<T>& lhs, const GObjectPtr<T>& rhs) noexcept
+{
+    return lhs.get() != rhs.get();
+}
+
+template<typename T>
+inline bool operator<(const GObjectPtr<T>& lhs, const GObjectPtr<T>& rhs) noexcept
+{
+    return std::less<T*>()(lhs.get(), rhs.get());
+}
+
+template<typename T>
+inline bool operator==(const GObjectPtr<T>& lhs, std::nullptr_t) noexcept
+{
+    return !lhs;
+}
+
+template<typename T>
+inline bool operator!=(const GObjectPtr<T>& lhs, std::nullptr_t) noexcept
+{
+    return bool(lhs);
+}
+
 namespace internal
 {
 
+// Lets GObjectAssigner construct the smart pointer it assigns to.
+
+template<typename SP>
+struct GObjectAdopter
+{
+    static SP adopt(typename SP::element_type* ptr)
+    {
+        return SP(ptr, GObjectDeleter());
+    }
+};
+
+template<typename T>
+struct GObjectAdopter<GObjectPtr<T>>
+{
+    static GObjectPtr<T> adopt(T* ptr) noexcept
+    {
+        return GObjectPtr<T>(ptr);
+    }
+};
+
 template<typename SP>
 class GObjectAssigner
 {
@@ -95,7 +276,7 @@ public:
 
     ~GObjectAssigner() noexcept
     {
-        smart_ptr_ = SP(ptr_, GObjectDeleter());
+        smart_ptr_ = GObjectAdopter<SP>::adopt(ptr_);
     }
 
     GObjectAssigner& operator=(const GObjectAssigner& other) = delete;
@@ -167,6 +348,24 @@ inline GObjectSPtr<T> share_gobject(T* ptr)
     return GObjectSPtr<T>(ptr, d);
 }
 
+/**
+ \brief Helper method to wrap a GObjectPtr around an existing GObject.
+
+ Takes ownership of the reference passed in, like share_gobject(), but
+ without allocating a shared_ptr control block.
+
+ Example:
+ \code{.cpp}
+ auto obj = intrusive_gobject(foo_bar_new("name"));
+ \endcode
+ */
+template<typename T>
+inline GObjectPtr<T> intrusive_gobject(T* ptr)
+{
+    check_floating_gobject(ptr);
+    return GObjectPtr<T>(ptr);
+}
+
 /**
  \brief Helper method to construct a gobj_ptr-wrapped GObject class.
 
@@ -225,4 +424,18 @@ inline GObjectSignalConnection<T> gobject_signal_connection(gulong id, const GOb
 
 }  // namespace unity
 
+namespace std
+{
+
+template<typename T>
+struct hash<unity::util::GObjectPtr<T>>
+{
+    size_t operator()(const unity::util::GObjectPtr<T>& p) const noexcept
+    {
+        return hash<T*>()(p.get());
+    }
+};
+
+}  // namespace std
+
 #endif
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_GVARIANTSERIALIZATION_H
+#define UNITY_UTIL_GVARIANTSERIALIZATION_H
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/GlibMemory.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+// A GVariant type string as a sequence of characters, so it can be assembled at compile time.
+
+template<char... C>
+struct GVariantSig
+{
+    static constexpr char value[sizeof...(C) + 1] = { C..., '\0' };
+};
+
+template<char... C>
+constexpr char GVariantSig<C...>::value[sizeof...(C) + 1];
+
+template<typename... S>
+struct GVariantSigConcat;
+
+template<>
+struct GVariantSigConcat<>
+{
+    typedef GVariantSig<> type;
+};
+
+template<char... A>
+struct GVariantSigConcat<GVariantSig<A...>>
+{
+    typedef GVariantSig<A...> type;
+};
+
+template<char... A, char... B, typename... Rest>
+struct GVariantSigConcat<GVariantSig<A...>, GVariantSig<B...>, Rest...>
+{
+    typedef typename GVariantSigConcat<GVariantSig<A..., B...>, Rest...>::type type;
+};
+
+template<size_t... I>
+struct IndexSequence
+{
+};
+
+template<size_t N, size_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...>
+{
+};
+
+template<size_t... I>
+struct MakeIndexSequence<0, I...> : IndexSequence<I...>
+{
+};
+
+}
+
+/**
+ \brief Converts between a C++ type and GVariant.
+
+ Specializations provide:
+ - <code>Signature</code>, the GVariant type string of <code>T</code> as a compile-time constant
+   (<code>Signature::value</code>),
+ - <code>fixed_size</code>, which is <code>true</code> if arrays of <code>T</code> are stored as a contiguous
+   block of <code>T</code>,
+ - <code>to_variant()</code>, which returns a new floating GVariant, and
+ - <code>from_variant()</code>, which decodes a GVariant that is known to have the correct type.
+
+ Specializations exist for <code>bool</code>, the fixed-width integer types, <code>double</code>,
+ <code>std::string</code>, GVariantSPtr (as a boxed variant), and for <code>std::vector</code>,
+ <code>std::map</code>, <code>std::unordered_map</code>, <code>std::tuple</code> and <code>std::pair</code>
+ of supported types. Use to_gvariant() and from_gvariant() rather than calling the traits directly.
+ */
+template<typename T>
+struct GVariantTraits;
+
+#define UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(Type, TypeChar, FixedSize, new_func, get_func) \
+template<> \
+struct GVariantTraits<Type> \
+{ \
+    typedef internal::GVariantSig<TypeChar> Signature; \
+    static constexpr bool fixed_size = FixedSize; \
+    static GVariant* to_variant(Type value) noexcept \
+    { \
+        return ::new_func(value); \
+    } \
+    static Type from_variant(GVariant* v) noexcept \
+    { \
+        return ::get_func(v); \
+    } \
+};
+
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(bool, 'b', false, g_variant_new_boolean, g_variant_get_boolean)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(uint8_t, 'y', true, g_variant_new_byte, g_variant_get_byte)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(int16_t, 'n', true, g_variant_new_int16, g_variant_get_int16)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(uint16_t, 'q', true, g_variant_new_uint16, g_variant_get_uint16)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(int32_t, 'i', true, g_variant_new_int32, g_variant_get_int32)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(uint32_t, 'u', true, g_variant_new_uint32, g_variant_get_uint32)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(int64_t, 'x', true, g_variant_new_int64, g_variant_get_int64)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(uint64_t, 't', true, g_variant_new_uint64, g_variant_get_uint64)
+UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS(double, 'd', true, g_variant_new_double, g_variant_get_double)
+
+#undef UNITY_UTIL_DEFINE_GVARIANT_BASIC_TRAITS
+
+/**
+ \brief Strings are converted to and from type "s". The string must be valid UTF-8.
+ */
+template<>
+struct GVariantTraits<std::string>
+{
+    typedef internal::GVariantSig<'s'> Signature;
+    static constexpr bool fixed_size = false;
+
+    static GVariant* to_variant(std::string const& value) noexcept
+    {
+        return g_variant_new_string(value.c_str());
+    }
+
+    static std::string from_variant(GVariant* v)
+    {
+        gsize length;
+        gchar const* s = g_variant_get_string(v, &length);
+        return std::string(s, length);
+    }
+};
+
+/**
+ \brief A GVariantSPtr is converted to and from a boxed variant, type "v".
+ */
+template<>
+struct GVariantTraits<GVariantSPtr>
+{
+    typedef internal::GVariantSig<'v'> Signature;
+    static constexpr bool fixed_size = false;
+
+    static GVariant* to_variant(GVariantSPtr const& value) noexcept
+    {
+        return g_variant_new_variant(value.get());
+    }
+
+    static GVariantSPtr from_variant(GVariant* v)
+    {
+        return share_glib(g_variant_get_variant(v));
+    }
+};
+
+namespace internal
+{
+
+// Decodes child i of v, which must be a container.
+
+template<typename T>
+inline T gvariant_child(GVariant* v, gsize i)
+{
+    GVariantUPtr child(g_variant_get_child_value(v, i));
+    return GVariantTraits<T>::from_variant(child.get());
+}
+
+// Arrays of fixed-size elements are copied as a single block; all others are built element by element.
+
+template<typename T, bool FixedSize = GVariantTraits<T>::fixed_size>
+struct GVariantArrayCodec
+{
+    static GVariant* to_variant(std::vector<T> const& value)
+    {
+        std::vector<GVariant*> children;
+        children.reserve(value.size());
+        for (auto const& e : value)
+        {
+            children.push_back(GVariantTraits<T>::to_variant(e));
+        }
+        return g_variant_new_array(G_VARIANT_TYPE(GVariantTraits<T>::Signature::value), children.data(), children.size());
+    }
+
+    static std::vector<T> from_variant(GVariant* v)
+    {
+        gsize n = g_variant_n_children(v);
+        std::vector<T> value;
+        value.reserve(n);
+        for (gsize i = 0; i < n; ++i)
+        {
+            value.push_back(gvariant_child<T>(v, i));
+        }
+        return value;
+    }
+};
+
+template<typename T>
+struct GVariantArrayCodec<T, true>
+{
+    static GVariant* to_variant(std::vector<T> const& value) noexcept
+    {
+        return g_variant_new_fixed_array(G_VARIANT_TYPE(GVariantTraits<T>::Signature::value),
+                                         value.data(), value.size(), sizeof(T));
+    }
+
+    static std::vector<T> from_variant(GVariant* v)
+    {
+        gsize n;
+        auto data = static_cast<T const*>(g_variant_get_fixed_array(v, &n, sizeof(T)));
+        return std::vector<T>(data, data + n);
+    }
+};
+
+template<typename M>
+struct GVariantDictCodec
+{
+    typedef typename M::key_type K;
+    typedef typename M::mapped_type V;
+    typedef typename GVariantSigConcat<GVariantSig<'{'>,
+                                       typename GVariantTraits<K>::Signature,
+                                       typename GVariantTraits<V>::Signature,
+                                       GVariantSig<'}'>>::type EntrySignature;
+    typedef typename GVariantSigConcat<GVariantSig<'a'>, EntrySignature>::type Signature;
+
+    static GVariant* to_variant(M const& value)
+    {
+        std::vector<GVariant*> children;
+        children.reserve(value.size());
+        for (auto const& e : value)
+        {
+            children.push_back(g_variant_new_dict_entry(GVariantTraits<K>::to_variant(e.first),
+                                                        GVariantTraits<V>::to_variant(e.second)));
+        }
+        return g_variant_new_array(G_VARIANT_TYPE(EntrySignature::value), children.data(), children.size());
+    }
+
+    static M from_variant(GVariant* v)
+    {
+        M value;
+        gsize n = g_variant_n_children(v);
+        for (gsize i = 0; i < n; ++i)
+        {
+            GVariantUPtr entry(g_variant_get_child_value(v, i));
+            value.emplace(gvariant_child<K>(entry.get(), 0), gvariant_child<V>(entry.get(), 1));
+        }
+        return value;
+    }
+};
+
+template<typename Tuple, typename... Ts>
+struct GVariantTupleCodec
+{
+    typedef typename GVariantSigConcat<GVariantSig<'('>,
+                                       typename GVariantTraits<Ts>::Signature...,
+                                       GVariantSig<')'>>::type Signature;
+
+    static GVariant* to_variant(Tuple const& value)
+    {
+        return to_variant(value, MakeIndexSequence<sizeof...(Ts)>());
+    }
+
+    static Tuple from_variant(GVariant* v)
+    {
+        return from_variant(v, MakeIndexSequence<sizeof...(Ts)>());
+    }
+
+private:
+    template<size_t... I>
+    static GVariant* to_variant(Tuple const& value, IndexSequence<I...>)
+    {
+        (void)value;
+        GVariant* children[] = { GVariantTraits<Ts>::to_variant(std::get<I>(value))..., nullptr };
+        return g_variant_new_tuple(children, sizeof...(Ts));
+    }
+
+    template<size_t... I>
+    static Tuple from_variant(GVariant* v, IndexSequence<I...>)
+    {
+        (void)v;
+        return Tuple(gvariant_child<Ts>(v, I)...);
+    }
+};
+
+}
+
+/**
+ \brief Vectors are converted to and from arrays, type "a" followed by the element type.
+
+ Vectors of fixed-size types (integers and <code>double</code>, but not <code>bool</code>) are copied as
+ a single block, without creating a GVariant for each element. To read such an array without copying it,
+ use GVariantFixedArray.
+ */
+template<typename T>
+struct GVariantTraits<std::vector<T>> : internal::GVariantArrayCodec<T>
+{
+    typedef typename internal::GVariantSigConcat<internal::GVariantSig<'a'>,
+                                                 typename GVariantTraits<T>::Signature>::type Signature;
+    static constexpr bool fixed_size = false;
+};
+
+/**
+ \brief Maps are converted to and from dictionaries, type "a{..}". The key type must be a basic type.
+ */
+template<typename K, typename V, typename C, typename A>
+struct GVariantTraits<std::map<K, V, C, A>> : internal::GVariantDictCodec<std::map<K, V, C, A>>
+{
+    static constexpr bool fixed_size = false;
+};
+
+/**
+ \brief Unordered maps are converted to and from dictionaries, type "a{..}". The key type must be a basic type.
+ */
+template<typename K, typename V, typename H, typename E, typename A>
+struct GVariantTraits<std::unordered_map<K, V, H, E, A>> : internal::GVariantDictCodec<std::unordered_map<K, V, H, E, A>>
+{
+    static constexpr bool fixed_size = false;
+};
+
+/**
+ \brief Tuples are converted to and from tuples, type "(..)".
+ */
+template<typename... Ts>
+struct GVariantTraits<std::tuple<Ts...>> : internal::GVariantTupleCodec<std::tuple<Ts...>, Ts...>
+{
+    static constexpr bool fixed_size = false;
+};
+
+/**
+ \brief Pairs are converted to and from tuples with two elements.
+ */
+template<typename T1, typename T2>
+struct GVariantTraits<std::pair<T1, T2>> : internal::GVariantTupleCodec<std::pair<T1, T2>, T1, T2>
+{
+    static constexpr bool fixed_size = false;
+};
+
+/**
+ \brief Returns the GVariant type string for <code>T</code>, such as "a{sv}" for
+ <code>std::map<std::string, GVariantSPtr></code>. The string is assembled at compile time.
+ */
+template<typename T>
+constexpr char const* gvariant_type_string() noexcept
+{
+    return GVariantTraits<T>::Signature::value;
+}
+
+/**
+ \brief Converts a value to a GVariant.
+
+ The value is built with the typed constructors, such as g_variant_new_int32() and
+ g_variant_new_tuple(), so no format string is parsed.
+
+ Example:
+ \code{.cpp}
+ std::map<std::string, std::vector<int32_t>> m{ { "a", { 1, 2 } } };
+ auto v = to_gvariant(m);  // "a{sai}"
+ \endcode
+ \return A new (non-floating) reference.
+ */
+template<typename T>
+inline GVariantSPtr to_gvariant(T const& value)
+{
+    return share_glib(g_variant_ref_sink(GVariantTraits<T>::to_variant(value)));
+}
+
+/**
+ \brief Converts a GVariant to a value.
+
+ The type of the GVariant is checked once against the type string of <code>T</code>;
+ the contents are then read with the typed accessors, such as g_variant_get_int32().
+ \throws InvalidArgumentException <code>v</code> is null or does not have the type of <code>T</code>.
+ */
+template<typename T>
+inline T from_gvariant(GVariant* v)
+{
+    if (!v)
+    {
+        throw InvalidArgumentException("from_gvariant(): variant must not be null");
+    }
+    if (!g_variant_is_of_type(v, G_VARIANT_TYPE(gvariant_type_string<T>())))
+    {
+        throw InvalidArgumentException(std::string("from_gvariant(): expected type '") + gvariant_type_string<T>()
+                                       + "', got '" + g_variant_get_type_string(v) + "'");
+    }
+    return GVariantTraits<T>::from_variant(v);
+}
+
+/**
+ \brief Read-only view of an array of fixed-size elements in a GVariant, such as "ay" or "ai".
+
+ The view points directly into the serialized data of the GVariant and holds a reference to it,
+ so the elements are not copied.
+
+ Example:
+ \code{.cpp}
+ GVariantFixedArray<uint8_t> bytes(reply);
+ write(fd, bytes.data(), bytes.size());
+ \endcode
+ */
+template<typename T>
+class GVariantFixedArray
+{
+    static_assert(GVariantTraits<T>::fixed_size, "GVariantFixedArray requires a fixed-size element type");
+
+public:
+    /**
+     \brief Creates a view of the specified array.
+     \throws InvalidArgumentException <code>v</code> is null or is not an array of <code>T</code>.
+     */
+    explicit GVariantFixedArray(GVariant* v)
+    {
+        typedef std::vector<T> Vector;
+        if (!v || !g_variant_is_of_type(v, G_VARIANT_TYPE(gvariant_type_string<Vector>())))
+        {
+            throw InvalidArgumentException(std::string("GVariantFixedArray(): expected type '")
+                                           + gvariant_type_string<Vector>() + "', got '"
+                                           + (v ? g_variant_get_type_string(v) : "null") + "'");
+        }
+        variant_ = share_glib(g_variant_ref_sink(v));
+        gsize n;
+        data_ = static_cast<T const*>(g_variant_get_fixed_array(v, &n, sizeof(T)));
+        size_ = n;
+    }
+
+    T const* data() const noexcept
+    {
+        return data_;
+    }
+
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    T const* begin() const noexcept
+    {
+        return data_;
+    }
+
+    T const* end() const noexcept
+    {
+        return data_ + size_;
+    }
+
+    T const& operator[](size_t i) const noexcept
+    {
+        return data_[i];
+    }
+
+private:
+    GVariantSPtr variant_;
+    T const* data_;
+    size_t size_;
+};
+
+}  // namespace util
+
+}  // namespace unity
+
+#endif
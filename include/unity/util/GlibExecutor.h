@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_GLIBEXECUTOR_H
+#define UNITY_UTIL_GLIBEXECUTOR_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/GlibMemory.h>
+#include <unity/util/GObjectMemory.h>
+#include <unity/util/NonCopyable.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct GlibExecutorPrivate;
+
+// Holds a submitted task and the promise for its result. Unlike with std::packaged_task, the future
+// does not share ownership of the task: run() destroys the task before it makes the result ready,
+// so anything the task captured is released on the worker thread.
+
+template<typename F, typename R>
+class GlibExecutorTask
+{
+public:
+    explicit GlibExecutorTask(F f)
+        : f_(new F(std::move(f)))
+    {
+    }
+
+    std::future<R> get_future()
+    {
+        return promise_.get_future();
+    }
+
+    void run() noexcept
+    {
+        try
+        {
+            run(std::is_void<R>());
+        }
+        catch (...)
+        {
+            f_.reset();
+            promise_.set_exception(std::current_exception());
+        }
+    }
+
+private:
+    void run(std::true_type)
+    {
+        (*f_)();
+        f_.reset();
+        promise_.set_value();
+    }
+
+    void run(std::false_type)
+    {
+        R result = (*f_)();
+        f_.reset();
+        promise_.set_value(std::forward<R>(result));
+    }
+
+    std::unique_ptr<F> f_;
+    std::promise<R> promise_;
+};
+
+} // namespace internal
+
+/**
+\brief Runs tasks on a dedicated thread with its own GLib main context.
+
+GlibExecutor owns a worker thread that runs a GMainLoop for a private GMainContext. The context is
+the thread-default context of the worker, so asynchronous GIO calls made by a task deliver their
+callbacks to the worker thread rather than to the caller's main loop. This allows components that
+do not run a GLib main loop (or that must not block their main loop) to use GIO without blocking calls.
+
+Tasks can be submitted from any thread. They run in the order they were submitted. The result of a
+task is returned as a <code>std::future</code>, or passed to a callback that is posted to a context of
+the caller's choice, such as the default main context that is run by the UI thread:
+
+\code{.cpp}
+GlibExecutor executor;
+
+auto future = executor.submit([]{ return g_get_host_name(); });
+
+executor.submit([]{ return intrusive_gobject(g_file_new_for_path("/tmp")); },
+                nullptr,    // Deliver to the default main context.
+                [](std::future<GObjectPtr<GFile>> f){ use(f.get()); });
+\endcode
+
+Any GObject held by a task (for example, as a GObjectPtr or GObjectSPtr captured by the task's
+lambda) is released on the worker thread once the task has run. hold() keeps an object alive until
+the executor shuts down, for objects that must outlive the task that created them, such as a
+GDBusConnection with signal subscriptions.
+
+\note The executor must not be shut down or destroyed by one of its own tasks.
+*/
+
+class UNITY_API GlibExecutor final
+{
+public:
+    /// @cond
+    NONCOPYABLE(GlibExecutor);
+    UNITY_DEFINES_PTRS(GlibExecutor);
+    /// @endcond
+
+    /**
+    \brief Creates the main context and starts the worker thread.
+    \throws ResourceException The thread could not be created.
+    */
+    GlibExecutor();
+
+    /**
+    \brief Calls shutdown().
+    */
+    ~GlibExecutor() noexcept;
+
+    /**
+    \brief Returns the main context that is run by the worker thread.
+    */
+    GMainContext* context() const noexcept;
+
+    /**
+    \brief Returns <code>true</code> if the calling thread is the worker thread.
+    */
+    bool is_executor_thread() const noexcept;
+
+    /**
+    \brief Queues a task to run on the worker thread.
+
+    Exceptions thrown by the task are ignored. Use submit() to receive them.
+    \throws LogicException The executor has been shut down.
+    */
+    void post(std::function<void()> task);
+
+    /**
+    \brief Queues a task to run on the thread that iterates <code>context</code>.
+    \param context The context to run the task on. If <code>nullptr</code>, the global default main context is used.
+    \param task The task to run. Exceptions thrown by the task are ignored.
+    */
+    static void post(GMainContext* context, std::function<void()> task);
+
+    /**
+    \brief Queues a task to run on the worker thread.
+    \return A future that receives the result of the task, or the exception it throws.
+    \throws LogicException The executor has been shut down.
+    */
+    template<typename F>
+    auto submit(F f) -> std::future<decltype(f())>
+    {
+        typedef decltype(f()) R;
+        auto task = std::make_shared<internal::GlibExecutorTask<F, R>>(std::move(f));
+        auto future = task->get_future();
+        post([task]{ task->run(); });
+        return future;
+    }
+
+    /**
+    \brief Queues a task to run on the worker thread and passes its result to a callback.
+
+    Once the task has run, <code>callback</code> is posted to <code>reply_context</code>. The callback
+    receives a ready <code>std::future</code> that holds the result of the task, or the exception it threw.
+    \param f The task to run.
+    \param reply_context The context to run the callback on. If <code>nullptr</code>, the global
+    default main context is used. The executor holds a reference to the context until the callback has been posted.
+    \param callback The callback. It must be callable with a <code>std::future</code> of the task's result type.
+    \throws LogicException The executor has been shut down.
+    */
+    template<typename F, typename C>
+    void submit(F f, GMainContext* reply_context, C callback)
+    {
+        typedef decltype(f()) R;
+        auto task = std::make_shared<internal::GlibExecutorTask<F, R>>(std::move(f));
+        auto future = std::make_shared<std::future<R>>(task->get_future());
+        auto context = share_glib(g_main_context_ref(reply_context ? reply_context : g_main_context_default()));
+        post([task, future, context, callback]
+        {
+            task->run();
+            GlibExecutor::post(context.get(), [future, callback]() mutable { callback(std::move(*future)); });
+        });
+    }
+
+    /**
+    \brief Keeps a GObject (or any other object) alive until the executor shuts down.
+
+    The reference is dropped on the worker thread.
+    \throws LogicException The executor has been shut down.
+    */
+    void hold(std::shared_ptr<void> object);
+
+    /**
+    \brief Keeps a GObject alive until the executor shuts down.
+
+    The reference is dropped on the worker thread.
+    \throws LogicException The executor has been shut down.
+    */
+    template<typename T>
+    void hold(GObjectPtr<T> object)
+    {
+        hold(std::make_shared<GObjectPtr<T>>(std::move(object)));
+    }
+
+    /**
+    \brief Stops the executor.
+
+    Tasks that are queued already still run, including tasks they post themselves before the
+    loop stops. Objects passed to hold() are released on the worker thread, and the worker thread is joined.
+    Calling shutdown() more than once has no effect.
+    \throws LogicException shutdown() was called from the worker thread.
+    */
+    void shutdown();
+
+private:
+    std::unique_ptr<internal::GlibExecutorPrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
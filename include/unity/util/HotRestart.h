@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_HOTRESTART_H
+#define UNITY_UTIL_HOTRESTART_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct HotRestartPrivate;
+struct HotRestartSuccessorPrivate;
+}
+
+/**
+\brief Replaces a running daemon with a new instance without closing its listening sockets.
+
+When a daemon is restarted by stopping it and starting a new instance, connections that arrive in between
+are refused, and clients have to reconnect. With a hot restart, the old process starts its successor and hands it
+the listening sockets (and any other file descriptors it chooses), so the successor accepts connections on
+the very same sockets. Connections that arrive while the processes change over wait in the listen backlog;
+none are refused.
+
+The old process calls add_fd() for each descriptor to hand over and then start_successor(). This executes the
+successor and passes the descriptors over a Unix domain socket with <code>SCM_RIGHTS</code>. The successor
+finds the socket via the environment variable <code>UNITY_HOT_RESTART_FD</code>. It calls Successor::attach()
+to receive the descriptors, takes the ones it needs with Successor::take_fd(), and calls
+Successor::notify_ready() once it is accepting connections. At that point, start_successor() returns in the old
+process, which stops accepting connections, finishes the requests it is serving, and exits.
+
+\code
+// Old process, on receipt of SIGHUP:
+HotRestart restart;
+restart.add_fd("http", listen_fd);
+restart.start_successor({ "/usr/bin/mydaemon" }, std::chrono::seconds(10));
+stop_accepting();
+drain_and_exit();
+
+// New process, at start-up:
+int listen_fd = -1;
+auto handoff = HotRestart::Successor::attach();
+if (handoff)
+{
+    listen_fd = handoff->take_fd("http");
+}
+if (listen_fd == -1)
+{
+    listen_fd = create_listen_socket();
+}
+...
+if (handoff)
+{
+    handoff->notify_ready();
+}
+\endcode
+*/
+
+class UNITY_API HotRestart final
+{
+public:
+    /// @cond
+    NONCOPYABLE(HotRestart);
+    UNITY_DEFINES_PTRS(HotRestart);
+    /// @endcond
+
+    /**
+    \brief The successor's side of a hot restart.
+    */
+    class UNITY_API Successor final
+    {
+    public:
+        /// @cond
+        NONCOPYABLE(Successor);
+        UNITY_DEFINES_PTRS(Successor);
+        /// @endcond
+
+        /**
+        \brief Receives the file descriptors from the old process.
+
+        The environment variable <code>UNITY_HOT_RESTART_FD</code> is removed, so it is not inherited by
+        child processes. All received descriptors have the close-on-exec flag set.
+        \return <code>nullptr</code> if the process was not started by HotRestart::start_successor().
+        \throws SyscallException The descriptors could not be received.
+        */
+        static UPtr attach();
+
+        /**
+        \brief Closes any received descriptors that were not taken with take_fd().
+        If notify_ready() was not called, the old process gives up on this successor.
+        */
+        ~Successor() noexcept;
+
+        /**
+        \brief Returns the names of the descriptors that were received and not yet taken.
+        */
+        std::vector<std::string> names() const;
+
+        /**
+        \brief Returns the descriptor with the specified name and transfers its ownership to the caller.
+        \return The descriptor, or -1 if no descriptor with that name was received or it was taken already.
+        */
+        int take_fd(std::string const& name);
+
+        /**
+        \brief Tells the old process that the successor is ready, so it can stop serving and exit.
+        \throws LogicException notify_ready() was called already.
+        \throws SyscallException The old process could not be notified.
+        */
+        void notify_ready();
+
+    private:
+        Successor(int channel);
+
+        std::unique_ptr<internal::HotRestartSuccessorPrivate> p_;
+    };
+
+    /**
+    \brief Creates a hot restart without any descriptors to hand over.
+    */
+    HotRestart();
+
+    ~HotRestart() noexcept;
+
+    /**
+    \brief Adds a descriptor to hand over to the successor.
+
+    The descriptor remains owned by the caller; the successor receives a duplicate.
+    \param name The name by which the successor finds the descriptor. It must be unique and at most
+    255 bytes long.
+    \param fd The descriptor.
+    \throws InvalidArgumentException The name is empty, too long, or already used, or the descriptor is invalid.
+    */
+    void add_fd(std::string const& name, int fd);
+
+    /**
+    \brief Starts the successor, hands over the descriptors, and waits until the successor is ready.
+    \param args The program to run and its arguments. The program is searched for in <code>PATH</code>.
+    The successor inherits the environment of the calling process.
+    \param timeout The time to wait for Successor::notify_ready().
+    \return The process ID of the successor, which is a child of the calling process.
+    \throws InvalidArgumentException <code>args</code> is empty.
+    \throws SyscallException The successor could not be started, or the descriptors could not be sent.
+    \throws ResourceException The successor exited or did not become ready in time. In this case, the successor
+    is killed.
+    */
+    pid_t start_successor(std::vector<std::string> const& args, std::chrono::milliseconds timeout);
+
+private:
+    std::unique_ptr<internal::HotRestartPrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_LINEREADER_H
+#define UNITY_UTIL_LINEREADER_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+#include <unity/util/StringView.h>
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct LineReaderPrivate;
+}
+
+/**
+\brief Iterates over the lines of a file or a memory buffer without copying them.
+
+Many parsers read a whole file with read_text_file() and then split the result into lines,
+which copies every line into a separate <code>std::string</code>. LineReader instead returns each
+line as a StringView into its own buffer. Newlines are located with <code>memchr()</code>, which
+scans many bytes per instruction.
+
+When reading a file, LineReader reads it in windows of <code>window_size</code> bytes, so memory use
+is bounded regardless of the size of the file. When a partial line remains at the end of the window,
+it is moved to the front and the rest of the window is refilled. The window grows only if a single
+line is longer than the window.
+
+When reading from memory (such as a mapped file), lines refer directly to the caller's buffer.
+
+The returned lines do not include the terminating newline. If the last line is not terminated by
+a newline, it is returned as well. A StringView returned by next() (or via an iterator) remains
+valid until the next call to next() or until the LineReader is destroyed.
+
+Use it like this:
+
+~~~
+LineReader reader("/proc/self/mounts");
+for (auto line : reader)
+{
+    if (line.starts_with("tmpfs "))
+    {
+        // ...
+    }
+}
+~~~
+
+LineReader is not thread-safe.
+*/
+
+class UNITY_API LineReader final
+{
+public:
+    /// @cond
+    NONCOPYABLE(LineReader);
+    UNITY_DEFINES_PTRS(LineReader);
+    /// @endcond
+
+    /**
+    \brief The default window size for reading files.
+    */
+    static constexpr size_t default_window_size = 64 * 1024;
+
+    /**
+    \brief Reads lines from the specified file.
+    \param window_size The number of bytes to read from the file at a time.
+    \throws FileException The file could not be opened.
+    */
+    explicit LineReader(std::string const& filename, size_t window_size = default_window_size);
+
+    /**
+    \brief Returns a reader for the lines in the <code>size</code> bytes at <code>data</code>.
+    The data is not copied and must remain valid until the LineReader is destroyed.
+    */
+    static UPtr from_buffer(char const* data, size_t size);
+
+    /**
+    \brief Returns a reader for the lines of a file that may be compressed with gzip or zstd.
+    The data is decompressed directly into the window as the lines are read. Files that are not
+    compressed are read unchanged.
+    \param window_size The number of uncompressed bytes to hold at a time.
+    \throws FileException The file could not be opened. next() throws FileException if the file
+    contains invalid compressed data.
+    */
+    static UPtr from_compressed_file(std::string const& filename, size_t window_size = default_window_size);
+
+    ~LineReader() noexcept;
+
+    /**
+    \brief Returns the next line.
+    \param line Set to the next line if there is one.
+    \return <code>false</code> if there are no more lines.
+    \throws FileException The file could not be read.
+    */
+    bool next(StringView& line);
+
+    /**
+    \brief Input iterator over the lines returned by a LineReader.
+
+    Incrementing the iterator calls LineReader::next(). All iterators for a reader share its position,
+    so only single-pass algorithms can be used.
+    */
+    class iterator
+    {
+    public:
+        /// @cond
+        typedef std::input_iterator_tag iterator_category;
+        typedef StringView value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef StringView const* pointer;
+        typedef StringView const& reference;
+
+        iterator() noexcept
+            : reader_(nullptr)
+        {
+        }
+
+        explicit iterator(LineReader* reader)
+            : reader_(reader)
+        {
+            ++*this;
+        }
+
+        StringView const& operator*() const noexcept
+        {
+            return line_;
+        }
+
+        StringView const* operator->() const noexcept
+        {
+            return &line_;
+        }
+
+        iterator& operator++()
+        {
+            if (reader_ && !reader_->next(line_))
+            {
+                reader_ = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(iterator const& rhs) const noexcept
+        {
+            return reader_ == rhs.reader_;
+        }
+
+        bool operator!=(iterator const& rhs) const noexcept
+        {
+            return reader_ != rhs.reader_;
+        }
+        /// @endcond
+
+    private:
+        LineReader* reader_;
+        StringView line_;
+    };
+
+    /**
+    \brief Returns an iterator to the next line.
+    */
+    iterator begin()
+    {
+        return iterator(this);
+    }
+
+    /**
+    \brief Returns the end iterator.
+    */
+    iterator end() noexcept
+    {
+        return iterator();
+    }
+
+private:
+    LineReader();
+
+    std::unique_ptr<internal::LineReaderPrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_PROCESSSPAWNER_H
+#define UNITY_UTIL_PROCESSSPAWNER_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct ProcessSpawnerPrivate;
+}
+
+/**
+\brief Starts child processes without copying the address space of the caller.
+
+With <code>fork()</code>, the kernel has to copy the page tables of the calling process, which takes several
+milliseconds for a process with a large heap, even though the child immediately replaces them with
+<code>exec()</code>. ProcessSpawner instead creates the child with <code>CLONE_VM | CLONE_VFORK</code>, the way
+<code>posix_spawn()</code> does: the child borrows the caller's memory until it calls <code>exec()</code>, so the
+cost of starting a process does not depend on the size of the caller.
+
+In addition to what <code>posix_spawn()</code> offers, the child's resource limits can be set.
+
+To start a process, create a ProcessSpawner with the program and its arguments, configure it, and call spawn().
+The same ProcessSpawner can be used to start any number of processes.
+
+\code
+ProcessSpawner spawner({ "/usr/bin/app", "--fullscreen" });
+spawner.map_fd(log_fd, 1);
+spawner.close_other_fds();
+spawner.set_env("LANG", "C");
+spawner.set_rlimit(RLIMIT_CORE, 0, 0);
+pid_t pid = spawner.spawn();
+\endcode
+
+The caller is responsible for reaping the child with <code>waitpid()</code>.
+*/
+
+class UNITY_API ProcessSpawner final
+{
+public:
+    /// @cond
+    NONCOPYABLE(ProcessSpawner);
+    UNITY_DEFINES_PTRS(ProcessSpawner);
+    /// @endcond
+
+    /**
+    \brief Creates a spawner for the specified program.
+    \param args The program to run and its arguments. If the program does not contain a slash,
+    it is searched for in <code>PATH</code>.
+    \throws InvalidArgumentException <code>args</code> is empty.
+    */
+    explicit ProcessSpawner(std::vector<std::string> const& args);
+
+    ~ProcessSpawner() noexcept;
+
+    /**
+    \brief Makes a descriptor of the caller available in the child under a different number.
+
+    Mappings are applied together, so one mapping may use a descriptor as its source that another
+    mapping replaces. The child's descriptor does not have the close-on-exec flag set, even if the
+    caller's descriptor does.
+    \param parent_fd The descriptor in the calling process.
+    \param child_fd The descriptor number in the child.
+    \throws InvalidArgumentException A descriptor is negative, or <code>child_fd</code> is mapped already.
+    */
+    void map_fd(int parent_fd, int child_fd);
+
+    /**
+    \brief Closes all descriptors in the child other than the standard three and those passed to map_fd().
+
+    By default, the child inherits all descriptors that do not have the close-on-exec flag set.
+    */
+    void close_other_fds() noexcept;
+
+    /**
+    \brief Starts the child with an empty environment instead of a copy of the caller's environment.
+    Variables added with set_env() are still passed to the child.
+    */
+    void clear_env() noexcept;
+
+    /**
+    \brief Sets an environment variable for the child, overriding any value it inherits.
+    \throws InvalidArgumentException The name is empty or contains '='.
+    */
+    void set_env(std::string const& name, std::string const& value);
+
+    /**
+    \brief Removes an environment variable from the environment inherited by the child.
+    \throws InvalidArgumentException The name is empty or contains '='.
+    */
+    void unset_env(std::string const& name);
+
+    /**
+    \brief Sets the working directory of the child.
+    */
+    void set_working_directory(std::string const& dir);
+
+    /**
+    \brief Moves the child into a process group.
+    \param pgid The process group to join, or 0 to make the child the leader of a new process group.
+    \throws InvalidArgumentException <code>pgid</code> is negative.
+    */
+    void set_process_group(pid_t pgid);
+
+    /**
+    \brief Sets a resource limit of the child.
+    \param resource The resource, as for <code>setrlimit()</code>.
+    \param soft The soft limit.
+    \param hard The hard limit. Raising the hard limit requires privileges.
+    \throws InvalidArgumentException The resource is invalid, or <code>soft</code> is greater than <code>hard</code>.
+    */
+    void set_rlimit(int resource, rlim_t soft, rlim_t hard);
+
+    /**
+    \brief Starts a child process.
+
+    The child inherits the signal mask of the calling thread. Signals that are caught in the caller
+    are reset to their default disposition in the child.
+    \return The process ID of the child.
+    \throws SyscallException The child could not be created, could not be set up as requested, or the
+    program could not be executed. In the latter two cases, the child has been reaped already.
+    */
+    pid_t spawn() const;
+
+private:
+    std::unique_ptr<internal::ProcessSpawnerPrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
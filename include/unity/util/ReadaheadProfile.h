@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_READAHEADPROFILE_H
+#define UNITY_UTIL_READAHEADPROFILE_H
+
+#include <unity/SymbolExport.h>
+#include <unity/util/DefinesPtrs.h>
+#include <unity/util/NonCopyable.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+struct ReadaheadProfilePrivate;
+}
+
+/**
+\brief Records the files that are read during startup and pre-loads them into the page cache on the next start.
+
+The cold start time of a process is often dominated by page cache misses on a predictable set of files.
+While recording is active, the FileIO functions, LineReader, and IniParser log the path and byte
+range of every file they read. Calling stop_recording() returns the recorded profile, which can be saved
+to a compact binary file.
+
+On the next start, the process loads the profile and calls replay() as early as possible. replay() opens
+the recorded files from several threads in parallel and asks the kernel to read the recorded ranges into
+the page cache with <code>posix_fadvise(POSIX_FADV_WILLNEED)</code> and <code>readahead()</code>. By the
+time the process gets to reading the files, the data is (at least partially) in memory already.
+
+~~~
+auto profile = ReadaheadProfile::load(profile_path);    // On a later start
+std::thread preload([&profile]{ profile->replay(); });
+
+ReadaheadProfile::start_recording();
+// ... initialize ...
+ReadaheadProfile::stop_recording()->save(profile_path);
+preload.join();
+~~~
+
+Relative paths are converted to absolute paths when they are recorded. Files that cannot be opened
+during replay (for example, because they were removed) are skipped.
+
+Recording has negligible overhead while it is not active. All methods are thread-safe.
+*/
+
+class UNITY_API ReadaheadProfile final
+{
+public:
+    /// @cond
+    NONCOPYABLE(ReadaheadProfile);
+    UNITY_DEFINES_PTRS(ReadaheadProfile);
+    /// @endcond
+
+    /**
+    \brief A byte range of a file.
+    */
+    struct Range
+    {
+        std::string path;       ///< Absolute path of the file.
+        uint64_t offset;        ///< Start of the range.
+        uint64_t length;        ///< Length of the range. Zero means "to the end of the file".
+    };
+
+    /**
+    \brief Starts recording file reads. Any previously recorded (and not yet returned) reads are discarded.
+    */
+    static void start_recording();
+
+    /**
+    \brief Stops recording and returns the profile with the reads since start_recording() was called.
+    */
+    static UPtr stop_recording();
+
+    /**
+    \brief Returns <code>true</code> while recording is active.
+    */
+    static bool is_recording() noexcept;
+
+    /**
+    \brief Adds a read to the profile that is currently being recorded.
+
+    This is called by the FileIO functions, LineReader, and IniParser. Other code that reads files
+    at start-up can call it, too. The call does nothing if recording is not active.
+    \param length The number of bytes read. Zero means "to the end of the file".
+    */
+    static void record(std::string const& path, uint64_t offset, uint64_t length) noexcept;
+
+    /**
+    \brief Loads a profile that was saved with save().
+    \throws FileException The file could not be read or is not a readahead profile.
+    */
+    static UPtr load(std::string const& profile_filename);
+
+    ~ReadaheadProfile() noexcept;
+
+    /**
+    \brief Writes the profile to the specified file.
+    \throws FileException The file could not be written.
+    */
+    void save(std::string const& profile_filename) const;
+
+    /**
+    \brief Returns the recorded ranges, sorted by path and offset.
+    Overlapping and adjacent ranges of the same file are merged.
+    */
+    std::vector<Range> ranges() const;
+
+    /**
+    \brief Asks the kernel to read all ranges of the profile into the page cache.
+    \param concurrency The number of threads that issue requests in parallel.
+           Zero selects the number of hardware threads.
+    \return The number of files for which readahead was issued.
+    */
+    size_t replay(unsigned concurrency = 0) const noexcept;
+
+private:
+    ReadaheadProfile();
+
+    std::unique_ptr<internal::ReadaheadProfilePrivate> p_;
+};
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_RESOURCEPOOL_H
+#define UNITY_UTIL_RESOURCEPOOL_H
+
+#include <unity/UnityExceptions.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+/**
+\brief Class to reuse resources that are expensive to create.
+
+A ResourcePool hands out leases for resources. When a lease is destroyed, its resource is returned to the pool
+instead of being deallocated, and the next call to acquire() hands it out again. New resources are created by
+the factory function only if no idle resource is available.
+
+The pool keeps at most <code>max_idle</code> idle resources. If a resource is returned while that many
+are idle, it is deallocated with the deleter. If an idle timeout is set, resources that have been idle for
+longer than that are never handed out again; acquire() deallocates them instead, and evict_idle() deallocates
+all of them, so you can call it periodically to release resources the application no longer needs.
+
+A reset function, if provided, is applied to each resource as it is returned, for example to clear a buffer or
+to rewind a file. If it throws, the resource is deallocated instead of being returned.
+
+~~~
+ResourcePool<GKeyFile*, decltype(&g_key_file_free)> pool(g_key_file_new, g_key_file_free, 4);
+{
+    auto parser = pool.acquire();
+    g_key_file_load_from_data(parser.get(), ...);
+}   // parser is returned to the pool.
+~~~
+
+ResourcePool is thread-safe. While idle resources are available, acquire() and the return of a lease
+do not take a lock unless other threads are acquiring or returning resources at the same time.
+
+\note The pool must outlive all of its leases.
+*/
+
+template<typename R, typename D>
+class ResourcePool final
+{
+    struct Entry
+    {
+        R resource;
+        std::chrono::steady_clock::time_point idle_since;
+    };
+
+public:
+    /** Deleted */
+    ResourcePool(ResourcePool const&) = delete;
+    /** Deleted */
+    ResourcePool& operator=(ResourcePool const&) = delete;
+
+    /**
+    \typedef element_type
+    The type of resource managed by this ResourcePool.
+    */
+    typedef R element_type;
+
+    /**
+    \typedef deleter_type
+    A function object or function pointer that is called to deallocate a resource.
+    */
+    typedef D deleter_type;
+
+    /**
+    \brief A lease for a resource from the pool.
+
+    The lease returns its resource to the pool when it is destroyed. A lease can be moved, but not copied.
+    */
+    class Lease final
+    {
+    public:
+        /** Deleted */
+        Lease(Lease const&) = delete;
+        /** Deleted */
+        Lease& operator=(Lease const&) = delete;
+
+        /**
+        Transfers the resource from <code>other</code> to <code>this</code>.
+        */
+        Lease(Lease&& other) noexcept
+            : pool_(other.pool_)
+            , entry_(std::move(other.entry_))
+        {
+        }
+
+        /**
+        Returns the current resource (if any) to the pool and transfers the resource from <code>other</code>
+        to <code>this</code>.
+        */
+        Lease& operator=(Lease&& other) noexcept
+        {
+            if (this != &other)
+            {
+                give_back();
+                pool_ = other.pool_;
+                entry_ = std::move(other.entry_);
+            }
+            return *this;
+        }
+
+        /**
+        Returns the resource (if any) to the pool.
+        */
+        ~Lease() noexcept
+        {
+            give_back();
+        }
+
+        /**
+        \return The resource.
+        \throw LogicException The lease does not hold a resource because it was moved from or discarded.
+        */
+        R& get() const
+        {
+            if (!entry_)
+            {
+                throw LogicException("ResourcePool::Lease::get(): lease does not hold a resource");
+            }
+            return entry_->resource;
+        }
+
+        /**
+        \return <code>true</code> if the lease holds a resource.
+        */
+        explicit operator bool() const noexcept
+        {
+            return entry_ != nullptr;
+        }
+
+        /**
+        \brief Deallocates the resource instead of returning it to the pool.
+
+        Call this if the resource turned out to be unusable, for example, because a connection was lost.
+        Exceptions from the deleter are ignored.
+        */
+        void discard() noexcept
+        {
+            if (entry_)
+            {
+                pool_->destroy(std::move(entry_));
+            }
+        }
+
+    private:
+        Lease(ResourcePool* pool, std::unique_ptr<Entry> entry) noexcept
+            : pool_(pool)
+            , entry_(std::move(entry))
+        {
+        }
+
+        void give_back() noexcept
+        {
+            if (entry_)
+            {
+                pool_->give_back(std::move(entry_));
+            }
+        }
+
+        ResourcePool* pool_;
+        std::unique_ptr<Entry> entry_;
+
+        friend class ResourcePool;
+    };
+
+    /**
+    \brief Creates an empty pool.
+    \param factory The function that creates a new resource. If it throws, acquire() propagates the exception.
+    \param deleter The function that deallocates a resource.
+    \param max_idle The maximum number of idle resources kept by the pool.
+    \param idle_timeout The time after which an idle resource is no longer handed out. Zero means that
+    resources do not expire.
+    \param reset The function to apply to a resource when it is returned (may be empty).
+    \throws InvalidArgumentException <code>factory</code> is empty, or <code>idle_timeout</code> is negative.
+    */
+    ResourcePool(std::function<R()> factory,
+                 D deleter,
+                 size_t max_idle,
+                 std::chrono::milliseconds idle_timeout = std::chrono::milliseconds::zero(),
+                 std::function<void(R&)> reset = nullptr)
+        : factory_(std::move(factory))
+        , deleter_(std::move(deleter))
+        , reset_(std::move(reset))
+        , idle_timeout_(idle_timeout)
+        , slot_count_(std::min(max_idle, slot_capacity))
+        , max_listed_(max_idle - slot_count_)
+    {
+        if (!factory_)
+        {
+            throw InvalidArgumentException("ResourcePool(): factory must not be empty");
+        }
+        if (idle_timeout.count() < 0)
+        {
+            throw InvalidArgumentException("ResourcePool(): invalid idle timeout: "
+                                           + std::to_string(idle_timeout.count()) + " ms");
+        }
+        for (auto& s : slots_)
+        {
+            s.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+    Deallocates all idle resources.
+    */
+    ~ResourcePool() noexcept
+    {
+        for (auto& s : slots_)
+        {
+            std::unique_ptr<Entry> e(s.exchange(nullptr, std::memory_order_acquire));
+            if (e)
+            {
+                destroy(std::move(e));
+            }
+        }
+        for (auto& e : listed_)
+        {
+            destroy(std::move(e));
+        }
+    }
+
+    /**
+    \brief Hands out an idle resource or, if there is none, creates a new one.
+    \return A lease for the resource.
+    */
+    Lease acquire()
+    {
+        auto const now = std::chrono::steady_clock::now();
+
+        // Fast path: take a resource from one of the slots.
+
+        for (size_t i = 0; i < slot_count_; ++i)
+        {
+            if (slots_[i].load(std::memory_order_relaxed) == nullptr)
+            {
+                continue;
+            }
+            std::unique_ptr<Entry> e(slots_[i].exchange(nullptr, std::memory_order_acquire));
+            if (!e)
+            {
+                continue;   // Another thread got there first.
+            }
+            if (!expired(*e, now))
+            {
+                return Lease(this, std::move(e));
+            }
+            destroy(std::move(e));
+        }
+
+        // Slow path: the most recently returned resource from the list.
+
+        std::unique_ptr<Entry> e;
+        std::vector<std::unique_ptr<Entry>> expired_entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!e && !listed_.empty())
+            {
+                std::unique_ptr<Entry> x(std::move(listed_.back()));
+                listed_.pop_back();
+                if (expired(*x, now))
+                {
+                    expired_entries.push_back(std::move(x));
+                }
+                else
+                {
+                    e = std::move(x);
+                }
+            }
+        }
+        for (auto& x : expired_entries)
+        {
+            destroy(std::move(x));
+        }
+        if (e)
+        {
+            return Lease(this, std::move(e));
+        }
+
+        e.reset(new Entry{ factory_(), now });
+        return Lease(this, std::move(e));
+    }
+
+    /**
+    \brief Deallocates all idle resources that have expired.
+
+    If there is no idle timeout, this does nothing.
+    */
+    void evict_idle()
+    {
+        if (idle_timeout_.count() == 0)
+        {
+            return;
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < slot_count_; ++i)
+        {
+            std::unique_ptr<Entry> e(slots_[i].exchange(nullptr, std::memory_order_acquire));
+            if (!e)
+            {
+                continue;
+            }
+            if (expired(*e, now))
+            {
+                destroy(std::move(e));
+            }
+            else
+            {
+                give_back_to_pool(std::move(e));
+            }
+        }
+
+        std::vector<std::unique_ptr<Entry>> expired_entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& e : listed_)
+            {
+                if (expired(*e, now))
+                {
+                    expired_entries.push_back(std::move(e));
+                }
+            }
+            listed_.erase(std::remove(listed_.begin(), listed_.end(), nullptr), listed_.end());
+        }
+        for (auto& e : expired_entries)
+        {
+            destroy(std::move(e));
+        }
+    }
+
+    /**
+    \return The number of idle resources. If other threads use the pool at the same time, the result
+    is approximate.
+    */
+    size_t idle_count() const noexcept
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < slot_count_; ++i)
+        {
+            if (slots_[i].load(std::memory_order_relaxed) != nullptr)
+            {
+                ++count;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count + listed_.size();
+    }
+
+private:
+    // Number of slots for the lock-free path. Any further idle resources are kept in a list protected by mutex_.
+
+    static constexpr size_t slot_capacity = 4;
+
+    bool expired(Entry const& e, std::chrono::steady_clock::time_point now) const noexcept
+    {
+        return idle_timeout_.count() != 0 && now - e.idle_since > idle_timeout_;
+    }
+
+    void destroy(std::unique_ptr<Entry> e) noexcept
+    {
+        try
+        {
+            deleter_(e->resource);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void give_back(std::unique_ptr<Entry> e) noexcept
+    {
+        if (reset_)
+        {
+            try
+            {
+                reset_(e->resource);
+            }
+            catch (...)
+            {
+                destroy(std::move(e));
+                return;
+            }
+        }
+        if (idle_timeout_.count() != 0)
+        {
+            e->idle_since = std::chrono::steady_clock::now();
+        }
+        give_back_to_pool(std::move(e));
+    }
+
+    void give_back_to_pool(std::unique_ptr<Entry> e) noexcept
+    {
+        // Fast path: put the resource into an empty slot.
+
+        for (size_t i = 0; i < slot_count_; ++i)
+        {
+            Entry* expected = nullptr;
+            if (slots_[i].load(std::memory_order_relaxed) == nullptr
+                && slots_[i].compare_exchange_strong(expected, e.get(), std::memory_order_release))
+            {
+                e.release();
+                return;
+            }
+        }
+
+        // Slow path: append to the list, unless it is full.
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (listed_.size() < max_listed_)
+            {
+                try
+                {
+                    listed_.push_back(std::move(e));
+                    return;
+                }
+                catch (std::bad_alloc const&)   // LCOV_EXCL_LINE
+                {
+                }
+            }
+        }
+        destroy(std::move(e));
+    }
+
+    std::function<R()> const factory_;
+    D deleter_;
+    std::function<void(R&)> const reset_;
+    std::chrono::milliseconds const idle_timeout_;
+    size_t const slot_count_;
+    size_t const max_listed_;
+    std::array<std::atomic<Entry*>, slot_capacity> slots_;
+    mutable std::mutex mutex_;                      // Protects listed_
+    std::vector<std::unique_ptr<Entry>> listed_;    // Most recently returned last
+};
+
+template<typename R, typename D>
+constexpr size_t ResourcePool<R, D>::slot_capacity;
+
+} // namespace util
+
+} // namespace unity
+
+#endif
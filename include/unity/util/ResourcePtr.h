@@ -19,7 +19,9 @@
 #ifndef UNITY_UTIL_RESOURCEPTR_H
 #define UNITY_UTIL_RESOURCEPTR_H
 
+#include <atomic>
 #include <mutex>
+#include <thread>
 #include <type_traits>
 
 namespace unity
@@ -49,6 +51,119 @@ private:
 
 } // namespace
 
+/**
+\brief Locking policy for ResourcePtr that protects each instance with a <code>std::mutex</code>.
+
+This is the default policy.
+*/
+
+class MutexLockPolicy
+{
+public:
+    /// @cond
+    void lock() const
+    {
+        m_.lock();
+    }
+
+    void unlock() const noexcept
+    {
+        m_.unlock();
+    }
+
+    bool try_lock() const
+    {
+        return m_.try_lock();
+    }
+    /// @endcond
+
+private:
+    mutable std::mutex m_;
+};
+
+/**
+\brief Locking policy for ResourcePtr that protects each instance with a spin lock.
+
+The lock occupies a single byte and, without contention, costs a single atomic operation to acquire.
+While the lock is held by another thread, the caller yields the CPU rather than sleeping.
+Use this for instances that are shared among threads, but accessed only briefly.
+*/
+
+class SpinLockPolicy
+{
+public:
+    /// @cond
+    SpinLockPolicy() noexcept
+    {
+        flag_.clear();
+    }
+
+    void lock() const noexcept
+    {
+        while (flag_.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock() const noexcept
+    {
+        flag_.clear(std::memory_order_release);
+    }
+
+    bool try_lock() const noexcept
+    {
+        return !flag_.test_and_set(std::memory_order_acquire);
+    }
+    /// @endcond
+
+private:
+    mutable std::atomic_flag flag_;
+};
+
+/**
+\brief Locking policy for ResourcePtr that does no locking at all.
+
+A ResourcePtr with this policy is not thread-safe, but it adds no space to the ResourcePtr, and
+none of its operations acquire a lock. Use this for instances that are owned by a single thread,
+which is the common case for file descriptors and similar handles.
+*/
+
+class NoLockPolicy
+{
+public:
+    /// @cond
+    void lock() const noexcept
+    {
+    }
+
+    void unlock() const noexcept
+    {
+    }
+
+    bool try_lock() const noexcept
+    {
+        return true;
+    }
+    /// @endcond
+};
+
+namespace
+{
+
+// There is nothing to adopt, and the assertion in LockAdopter would fail.
+
+template<>
+class LockAdopter<NoLockPolicy const>
+{
+public:
+    LockAdopter(NoLockPolicy const&) noexcept
+    {
+    }
+};
+
+} // namespace
+
 /**
 \brief Class to guarantee deallocation of arbitrary resources.
 
@@ -61,7 +176,19 @@ The resource managed by this class must be default-constructible, copy-construct
 ResourcePtr essentially does what <code>std::unique_ptr</code> does, but it works with opaque types
 and resource allocation functions that do not return a pointer type, such as <code>open()</code>.
 
-ResourcePtr is thread-safe.
+By default, ResourcePtr is thread-safe: each instance contains a <code>std::mutex</code> that is locked by
+every operation. The optional third template parameter selects a different locking policy:
+
+- MutexLockPolicy (the default) locks a <code>std::mutex</code>.
+- SpinLockPolicy locks a one-byte spin lock.
+- NoLockPolicy does no locking. Such a ResourcePtr is not thread-safe, and it is no larger than
+  the resource, the deleter, and a flag.
+
+Most resources are owned by a single thread, so they do not need the protection of a lock:
+
+~~~
+ResourcePtr<int, void(*)(int), NoLockPolicy> fd(::open(...), close_fd);
+~~~
 
 \note Do not use reset() to set the resource to the "no resource allocated" state.
       Instead, call dealloc() to do this. ResourcePtr has no idea
@@ -115,8 +242,8 @@ Use <code>std::unique_ptr</code> instead, which is better suited to the task.
 
 // TODO: Discuss throwing deleters and requirements (copy constructible, etc.) on deleter.
 
-template<typename R, typename D>
-class ResourcePtr final
+template<typename R, typename D, typename L = MutexLockPolicy>
+class ResourcePtr final : private L     // Private base, so a stateless policy takes no space.
 {
 public:
     /** Deleted */
@@ -136,6 +263,12 @@ public:
     */
     typedef D deleter_type;
 
+    /**
+    \typedef lock_policy_type
+    The locking policy of this ResourcePtr.
+    */
+    typedef L lock_policy_type;
+
     ResourcePtr();
     explicit ResourcePtr(D d);
     ResourcePtr(R r, D d);
@@ -171,14 +304,20 @@ private:
     R resource_;                   // The managed resource.
     D delete_;                     // The deleter to call.
     bool initialized_;             // True while we have a resource assigned.
-    mutable std::mutex m_;         // Protects this instance.
 
-    typedef std::lock_guard<decltype(m_)>  AutoLock;
-    typedef LockAdopter<decltype(m_)>      AdoptLock;
+    // Protects this instance.
+
+    L const& lock_policy() const noexcept
+    {
+        return *this;
+    }
+
+    typedef std::lock_guard<L const>  AutoLock;
+    typedef LockAdopter<L const>      AdoptLock;
 };
 
-template<typename R, typename D>
-ResourcePtr<R, D>::ResourcePtr()
+template<typename R, typename D, typename L>
+ResourcePtr<R, D, L>::ResourcePtr()
     : initialized_(false)
 {
     static_assert(!std::is_pointer<deleter_type>::value,
@@ -190,8 +329,8 @@ Constructs a ResourcePtr with the specified deleter. No resource is held, so a c
 after constructing a ResourcePtr this way returns <code>false</code>.
 */
 
-template<typename R, typename D>
-ResourcePtr<R, D>::ResourcePtr(D d)
+template<typename R, typename D, typename L>
+ResourcePtr<R, D, L>::ResourcePtr(D d)
     : delete_(d), initialized_(false)
 {
 }
@@ -233,8 +372,8 @@ ResourcePtr<int, decltype(&::close)> fd(::open("/somefile", O_RDONLY), ::close);
       exception, so the first approach is the recommended one.
 */
 
-template<typename R, typename D>
-ResourcePtr<R, D>::ResourcePtr(R r, D d)
+template<typename R, typename D, typename L>
+ResourcePtr<R, D, L>::ResourcePtr(R r, D d)
     : resource_(r), delete_(d), initialized_(true)
 {
 }
@@ -247,8 +386,8 @@ The strong exception guarantee is preserved if it is provided by the resource.
 */
 // TODO: Mark as nothrow if the resource has a nothrow move constructor or nothrow copy constructor
 
-template<typename R, typename D>
-ResourcePtr<R, D>::ResourcePtr(ResourcePtr<R, D>&& r)
+template<typename R, typename D, typename L>
+ResourcePtr<R, D, L>::ResourcePtr(ResourcePtr<R, D, L>&& r)
     : resource_(std::move(r.resource_)), delete_(r.delete_), initialized_(r.initialized_)
 {
     r.initialized_ = false; // Stop r from deleting its resource, if it held any. No need to lock: r is a temporary.
@@ -261,10 +400,10 @@ the value of <code>r.has_resource()</code> prior to the assignment.
 */
 // TODO: document exception safety behavior
 
-template<typename R, typename D>
-ResourcePtr<R, D>& ResourcePtr<R, D>::operator=(ResourcePtr&& r)
+template<typename R, typename D, typename L>
+ResourcePtr<R, D, L>& ResourcePtr<R, D, L>::operator=(ResourcePtr&& r)
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
 
     if (initialized_)                   // If we hold a resource, deallocate it first.
     {
@@ -286,8 +425,8 @@ ResourcePtr<R, D>& ResourcePtr<R, D>::operator=(ResourcePtr&& r)
 Destroys the ResourcePtr. If a resource is held, it calls the deleter for the current resource (if any).
 */
 
-template<typename R, typename D>
-ResourcePtr<R, D>::~ResourcePtr() noexcept
+template<typename R, typename D, typename L>
+ResourcePtr<R, D, L>::~ResourcePtr() noexcept
 {
     try
     {
@@ -307,17 +446,17 @@ held by the ResourcePtr is unchanged.
 */
 // TODO Split this into throw and no-throw versions depending on the underlying swap?
 
-template<typename R, typename D>
-void ResourcePtr<R, D>::swap(ResourcePtr& other)
+template<typename R, typename D, typename L>
+void ResourcePtr<R, D, L>::swap(ResourcePtr& other)
 {
     if (this == &other)   // This is necessary to avoid deadlock for self-swap
     {
         return;
     }
 
-    std::lock(m_, other.m_);
-    AdoptLock left(m_);
-    AdoptLock right(other.m_);
+    std::lock(lock_policy(), other.lock_policy());
+    AdoptLock left(lock_policy());
+    AdoptLock right(other.lock_policy());
 
     using std::swap; // Enable ADL
     swap(resource_, other.resource_);
@@ -338,8 +477,8 @@ held by the ResourcePtr is unchanged.
 */
 // TODO Split this into throw and no-throw versions depending on the underlying swap?
 
-template<typename R, typename D>
-void swap(unity::util::ResourcePtr<R, D>& lhs, unity::util::ResourcePtr<R, D>& rhs)
+template<typename R, typename D, typename L>
+void swap(unity::util::ResourcePtr<R, D, L>& lhs, unity::util::ResourcePtr<R, D, L>& rhs)
 {
     lhs.swap(rhs);
 }
@@ -353,10 +492,10 @@ case, the transfer of <code>r</code> to <code>this</code> is still carried out s
 no attempt is made to call the deleter again for the same resource.)
 */
 
-template<typename R, typename D>
-void ResourcePtr<R, D>::reset(R r)
+template<typename R, typename D, typename L>
+void ResourcePtr<R, D, L>::reset(R r)
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
 
     bool has_old = initialized_;
     R old_resource;
@@ -379,11 +518,11 @@ Releases ownership of the current resource without calling the deleter.
 \throw std::logic_error if has_resource() is false.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-R ResourcePtr<R, D>::release()
+R ResourcePtr<R, D, L>::release()
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
 
     if (!initialized_)
     {
@@ -400,10 +539,10 @@ If the deleter throws, the resource is considered in the "not allocated" state,
 that is, no attempt is made to call the deleter again for this resource.
 */
 
-template<typename R, typename D>
-void ResourcePtr<R, D>::dealloc()
+template<typename R, typename D, typename L>
+void ResourcePtr<R, D, L>::dealloc()
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
 
     if (!initialized_)
     {
@@ -422,11 +561,11 @@ If the resource's copy constructor throws an exception, that exception is propag
 \throw std::logic_error if has_resource() is false.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-R ResourcePtr<R, D>::get() const
+R ResourcePtr<R, D, L>::get() const
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
 
     if (!initialized_)
     {
@@ -439,11 +578,11 @@ R ResourcePtr<R, D>::get() const
 \return <code>true</code> if <code>this</code> currently manages a resource; <code>false</code>, otherwise.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-bool ResourcePtr<R, D>::has_resource() const noexcept
+bool ResourcePtr<R, D, L>::has_resource() const noexcept
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
     return initialized_;
 }
 
@@ -451,9 +590,9 @@ bool ResourcePtr<R, D>::has_resource() const noexcept
 Synonym for has_resource().
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-ResourcePtr<R, D>::operator bool() const noexcept
+ResourcePtr<R, D, L>::operator bool() const noexcept
 {
     return has_resource();
 }
@@ -462,11 +601,11 @@ ResourcePtr<R, D>::operator bool() const noexcept
 \return The deleter for the resource.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-D& ResourcePtr<R, D>::get_deleter() noexcept
+D& ResourcePtr<R, D, L>::get_deleter() noexcept
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
     return delete_;
 }
 
@@ -474,11 +613,11 @@ D& ResourcePtr<R, D>::get_deleter() noexcept
 \return The deleter for the resource.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-D const& ResourcePtr<R, D>::get_deleter() const noexcept
+D const& ResourcePtr<R, D, L>::get_deleter() const noexcept
 {
-    AutoLock lock(m_);
+    AutoLock lock(lock_policy());
     return delete_;
 }
 
@@ -493,17 +632,17 @@ If the underlying <code>operator==</code> throws an exception, that exception is
 \note This operator is available only if the underlying resource provides <code>operator==</code>.
 */
 
-template<typename R, typename D>
-bool ResourcePtr<R, D>::operator==(ResourcePtr<R, D> const& rhs) const
+template<typename R, typename D, typename L>
+bool ResourcePtr<R, D, L>::operator==(ResourcePtr<R, D, L> const& rhs) const
 {
     if (this == &rhs)   // This is necessary to avoid deadlock for self-comparison
     {
         return true;
     }
 
-    std::lock(m_, rhs.m_);
-    AdoptLock left(m_);
-    AdoptLock right(rhs.m_);
+    std::lock(lock_policy(), rhs.lock_policy());
+    AdoptLock left(lock_policy());
+    AdoptLock right(rhs.lock_policy());
 
     if (!initialized_)
     {
@@ -527,9 +666,9 @@ If the underlying <code>operator==</code> throws an exception, that exception is
 \note This operator is available only if the underlying resource provides <code>operator==</code>.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-bool ResourcePtr<R, D>::operator!=(ResourcePtr<R, D> const& rhs) const
+bool ResourcePtr<R, D, L>::operator!=(ResourcePtr<R, D, L> const& rhs) const
 {
     return !(*this == rhs);
 }
@@ -544,17 +683,17 @@ If the underlying <code>operator\<</code> throws an exception, that exception is
 \note This operator is available only if the underlying resource provides <code>operator\<</code>.
 */
 
-template<typename R, typename D>
-bool ResourcePtr<R, D>::operator<(ResourcePtr<R, D> const& rhs) const
+template<typename R, typename D, typename L>
+bool ResourcePtr<R, D, L>::operator<(ResourcePtr<R, D, L> const& rhs) const
 {
     if (this == &rhs)   // This is necessary to avoid deadlock for self-comparison
     {
         return false;
     }
 
-    std::lock(m_, rhs.m_);
-    AdoptLock left(m_);
-    AdoptLock right(rhs.m_);
+    std::lock(lock_policy(), rhs.lock_policy());
+    AdoptLock left(lock_policy());
+    AdoptLock right(rhs.lock_policy());
 
     if (!initialized_)
     {
@@ -583,8 +722,8 @@ that exception is propagated to the caller.
 and <code>operator==</code>.
 */
 
-template<typename R, typename D>
-bool ResourcePtr<R, D>::operator<=(ResourcePtr<R, D> const& rhs) const
+template<typename R, typename D, typename L>
+bool ResourcePtr<R, D, L>::operator<=(ResourcePtr<R, D, L> const& rhs) const
 {
     if (this == &rhs)   // This is necessary to avoid deadlock for self-comparison
     {
@@ -598,9 +737,9 @@ bool ResourcePtr<R, D>::operator<=(ResourcePtr<R, D> const& rhs) const
     // because that creates a race condition: the locks would be released and
     // re-aquired in between the two comparisons.
 
-    std::lock(m_, rhs.m_);
-    AdoptLock left(m_);
-    AdoptLock right(rhs.m_);
+    std::lock(lock_policy(), rhs.lock_policy());
+    AdoptLock left(lock_policy());
+    AdoptLock right(rhs.lock_policy());
 
     return resource_ < rhs.resource_ || resource_ == rhs.resource_;
 }
@@ -617,9 +756,9 @@ that exception is propagated to the caller.
 and <code>operator==</code>.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-bool ResourcePtr<R, D>::operator>(ResourcePtr<R, D> const& rhs) const
+bool ResourcePtr<R, D, L>::operator>(ResourcePtr<R, D, L> const& rhs) const
 {
     return !(*this <= rhs);
 }
@@ -635,9 +774,9 @@ If the underlying <code>operator\<</code> throws an exception, that exception is
 \note This operator is available only if the underlying resource provides <code>operator\<</code>.
 */
 
-template<typename R, typename D>
+template<typename R, typename D, typename L>
 inline
-bool ResourcePtr<R, D>::operator>=(ResourcePtr<R, D> const& rhs) const
+bool ResourcePtr<R, D, L>::operator>=(ResourcePtr<R, D, L> const& rhs) const
 {
     return !(*this < rhs);
 }
@@ -655,13 +794,13 @@ namespace std
 \brief Function object for equality comparison.
 */
 
-template<typename R, typename D>
-struct equal_to<unity::util::ResourcePtr<R, D>>
+template<typename R, typename D, typename L>
+struct equal_to<unity::util::ResourcePtr<R, D, L>>
 {
     /**
     Invokes <code>operator==</code> on <code>lhs</code>.
     */
-    bool operator()(unity::util::ResourcePtr<R, D> const& lhs, unity::util::ResourcePtr<R, D> const& rhs) const
+    bool operator()(unity::util::ResourcePtr<R, D, L> const& lhs, unity::util::ResourcePtr<R, D, L> const& rhs) const
     {
         return lhs == rhs;
     }
@@ -671,13 +810,13 @@ struct equal_to<unity::util::ResourcePtr<R, D>>
 \brief Function object for inequality comparison.
 */
 
-template<typename R, typename D>
-struct not_equal_to<unity::util::ResourcePtr<R, D>>
+template<typename R, typename D, typename L>
+struct not_equal_to<unity::util::ResourcePtr<R, D, L>>
 {
     /**
     Invokes <code>operator!=</code> on <code>lhs</code>.
     */
-    bool operator()(unity::util::ResourcePtr<R, D> const& lhs, unity::util::ResourcePtr<R, D> const& rhs) const
+    bool operator()(unity::util::ResourcePtr<R, D, L> const& lhs, unity::util::ResourcePtr<R, D, L> const& rhs) const
     {
         return lhs != rhs;
     }
@@ -687,13 +826,13 @@ struct not_equal_to<unity::util::ResourcePtr<R, D>>
 \brief Function object for less than comparison.
 */
 
-template<typename R, typename D>
-struct less<unity::util::ResourcePtr<R, D>>
+template<typename R, typename D, typename L>
+struct less<unity::util::ResourcePtr<R, D, L>>
 {
     /**
     Invokes <code>operator\<</code> on <code>lhs</code>.
     */
-    bool operator()(unity::util::ResourcePtr<R, D> const& lhs, unity::util::ResourcePtr<R, D> const& rhs) const
+    bool operator()(unity::util::ResourcePtr<R, D, L> const& lhs, unity::util::ResourcePtr<R, D, L> const& rhs) const
     {
         return lhs < rhs;
     }
@@ -703,13 +842,13 @@ struct less<unity::util::ResourcePtr<R, D>>
 \brief Function object for less than or equal comparison.
 */
 
-template<typename R, typename D>
-struct less_equal<unity::util::ResourcePtr<R, D>>
+template<typename R, typename D, typename L>
+struct less_equal<unity::util::ResourcePtr<R, D, L>>
 {
     /**
     Invokes <code>operator\<=</code> on <code>lhs</code>.
     */
-    bool operator()(unity::util::ResourcePtr<R, D> const& lhs, unity::util::ResourcePtr<R, D> const& rhs) const
+    bool operator()(unity::util::ResourcePtr<R, D, L> const& lhs, unity::util::ResourcePtr<R, D, L> const& rhs) const
     {
         return lhs <= rhs;
     }
@@ -719,13 +858,13 @@ struct less_equal<unity::util::ResourcePtr<R, D>>
 \brief Function object for greater than comparison.
 */
 
-template<typename R, typename D>
-struct greater<unity::util::ResourcePtr<R, D>>
+template<typename R, typename D, typename L>
+struct greater<unity::util::ResourcePtr<R, D, L>>
 {
     /**
     Invokes <code>operator\></code> on <code>lhs</code>.
     */
-    bool operator()(unity::util::ResourcePtr<R, D> const& lhs, unity::util::ResourcePtr<R, D> const& rhs) const
+    bool operator()(unity::util::ResourcePtr<R, D, L> const& lhs, unity::util::ResourcePtr<R, D, L> const& rhs) const
     {
         return lhs > rhs;
     }
@@ -735,13 +874,13 @@ struct greater<unity::util::ResourcePtr<R, D>>
 \brief Function object for less than or equal comparison.
 */
 
-template<typename R, typename D>
-struct greater_equal<unity::util::ResourcePtr<R, D>>
+template<typename R, typename D, typename L>
+struct greater_equal<unity::util::ResourcePtr<R, D, L>>
 {
     /**
     Invokes <code>operator\>=</code> on <code>lhs</code>.
     */
-    bool operator()(unity::util::ResourcePtr<R, D> const& lhs, unity::util::ResourcePtr<R, D> const& rhs) const
+    bool operator()(unity::util::ResourcePtr<R, D, L> const& lhs, unity::util::ResourcePtr<R, D, L> const& rhs) const
     {
         return lhs >= rhs;
     }
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_STRINGVIEW_H
+#define UNITY_UTIL_STRINGVIEW_H
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace unity
+{
+
+namespace util
+{
+
+/**
+\brief Non-owning, read-only reference to a sequence of characters.
+
+This is a minimal stand-in for <code>std::string_view</code>, which is not available in C++11.
+A StringView does not own the characters it refers to; the caller must ensure that they remain
+valid for as long as the view is used.
+*/
+
+class StringView final
+{
+public:
+    /** \brief Iterator type. */
+    typedef char const* const_iterator;
+
+    /** \brief Constructs an empty view. */
+    StringView() noexcept
+        : data_(nullptr)
+        , size_(0)
+    {
+    }
+
+    /** \brief Constructs a view of <code>size</code> characters starting at <code>data</code>. */
+    StringView(char const* data, size_t size) noexcept
+        : data_(data)
+        , size_(size)
+    {
+    }
+
+    /** \brief Constructs a view of a NUL-terminated string. */
+    StringView(char const* s) noexcept
+        : data_(s)
+        , size_(std::strlen(s))
+    {
+    }
+
+    /** \brief Constructs a view of the contents of <code>s</code>. */
+    StringView(std::string const& s) noexcept
+        : data_(s.data())
+        , size_(s.size())
+    {
+    }
+
+    /** \brief Returns a pointer to the first character. The characters are not NUL-terminated. */
+    char const* data() const noexcept
+    {
+        return data_;
+    }
+
+    /** \brief Returns the number of characters. */
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    /** \brief Returns <code>true</code> if the view has zero length. */
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    /** \brief Returns an iterator to the first character. */
+    const_iterator begin() const noexcept
+    {
+        return data_;
+    }
+
+    /** \brief Returns an iterator one past the last character. */
+    const_iterator end() const noexcept
+    {
+        return data_ + size_;
+    }
+
+    /** \brief Returns the character at position <code>i</code>. No bounds checking is performed. */
+    char operator[](size_t i) const noexcept
+    {
+        return data_[i];
+    }
+
+    /** \brief Returns <code>true</code> if the view starts with <code>prefix</code>. */
+    bool starts_with(StringView prefix) const noexcept
+    {
+        return prefix.size_ <= size_ && (prefix.size_ == 0 || std::memcmp(data_, prefix.data_, prefix.size_) == 0);
+    }
+
+    /** \brief Returns <code>true</code> if the view ends with <code>suffix</code>. */
+    bool ends_with(StringView suffix) const noexcept
+    {
+        return suffix.size_ <= size_
+               && (suffix.size_ == 0 || std::memcmp(data_ + size_ - suffix.size_, suffix.data_, suffix.size_) == 0);
+    }
+
+    /** \brief Returns a copy of the characters as a <code>std::string</code>. */
+    std::string str() const
+    {
+        return std::string(data_, size_);
+    }
+
+    /** \brief Returns <code>true</code> if both views contain the same characters. */
+    bool operator==(StringView rhs) const noexcept
+    {
+        return size_ == rhs.size_ && (size_ == 0 || std::memcmp(data_, rhs.data_, size_) == 0);
+    }
+
+    /** \brief Returns <code>true</code> if the views contain different characters. */
+    bool operator!=(StringView rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    char const* data_;
+    size_t size_;
+};
+
+/**
+\brief Writes the characters of <code>s</code> to <code>out</code>.
+*/
+inline std::ostream& operator<<(std::ostream& out, StringView s)
+{
+    return out.write(s.data(), s.size());
+}
+
+} // namespace util
+
+} // namespace unity
+
+#endif
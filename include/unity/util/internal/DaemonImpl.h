@@ -22,9 +22,14 @@
 #include <unity/UnityExceptions.h>
 #include <unity/util/NonCopyable.h>
 
+#include <sys/resource.h>
 #include <sys/types.h>
 
+#include <chrono>
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace unity
 {
@@ -41,14 +46,27 @@ public:
     NONCOPYABLE(DaemonImpl);
 
     DaemonImpl();
-    ~DaemonImpl() = default;
+    ~DaemonImpl();
 
     void close_fds() noexcept;
+    void keep_fd(int fd);
     void reset_signals() noexcept;
     void set_umask(mode_t mask) noexcept;
     void set_working_directory(std::string const& working_directory);
+    void wait_for_ready(std::chrono::milliseconds timeout);
+    void set_rlimit(int resource, rlim_t soft, rlim_t hard);
+    void set_nice(int nice);
+    void set_io_priority(int io_class, int level);
+    void set_cpu_affinity(std::vector<int> const& cpus);
+    void set_oom_score_adj(int adj);
+    void lock_memory() noexcept;
 
     void daemonize_me();
+    void notify_ready(int status) noexcept;
+
+    void pin_workers() noexcept;
+    void set_restart_delay(std::chrono::milliseconds initial, std::chrono::milliseconds max);
+    void run_workers(unsigned count, std::function<int(unsigned)> const& worker);
 
 private:
     bool close_fds_;
@@ -56,10 +74,36 @@ private:
     bool set_umask_;
     mode_t umask_;
     std::string working_directory_;
-
-    void close_open_files() noexcept;
+    std::vector<int> keep_fds_;     // Sorted
+    std::chrono::milliseconds ready_timeout_;
+    int ready_fd_;                  // Daemon's end of the readiness channel, or -1
+    std::vector<std::pair<int, struct rlimit>> rlimits_;
+    bool set_nice_;
+    int nice_;
+    int ioprio_;                    // -1 if unchanged
+    std::vector<int> cpus_;         // Empty if unchanged
+    bool set_oom_score_adj_;
+    int oom_score_adj_;
+    bool lock_memory_;
+    bool pin_workers_;
+    std::chrono::milliseconds restart_delay_;
+    std::chrono::milliseconds max_restart_delay_;
+
+    int apply_settings(int& resource) const noexcept;
+    void close_open_files(std::vector<int> const& keep) noexcept;
+    void notify_parent(int status) noexcept;
 };
 
+// Closes all file descriptors >= first, except for those in keep, which must be sorted.
+// Uses close_range() if the kernel supports it and otherwise scans /proc/self/fd.
+// Does not allocate memory, so it is safe to call in the child after fork() in a multi-threaded process.
+
+void close_fds_from(int first, std::vector<int> const& keep) noexcept;
+
+// The /proc/self/fd fallback used by close_fds_from(). Returns false if /proc/self/fd cannot be opened.
+
+bool close_fds_by_scan(int first, std::vector<int> const& keep) noexcept;
+
 } // namespace internal
 
 } // namespace util
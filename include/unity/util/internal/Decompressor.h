@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_DECOMPRESSOR_H
+#define UNITY_UTIL_DECOMPRESSOR_H
+
+#include <unity/util/NonCopyable.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct DecompressorPrivate;
+
+// Streaming reader for files that may be compressed with gzip or zstd. The format is
+// detected from the magic number; files in any other format are returned unchanged.
+// The compressed file is mapped into memory, so the input is decompressed in place
+// and read() writes the output directly into the caller's buffer.
+
+class Decompressor final
+{
+public:
+    NONCOPYABLE(Decompressor);
+
+    enum class Format { plain, gzip, zstd };
+
+    explicit Decompressor(std::string const& filename);
+    ~Decompressor() noexcept;
+
+    Format format() const noexcept;
+
+    // Uncompressed size as recorded in the file, or 0 if unknown. This is only a hint
+    // for sizing buffers; the actual size may differ for corrupt or concatenated input.
+    uint64_t size_hint() const noexcept;
+
+    // Writes up to len bytes of uncompressed data to buf and returns the number of bytes
+    // written. Returns 0 once all data has been returned.
+    size_t read(char* buf, size_t len);
+
+private:
+    std::unique_ptr<DecompressorPrivate> p_;
+};
+
+} // namespace internal
+
+} // namespace util
+
+} // namespace unity
+
+#endif
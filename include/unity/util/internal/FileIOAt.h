@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_FILEIOAT_H
+#define UNITY_UTIL_FILEIOAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+// Like read_text_file() and read_binary_file(), but name is opened relative to dirfd
+// (which can be AT_FDCWD). The filename is used in error messages.
+
+std::string read_text_file_at(int dirfd, std::string const& name, std::string const& filename);
+std::vector<uint8_t> read_binary_file_at(int dirfd, std::string const& name, std::string const& filename);
+
+} // namespace internal
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_UTIL_WORKERSUPERVISOR_H
+#define UNITY_UTIL_WORKERSUPERVISOR_H
+
+#include <unity/util/NonCopyable.h>
+
+#include <signal.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+// Runs a fixed number of worker processes and restarts those that fail, with exponential backoff.
+// Child processes are reaped via a signalfd, so no signal handlers are installed. SIGTERM and SIGINT
+// are forwarded to the workers; run() returns once all of them have exited.
+
+class WorkerSupervisor final
+{
+public:
+    NONCOPYABLE(WorkerSupervisor);
+
+    typedef std::function<int(unsigned)> WorkerFunction;
+
+    WorkerSupervisor(unsigned count,
+                     WorkerFunction const& func,
+                     bool pin,
+                     std::chrono::milliseconds min_delay,
+                     std::chrono::milliseconds max_delay);
+    ~WorkerSupervisor() = default;
+
+    void run();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Worker
+    {
+        pid_t pid = -1;
+        bool done = false;              // Exited with status zero, not restarted
+        unsigned failures = 0;          // Consecutive failures, determines the restart delay
+        Clock::time_point started;
+        Clock::time_point restart_at;
+    };
+
+    void start(unsigned index);
+    void reap();
+    void stop(int sig) noexcept;
+    std::chrono::milliseconds restart_delay(unsigned failures) const noexcept;
+
+    WorkerFunction func_;
+    bool pin_;
+    std::chrono::milliseconds min_delay_;
+    std::chrono::milliseconds max_delay_;
+    std::vector<Worker> workers_;
+    std::vector<int> cpus_;             // CPUs the process may run on
+    sigset_t old_mask_;
+    int signal_fd_;
+    bool stopping_;
+};
+
+} // namespace internal
+
+} // namespace util
+
+} // namespace unity
+
+#endif
@@ -39,119 +39,165 @@ string get_margin(int indent_level, string const& indent)
     return margin;
 }
 
+} // namespace
+
+namespace unity
+{
+
 //
-// Follow the nested exceptions that were rethrown along the call stack, printing them into s.
+// An exception together with its history and nested exceptions. The chain is resolved once, by rethrowing
+// each earlier and nested exception a single time, and is then cached in the exception and shared by its copies
+// and by any exceptions that remember or nest it, so formatting the history never needs to rethrow.
 //
 
-void print_name_and_reason(string& s, nested_exception const* nested)
+struct Exception::Chain
 {
-    auto unity_exception = dynamic_cast<unity::Exception const*>(nested);
-    auto std_exception = dynamic_cast<std::exception const*>(nested);
+    bool unity_exception;               // True if text and earlier belong to a unity::Exception
+    string text;                        // Name and reason, or what() for other exceptions
+    shared_ptr<Chain const> earlier;    // The remembered exception, if any
+    shared_ptr<Chain const> nested;     // The exception that was being handled when this one was created
 
-    if (unity_exception)
+    static shared_ptr<Chain const> of(Exception const& e)
     {
-        s += unity_exception->name();
-        string reason = unity_exception->reason();
-        if (!reason.empty())
+        auto chain = atomic_load(&e.chain_);
+        if (!chain)
         {
-            s += ": " + reason;
+            auto c = make_shared<Chain>();
+            c->unity_exception = true;
+            c->text = e.name_;
+            if (!e.reason_.empty())
+            {
+                c->text += ": " + e.reason_;
+            }
+            c->earlier = resolve(e.earlier_);
+            c->nested = resolve(e.nested_ptr());
+            chain = c;
+            atomic_store(&e.chain_, chain);     // Harmless if another thread did the same.
         }
+        return chain;
     }
-    else if (std_exception)
-    {
-        s += std_exception->what();
-    }
-
-    // Append info about unknown std::exception and std::nested_exception.
 
-    if (!unity_exception)
+    static shared_ptr<Chain const> resolve(exception_ptr ep)
     {
-        if (std_exception)
+        if (!ep)
         {
-            s += " (derived from std::exception and std::nested_exception)";
+            return nullptr;
         }
-        else
-        {
-            s += "std::nested_exception";
-        }
-    }
-}
-
-void follow_nested(string& s, nested_exception const* nested, int indent_level, std::string const& indent)
-{
-    if (nested->nested_ptr())
-    {
-        string margin = get_margin(indent_level, indent);
 
-        s += ":\n";
+        auto c = make_shared<Chain>();
+        c->unity_exception = false;
         try
         {
-            nested->rethrow_nested();
+            rethrow_exception(ep);
+        }
+        catch (Exception const& e)
+        {
+            return of(e);
         }
         catch (std::nested_exception const& e)
         {
-            auto unity_exception = dynamic_cast<unity::Exception const*>(&e);
-            if (unity_exception)
+            // Append info about unknown std::exception and std::nested_exception.
+
+            auto std_exception = dynamic_cast<std::exception const*>(&e);
+            if (std_exception)
             {
-                s += unity_exception->to_string(indent_level + 1, indent);
+                c->text = std_exception->what();
+                c->text += " (derived from std::exception and std::nested_exception)";
             }
             else
             {
-                s += margin + indent;
-                print_name_and_reason(s, &e);
-                follow_nested(s, &e, indent_level + 1, indent);
+                c->text = "std::nested_exception";
             }
+            c->nested = resolve(e.nested_ptr());
         }
         catch (std::exception const& e)
         {
-            s += margin + indent;
-            s += e.what();                                    // Can show only what() for std::exception.
+            c->text = e.what();                             // Can show only what() for std::exception.
         }
         catch (...)
         {
-            s += margin + indent;
-            s += "unknown exception";                         // Best we can do for an exception whose type we don't know.
+            c->text = "unknown exception";                  // Best we can do for an exception whose type we don't know.
         }
+        return c;
     }
-}
 
-//
-// Follow the history chain and print each exception in the chain.
-//
+    //
+    // Print a unity exception, followed by its history and its nested exceptions.
+    //
 
-void follow_history(string& s, int& count, unity::Exception const* e, int indent_level, std::string const& indent)
-{
-    if (!e->get_earlier())
+    static void print(string& s, Chain const& c, int indent_level, string const& indent)
     {
-        count = 1;  // We have reached the oldest exception; set exception generation count and terminate recursion.
+        string margin = get_margin(indent_level, indent);
+        s += margin;
+        s += c.text;
+
+        // Check whether there is an exception history and print each exception in the history.
+
+        if (c.earlier)
+        {
+            s += "\n" + margin + indent + "Exception history:";
+            int count;
+            follow_history(s, count, *c.earlier, indent_level + 2, indent);
+        }
+
+        // Print this and any nested exceptions.
+
+        follow_nested(s, c, indent_level, indent);
     }
-    else
+
+    //
+    // Follow the nested exceptions that were rethrown along the call stack, printing them into s.
+    //
+
+    static void follow_nested(string& s, Chain const& c, int indent_level, string const& indent)
     {
-        try
+        if (c.nested)
         {
-            rethrow_exception(e->get_earlier());
+            s += ":\n";
+            if (c.nested->unity_exception)
+            {
+                print(s, *c.nested, indent_level + 1, indent);
+            }
+            else
+            {
+                s += get_margin(indent_level, indent) + indent;
+                s += c.nested->text;
+                follow_nested(s, *c.nested, indent_level + 1, indent);
+            }
         }
-        catch (unity::Exception const& e)
+    }
+
+    //
+    // Follow the history chain and print each exception in the chain.
+    //
+
+    static void follow_history(string& s, int& count, Chain const& c, int indent_level, string const& indent)
+    {
+        if (!c.earlier)
+        {
+            count = 1;  // We have reached the oldest exception; set exception generation count and terminate recursion.
+        }
+        else
         {
             // Recurse along the chain until we hit the end, then, as we pop back up the levels, we increment the
             // count and print it as a generation number for the exception information.
             // A bit like the "kicks" in "Inception", except that the deepest level is level 1...
 
-            follow_history(s, count, &e, indent_level, indent);
+            follow_history(s, count, *c.earlier, indent_level, indent);
+            ++count;
         }
-        ++count;
-    }
 
-    // Show info for this exception.
+        // Show info for this exception.
 
-    s += "\n" + get_margin(indent_level, indent) + "Exception #";
-    s += to_string(count) + ":\n";
-    s += get_margin(indent_level, indent) + indent;
-    print_name_and_reason(s, e);
-    follow_nested(s, e, indent_level + 1, indent);
-}
+        s += "\n" + get_margin(indent_level, indent) + "Exception #";
+        s += std::to_string(count) + ":\n";
+        s += get_margin(indent_level, indent) + indent;
+        s += c.text;
+        follow_nested(s, c, indent_level + 1, indent);
+    }
+};
 
-} // namespace
+} // namespace unity
 
 namespace unity
 {
@@ -183,15 +229,26 @@ Exception::~Exception() noexcept = default;
 \brief Returns a string describing the exception, including any exceptions that were nested or chained.
 
 \return The return value is the same string that is returned by calling to_string().
-The returned pointer remains valid until the next call to what(), or until the exception is destroyed.
+The string is formatted by the first call and returned by later calls without formatting it again.
+The returned pointer remains valid until remember() is called, a different exception is assigned,
+or the exception is destroyed.
 */
 
 char const* Exception::what() const noexcept
 {
     try
     {
-        what_ = to_string();
-        return what_.c_str();
+        auto what = atomic_load(&what_);
+        if (!what)
+        {
+            // If another thread got there first, return its string, which what_ keeps alive.
+            shared_ptr<string const> formatted = make_shared<string>(to_string());
+            if (atomic_compare_exchange_strong(&what_, &what, formatted))
+            {
+                what = formatted;
+            }
+        }
+        return what->c_str();
     }
     // LCOV_EXCL_START
     catch (std::exception const& e) // to_string() may throw (bad_alloc, in particular)
@@ -247,7 +304,8 @@ string Exception::to_string(std::string const& indent) const
 \brief Returns a string describing the exception, including any exceptions that were nested or chained.
 
 Nested exceptions are indented according to their nesting level. If the exception contains chained
-exceptions, these are shown in oldest-to-newest order.
+exceptions, these are shown in oldest-to-newest order. The chain is resolved by the first call and reused
+by later calls, so the earlier and nested exceptions are not rethrown each time.
 
 \param indent_level This controls the indent level. The value <code>0</code> indicates
        the outermost level (no indent).
@@ -261,34 +319,8 @@ exceptions, these are shown in oldest-to-newest order.
 
 string Exception::to_string(int indent_level, std::string const& indent) const
 {
-    string margin = get_margin(indent_level, indent);
-    string s = margin;
-    s += name_;
-    if (!reason_.empty())
-    {
-        s += ": " + reason_;
-    }
-
-    // Check whether there is an exception history and print each exception in the history.
-
-    if (get_earlier())
-    {
-        s += "\n" + margin + indent + "Exception history:";
-        try
-        {
-            rethrow_exception(get_earlier());
-        }
-        catch (unity::Exception const& e)
-        {
-            int count;
-            follow_history(s, count, &e, indent_level + 2, indent);
-        }
-    }
-
-    // Print this and any nested exceptions.
-
-    follow_nested(s, this, indent_level, indent);
-
+    string s;
+    Chain::print(s, *Chain::of(*this), indent_level, indent);
     return s;
 }
 
@@ -302,6 +334,9 @@ can fail, but we want to continue and try all the following steps and only throw
 tried. In this case, each step that fails can add itself to the sequence of remembered exceptions, and finally
 throw something like <code>ShutdownException</code>.
 \return A <code>std::exception_ptr</code> to <code>this</code>.
+
+\note Changing the history discards the string returned by what(). Exceptions that have already
+formatted a history containing this exception continue to show the history as it was then.
 */
 
 exception_ptr Exception::remember(exception_ptr earlier_exception)
@@ -311,6 +346,8 @@ exception_ptr Exception::remember(exception_ptr earlier_exception)
     if (earlier_ != earlier_exception)
     {
         earlier_ = earlier_exception;
+        atomic_store(&what_, shared_ptr<string const>());
+        atomic_store(&chain_, shared_ptr<Chain const>());
     }
     return self();
 }
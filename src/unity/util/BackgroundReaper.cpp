@@ -0,0 +1,266 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/BackgroundReaper.h>
+#include <unity/UnityExceptions.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+// Deleters are queued on a lock-free stack: producers push with a CAS on head, and the reaper thread
+// takes the whole stack with a single exchange and reverses it, so deleters run in the order they were queued.
+//
+// The mutex is taken only to park and wake threads. The reaper sets parked (under the mutex) before it
+// waits for work, and a producer takes the mutex only if it sees parked after its push. Likewise, flush()
+// registers in flushers before it waits, and the reaper notifies only while flushers is non-zero.
+// All four variables use sequentially consistent operations, so either the waiter sees the update
+// before it waits, or the updater sees the waiter and wakes it up.
+
+struct Node
+{
+    function<void()> deleter;
+    Node* next;
+};
+
+struct BackgroundReaperPrivate
+{
+    atomic<Node*> head{ nullptr };
+    atomic<uint64_t> queued{ 0 };       // Incremented before a node is pushed.
+    atomic<size_t> depth{ 0 };
+    atomic<size_t> max_depth{ 0 };
+    atomic<uint64_t> failed{ 0 };
+    atomic<int64_t> total_ns{ 0 };
+    atomic<int64_t> max_ns{ 0 };
+    atomic<uint64_t> completed{ 0 };
+    atomic<bool> parked{ false };       // True while the reaper waits for work.
+    atomic<unsigned> flushers{ 0 };     // Number of threads waiting in flush().
+
+    mutex m;
+    condition_variable work_cond;       // Signalled when the queue becomes non-empty or on shutdown.
+    condition_variable done_cond;       // Signalled when completed changes while a flush() is waiting.
+    bool stop = false;                  // Protected by m.
+    bool detached = false;              // Protected by m. If set, run() deletes this on exit.
+    thread reaper;
+
+    void push(Node* n) noexcept;
+    void run() noexcept;
+    void run_batch(Node* n) noexcept;
+};
+
+void BackgroundReaperPrivate::push(Node* n) noexcept
+{
+    queued.fetch_add(1, memory_order_relaxed);
+    size_t d = depth.fetch_add(1, memory_order_relaxed) + 1;
+    size_t max = max_depth.load(memory_order_relaxed);
+    while (d > max && !max_depth.compare_exchange_weak(max, d, memory_order_relaxed))
+    {
+    }
+
+    Node* old_head = head.load(memory_order_relaxed);
+    do
+    {
+        n->next = old_head;
+    }
+    while (!head.compare_exchange_weak(old_head, n, memory_order_seq_cst, memory_order_relaxed));
+
+    // Taking the lock before notifying ensures that the reaper is already waiting.
+    if (parked.load(memory_order_seq_cst))
+    {
+        lock_guard<mutex> lock(m);
+        work_cond.notify_one();
+    }
+}
+
+void BackgroundReaperPrivate::run() noexcept
+{
+    for (;;)
+    {
+        Node* n = head.exchange(nullptr, memory_order_acquire);
+        if (n)
+        {
+            run_batch(n);
+            continue;
+        }
+        unique_lock<mutex> lock(m);
+        parked.store(true, memory_order_seq_cst);
+        work_cond.wait(lock, [this]{ return stop || head.load(memory_order_seq_cst) != nullptr; });
+        parked.store(false, memory_order_relaxed);
+        if (stop && head.load(memory_order_relaxed) == nullptr)
+        {
+            bool const delete_this = detached;
+            lock.unlock();
+            if (delete_this)
+            {
+                delete this;
+            }
+            return;
+        }
+    }
+}
+
+void BackgroundReaperPrivate::run_batch(Node* n) noexcept
+{
+    // Reverse the list into queuing order.
+    Node* first = nullptr;
+    while (n)
+    {
+        Node* next = n->next;
+        n->next = first;
+        first = n;
+        n = next;
+    }
+
+    while (first)
+    {
+        unique_ptr<Node> node(first);
+        first = first->next;
+
+        auto start = chrono::steady_clock::now();
+        try
+        {
+            node->deleter();
+        }
+        catch (...)
+        {
+            failed.fetch_add(1, memory_order_relaxed);
+        }
+        node.reset();   // Destroys anything the deleter captured as part of the timed work.
+        int64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+        total_ns.fetch_add(ns, memory_order_relaxed);
+        if (ns > max_ns.load(memory_order_relaxed))
+        {
+            max_ns.store(ns, memory_order_relaxed);     // Only this thread writes max_ns.
+        }
+        depth.fetch_sub(1, memory_order_relaxed);
+        completed.fetch_add(1, memory_order_seq_cst);
+        if (flushers.load(memory_order_seq_cst) != 0)
+        {
+            lock_guard<mutex> lock(m);
+            done_cond.notify_all();
+        }
+    }
+}
+
+} // namespace internal
+
+BackgroundReaper::BackgroundReaper()
+    : p_(new internal::BackgroundReaperPrivate)
+{
+    try
+    {
+        p_->reaper = thread(&internal::BackgroundReaperPrivate::run, p_.get());
+    }
+    // LCOV_EXCL_START
+    catch (std::system_error const& e)
+    {
+        throw ResourceException(string("BackgroundReaper(): cannot create thread: ") + e.what());
+    }
+    // LCOV_EXCL_STOP
+}
+
+BackgroundReaper::~BackgroundReaper() noexcept
+{
+    // If a deleter dropped the last reference, we are running on the reaper thread and cannot join it.
+    // Instead, the thread takes ownership of the private state, runs the remaining deleters, and deletes
+    // the state when it exits.
+    bool const on_reaper = this_thread::get_id() == p_->reaper.get_id();
+    {
+        lock_guard<mutex> lock(p_->m);
+        p_->stop = true;
+        p_->detached = on_reaper;
+    }
+    if (on_reaper)
+    {
+        p_->reaper.detach();
+        p_.release();
+        return;
+    }
+    p_->work_cond.notify_one();
+    p_->reaper.join();
+}
+
+void BackgroundReaper::defer(function<void()> deleter) noexcept
+{
+    internal::Node* n;
+    try
+    {
+        n = new internal::Node{ move(deleter), nullptr };
+    }
+    // LCOV_EXCL_START
+    catch (std::bad_alloc const&)
+    {
+        try
+        {
+            deleter();
+        }
+        catch (...)
+        {
+            p_->failed.fetch_add(1, memory_order_relaxed);
+        }
+        return;
+    }
+    // LCOV_EXCL_STOP
+    p_->push(n);
+}
+
+void BackgroundReaper::flush()
+{
+    if (this_thread::get_id() == p_->reaper.get_id())
+    {
+        throw LogicException("BackgroundReaper::flush(): cannot be called from a deleter");
+    }
+
+    // Deleters run in queuing order, and queued is incremented before a node is pushed, so once
+    // completed reaches the current value of queued, every deleter pushed before this point has run.
+    uint64_t target = p_->queued.load(memory_order_relaxed);
+    p_->flushers.fetch_add(1, memory_order_seq_cst);
+    {
+        unique_lock<mutex> lock(p_->m);
+        p_->done_cond.wait(lock, [this, target]{ return p_->completed.load(memory_order_seq_cst) >= target; });
+    }
+    p_->flushers.fetch_sub(1, memory_order_relaxed);
+}
+
+BackgroundReaper::Stats BackgroundReaper::stats() const noexcept
+{
+    Stats s;
+    s.queue_depth = p_->depth.load(memory_order_relaxed);
+    s.max_queue_depth = p_->max_depth.load(memory_order_relaxed);
+    s.completed = p_->completed.load(memory_order_relaxed);
+    s.failed = p_->failed.load(memory_order_relaxed);
+    s.total_delete_time = chrono::nanoseconds(p_->total_ns.load(memory_order_relaxed));
+    s.max_delete_time = chrono::nanoseconds(p_->max_ns.load(memory_order_relaxed));
+    return s;
+}
+
+} // namespace util
+
+} // namespace unity
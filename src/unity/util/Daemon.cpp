@@ -44,6 +44,11 @@ void Daemon::close_fds() noexcept
 
 // LCOV_EXCL_STOP
 
+void Daemon::keep_fd(int fd)
+{
+    p_->keep_fd(fd);
+}
+
 void Daemon::reset_signals() noexcept
 {
     p_->reset_signals();
@@ -59,6 +64,41 @@ void Daemon::set_working_directory(string const& working_directory)
     p_->set_working_directory(working_directory);
 }
 
+void Daemon::set_rlimit(int resource, rlim_t soft, rlim_t hard)
+{
+    p_->set_rlimit(resource, soft, hard);
+}
+
+void Daemon::set_nice(int nice)
+{
+    p_->set_nice(nice);
+}
+
+void Daemon::set_io_priority(IoPriorityClass io_class, int level)
+{
+    p_->set_io_priority(static_cast<int>(io_class), level);
+}
+
+void Daemon::set_cpu_affinity(vector<int> const& cpus)
+{
+    p_->set_cpu_affinity(cpus);
+}
+
+void Daemon::set_oom_score_adj(int adj)
+{
+    p_->set_oom_score_adj(adj);
+}
+
+void Daemon::lock_memory() noexcept
+{
+    p_->lock_memory();
+}
+
+void Daemon::wait_for_ready(chrono::milliseconds timeout)
+{
+    p_->wait_for_ready(timeout);
+}
+
 // Turn this process into a proper daemon in its own session and without a control terminal.
 // Whether to close open file descriptors, reset signals to their defaults, change the umask,
 // or change the working directory is determined by the setters above.
@@ -68,6 +108,26 @@ void Daemon::daemonize_me()
     p_->daemonize_me();
 }
 
+void Daemon::notify_ready(int status) noexcept
+{
+    p_->notify_ready(status);
+}
+
+void Daemon::pin_workers() noexcept
+{
+    p_->pin_workers();
+}
+
+void Daemon::set_restart_delay(chrono::milliseconds initial, chrono::milliseconds max)
+{
+    p_->set_restart_delay(initial, max);
+}
+
+void Daemon::run_workers(unsigned count, WorkerFunction const& worker)
+{
+    p_->run_workers(count, worker);
+}
+
 Daemon::Daemon()
     : p_(new internal::DaemonImpl())
 {
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/Directory.h>
+#include <unity/util/internal/FileIOAt.h>
+#include <unity/util/CompactResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct DirectoryPrivate
+{
+    explicit DirectoryPrivate(string const& path)
+        : path(path)
+    {
+    }
+
+    util::UniqueFd fd;
+    string path;
+};
+
+} // namespace internal
+
+namespace
+{
+
+int open_directory_at(int dirfd, string const& name, string const& path)
+{
+    int fd = ::openat(dirfd, name.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        int const err = errno;
+        throw FileException("cannot open directory \"" + path + "\": " + strerror(err), err);
+    }
+    return fd;
+}
+
+} // namespace
+
+Directory::Directory(string const& path)
+    : Directory(AT_FDCWD, path, path)
+{
+}
+
+// Everything that can throw is done before the directory is opened, so the descriptor cannot leak.
+
+Directory::Directory(int dirfd, string const& name, string const& path)
+    : p_(new internal::DirectoryPrivate(path))
+{
+    p_->fd.reset(open_directory_at(dirfd, name, path));
+}
+
+Directory::~Directory() noexcept = default;
+
+string const& Directory::path() const noexcept
+{
+    return p_->path;
+}
+
+int Directory::fd() const noexcept
+{
+    return p_->fd.get();
+}
+
+Directory::UPtr Directory::open_directory(string const& name) const
+{
+    string const path = path_of(name);
+    return UPtr(new Directory(p_->fd.get(), name, path));
+}
+
+string Directory::read_text_file(string const& name) const
+{
+    return internal::read_text_file_at(p_->fd.get(), name, path_of(name));
+}
+
+vector<uint8_t> Directory::read_binary_file(string const& name) const
+{
+    return internal::read_binary_file_at(p_->fd.get(), name, path_of(name));
+}
+
+struct stat Directory::stat(string const& name, bool follow_symlinks) const
+{
+    struct stat st;
+    if (fstatat(p_->fd.get(), name.c_str(), &st, follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) == -1)
+    {
+        throw FileException("cannot stat \"" + path_of(name) + "\": " + strerror(errno), errno);
+    }
+    return st;
+}
+
+string Directory::path_of(string const& name) const
+{
+    if (!name.empty() && name[0] == '/')
+    {
+        return name;
+    }
+    if (!p_->path.empty() && p_->path.back() == '/')
+    {
+        return p_->path + name;
+    }
+    return p_->path + "/" + name;
+}
+
+} // namespace util
+
+} // namespace unity
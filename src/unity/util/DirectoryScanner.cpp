@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/DirectoryScanner.h>
+#include <unity/util/Directory.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct DirectoryListingBuilder
+{
+    // Appends dir + "/" + name (or just name if dir is empty) and a terminating NUL to the arena.
+    static void add(DirectoryListing& listing,
+                    string const& dir,
+                    char const* name,
+                    size_t name_len,
+                    DirectoryListing::Type type)
+    {
+        size_t const offset = listing.names_.size();
+        size_t const len = dir.empty() ? name_len : dir.size() + 1 + name_len;
+        listing.names_.resize(offset + len + 1);
+        char* p = &listing.names_[offset];
+        if (!dir.empty())
+        {
+            memcpy(p, dir.data(), dir.size());
+            p[dir.size()] = '/';
+            p += dir.size() + 1;
+        }
+        memcpy(p, name, name_len);
+        p[name_len] = '\0';
+        listing.slots_.push_back(DirectoryListing::Slot{ offset, static_cast<uint32_t>(len), type });
+    }
+
+    static void append(DirectoryListing& to, DirectoryListing const& from)
+    {
+        size_t const shift = to.names_.size();
+        to.names_.insert(to.names_.end(), from.names_.begin(), from.names_.end());
+        to.slots_.reserve(to.slots_.size() + from.slots_.size());
+        for (auto s : from.slots_)
+        {
+            s.offset += shift;
+            to.slots_.push_back(s);
+        }
+    }
+};
+
+} // namespace internal
+
+namespace
+{
+
+// getdents64() has no glibc wrapper on older systems, so we define the record ourselves.
+
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[256];   // Actual length is given by d_reclen
+};
+
+DirectoryListing::Type type_from_mode(mode_t mode)
+{
+    if (S_ISREG(mode))
+    {
+        return DirectoryListing::Type::regular;
+    }
+    if (S_ISDIR(mode))
+    {
+        return DirectoryListing::Type::directory;
+    }
+    if (S_ISLNK(mode))
+    {
+        return DirectoryListing::Type::symlink;
+    }
+    return DirectoryListing::Type::other;
+}
+
+class Scanner
+{
+public:
+    Scanner(ScanOptions const& options)
+        : options_(options)
+    {
+        for (auto const& s : options.suffixes)
+        {
+            suffixes_.emplace_back(s);
+        }
+    }
+
+    // Reads the directory open at fd, whose path relative to the scan root is dir, and appends matching
+    // entries to out and sub-directories to subdirs. Returns false (with errno set) if the directory
+    // cannot be read.
+    bool scan(int fd, string const& dir, vector<char>& buf, DirectoryListing& out, vector<string>& subdirs) const
+    {
+        for (;;)
+        {
+            long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;   // LCOV_EXCL_LINE
+                }
+                return false;
+            }
+            if (n == 0)
+            {
+                return true;
+            }
+            for (long pos = 0; pos < n; )
+            {
+                auto const d = reinterpret_cast<linux_dirent64 const*>(&buf[pos]);
+                pos += d->d_reclen;
+
+                char const* name = d->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                {
+                    continue;
+                }
+                size_t const name_len = strlen(name);
+
+                DirectoryListing::Type type;
+                switch (d->d_type)
+                {
+                    case DT_REG:
+                        type = DirectoryListing::Type::regular;
+                        break;
+                    case DT_DIR:
+                        type = DirectoryListing::Type::directory;
+                        break;
+                    case DT_LNK:
+                        type = DirectoryListing::Type::symlink;
+                        break;
+                    case DT_UNKNOWN:
+                    {
+                        // LCOV_EXCL_START
+                        struct stat st;
+                        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+                        {
+                            continue;   // Removed in the mean time
+                        }
+                        type = type_from_mode(st.st_mode);
+                        break;
+                        // LCOV_EXCL_STOP
+                    }
+                    default:
+                        type = DirectoryListing::Type::other;
+                        break;
+                }
+
+                if (type == DirectoryListing::Type::directory)
+                {
+                    if (options_.recursive)
+                    {
+                        subdirs.push_back(dir.empty() ? string(name, name_len) : dir + "/" + name);
+                    }
+                    if (!options_.include_directories)
+                    {
+                        continue;
+                    }
+                }
+                if (matches(name, name_len))
+                {
+                    internal::DirectoryListingBuilder::add(out, dir, name, name_len, type);
+                }
+            }
+        }
+    }
+
+private:
+    bool matches(char const* name, size_t name_len) const noexcept
+    {
+        if (suffixes_.empty())
+        {
+            return true;
+        }
+        StringView const n(name, name_len);
+        for (auto const& s : suffixes_)
+        {
+            if (n.ends_with(s))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ScanOptions const& options_;
+    vector<StringView> suffixes_;
+};
+
+} // namespace
+
+void DirectoryListing::sort()
+{
+    auto const& names = names_;
+    std::sort(slots_.begin(), slots_.end(), [&names](Slot const& a, Slot const& b)
+    {
+        int c = memcmp(&names[a.offset], &names[b.offset], min(a.length, b.length));
+        return c != 0 ? c < 0 : a.length < b.length;
+    });
+}
+
+namespace
+{
+
+// Scans the directory open at root_fd. The path is used only for error messages.
+
+DirectoryListing scan(int root_fd, string const& path, ScanOptions const& options)
+{
+    Scanner const scanner(options);
+    size_t const buffer_size = max<size_t>(options.buffer_size, 4096);
+
+    DirectoryListing result;
+    vector<string> subdirs;
+    {
+        vector<char> buf(buffer_size);
+        if (!scanner.scan(root_fd, "", buf, result, subdirs))
+        {
+            throw FileException("cannot read directory \"" + path + "\": " + strerror(errno), errno); // LCOV_EXCL_LINE
+        }
+    }
+    if (subdirs.empty())
+    {
+        return result;
+    }
+
+    // Sub-directories are processed by a pool of workers that share a queue. Each worker
+    // collects its results in its own listing, and adds any sub-directories it finds to the queue.
+    // Once the queue is empty and no worker is busy, there is nothing left to do.
+
+    mutex m;
+    condition_variable cond;
+    deque<string> queue(subdirs.begin(), subdirs.end());
+    unsigned busy = 0;
+    exception_ptr error;
+
+    auto worker = [&](DirectoryListing& out)
+    {
+        vector<char> buf(buffer_size);
+        vector<string> found;
+        unique_lock<mutex> lock(m);
+        for (;;)
+        {
+            cond.wait(lock, [&]{ return !queue.empty() || busy == 0 || error; });
+            if (queue.empty() || error)
+            {
+                cond.notify_all();
+                return;
+            }
+            string dir = move(queue.front());
+            queue.pop_front();
+            ++busy;
+            lock.unlock();
+
+            found.clear();
+            try
+            {
+                util::ResourcePtr<int, std::function<void(int)>> fd(
+                    ::openat(root_fd, dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC),
+                    [](int fd) { if (fd != -1) ::close(fd); });
+                if (fd.get() != -1)
+                {
+                    scanner.scan(fd.get(), dir, buf, out, found);  // Unreadable directories are skipped.
+                }
+            }
+            // LCOV_EXCL_START
+            catch (...)
+            {
+                lock.lock();
+                if (!error)
+                {
+                    error = current_exception();
+                }
+                --busy;
+                cond.notify_all();
+                return;
+            }
+            // LCOV_EXCL_STOP
+
+            lock.lock();
+            --busy;
+            for (auto& d : found)
+            {
+                queue.push_back(move(d));
+            }
+            if (!found.empty() || busy == 0)
+            {
+                cond.notify_all();
+            }
+        }
+    };
+
+    unsigned concurrency = options.concurrency == 0 ? thread::hardware_concurrency() : options.concurrency;
+    concurrency = max(concurrency, 1u);
+
+    // If we cannot create as many threads as requested, for whatever reason, we make do with the ones
+    // we have; workers that are already running must be joined in any case.
+
+    vector<DirectoryListing> partial(concurrency);
+    vector<thread> threads;
+    try
+    {
+        threads.reserve(concurrency - 1);
+        for (unsigned i = 1; i < concurrency; ++i)
+        {
+            threads.emplace_back(worker, ref(partial[i]));
+        }
+    }
+    catch (...) // LCOV_EXCL_LINE
+    {
+    }
+    worker(partial[0]);
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    if (error)
+    {
+        rethrow_exception(error);   // LCOV_EXCL_LINE
+    }
+
+    for (auto const& p : partial)
+    {
+        internal::DirectoryListingBuilder::append(result, p);
+    }
+    return result;
+}
+
+DirectoryListing scan_at(int dirfd, string const& name, string const& path, ScanOptions const& options)
+{
+    util::ResourcePtr<int, std::function<void(int)>> root_fd(
+        ::openat(dirfd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC),
+        [](int fd) { if (fd != -1) ::close(fd); });
+    if (root_fd.get() == -1)
+    {
+        throw FileException("cannot open directory \"" + path + "\": " + strerror(errno), errno);
+    }
+    return scan(root_fd.get(), path, options);
+}
+
+} // namespace
+
+DirectoryListing scan_directory(string const& path, ScanOptions const& options)
+{
+    return scan_at(AT_FDCWD, path, path, options);
+}
+
+DirectoryListing scan_directory(Directory const& dir, ScanOptions const& options)
+{
+    // The Directory is opened with O_PATH, which getdents64() does not accept,
+    // so we re-open it for reading without resolving its path again.
+    return scan_at(dir.fd(), ".", dir.path(), options);
+}
+
+} // namespace util
+
+} // namespace unity
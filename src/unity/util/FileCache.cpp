@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/FileCache.h>
+#include <unity/util/Directory.h>
+#include <unity/util/internal/FileIOAt.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+namespace
+{
+
+// The identity of a file's contents. If any of these change, we assume that the contents
+// have changed, too.
+
+struct FileKey
+{
+    dev_t dev;
+    ino_t ino;
+    time_t mtime_sec;
+    long mtime_nsec;
+    off_t size;
+
+    bool operator==(FileKey const& rhs) const noexcept
+    {
+        return dev == rhs.dev
+               && ino == rhs.ino
+               && mtime_sec == rhs.mtime_sec
+               && mtime_nsec == rhs.mtime_nsec
+               && size == rhs.size;
+    }
+};
+
+bool get_key(int dirfd, string const& name, FileKey& key) noexcept
+{
+    struct stat st;
+    if (fstatat(dirfd, name.c_str(), &st, 0) == -1 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.mtime_sec = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+    key.size = st.st_size;
+    return true;
+}
+
+struct Entry
+{
+    string filename;
+    FileKey key;
+    FileCache::Buffer buf;
+};
+
+} // namespace
+
+struct FileCachePrivate
+{
+    typedef list<Entry> LRUList;            // Most-recently used entry is at the front.
+
+    size_t max_bytes;
+    size_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    LRUList lru;
+    unordered_map<string, LRUList::iterator> entries;
+    mutable mutex m;
+
+    void remove(LRUList::iterator it) noexcept
+    {
+        bytes -= it->buf->size();
+        entries.erase(it->filename);
+        lru.erase(it);
+    }
+
+    FileCache::Buffer read(int dirfd, string const& name, string const& filename);
+};
+
+// Reads name relative to dirfd. The entry is keyed by filename, which is the full path of the file.
+
+FileCache::Buffer FileCachePrivate::read(int dirfd, string const& name, string const& filename)
+{
+    FileKey key;
+    bool have_key = get_key(dirfd, name, key);
+
+    {
+        lock_guard<mutex> lock(m);
+
+        auto it = entries.find(filename);
+        if (it != entries.end())
+        {
+            if (have_key && it->second->key == key)
+            {
+                ++hits;
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->buf;
+            }
+            remove(it->second);     // Stale entry
+        }
+        ++misses;
+    }
+
+    // We don't hold the lock while reading, so a slow file doesn't hold up hits for other files.
+    // If the file was modified after we called stat(), the buffer is stored under the old key,
+    // so the next lookup detects the change and reads the file again.
+
+    FileCache::Buffer buf = make_shared<vector<uint8_t>>(read_binary_file_at(dirfd, name, filename));
+    if (!have_key)
+    {
+        return buf;                     // File changed or appeared after the stat, don't cache it.
+    }
+
+    lock_guard<mutex> lock(m);
+
+    if (buf->size() > max_bytes)
+    {
+        return buf;
+    }
+
+    auto it = entries.find(filename);
+    if (it != entries.end())
+    {
+        remove(it->second);         // Another thread added the same file while we were reading it.
+    }
+
+    while (bytes + buf->size() > max_bytes)
+    {
+        remove(prev(lru.end()));
+        ++evictions;
+    }
+
+    lru.push_front(Entry{ filename, key, buf });
+    entries[filename] = lru.begin();
+    bytes += buf->size();
+
+    return buf;
+}
+
+} // namespace internal
+
+FileCache::FileCache(size_t max_bytes)
+    : p_(new internal::FileCachePrivate)
+{
+    p_->max_bytes = max_bytes;
+}
+
+FileCache::~FileCache() noexcept = default;
+
+FileCache::Buffer FileCache::read_binary_file(string const& filename)
+{
+    return p_->read(AT_FDCWD, filename, filename);
+}
+
+FileCache::Buffer FileCache::read_binary_file(Directory const& dir, string const& name)
+{
+    return p_->read(dir.fd(), name, dir.path_of(name));
+}
+
+void FileCache::invalidate(string const& filename) noexcept
+{
+    lock_guard<mutex> lock(p_->m);
+
+    auto it = p_->entries.find(filename);
+    if (it != p_->entries.end())
+    {
+        p_->remove(it->second);
+    }
+}
+
+void FileCache::clear() noexcept
+{
+    lock_guard<mutex> lock(p_->m);
+
+    p_->entries.clear();
+    p_->lru.clear();
+    p_->bytes = 0;
+}
+
+size_t FileCache::max_bytes() const noexcept
+{
+    return p_->max_bytes;
+}
+
+FileCache::Stats FileCache::stats() const noexcept
+{
+    lock_guard<mutex> lock(p_->m);
+
+    return Stats{ p_->hits, p_->misses, p_->evictions, p_->entries.size(), p_->bytes };
+}
+
+} // namespace util
+
+} // namespace unity
@@ -17,15 +17,25 @@
  */
 
 #include <unity/util/FileIO.h>
-#include <unity/util/ResourcePtr.h>
+#include <unity/util/internal/Decompressor.h>
+#include <unity/util/internal/FileIOAt.h>
+#include <unity/util/ReadaheadProfile.h>
+#include <unity/util/CompactResourcePtr.h>
 #include <unity/UnityExceptions.h>
 
+#include <algorithm>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <fcntl.h>
+#include <linux/fs.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 using namespace std;
 
@@ -43,12 +53,13 @@ namespace
 // down to system calls. At least then, when something goes wrong, we know what it was.
 //
 
+// Reads name relative to dirfd. The filename is the name of the file for error messages.
+
 template<typename T>
-vector<T> read_file(string const& filename)
+vector<T> read_file(int dirfd, string const& name, string const& filename)
 {
-    util::ResourcePtr<int, std::function<void(int)>> fd(::open(filename.c_str(), O_RDONLY),
-                                                        [](int fd) { if (fd != -1) ::close(fd); });
-    if (fd.get() == -1)
+    util::UniqueFd fd(::openat(dirfd, name.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd)
     {
         throw FileException("cannot open \"" + filename + "\": " + strerror(errno), errno);
     }
@@ -64,6 +75,8 @@ vector<T> read_file(string const& filename)
         throw FileException("\"" + filename + "\" is not a regular file", 0);
     }
 
+    ReadaheadProfile::record(filename, 0, st.st_size);
+
     vector<T> buf(st.st_size);
 
     if (st.st_size == 0)
@@ -88,19 +101,438 @@ vector<T> read_file(string const& filename)
     return buf;
 }
 
+// Table-driven CRC-32 (the polynomial used by zlib and gzip).
+
+class CRC32
+{
+public:
+    CRC32() noexcept
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table_[i] = c;
+        }
+    }
+
+    uint32_t operator()(uint8_t const* data, size_t len) const noexcept
+    {
+        uint32_t c = 0xFFFFFFFF;
+        for (size_t i = 0; i < len; ++i)
+        {
+            c = table_[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+        }
+        return c ^ 0xFFFFFFFF;
+    }
+
+private:
+    uint32_t table_[256];
+};
+
+// The amount of data we ask the kernel to transfer in one system call. We check for cancellation
+// in between, so this bounds the time it takes for a copy to notice that it was cancelled.
+
+size_t const transfer_chunk_size = 16 * 1024 * 1024;
+
+// Buffer size for the read()/write() fallback.
+
+size_t const copy_buffer_size = 128 * 1024;
+
+ssize_t write_all(int fd, char const* buf, size_t len)
+{
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = ::write(fd, buf + written, len - written);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;   // LCOV_EXCL_LINE
+            }
+            return -1;
+        }
+        written += n;
+    }
+    return written;
+}
+
+// Copies up to max_bytes from from_fd to to_fd. We try copy_file_range() first, then sendfile(), and then
+// fall back to read()/write(). Each method is abandoned as soon as the kernel tells us that it
+// doesn't support it for this pair of descriptors.
+
+uint64_t transfer(int from_fd, int to_fd, uint64_t max_bytes, atomic<bool> const* cancel, string const& what)
+{
+    enum Method { CopyFileRange, SendFile, ReadWrite };
+
+#ifdef __NR_copy_file_range
+    Method method = CopyFileRange;
+#else
+    Method method = SendFile;
+#endif
+
+    vector<char> buf;
+    uint64_t total = 0;
+
+    while (total < max_bytes)
+    {
+        if (cancel && cancel->load(memory_order_relaxed))
+        {
+            throw FileException(what + ": cancelled", ECANCELED);
+        }
+
+        size_t chunk = static_cast<size_t>(min<uint64_t>(max_bytes - total, transfer_chunk_size));
+        ssize_t n = -1;
+
+        switch (method)
+        {
+            case CopyFileRange:
+            {
+#ifdef __NR_copy_file_range
+                n = syscall(__NR_copy_file_range, from_fd, nullptr, to_fd, nullptr, chunk, 0);
+                if ((n == -1 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP
+                                 || errno == EBADF || errno == EPERM || errno == ETXTBSY))
+                    || (n == 0 && total == 0))
+                {
+                    // Not supported for these descriptors. Some pseudo file systems also
+                    // report a zero-length copy instead of failing, so we don't trust an immediate EOF.
+                    method = SendFile;
+                    continue;
+                }
+#endif
+                break;
+            }
+            case SendFile:
+            {
+                n = sendfile(to_fd, from_fd, nullptr, chunk);
+                if ((n == -1 && (errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+                    || (n == 0 && total == 0))
+                {
+                    method = ReadWrite;
+                    continue;
+                }
+                break;
+            }
+            default:
+            {
+                buf.resize(copy_buffer_size);
+                n = ::read(from_fd, &buf[0], min(chunk, buf.size()));
+                if (n > 0 && write_all(to_fd, &buf[0], n) == -1)
+                {
+                    n = -1;
+                }
+                break;
+            }
+        }
+
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;   // LCOV_EXCL_LINE
+            }
+            throw FileException(what + ": " + strerror(errno), errno);
+        }
+        if (n == 0)
+        {
+            break;          // EOF
+        }
+        total += n;
+    }
+
+    return total;
+}
+
+// Appends the uncompressed contents of the file to out. The container is grown up-front to the size
+// recorded in the file plus one byte, so we reach the end of the data without growing it again if the
+// recorded size is correct. If the data turns out to be larger, the container is doubled as needed.
+
+template<typename C>
+size_t decompress_into(string const& filename, C& out)
+{
+    internal::Decompressor decompressor(filename);
+
+    size_t const start = out.size();
+    size_t end = start;
+    try
+    {
+        out.resize(start + max<uint64_t>(decompressor.size_hint(), 64 * 1024 - 1) + 1);
+        size_t n;
+        while ((n = decompressor.read(reinterpret_cast<char*>(&out[end]), out.size() - end)) != 0)
+        {
+            end += n;
+            if (end == out.size())
+            {
+                out.resize(start + (out.size() - start) * 2);
+            }
+        }
+    }
+    catch (...)
+    {
+        out.resize(start);
+        throw;
+    }
+    out.resize(end);
+    return end - start;
+}
+
 } // namespace
 
 string
 read_text_file(string const& filename)
 {
-    vector<char> buf(read_file<char>(filename));
+    vector<char> buf(read_file<char>(AT_FDCWD, filename, filename));
     return string(buf.begin(), buf.end());
 }
 
 vector<uint8_t>
 read_binary_file(string const& filename)
 {
-    return read_file<uint8_t>(filename);
+    return read_file<uint8_t>(AT_FDCWD, filename, filename);
+}
+
+namespace internal
+{
+
+string
+read_text_file_at(int dirfd, string const& name, string const& filename)
+{
+    vector<char> buf(read_file<char>(dirfd, name, filename));
+    return string(buf.begin(), buf.end());
+}
+
+vector<uint8_t>
+read_binary_file_at(int dirfd, string const& name, string const& filename)
+{
+    return read_file<uint8_t>(dirfd, name, filename);
+}
+
+} // namespace internal
+
+string
+read_decompressed_text_file(string const& filename)
+{
+    string buf;
+    decompress_into(filename, buf);
+    return buf;
+}
+
+vector<uint8_t>
+read_decompressed_binary_file(string const& filename)
+{
+    vector<uint8_t> buf;
+    decompress_into(filename, buf);
+    return buf;
+}
+
+size_t
+decompress_file_into(string const& filename, vector<uint8_t>& arena)
+{
+    return decompress_into(filename, arena);
+}
+
+LargeFileBuffer
+read_large_binary_file(string const& filename, LargeFileReadOptions const& options, vector<uint32_t>* chunk_checksums)
+{
+    util::UniqueFd fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd)
+    {
+        throw FileException("cannot open \"" + filename + "\": " + strerror(errno), errno);
+    }
+
+    struct stat st;
+    if (fstat(fd.get(), &st) == -1)
+    {
+        throw FileException("cannot fstat \"" + filename + "\": " + strerror(errno), errno); // LCOV_EXCL_LINE
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        throw FileException("\"" + filename + "\" is not a regular file", 0);
+    }
+
+    ReadaheadProfile::record(filename, 0, st.st_size);
+
+    size_t const page_size = sysconf(_SC_PAGESIZE);
+    size_t chunk_size = options.chunk_size == 0 ? LargeFileReadOptions().chunk_size : options.chunk_size;
+    chunk_size = (chunk_size + page_size - 1) / page_size * page_size;
+
+    size_t const size = st.st_size;
+    size_t const num_chunks = (size + chunk_size - 1) / chunk_size;
+
+    unsigned concurrency = options.concurrency == 0 ? thread::hardware_concurrency() : options.concurrency;
+    concurrency = static_cast<unsigned>(max<size_t>(1, min<size_t>(max(concurrency, 1u), num_chunks)));
+
+    // new[] leaves the bytes uninitialized, so the reads below are the only pass over the buffer.
+
+    unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+    if (chunk_checksums)
+    {
+        chunk_checksums->assign(num_chunks, 0);
+    }
+    if (size == 0)
+    {
+        return LargeFileBuffer(move(buf), 0);
+    }
+
+    static CRC32 const crc32;
+
+    int const file = fd.get();
+    atomic<size_t> next_chunk(0);
+    atomic<bool> failed(false);
+    mutex error_mutex;
+    exception_ptr error;
+
+    // Each worker claims the next unread chunk until there are none left.
+    // The first error stops all workers and is rethrown to the caller.
+
+    auto worker = [&]
+    {
+        size_t chunk;
+        while (!failed.load(memory_order_relaxed) && (chunk = next_chunk.fetch_add(1)) < num_chunks)
+        {
+            size_t const offset = chunk * chunk_size;
+            size_t const len = min(chunk_size, size - offset);
+            size_t done = 0;
+            while (done < len)
+            {
+                ssize_t n = pread(file, &buf[offset + done], len - done, offset + done);
+                if (n == -1 && errno == EINTR)
+                {
+                    continue;   // LCOV_EXCL_LINE
+                }
+                if (n <= 0)
+                {
+                    // LCOV_EXCL_START
+                    int const err = n == 0 ? 0 : errno;
+                    ostringstream msg;
+                    msg << "cannot read " << len << " bytes at offset " << offset << " from \"" << filename << "\": "
+                        << (n == 0 ? "file was truncated" : strerror(err));
+                    lock_guard<mutex> lock(error_mutex);
+                    if (!error)
+                    {
+                        error = make_exception_ptr(FileException(msg.str(), err));
+                    }
+                    failed = true;
+                    return;
+                    // LCOV_EXCL_STOP
+                }
+                done += n;
+            }
+            if (chunk_checksums)
+            {
+                (*chunk_checksums)[chunk] = crc32(&buf[offset], len);
+            }
+        }
+    };
+
+    // The calling thread is one of the workers. If we cannot create as many threads as requested,
+    // for whatever reason, we make do with the ones we have; workers that are already running
+    // must be joined in any case.
+
+    vector<thread> threads;
+    try
+    {
+        threads.reserve(concurrency - 1);
+        for (unsigned i = 1; i < concurrency; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+    }
+    catch (...) // LCOV_EXCL_LINE
+    {
+    }
+    worker();
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    if (error)
+    {
+        rethrow_exception(error);   // LCOV_EXCL_LINE
+    }
+    return LargeFileBuffer(move(buf), size);
+}
+
+uint64_t
+copy_file(string const& source, string const& destination, atomic<bool> const* cancel)
+{
+    string what = "cannot copy \"" + source + "\" to \"" + destination + "\"";
+
+    util::UniqueFd from_fd(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!from_fd)
+    {
+        throw FileException("cannot open \"" + source + "\": " + strerror(errno), errno);
+    }
+
+    struct stat st;
+    if (fstat(from_fd.get(), &st) == -1)
+    {
+        throw FileException("cannot fstat \"" + source + "\": " + strerror(errno), errno); // LCOV_EXCL_LINE
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        throw FileException("\"" + source + "\" is not a regular file", 0);
+    }
+
+    // Opening the destination truncates it, so we must not allow a copy onto the source.
+
+    struct stat dst_st;
+    if (stat(destination.c_str(), &dst_st) == 0 && dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino)
+    {
+        throw FileException(what + ": source and destination are the same file", 0);
+    }
+
+    util::UniqueFd to_fd(::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777));
+    if (!to_fd)
+    {
+        throw FileException("cannot open \"" + destination + "\": " + strerror(errno), errno);
+    }
+
+    uint64_t bytes;
+    try
+    {
+        if (cancel && cancel->load(memory_order_relaxed))
+        {
+            throw FileException(what + ": cancelled", ECANCELED);
+        }
+#ifdef FICLONE
+        if (ioctl(to_fd.get(), FICLONE, from_fd.get()) == 0)
+        {
+            bytes = st.st_size;
+        }
+        else
+#endif
+        {
+            bytes = transfer(from_fd.get(), to_fd.get(), numeric_limits<uint64_t>::max(), cancel, what);
+        }
+        if (::close(to_fd.release()) == -1)
+        {
+            throw FileException(what + ": " + strerror(errno), errno);  // LCOV_EXCL_LINE
+        }
+    }
+    catch (...)
+    {
+        to_fd.dealloc();
+        ::unlink(destination.c_str());
+        throw;
+    }
+
+    return bytes;
+}
+
+uint64_t
+transfer_fd(int from_fd, int to_fd, uint64_t max_bytes, atomic<bool> const* cancel)
+{
+    ostringstream what;
+    what << "cannot transfer data from descriptor " << from_fd << " to descriptor " << to_fd;
+    return transfer(from_fd, to_fd, max_bytes, cancel, what.str());
 }
 
 } // namespace util
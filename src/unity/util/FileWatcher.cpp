@@ -0,0 +1,657 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/FileWatcher.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <dirent.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+class WatchService;
+
+struct FileWatcherState : public enable_shared_from_this<FileWatcherState>
+{
+    FileWatcher::Callback callback;
+    FileWatcher::Executor executor;
+    chrono::milliseconds window;
+    WatchService* service = nullptr;
+
+    // Held while the callback runs, so the destructor can wait for it. The mutex is recursive
+    // because the callback may destroy its own FileWatcher.
+    recursive_mutex callback_mutex;
+    bool active = true;
+
+    // Events that have not been reported yet, protected by the service mutex. pending_order
+    // holds the paths in the order of their first event, which is also the order of their deadlines.
+    unordered_map<string, unsigned> pending;
+    deque<pair<chrono::steady_clock::time_point, string>> pending_order;
+
+    void invoke(FileWatcher::Change const& change) noexcept
+    {
+        lock_guard<recursive_mutex> lock(callback_mutex);
+        if (active)
+        {
+            try
+            {
+                callback(change);
+            }
+            catch (...)
+            {
+                // There is nobody to report the error to, and we must not unwind the service thread.
+            }
+        }
+    }
+};
+
+// Owns the process-wide inotify descriptor and the thread that reads it.
+
+class WatchService final
+{
+public:
+    NONCOPYABLE(WatchService);
+
+    static WatchService* acquire();
+    static void release(WatchService* service) noexcept;
+
+    void add_watcher(FileWatcherState* watcher);
+    void remove_watcher(FileWatcherState* watcher) noexcept;
+
+    void add_file(FileWatcherState* watcher, string const& path);
+    void add_directory(FileWatcherState* watcher, string const& path, bool recursive);
+    void remove(FileWatcherState* watcher, string const& root) noexcept;
+
+private:
+    WatchService();
+    ~WatchService();
+
+    struct Subscription
+    {
+        FileWatcherState* watcher;
+        string root;        // Path passed to add_file() or add_directory()
+        string dir;         // Path of the watched directory, as seen by this subscription
+        string name;        // For add_file(), the name of the file in dir
+        bool recursive;
+    };
+
+    struct Watch
+    {
+        vector<Subscription> subs;
+    };
+
+    void run() noexcept;
+    void process_event(inotify_event const* ev);
+    void add_pending(FileWatcherState* watcher, string const& path, unsigned events);
+    void watch_tree(FileWatcherState* watcher, string const& root, string const& dir, bool report_contents);
+    int add_watch(string const& dir);
+    void remove_subs_if(function<bool(Subscription const&)> const& pred) noexcept;
+
+    util::ResourcePtr<int, std::function<void(int)>> inotify_fd_;
+    util::ResourcePtr<int, std::function<void(int)>> wakeup_fd_;
+    mutex mutex_;
+    unordered_map<int, Watch> watches_;
+    set<FileWatcherState*> watchers_;
+    bool stop_ = false;
+    bool delete_on_return_ = false;     // Only accessed by the service thread
+    thread thread_;
+
+    static mutex instance_mutex_;
+    static WatchService* instance_;
+    static int users_;
+};
+
+mutex WatchService::instance_mutex_;
+WatchService* WatchService::instance_ = nullptr;
+int WatchService::users_ = 0;
+
+namespace
+{
+
+uint32_t const watch_mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+                            | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+string join(string const& dir, string const& name)
+{
+    return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+string strip_trailing_slashes(string path)
+{
+    while (path.size() > 1 && path.back() == '/')
+    {
+        path.pop_back();
+    }
+    return path;
+}
+
+unsigned translate(uint32_t mask)
+{
+    unsigned events = 0;
+    if (mask & (IN_CREATE | IN_MOVED_TO))
+    {
+        events |= FileWatcher::created;
+    }
+    if (mask & (IN_MODIFY | IN_CLOSE_WRITE))
+    {
+        events |= FileWatcher::modified;
+    }
+    if (mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF))
+    {
+        events |= FileWatcher::removed;
+    }
+    if (mask & IN_ATTRIB)
+    {
+        events |= FileWatcher::attributes;
+    }
+    return events;
+}
+
+} // namespace
+
+WatchService* WatchService::acquire()
+{
+    lock_guard<mutex> lock(instance_mutex_);
+    if (!instance_)
+    {
+        instance_ = new WatchService;
+    }
+    ++users_;
+    return instance_;
+}
+
+void WatchService::release(WatchService* service) noexcept
+{
+    {
+        lock_guard<mutex> lock(instance_mutex_);
+        if (--users_ > 0)
+        {
+            return;
+        }
+        instance_ = nullptr;
+    }
+
+    if (this_thread::get_id() == service->thread_.get_id())
+    {
+        // The last FileWatcher was destroyed by a callback. We cannot join ourselves, so the
+        // service thread deletes the service once the callback has returned.
+        service->delete_on_return_ = true;
+        return;
+    }
+    delete service;
+}
+
+WatchService::WatchService()
+    : inotify_fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC), [](int fd) { if (fd != -1) ::close(fd); })
+    , wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), [](int fd) { if (fd != -1) ::close(fd); })
+{
+    if (inotify_fd_.get() == -1)
+    {
+        throw SyscallException(string("FileWatcher: inotify_init1() failed: ") + strerror(errno), errno);
+    }
+    if (wakeup_fd_.get() == -1)
+    {
+        throw SyscallException(string("FileWatcher: eventfd() failed: ") + strerror(errno), errno); // LCOV_EXCL_LINE
+    }
+    try
+    {
+        thread_ = thread(&WatchService::run, this);
+    }
+    // LCOV_EXCL_START
+    catch (system_error const& e)
+    {
+        throw SyscallException(string("FileWatcher: cannot create thread: ") + e.what(), e.code().value());
+    }
+    // LCOV_EXCL_STOP
+}
+
+WatchService::~WatchService()
+{
+    if (thread_.get_id() == this_thread::get_id())
+    {
+        thread_.detach();
+        return;
+    }
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    uint64_t one = 1;
+    ssize_t rc = ::write(wakeup_fd_.get(), &one, sizeof(one));  // Cannot fail for an eventfd with a small count.
+    (void)rc;
+    thread_.join();
+}
+
+void WatchService::add_watcher(FileWatcherState* watcher)
+{
+    lock_guard<mutex> lock(mutex_);
+    watchers_.insert(watcher);
+}
+
+void WatchService::remove_watcher(FileWatcherState* watcher) noexcept
+{
+    remove(watcher, "");
+    lock_guard<mutex> lock(mutex_);
+    watchers_.erase(watcher);
+}
+
+void WatchService::add_file(FileWatcherState* watcher, string const& path)
+{
+    string const p = strip_trailing_slashes(path);
+    auto const slash = p.rfind('/');
+    string const dir = slash == string::npos ? "." : (slash == 0 ? "/" : p.substr(0, slash));
+    string const name = slash == string::npos ? p : p.substr(slash + 1);
+
+    lock_guard<mutex> lock(mutex_);
+    int wd = add_watch(dir);
+    if (wd == -1)
+    {
+        throw FileException("cannot watch \"" + dir + "\": " + strerror(errno), errno);
+    }
+    auto& subs = watches_[wd].subs;
+    for (auto const& s : subs)
+    {
+        if (s.watcher == watcher && s.root == path)
+        {
+            return;
+        }
+    }
+    subs.push_back(Subscription{ watcher, path, dir, name, false });
+}
+
+void WatchService::add_directory(FileWatcherState* watcher, string const& path, bool recursive)
+{
+    string const dir = strip_trailing_slashes(path);
+
+    lock_guard<mutex> lock(mutex_);
+    int wd = add_watch(dir);
+    if (wd == -1)
+    {
+        throw FileException("cannot watch \"" + dir + "\": " + strerror(errno), errno);
+    }
+    if (recursive)
+    {
+        watch_tree(watcher, path, dir, false);
+    }
+    else
+    {
+        auto& subs = watches_[wd].subs;
+        for (auto const& s : subs)
+        {
+            if (s.watcher == watcher && s.root == path)
+            {
+                return;
+            }
+        }
+        subs.push_back(Subscription{ watcher, path, dir, "", false });
+    }
+}
+
+void WatchService::remove(FileWatcherState* watcher, string const& root) noexcept
+{
+    lock_guard<mutex> lock(mutex_);
+    remove_subs_if([watcher, &root](Subscription const& s)
+    {
+        return s.watcher == watcher && (root.empty() || s.root == root);
+    });
+
+    if (!root.empty())
+    {
+        // Drop anything we have not reported yet for this root.
+        auto& pending = watcher->pending;
+        auto& order = watcher->pending_order;
+        string const prefix = join(strip_trailing_slashes(root), "");
+        order.erase(remove_if(order.begin(), order.end(), [&](pair<chrono::steady_clock::time_point, string> const& p)
+        {
+            if (p.second == root || p.second.compare(0, prefix.size(), prefix) == 0)
+            {
+                pending.erase(p.second);
+                return true;
+            }
+            return false;
+        }), order.end());
+    }
+}
+
+// Called with mutex_ locked.
+
+void WatchService::remove_subs_if(function<bool(Subscription const&)> const& pred) noexcept
+{
+    for (auto it = watches_.begin(); it != watches_.end(); )
+    {
+        auto& subs = it->second.subs;
+        subs.erase(remove_if(subs.begin(), subs.end(), pred), subs.end());
+        if (subs.empty())
+        {
+            inotify_rm_watch(inotify_fd_.get(), it->first);
+            it = watches_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// Called with mutex_ locked. Adding a watch for a directory that is watched already
+// returns the existing watch descriptor.
+
+int WatchService::add_watch(string const& dir)
+{
+    return inotify_add_watch(inotify_fd_.get(), dir.c_str(), watch_mask);
+}
+
+// Called with mutex_ locked. Watches dir and all directories below it. If report_contents is set,
+// the entries that exist already are reported as created. (We need this for directories that
+// are created while we watch their parent: files may be added before we get to watch the new directory.)
+
+void WatchService::watch_tree(FileWatcherState* watcher, string const& root, string const& dir, bool report_contents)
+{
+    int wd = add_watch(dir);
+    if (wd == -1)
+    {
+        return;     // Removed in the mean time, or not a directory. We get a separate event for that.
+    }
+    auto& subs = watches_[wd].subs;
+    bool const already_watched = any_of(subs.begin(), subs.end(), [watcher, &root](Subscription const& s)
+    {
+        return s.watcher == watcher && s.root == root;
+    });
+    if (already_watched)
+    {
+        return;
+    }
+    subs.push_back(Subscription{ watcher, root, dir, "", true });
+
+    unique_ptr<DIR, int(*)(DIR*)> d(opendir(dir.c_str()), closedir);
+    if (!d)
+    {
+        return;     // LCOV_EXCL_LINE
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d.get())) != nullptr)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        string const path = join(dir, entry->d_name);
+        if (report_contents)
+        {
+            add_pending(watcher, path, FileWatcher::created);
+        }
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            is_dir = lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);  // LCOV_EXCL_LINE
+        }
+        if (is_dir)
+        {
+            watch_tree(watcher, root, path, report_contents);
+        }
+    }
+}
+
+// Called with mutex_ locked.
+
+void WatchService::add_pending(FileWatcherState* watcher, string const& path, unsigned events)
+{
+    auto it = watcher->pending.find(path);
+    if (it != watcher->pending.end())
+    {
+        it->second |= events;
+        return;
+    }
+    watcher->pending.emplace(path, events);
+    watcher->pending_order.emplace_back(chrono::steady_clock::now() + watcher->window, path);
+}
+
+// Called with mutex_ locked.
+
+void WatchService::process_event(inotify_event const* ev)
+{
+    if (ev->mask & IN_Q_OVERFLOW)
+    {
+        for (auto const& w : watches_)
+        {
+            for (auto const& s : w.second.subs)
+            {
+                add_pending(s.watcher, s.root, FileWatcher::overflow);
+            }
+        }
+        return;
+    }
+
+    auto it = watches_.find(ev->wd);
+    if (it == watches_.end())
+    {
+        return;     // Watch was removed, but some events were still queued.
+    }
+    if (ev->mask & IN_IGNORED)
+    {
+        watches_.erase(it);     // The directory was deleted or unmounted.
+        return;
+    }
+
+    unsigned const events = translate(ev->mask);
+    string const name = ev->len > 0 ? ev->name : "";
+    bool const new_dir = (ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO));
+
+    // Copy the subscriptions because watch_tree() can insert into watches_.
+    auto const subs = it->second.subs;
+    for (auto const& s : subs)
+    {
+        if (name.empty())
+        {
+            // Event for the watched directory itself. For sub-directories of a recursive watch,
+            // the event in the parent directory reports this already.
+            if (s.name.empty() && s.dir == strip_trailing_slashes(s.root))
+            {
+                add_pending(s.watcher, s.dir, events);
+            }
+            continue;
+        }
+        if (!s.name.empty())
+        {
+            if (s.name == name)
+            {
+                add_pending(s.watcher, s.root, events);
+            }
+            continue;
+        }
+        string const path = join(s.dir, name);
+        add_pending(s.watcher, path, events);
+        if (new_dir && s.recursive)
+        {
+            watch_tree(s.watcher, s.root, path, true);
+        }
+    }
+}
+
+void WatchService::run() noexcept
+{
+    // Large enough for many events, and correctly aligned for inotify_event.
+    alignas(inotify_event) char buf[64 * 1024];
+
+    for (;;)
+    {
+        vector<pair<shared_ptr<FileWatcherState>, FileWatcher::Change>> due;
+        int timeout = -1;
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (stop_)
+            {
+                return;
+            }
+            auto const now = chrono::steady_clock::now();
+            for (auto w : watchers_)
+            {
+                auto& order = w->pending_order;
+                while (!order.empty() && order.front().first <= now)
+                {
+                    auto it = w->pending.find(order.front().second);
+                    due.emplace_back(w->shared_from_this(), FileWatcher::Change{ it->first, it->second });
+                    w->pending.erase(it);
+                    order.pop_front();
+                }
+                if (!order.empty())
+                {
+                    auto ms = chrono::duration_cast<chrono::milliseconds>(order.front().first - now).count() + 1;
+                    timeout = timeout == -1 ? int(ms) : min(timeout, int(ms));
+                }
+            }
+        }
+
+        for (auto const& d : due)
+        {
+            auto state = d.first;
+            auto change = d.second;
+            if (state->executor)
+            {
+                try
+                {
+                    state->executor([state, change] { state->invoke(change); });
+                }
+                catch (...)
+                {
+                    // Ignore errors from the executor; there is nobody to report them to.
+                }
+            }
+            else
+            {
+                state->invoke(change);
+            }
+            if (delete_on_return_)
+            {
+                due.clear();
+                delete this;
+                return;
+            }
+        }
+        if (!due.empty())
+        {
+            continue;   // Time has passed while we delivered; recompute the deadlines.
+        }
+
+        struct pollfd fds[2] = { { inotify_fd_.get(), POLLIN, 0 }, { wakeup_fd_.get(), POLLIN, 0 } };
+        if (poll(fds, 2, timeout) == -1)
+        {
+            continue;   // EINTR
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t val;
+            ssize_t rc = ::read(wakeup_fd_.get(), &val, sizeof(val));  // Only wakes us up; the value does not matter.
+            (void)rc;
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            ssize_t n;
+            while ((n = ::read(inotify_fd_.get(), buf, sizeof(buf))) > 0)
+            {
+                lock_guard<mutex> lock(mutex_);
+                for (char const* p = buf; p < buf + n; )
+                {
+                    auto ev = reinterpret_cast<inotify_event const*>(p);
+                    process_event(ev);
+                    p += sizeof(inotify_event) + ev->len;
+                }
+            }
+        }
+    }
+}
+
+} // namespace internal
+
+FileWatcher::FileWatcher(Callback const& callback, chrono::milliseconds coalesce_window, Executor const& executor)
+    : p_(make_shared<internal::FileWatcherState>())
+{
+    if (!callback)
+    {
+        throw InvalidArgumentException("FileWatcher(): callback must not be empty");
+    }
+    p_->callback = callback;
+    p_->executor = executor;
+    p_->window = max(coalesce_window, chrono::milliseconds(0));
+    p_->service = internal::WatchService::acquire();
+    try
+    {
+        p_->service->add_watcher(p_.get());
+    }
+    // LCOV_EXCL_START
+    catch (...)
+    {
+        internal::WatchService::release(p_->service);
+        throw;
+    }
+    // LCOV_EXCL_STOP
+}
+
+FileWatcher::~FileWatcher() noexcept
+{
+    p_->service->remove_watcher(p_.get());
+    internal::WatchService::release(p_->service);
+
+    lock_guard<recursive_mutex> lock(p_->callback_mutex);
+    p_->active = false;
+}
+
+void FileWatcher::add_file(string const& path)
+{
+    p_->service->add_file(p_.get(), path);
+}
+
+void FileWatcher::add_directory(string const& path, bool recursive)
+{
+    p_->service->add_directory(p_.get(), path, recursive);
+}
+
+void FileWatcher::remove(string const& path) noexcept
+{
+    if (!path.empty())
+    {
+        p_->service->remove(p_.get(), path);
+    }
+}
+
+} // namespace util
+
+} // namespace unity
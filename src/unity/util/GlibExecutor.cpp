@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/GlibExecutor.h>
+#include <unity/UnityExceptions.h>
+
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct GlibExecutorPrivate
+{
+    GMainContextUPtr context;
+    GMainLoopUPtr loop;
+    thread worker;
+    mutex m;
+    bool shut_down = false;                 // Protected by m
+    vector<shared_ptr<void>> held;          // Protected by m
+
+    GlibExecutorPrivate()
+        : context(unique_glib(g_main_context_new()))
+        , loop(unique_glib(g_main_loop_new(context.get(), FALSE)))
+    {
+    }
+
+    void run() noexcept;
+};
+
+namespace
+{
+
+struct Task
+{
+    function<void()> f;
+};
+
+gboolean run_task(gpointer data)
+{
+    try
+    {
+        static_cast<Task*>(data)->f();
+    }
+    catch (...)
+    {
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void destroy_task(gpointer data)
+{
+    delete static_cast<Task*>(data);    // Releases whatever the task captured on the thread that ran it.
+}
+
+// Idle sources of the same priority are dispatched in the order they were attached,
+// so tasks run in the order they were posted.
+
+void attach_task(GMainContext* context, function<void()> task)
+{
+    GSource* source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, run_task, new Task{ move(task) }, destroy_task);
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
+} // namespace
+
+void GlibExecutorPrivate::run() noexcept
+{
+    g_main_context_push_thread_default(context.get());
+    g_main_loop_run(loop.get());
+
+    // Run whatever was queued behind the quit task.
+    while (g_main_context_iteration(context.get(), FALSE))
+    {
+    }
+    g_main_context_pop_thread_default(context.get());
+}
+
+} // namespace internal
+
+GlibExecutor::GlibExecutor()
+    : p_(new internal::GlibExecutorPrivate)
+{
+    try
+    {
+        p_->worker = thread(&internal::GlibExecutorPrivate::run, p_.get());
+    }
+    // LCOV_EXCL_START
+    catch (std::system_error const& e)
+    {
+        throw ResourceException(string("GlibExecutor(): cannot create thread: ") + e.what());
+    }
+    // LCOV_EXCL_STOP
+}
+
+GlibExecutor::~GlibExecutor() noexcept
+{
+    shutdown();
+}
+
+GMainContext* GlibExecutor::context() const noexcept
+{
+    return p_->context.get();
+}
+
+bool GlibExecutor::is_executor_thread() const noexcept
+{
+    return this_thread::get_id() == p_->worker.get_id();
+}
+
+void GlibExecutor::post(function<void()> task)
+{
+    // The task is attached with the lock held, so it is queued before the quit task that shutdown() adds.
+    // Tasks may still queue more work while the executor drains its queue.
+    lock_guard<mutex> lock(p_->m);
+    if (p_->shut_down && !is_executor_thread())
+    {
+        throw LogicException("GlibExecutor::post(): executor has been shut down");
+    }
+    internal::attach_task(p_->context.get(), move(task));
+}
+
+void GlibExecutor::post(GMainContext* context, function<void()> task)
+{
+    internal::attach_task(context ? context : g_main_context_default(), move(task));
+}
+
+void GlibExecutor::hold(shared_ptr<void> object)
+{
+    lock_guard<mutex> lock(p_->m);
+    if (p_->shut_down)
+    {
+        throw LogicException("GlibExecutor::hold(): executor has been shut down");
+    }
+    p_->held.push_back(move(object));
+}
+
+void GlibExecutor::shutdown()
+{
+    if (is_executor_thread())
+    {
+        throw LogicException("GlibExecutor::shutdown(): cannot be called from the executor thread");
+    }
+    {
+        lock_guard<mutex> lock(p_->m);
+        if (p_->shut_down)
+        {
+            return;
+        }
+        p_->shut_down = true;
+    }
+
+    auto p = p_.get();
+    internal::attach_task(p_->context.get(), [p]
+    {
+        vector<shared_ptr<void>> held;
+        {
+            lock_guard<mutex> lock(p->m);
+            held.swap(p->held);
+        }
+        held.clear();
+        g_main_loop_quit(p->loop.get());
+    });
+    p_->worker.join();
+}
+
+} // namespace util
+
+} // namespace unity
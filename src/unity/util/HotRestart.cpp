@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/HotRestart.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+extern char** environ;
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+namespace
+{
+
+char const* const env_var = "UNITY_HOT_RESTART_FD";
+
+// Descriptors are sent in batches of at most this many per message, well below the
+// kernel limit (SCM_MAX_FD) of 253.
+
+size_t const batch_size = 64;
+size_t const max_name_len = 255;
+size_t const max_message_size = sizeof(uint32_t) + batch_size * (max_name_len + 1);
+
+// Message from the successor to the old process.
+
+char const ready_msg = 'R';
+
+// Each message from the old process to the successor contains a count, followed by that many
+// NUL-terminated names, with the descriptors in the same order as ancillary data.
+// A message with a count of zero ends the list.
+
+void send_batch(int channel, vector<pair<string, int>>::const_iterator begin, size_t count)
+{
+    vector<char> data(sizeof(uint32_t));
+    uint32_t const n = count;
+    memcpy(data.data(), &n, sizeof(n));
+    vector<int> fds;
+    for (size_t i = 0; i < count; ++i, ++begin)
+    {
+        data.insert(data.end(), begin->first.begin(), begin->first.end());
+        data.push_back('\0');
+        fds.push_back(begin->second);
+    }
+
+    struct iovec iov = { data.data(), data.size() };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    vector<char> control(CMSG_SPACE(sizeof(int) * batch_size));
+    if (count > 0)
+    {
+        msg.msg_control = control.data();
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * count);
+    }
+
+    while (sendmsg(channel, &msg, MSG_NOSIGNAL) == -1)
+    {
+        if (errno != EINTR)
+        {
+            throw SyscallException("HotRestart: cannot send descriptors to successor", errno);
+        }
+    }
+}
+
+} // namespace
+
+struct HotRestartPrivate
+{
+    vector<pair<string, int>> fds;
+};
+
+struct HotRestartSuccessorPrivate
+{
+    int channel = -1;
+    map<string, int> fds;
+
+    ~HotRestartSuccessorPrivate()
+    {
+        for (auto const& f : fds)
+        {
+            ::close(f.second);
+        }
+        if (channel != -1)
+        {
+            ::close(channel);
+        }
+    }
+};
+
+} // namespace internal
+
+HotRestart::HotRestart()
+    : p_(new internal::HotRestartPrivate)
+{
+}
+
+HotRestart::~HotRestart() noexcept = default;
+
+void HotRestart::add_fd(string const& name, int fd)
+{
+    if (name.empty() || name.size() > internal::max_name_len || name.find('\0') != string::npos)
+    {
+        throw InvalidArgumentException("HotRestart::add_fd(): invalid name: \"" + name + "\"");
+    }
+    for (auto const& f : p_->fds)
+    {
+        if (f.first == name)
+        {
+            throw InvalidArgumentException("HotRestart::add_fd(): duplicate name: \"" + name + "\"");
+        }
+    }
+    if (fd < 0 || fcntl(fd, F_GETFD) == -1)
+    {
+        throw InvalidArgumentException("HotRestart::add_fd(): invalid file descriptor: " + to_string(fd));
+    }
+    p_->fds.emplace_back(name, fd);
+}
+
+pid_t HotRestart::start_successor(vector<string> const& args, chrono::milliseconds timeout)
+{
+    if (args.empty())
+    {
+        throw InvalidArgumentException("HotRestart::start_successor(): args must not be empty");
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        throw SyscallException("HotRestart: socketpair() failed", errno);  // LCOV_EXCL_LINE
+    }
+    auto closer = [](int fd) { if (fd != -1) ::close(fd); };
+    util::ResourcePtr<int, std::function<void(int)>> channel(sv[0], closer);
+    util::ResourcePtr<int, std::function<void(int)>> child_channel(sv[1], closer);
+
+    // Everything the child needs is prepared before forking, because the child of a
+    // multi-threaded process may only call async-signal-safe functions.
+
+    vector<char*> argv;
+    for (auto const& a : args)
+    {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    string const var = string(internal::env_var) + "=" + to_string(child_channel.get());
+    size_t const prefix_len = strlen(internal::env_var) + 1;
+    vector<char*> envp;
+    for (char** e = environ; *e; ++e)
+    {
+        if (strncmp(*e, var.c_str(), prefix_len) != 0)
+        {
+            envp.push_back(*e);
+        }
+    }
+    envp.push_back(const_cast<char*>(var.c_str()));
+    envp.push_back(nullptr);
+
+    // The child reports a failed exec on a close-on-exec pipe. If the exec succeeds,
+    // the pipe is closed and we read end-of-file.
+
+    int ep[2];
+    if (pipe2(ep, O_CLOEXEC) == -1)
+    {
+        throw SyscallException("HotRestart: pipe2() failed", errno);  // LCOV_EXCL_LINE
+    }
+    util::ResourcePtr<int, std::function<void(int)>> exec_read(ep[0], closer);
+    util::ResourcePtr<int, std::function<void(int)>> exec_write(ep[1], closer);
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        throw SyscallException("HotRestart: fork() failed", errno);  // LCOV_EXCL_LINE
+    }
+    if (pid == 0)
+    {
+        fcntl(child_channel.get(), F_SETFD, 0);
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        execvpe(argv[0], argv.data(), envp.data());
+
+        int const err = errno;
+        if (write(exec_write.get(), &err, sizeof(err))) {}
+        _exit(127);
+    }
+    child_channel.dealloc();
+    exec_write.dealloc();
+
+    auto reap_successor = [pid]
+    {
+        while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR)
+        {
+        }
+    };
+
+    int err;
+    ssize_t n;
+    while ((n = read(exec_read.get(), &err, sizeof(err))) == -1 && errno == EINTR)
+    {
+    }
+    if (n == sizeof(err))
+    {
+        reap_successor();
+        throw SyscallException("HotRestart: cannot execute \"" + args[0] + "\"", err);
+    }
+
+    // From here on, if anything goes wrong, we get rid of the successor.
+
+    auto kill_successor = [pid, &reap_successor]
+    {
+        kill(pid, SIGKILL);
+        reap_successor();
+    };
+    auto exited = [&args]
+    {
+        return ResourceException("HotRestart: successor \"" + args[0] + "\" exited before it became ready");
+    };
+
+    try
+    {
+        auto const& fds = p_->fds;
+        for (size_t i = 0; i < fds.size(); i += internal::batch_size)
+        {
+            internal::send_batch(channel.get(), fds.begin() + i, min(internal::batch_size, fds.size() - i));
+        }
+        internal::send_batch(channel.get(), fds.end(), 0);
+    }
+    catch (SyscallException const& e)
+    {
+        kill_successor();
+        if (e.error() == EPIPE || e.error() == ECONNRESET)
+        {
+            throw exited();  // The successor exited without receiving the descriptors.
+        }
+        throw;  // LCOV_EXCL_LINE
+    }
+
+    auto const deadline = chrono::steady_clock::now() + timeout;
+    char reply;
+    n = -1;
+    for (;;)
+    {
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+        {
+            kill_successor();
+            throw ResourceException("HotRestart: successor \"" + args[0] + "\" did not become ready within "
+                                    + to_string(timeout.count()) + " ms");
+        }
+        struct pollfd pfd = { channel.get(), POLLIN, 0 };
+        int rc = poll(&pfd, 1, static_cast<int>(min<decltype(remaining)>(remaining, INT_MAX)));
+        if (rc <= 0)
+        {
+            continue;
+        }
+        n = recv(channel.get(), &reply, sizeof(reply), 0);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;   // LCOV_EXCL_LINE
+        }
+        break;
+    }
+
+    if (n == 1 && reply == internal::ready_msg)
+    {
+        return pid;
+    }
+    kill_successor();
+    throw exited();
+}
+
+HotRestart::Successor::Successor(int channel)
+    : p_(new internal::HotRestartSuccessorPrivate)
+{
+    p_->channel = channel;
+}
+
+HotRestart::Successor::~Successor() noexcept = default;
+
+HotRestart::Successor::UPtr HotRestart::Successor::attach()
+{
+    char const* env = getenv(internal::env_var);
+    if (!env)
+    {
+        return nullptr;
+    }
+    string const value = env;   // unsetenv() may invalidate env.
+    char* end;
+    long channel = strtol(value.c_str(), &end, 10);
+    bool const valid = !value.empty() && *end == '\0' && channel >= 0 && channel <= INT_MAX;
+    unsetenv(internal::env_var);
+    if (!valid || fcntl(channel, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        throw SyscallException("HotRestart: invalid value for " + string(internal::env_var) + ": \"" + value + "\"",
+                               EBADF);
+    }
+
+    UPtr s(new Successor(static_cast<int>(channel)));
+
+    vector<char> data(internal::max_message_size);
+    vector<char> control(CMSG_SPACE(sizeof(int) * internal::batch_size));
+    for (;;)
+    {
+        struct iovec iov = { data.data(), data.size() };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        ssize_t n = recvmsg(s->p_->channel, &msg, MSG_CMSG_CLOEXEC);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;   // LCOV_EXCL_LINE
+        }
+        if (n == -1)
+        {
+            throw SyscallException("HotRestart: cannot receive descriptors", errno);
+        }
+
+        // Take ownership of whatever descriptors arrived before checking anything else, so none leak.
+
+        vector<int> fds;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                size_t const count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                size_t const old_size = fds.size();
+                fds.resize(old_size + count);
+                memcpy(&fds[old_size], CMSG_DATA(cmsg), count * sizeof(int));
+            }
+        }
+        auto close_fds = [&fds]
+        {
+            for (auto fd : fds)
+            {
+                ::close(fd);
+            }
+        };
+
+        uint32_t count;
+        if (n < static_cast<ssize_t>(sizeof(count)) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+        {
+            close_fds();
+            throw SyscallException("HotRestart: malformed message from predecessor", EPROTO);
+        }
+        memcpy(&count, data.data(), sizeof(count));
+        if (count == 0)
+        {
+            close_fds();
+            return s;
+        }
+        if (count != fds.size())
+        {
+            close_fds();
+            throw SyscallException("HotRestart: malformed message from predecessor", EPROTO);  // LCOV_EXCL_LINE
+        }
+
+        char const* p = data.data() + sizeof(count);
+        char const* const data_end = data.data() + n;
+        for (auto fd : fds)
+        {
+            char const* name_end = static_cast<char const*>(memchr(p, '\0', data_end - p));
+            string name = name_end ? string(p, name_end) : string();
+            if (name.empty() || !s->p_->fds.emplace(name, fd).second)
+            {
+                ::close(fd);    // LCOV_EXCL_LINE
+            }
+            p = name_end ? name_end + 1 : data_end;
+        }
+    }
+}
+
+vector<string> HotRestart::Successor::names() const
+{
+    vector<string> result;
+    for (auto const& f : p_->fds)
+    {
+        result.push_back(f.first);
+    }
+    return result;
+}
+
+int HotRestart::Successor::take_fd(string const& name)
+{
+    auto it = p_->fds.find(name);
+    if (it == p_->fds.end())
+    {
+        return -1;
+    }
+    int fd = it->second;
+    p_->fds.erase(it);
+    return fd;
+}
+
+void HotRestart::Successor::notify_ready()
+{
+    if (p_->channel == -1)
+    {
+        throw LogicException("HotRestart::Successor::notify_ready(): already notified");
+    }
+    char const msg = internal::ready_msg;
+    ssize_t n;
+    while ((n = send(p_->channel, &msg, 1, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    {
+    }
+    int const err = errno;
+    ::close(p_->channel);
+    p_->channel = -1;
+    if (n != 1)
+    {
+        throw SyscallException("HotRestart: cannot notify predecessor", err);
+    }
+}
+
+} // namespace util
+
+} // namespace unity
@@ -18,6 +18,7 @@
 
 #include <unity/UnityExceptions.h>
 #include <unity/util/IniParser.h>
+#include <unity/util/ReadaheadProfile.h>
 
 #include <mutex>
 
@@ -91,6 +92,8 @@ IniParser::IniParser(const char* filename)
     p = new IniParserPrivate();
     p->k = kf;
     p->filename = filename;
+
+    ReadaheadProfile::record(filename, 0, 0);
 }
 
 IniParser::~IniParser() noexcept
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/LineReader.h>
+#include <unity/util/internal/Decompressor.h>
+#include <unity/util/ReadaheadProfile.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct LineReaderPrivate
+{
+    // For a file, fill() reads up to len bytes into buf and returns the number of bytes read, or 0 at EOF.
+    // For a memory buffer, fill is empty, and buf points at the caller's data.
+
+    function<size_t(char* buf, size_t len)> fill;
+    vector<char> window;
+    char const* buf = nullptr;
+    size_t begin = 0;           // Start of the unconsumed data in buf
+    size_t end = 0;             // End of the valid data in buf
+    size_t scanned = 0;         // Position up to which we know there is no newline
+    bool eof = false;
+};
+
+} // namespace internal
+
+constexpr size_t LineReader::default_window_size;
+
+LineReader::LineReader(string const& filename, size_t window_size)
+    : p_(new internal::LineReaderPrivate)
+{
+    int tmp_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (tmp_fd == -1)
+    {
+        throw FileException("cannot open \"" + filename + "\": " + strerror(errno), errno);
+    }
+    auto fd = make_shared<ResourcePtr<int, function<void(int)>>>(tmp_fd, [](int fd) { ::close(fd); });
+    ReadaheadProfile::record(filename, 0, 0);
+
+    p_->window.resize(window_size == 0 ? default_window_size : window_size);
+    p_->buf = p_->window.data();
+    p_->fill = [fd, filename](char* buf, size_t len) -> size_t
+    {
+        ssize_t n;
+        while ((n = ::read(fd->get(), buf, len)) == -1)
+        {
+            if (errno != EINTR)
+            {
+                throw FileException("cannot read from \"" + filename + "\": " + strerror(errno), errno);
+            }
+        }
+        return n;
+    };
+}
+
+LineReader::LineReader()
+    : p_(new internal::LineReaderPrivate)
+{
+}
+
+LineReader::UPtr LineReader::from_buffer(char const* data, size_t size)
+{
+    UPtr reader(new LineReader);
+    reader->p_->buf = data;
+    reader->p_->end = size;
+    reader->p_->eof = true;
+    return reader;
+}
+
+LineReader::UPtr LineReader::from_compressed_file(string const& filename, size_t window_size)
+{
+    auto decompressor = make_shared<internal::Decompressor>(filename);
+
+    UPtr reader(new LineReader);
+    auto& p = *reader->p_;
+    p.window.resize(window_size == 0 ? default_window_size : window_size);
+    p.buf = p.window.data();
+    p.fill = [decompressor](char* buf, size_t len)
+    {
+        return decompressor->read(buf, len);
+    };
+    return reader;
+}
+
+LineReader::~LineReader() noexcept = default;
+
+bool LineReader::next(StringView& line)
+{
+    auto& p = *p_;
+
+    for (;;)
+    {
+        size_t const scan_from = max(p.begin, p.scanned);
+        char const* nl = nullptr;
+        if (scan_from < p.end)
+        {
+            nl = static_cast<char const*>(memchr(p.buf + scan_from, '\n', p.end - scan_from));
+        }
+        if (nl)
+        {
+            size_t const nl_pos = nl - p.buf;
+            line = StringView(p.buf + p.begin, nl_pos - p.begin);
+            p.begin = nl_pos + 1;
+            return true;
+        }
+        p.scanned = p.end;
+
+        if (p.eof)
+        {
+            if (p.begin == p.end)
+            {
+                return false;
+            }
+            line = StringView(p.buf + p.begin, p.end - p.begin);    // Last line without newline
+            p.begin = p.end;
+            return true;
+        }
+
+        // Slide the partial line to the front of the window. If the partial line fills the
+        // entire window, the line is longer than the window, so we have to grow it.
+
+        if (p.begin > 0)
+        {
+            memmove(&p.window[0], &p.window[p.begin], p.end - p.begin);
+            p.end -= p.begin;
+            p.scanned = p.end;
+            p.begin = 0;
+        }
+        else if (p.end == p.window.size())
+        {
+            p.window.resize(p.window.size() * 2);
+            p.buf = p.window.data();
+        }
+
+        size_t n = p.fill(&p.window[p.end], p.window.size() - p.end);
+        if (n == 0)
+        {
+            p.eof = true;
+        }
+        p.end += n;
+    }
+}
+
+} // namespace util
+
+} // namespace unity
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/ProcessSpawner.h>
+#include <unity/util/internal/DaemonImpl.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+
+extern char** environ;
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct ProcessSpawnerPrivate
+{
+    vector<string> args;
+    vector<pair<int, int>> fd_map;  // Parent fd, child fd
+    bool close_other_fds = false;
+    bool clear_env = false;
+    map<string, pair<bool, string>> env_changes;    // Name -> (set, value)
+    string working_directory;
+    bool set_pgid = false;
+    pid_t pgid = 0;
+    vector<pair<int, struct rlimit>> rlimits;
+};
+
+namespace
+{
+
+// Everything the child needs is prepared by the parent. The child shares the parent's memory,
+// so it must not allocate, and it must not modify anything other than the error fields.
+
+enum class Step { map_fd, chdir, setpgid, setrlimit, exec };
+
+struct ChildArgs
+{
+    char* const* argv;
+    char* const* envp;
+    bool search_path;
+    pair<int, int> const* fd_map;
+    int* tmp_fds;
+    size_t fd_count;
+    int first_tmp_fd;
+    vector<int> const* keep_fds;    // nullptr if other descriptors stay open
+    char const* working_directory;  // nullptr if unchanged
+    bool set_pgid;
+    pid_t pgid;
+    pair<int, struct rlimit> const* rlimits;
+    size_t rlimit_count;
+    sigset_t const* mask;
+
+    // Set by the child if it fails.
+
+    int err;
+    Step step;
+    size_t index;
+};
+
+[[noreturn]] void fail(ChildArgs* a, Step step, size_t index = 0) noexcept
+{
+    a->err = errno;
+    a->step = step;
+    a->index = index;
+    _exit(127);
+}
+
+// The parent has blocked all signals, so no signal handler can run in the child
+// (where it would modify the parent's memory) until the handlers have been reset.
+
+int child_main(void* arg) noexcept
+{
+    auto a = static_cast<ChildArgs*>(arg);
+
+    for (int sig = 1; sig < NSIG; ++sig)
+    {
+        struct sigaction sa;
+        if (sigaction(sig, nullptr, &sa) == 0 && sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN)
+        {
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = SIG_DFL;
+            sigaction(sig, &sa, nullptr);
+        }
+    }
+
+    // We first duplicate the sources above all targets, so no mapping can overwrite the source of another.
+    // The duplicates are close-on-exec.
+
+    for (size_t i = 0; i < a->fd_count; ++i)
+    {
+        if ((a->tmp_fds[i] = fcntl(a->fd_map[i].first, F_DUPFD_CLOEXEC, a->first_tmp_fd)) == -1)
+        {
+            fail(a, Step::map_fd, i);
+        }
+    }
+    for (size_t i = 0; i < a->fd_count; ++i)
+    {
+        if (dup2(a->tmp_fds[i], a->fd_map[i].second) == -1)
+        {
+            fail(a, Step::map_fd, i);  // LCOV_EXCL_LINE
+        }
+    }
+    if (a->keep_fds)
+    {
+        close_fds_from(3, *a->keep_fds);
+    }
+
+    if (a->working_directory && chdir(a->working_directory) == -1)
+    {
+        fail(a, Step::chdir);
+    }
+    if (a->set_pgid && setpgid(0, a->pgid) == -1)
+    {
+        fail(a, Step::setpgid);
+    }
+    for (size_t i = 0; i < a->rlimit_count; ++i)
+    {
+        if (setrlimit(a->rlimits[i].first, &a->rlimits[i].second) == -1)
+        {
+            fail(a, Step::setrlimit, i);
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, a->mask, nullptr);
+    if (a->search_path)
+    {
+        execvpe(a->argv[0], a->argv, a->envp);
+    }
+    else
+    {
+        execve(a->argv[0], a->argv, a->envp);
+    }
+    fail(a, Step::exec);
+}
+
+void check_env_name(string const& method, string const& name)
+{
+    if (name.empty() || name.find('=') != string::npos)
+    {
+        throw InvalidArgumentException("ProcessSpawner::" + method + "(): invalid variable name: \"" + name + "\"");
+    }
+}
+
+} // namespace
+
+} // namespace internal
+
+ProcessSpawner::ProcessSpawner(vector<string> const& args)
+    : p_(new internal::ProcessSpawnerPrivate)
+{
+    if (args.empty())
+    {
+        throw InvalidArgumentException("ProcessSpawner(): args must not be empty");
+    }
+    p_->args = args;
+}
+
+ProcessSpawner::~ProcessSpawner() = default;
+
+void ProcessSpawner::map_fd(int parent_fd, int child_fd)
+{
+    if (parent_fd < 0 || child_fd < 0)
+    {
+        throw InvalidArgumentException("ProcessSpawner::map_fd(): invalid file descriptor: parent_fd = "
+                                       + to_string(parent_fd) + ", child_fd = " + to_string(child_fd));
+    }
+    for (auto const& m : p_->fd_map)
+    {
+        if (m.second == child_fd)
+        {
+            throw InvalidArgumentException("ProcessSpawner::map_fd(): child_fd " + to_string(child_fd)
+                                           + " is mapped already");
+        }
+    }
+    p_->fd_map.emplace_back(parent_fd, child_fd);
+}
+
+void ProcessSpawner::close_other_fds() noexcept
+{
+    p_->close_other_fds = true;
+}
+
+void ProcessSpawner::clear_env() noexcept
+{
+    p_->clear_env = true;
+}
+
+void ProcessSpawner::set_env(string const& name, string const& value)
+{
+    internal::check_env_name("set_env", name);
+    p_->env_changes[name] = make_pair(true, value);
+}
+
+void ProcessSpawner::unset_env(string const& name)
+{
+    internal::check_env_name("unset_env", name);
+    p_->env_changes[name] = make_pair(false, string());
+}
+
+void ProcessSpawner::set_working_directory(string const& dir)
+{
+    p_->working_directory = dir;
+}
+
+void ProcessSpawner::set_process_group(pid_t pgid)
+{
+    if (pgid < 0)
+    {
+        throw InvalidArgumentException("ProcessSpawner::set_process_group(): invalid process group: "
+                                       + to_string(pgid));
+    }
+    p_->set_pgid = true;
+    p_->pgid = pgid;
+}
+
+void ProcessSpawner::set_rlimit(int resource, rlim_t soft, rlim_t hard)
+{
+    if (resource < 0 || resource >= RLIMIT_NLIMITS || soft > hard)
+    {
+        throw InvalidArgumentException("ProcessSpawner::set_rlimit(): invalid limit for resource "
+                                       + to_string(resource));
+    }
+    struct rlimit limit = { soft, hard };
+    for (auto& l : p_->rlimits)
+    {
+        if (l.first == resource)
+        {
+            l.second = limit;
+            return;
+        }
+    }
+    p_->rlimits.emplace_back(resource, limit);
+}
+
+pid_t ProcessSpawner::spawn() const
+{
+    vector<char*> argv;
+    for (auto const& a : p_->args)
+    {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    vector<string> added_vars;
+    vector<char*> envp;
+    if (!p_->clear_env)
+    {
+        for (char** e = environ; *e; ++e)
+        {
+            char const* eq = strchr(*e, '=');
+            string const name = eq ? string(*e, eq - *e) : string(*e);
+            if (p_->env_changes.find(name) == p_->env_changes.end())
+            {
+                envp.push_back(*e);
+            }
+        }
+    }
+    for (auto const& c : p_->env_changes)
+    {
+        if (c.second.first)
+        {
+            added_vars.push_back(c.first + "=" + c.second.second);
+        }
+    }
+    for (auto& v : added_vars)
+    {
+        envp.push_back(const_cast<char*>(v.c_str()));
+    }
+    envp.push_back(nullptr);
+
+    int first_tmp_fd = 3;
+    vector<int> keep_fds;
+    for (auto const& m : p_->fd_map)
+    {
+        first_tmp_fd = max(first_tmp_fd, m.second + 1);
+        if (m.second > 2)
+        {
+            keep_fds.push_back(m.second);
+        }
+    }
+    sort(keep_fds.begin(), keep_fds.end());
+    vector<int> tmp_fds(p_->fd_map.size());
+
+    internal::ChildArgs args;
+    args.argv = argv.data();
+    args.envp = envp.data();
+    args.search_path = p_->args[0].find('/') == string::npos;
+    args.fd_map = p_->fd_map.data();
+    args.tmp_fds = tmp_fds.data();
+    args.fd_count = p_->fd_map.size();
+    args.first_tmp_fd = first_tmp_fd;
+    args.keep_fds = p_->close_other_fds ? &keep_fds : nullptr;
+    args.working_directory = p_->working_directory.empty() ? nullptr : p_->working_directory.c_str();
+    args.set_pgid = p_->set_pgid;
+    args.pgid = p_->pgid;
+    args.rlimits = p_->rlimits.data();
+    args.rlimit_count = p_->rlimits.size();
+    args.err = 0;
+
+    // The child runs on its own stack. Besides the descriptor scan in close_fds_from(),
+    // execvpe() needs stack space for the path and, for scripts, a copy of argv.
+
+    size_t const page_size = sysconf(_SC_PAGESIZE);
+    size_t const stack_size = (64 * 1024 + argv.size() * sizeof(char*) + page_size - 1) / page_size * page_size;
+    void* stack = mmap(nullptr, stack_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED)
+    {
+        throw SyscallException("ProcessSpawner: cannot allocate stack for child", errno);  // LCOV_EXCL_LINE
+    }
+    util::ResourcePtr<void*, std::function<void(void*)>> stack_ptr(stack, [stack_size](void* p)
+    {
+        munmap(p, stack_size);
+    });
+
+    sigset_t all_signals;
+    sigset_t old_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_mask);
+    args.mask = &old_mask;
+
+    // With CLONE_VFORK, clone() returns only once the child has called exec() or exited.
+
+    pid_t pid = clone(internal::child_main,
+                      static_cast<char*>(stack) + stack_size,
+                      CLONE_VM | CLONE_VFORK | SIGCHLD,
+                      &args);
+    int const clone_err = errno;
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+    if (pid == -1)
+    {
+        throw SyscallException("ProcessSpawner: clone() failed", clone_err);  // LCOV_EXCL_LINE
+    }
+    if (args.err == 0)
+    {
+        return pid;
+    }
+
+    while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR)
+    {
+    }
+    string msg = "ProcessSpawner: ";
+    switch (args.step)
+    {
+        case internal::Step::map_fd:
+        {
+            auto const& m = p_->fd_map[args.index];
+            msg += "cannot map file descriptor " + to_string(m.first) + " to " + to_string(m.second);
+            break;
+        }
+        case internal::Step::chdir:
+        {
+            msg += "cannot change working directory to \"" + p_->working_directory + "\"";
+            break;
+        }
+        case internal::Step::setpgid:
+        {
+            msg += "cannot set process group " + to_string(p_->pgid);
+            break;
+        }
+        case internal::Step::setrlimit:
+        {
+            msg += "cannot set limit for resource " + to_string(p_->rlimits[args.index].first);
+            break;
+        }
+        default:
+        {
+            msg += "cannot execute \"" + p_->args[0] + "\"";
+            break;
+        }
+    }
+    throw SyscallException(msg, args.err);
+}
+
+} // namespace util
+
+} // namespace unity
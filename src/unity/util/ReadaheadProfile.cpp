@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/ReadaheadProfile.h>
+#include <unity/util/FileIO.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+struct ReadaheadProfilePrivate
+{
+    // Offset and end of each range. An end of UINT64_MAX means "to the end of the file".
+    typedef vector<pair<uint64_t, uint64_t>> Extents;
+
+    map<string, Extents> files;
+
+    void merge() noexcept
+    {
+        for (auto& f : files)
+        {
+            auto& extents = f.second;
+            sort(extents.begin(), extents.end());
+            Extents merged;
+            for (auto const& e : extents)
+            {
+                if (!merged.empty() && e.first <= merged.back().second)
+                {
+                    merged.back().second = max(merged.back().second, e.second);
+                }
+                else
+                {
+                    merged.push_back(e);
+                }
+            }
+            extents.swap(merged);
+        }
+    }
+};
+
+} // namespace internal
+
+namespace
+{
+
+uint64_t const to_eof = numeric_limits<uint64_t>::max();
+
+// The profile currently being recorded. The flag lets record() return without locking
+// when recording is not active.
+
+atomic<bool> recording(false);
+mutex recording_mutex;
+unique_ptr<internal::ReadaheadProfilePrivate> current;
+
+// Profile file format (host byte order, because a profile is only useful on the machine that recorded it):
+//
+// magic, version, number of files
+// for each file: path length, path, number of ranges, (offset, end) for each range
+
+char const magic[4] = { 'U', 'R', 'A', 'P' };
+uint32_t const version = 1;
+
+template<typename T>
+void append(string& buf, T val)
+{
+    buf.append(reinterpret_cast<char const*>(&val), sizeof(val));
+}
+
+class Parser
+{
+public:
+    Parser(vector<uint8_t> const& buf, string const& filename)
+        : buf_(buf)
+        , filename_(filename)
+        , pos_(0)
+    {
+    }
+
+    template<typename T>
+    T get()
+    {
+        T val;
+        memcpy(&val, get_bytes(sizeof(val)), sizeof(val));
+        return val;
+    }
+
+    uint8_t const* get_bytes(size_t len)
+    {
+        if (buf_.size() - pos_ < len)
+        {
+            throw FileException("\"" + filename_ + "\" is not a valid readahead profile", 0);
+        }
+        uint8_t const* p = buf_.data() + pos_;
+        pos_ += len;
+        return p;
+    }
+
+private:
+    vector<uint8_t> const& buf_;
+    string const& filename_;
+    size_t pos_;
+};
+
+} // namespace
+
+ReadaheadProfile::ReadaheadProfile()
+    : p_(new internal::ReadaheadProfilePrivate)
+{
+}
+
+ReadaheadProfile::~ReadaheadProfile() noexcept = default;
+
+void ReadaheadProfile::start_recording()
+{
+    lock_guard<mutex> lock(recording_mutex);
+    current.reset(new internal::ReadaheadProfilePrivate);
+    recording = true;
+}
+
+ReadaheadProfile::UPtr ReadaheadProfile::stop_recording()
+{
+    UPtr profile(new ReadaheadProfile);
+
+    lock_guard<mutex> lock(recording_mutex);
+    recording = false;
+    if (current)
+    {
+        profile->p_ = move(current);
+        profile->p_->merge();
+    }
+    return profile;
+}
+
+bool ReadaheadProfile::is_recording() noexcept
+{
+    return recording.load(memory_order_relaxed);
+}
+
+void ReadaheadProfile::record(string const& path, uint64_t offset, uint64_t length) noexcept
+{
+    if (!recording.load(memory_order_relaxed))
+    {
+        return;
+    }
+
+    try
+    {
+        string abs_path = path;
+        if (path.empty() || path[0] != '/')
+        {
+            char* cwd = get_current_dir_name();
+            if (cwd == nullptr)
+            {
+                return;     // LCOV_EXCL_LINE
+            }
+            abs_path = string(cwd) + "/" + path;
+            free(cwd);
+        }
+
+        uint64_t end = length == 0 || length > to_eof - offset ? to_eof : offset + length;
+
+        lock_guard<mutex> lock(recording_mutex);
+        if (current)
+        {
+            current->files[abs_path].emplace_back(offset, end);
+        }
+    }
+    // LCOV_EXCL_START
+    catch (...)
+    {
+        // Failing to record a read is harmless, so we ignore bad_alloc.
+    }
+    // LCOV_EXCL_STOP
+}
+
+ReadaheadProfile::UPtr ReadaheadProfile::load(string const& profile_filename)
+{
+    vector<uint8_t> buf = read_binary_file(profile_filename);
+    Parser parser(buf, profile_filename);
+
+    if (memcmp(parser.get_bytes(sizeof(magic)), magic, sizeof(magic)) != 0 || parser.get<uint32_t>() != version)
+    {
+        throw FileException("\"" + profile_filename + "\" is not a valid readahead profile", 0);
+    }
+
+    UPtr profile(new ReadaheadProfile);
+    uint32_t num_files = parser.get<uint32_t>();
+    for (uint32_t i = 0; i < num_files; ++i)
+    {
+        uint32_t path_len = parser.get<uint32_t>();
+        string path(reinterpret_cast<char const*>(parser.get_bytes(path_len)), path_len);
+        auto& extents = profile->p_->files[path];
+        uint32_t num_extents = parser.get<uint32_t>();
+        for (uint32_t j = 0; j < num_extents; ++j)
+        {
+            uint64_t offset = parser.get<uint64_t>();
+            uint64_t end = parser.get<uint64_t>();
+            extents.emplace_back(offset, end);
+        }
+    }
+    profile->p_->merge();
+    return profile;
+}
+
+void ReadaheadProfile::save(string const& profile_filename) const
+{
+    string buf(magic, sizeof(magic));
+    append(buf, version);
+    append(buf, static_cast<uint32_t>(p_->files.size()));
+    for (auto const& f : p_->files)
+    {
+        append(buf, static_cast<uint32_t>(f.first.size()));
+        buf += f.first;
+        append(buf, static_cast<uint32_t>(f.second.size()));
+        for (auto const& e : f.second)
+        {
+            append(buf, e.first);
+            append(buf, e.second);
+        }
+    }
+
+    // Write to a temporary file, flush it to disk, and rename, so a crash while saving cannot leave
+    // a truncated profile behind.
+
+    string tmp_filename = profile_filename + ".tmp";
+    auto fail = [&tmp_filename](string const& what, int err)
+    {
+        // LCOV_EXCL_START
+        ::unlink(tmp_filename.c_str());
+        throw FileException(what + ": " + strerror(err), err);
+        // LCOV_EXCL_STOP
+    };
+    {
+        util::ResourcePtr<int, std::function<void(int)>> fd(
+            ::open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644),
+            [](int fd) { if (fd != -1) ::close(fd); });
+        if (fd.get() == -1)
+        {
+            throw FileException("cannot open \"" + tmp_filename + "\": " + strerror(errno), errno);
+        }
+        size_t done = 0;
+        while (done < buf.size())
+        {
+            ssize_t n = ::write(fd.get(), buf.data() + done, buf.size() - done);
+            if (n == -1)
+            {
+                // LCOV_EXCL_START
+                int err = errno;
+                if (err == EINTR)
+                {
+                    continue;
+                }
+                fail("cannot write \"" + tmp_filename + "\"", err);
+                // LCOV_EXCL_STOP
+            }
+            done += n;
+        }
+        if (::fsync(fd.get()) == -1)
+        {
+            // LCOV_EXCL_START
+            int err = errno;
+            fail("cannot fsync \"" + tmp_filename + "\"", err);
+            // LCOV_EXCL_STOP
+        }
+        if (::close(fd.release()) == -1)
+        {
+            // LCOV_EXCL_START
+            int err = errno;
+            fail("cannot close \"" + tmp_filename + "\"", err);
+            // LCOV_EXCL_STOP
+        }
+    }
+    if (::rename(tmp_filename.c_str(), profile_filename.c_str()) == -1)
+    {
+        // LCOV_EXCL_START
+        int err = errno;
+        fail("cannot rename \"" + tmp_filename + "\" to \"" + profile_filename + "\"", err);
+        // LCOV_EXCL_STOP
+    }
+}
+
+vector<ReadaheadProfile::Range> ReadaheadProfile::ranges() const
+{
+    vector<Range> ranges;
+    for (auto const& f : p_->files)
+    {
+        for (auto const& e : f.second)
+        {
+            ranges.push_back(Range{ f.first, e.first, e.second == to_eof ? 0 : e.second - e.first });
+        }
+    }
+    return ranges;
+}
+
+size_t ReadaheadProfile::replay(unsigned concurrency) const noexcept
+{
+    try
+    {
+        vector<internal::ReadaheadProfilePrivate::Extents const*> extents;
+        vector<string const*> paths;
+        for (auto const& f : p_->files)
+        {
+            paths.push_back(&f.first);
+            extents.push_back(&f.second);
+        }
+
+        atomic<size_t> next_file(0);
+        atomic<size_t> files_issued(0);
+
+        // Each worker opens the next file and issues the reads for its ranges. posix_fadvise() starts
+        // the I/O without waiting; readahead() then waits for it, so each worker keeps a few
+        // requests in flight without getting too far ahead of the device.
+
+        auto worker = [&]
+        {
+            size_t i;
+            while ((i = next_file.fetch_add(1)) < paths.size())
+            {
+                int fd = ::open(paths[i]->c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1)
+                {
+                    continue;
+                }
+                struct stat st;
+                if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+                {
+                    for (auto const& e : *extents[i])
+                    {
+                        uint64_t end = min<uint64_t>(e.second, st.st_size);
+                        if (e.first < end)
+                        {
+                            posix_fadvise(fd, e.first, end - e.first, POSIX_FADV_WILLNEED);
+                        }
+                    }
+                    for (auto const& e : *extents[i])
+                    {
+                        uint64_t end = min<uint64_t>(e.second, st.st_size);
+                        if (e.first < end)
+                        {
+                            readahead(fd, e.first, end - e.first);
+                        }
+                    }
+                    ++files_issued;
+                }
+                ::close(fd);
+            }
+        };
+
+        if (concurrency == 0)
+        {
+            concurrency = max(thread::hardware_concurrency(), 1u);
+        }
+        concurrency = static_cast<unsigned>(min<size_t>(concurrency, max<size_t>(paths.size(), 1)));
+
+        // The calling thread is one of the workers. If we cannot create as many threads as requested,
+        // for whatever reason, we make do with the ones we have; workers that are already running
+        // must be joined in any case.
+
+        vector<thread> threads;
+        try
+        {
+            threads.reserve(concurrency - 1);
+            for (unsigned i = 1; i < concurrency; ++i)
+            {
+                threads.emplace_back(worker);
+            }
+        }
+        catch (...) // LCOV_EXCL_LINE
+        {
+        }
+        worker();
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        return files_issued;
+    }
+    // LCOV_EXCL_START
+    catch (...)
+    {
+        return 0;
+    }
+    // LCOV_EXCL_STOP
+}
+
+} // namespace util
+
+} // namespace unity
@@ -17,19 +17,29 @@
  */
 
 #include <unity/util/internal/DaemonImpl.h>
-#include <unity/util/ResourcePtr.h>
+#include <unity/util/internal/WorkerSupervisor.h>
+#include <unity/util/CompactResourcePtr.h>
 
-#include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
-#include <vector>
 
 using namespace std;
 
@@ -42,9 +52,287 @@ namespace util
 namespace internal
 {
 
+namespace
+{
+
+// getdents64() has no glibc wrapper on older systems, so we define the record ourselves.
+
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[256];   // Actual length is given by d_reclen
+};
+
+int sys_close_range(unsigned first, unsigned last) noexcept
+{
+#if defined(SYS_close_range)
+    return syscall(SYS_close_range, first, last, 0);
+#else
+    (void)first;
+    (void)last;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Deleter for a descriptor of the previous working directory, which changes back to it before closing it.
+
+struct RestoreWorkingDir
+{
+    void operator()(int fd) const noexcept
+    {
+        int rc __attribute__((unused))
+            = fchdir(fd);
+        close(fd);
+    }
+};
+
+// Parses a /proc/self/fd entry. Returns false for "." and "..".
+
+bool parse_fd(char const* name, int& fd) noexcept
+{
+    if (*name == '\0')
+    {
+        return false;
+    }
+    long n = 0;
+    for (; *name; ++name)
+    {
+        if (*name < '0' || *name > '9' || n > INT_MAX / 10)
+        {
+            return false;
+        }
+        n = n * 10 + (*name - '0');
+    }
+    fd = static_cast<int>(n);
+    return true;
+}
+
+bool must_close(int fd, int first, vector<int> const& keep) noexcept
+{
+    return fd >= first && !binary_search(keep.begin(), keep.end(), fd);
+}
+
+// The daemon reports its status to the original process with a message of this form.
+
+struct ReadyMessage
+{
+    int32_t kind;
+    int32_t value;
+    int32_t setting;        // For setup_failed, the setting that could not be applied
+    int32_t resource;       // For a failed rlimit_setting, the resource
+};
+
+enum MessageKind : int32_t
+{
+    ready = 1,              // Value is the exit status for the original process
+    setup_failed = 2        // Value is the errno of the failed system call
+};
+
+enum SettingKind : int32_t
+{
+    no_setting = 0,
+    rlimit_setting,
+    nice_setting,
+    ioprio_setting,
+    affinity_setting,
+    oom_score_adj_setting,
+    mlockall_setting
+};
+
+// Waits for the daemon's message on fd. A zero timeout waits indefinitely.
+// Returns false if the daemon exits without sending a message, or the timeout expires first.
+
+bool receive_message(int fd, chrono::milliseconds timeout, ReadyMessage& msg) noexcept
+{
+    auto const deadline = chrono::steady_clock::now() + timeout;
+
+    char* const p = reinterpret_cast<char*>(&msg);
+    size_t got = 0;
+    while (got < sizeof(msg))
+    {
+        int poll_timeout = -1;
+        if (timeout.count() > 0)
+        {
+            auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0)
+            {
+                return false;
+            }
+            poll_timeout = static_cast<int>(min<decltype(remaining)>(remaining, INT_MAX));
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int rc = poll(&pfd, 1, poll_timeout);
+        if (rc == -1 && errno != EINTR)
+        {
+            return false;           // LCOV_EXCL_LINE
+        }
+        if (rc <= 0)
+        {
+            continue;
+        }
+        ssize_t n = recv(fd, p + got, sizeof(msg) - got, 0);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;               // LCOV_EXCL_LINE
+        }
+        if (n <= 0)
+        {
+            return false;           // Daemon closed the channel without a message.
+        }
+        got += n;
+    }
+    return true;
+}
+
+void send_message(int fd, MessageKind kind, int value, int setting = no_setting, int resource = 0) noexcept
+{
+    ReadyMessage msg = { kind, value, setting, resource };
+    send(fd, &msg, sizeof(msg), MSG_NOSIGNAL);  // Nothing we can do if this fails.
+}
+
+string rlimit_name(int resource)
+{
+    switch (resource)
+    {
+        case RLIMIT_CORE:
+            return "RLIMIT_CORE";
+        case RLIMIT_MEMLOCK:
+            return "RLIMIT_MEMLOCK";
+        case RLIMIT_NOFILE:
+            return "RLIMIT_NOFILE";
+        default:
+            return to_string(resource);
+    }
+}
+
+// Returns the message for the exception that reports a failed setting.
+
+string setting_error(int setting, int resource)
+{
+    switch (setting)
+    {
+        case rlimit_setting:
+            return "setrlimit(" + rlimit_name(resource) + ") failed";
+        case nice_setting:
+            return "setpriority() failed";
+        case ioprio_setting:
+            return "ioprio_set() failed";
+        case affinity_setting:
+            return "sched_setaffinity() failed";
+        case oom_score_adj_setting:
+            return "cannot set oom_score_adj";
+        default:
+            return "mlockall() failed";
+    }
+}
+
+// Writes adj to /proc/self/oom_score_adj. Formats the value into a buffer on the stack, so it doesn't allocate.
+
+bool write_oom_score_adj(int adj) noexcept
+{
+    char buf[16];
+    char* p = buf + sizeof(buf);
+    unsigned n = adj < 0 ? -static_cast<unsigned>(adj) : adj;
+    do
+    {
+        *--p = '0' + n % 10;
+        n /= 10;
+    }
+    while (n != 0);
+    if (adj < 0)
+    {
+        *--p = '-';
+    }
+    ssize_t const len = buf + sizeof(buf) - p;
+
+    int fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+    bool ok = write(fd, p, len) == len;
+    int err = errno;
+    close(fd);
+    errno = err;
+    return ok;
+}
+
+// Waits for the specified child, so it doesn't remain as a zombie.
+
+void reap(pid_t pid) noexcept
+{
+    while (waitpid(pid, nullptr, 0) == -1 && errno == EINTR)
+    {
+    }
+}
+
+// Sends "READY=1" to the socket named by $NOTIFY_SOCKET, in the same way as sd_notify().
+// A name that starts with '@' refers to the abstract namespace.
+
+void sd_notify_ready() noexcept
+{
+    char const* name = getenv("NOTIFY_SOCKET");
+    if (!name || (name[0] != '/' && name[0] != '@'))
+    {
+        return;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    size_t const len = strlen(name);
+    if (len >= sizeof(addr.sun_path))
+    {
+        return;
+    }
+    memcpy(addr.sun_path, name, len);
+    if (addr.sun_path[0] == '@')
+    {
+        addr.sun_path[0] = '\0';
+    }
+    socklen_t const addr_len = offsetof(struct sockaddr_un, sun_path) + len + (name[0] == '/' ? 1 : 0);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        return;                     // LCOV_EXCL_LINE
+    }
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "READY=1\nMAINPID=%d", static_cast<int>(getpid()));
+    sendto(fd, buf, n, MSG_NOSIGNAL, reinterpret_cast<struct sockaddr*>(&addr), addr_len);
+    close(fd);
+}
+
+} // namespace
+
 DaemonImpl::DaemonImpl()
-    : close_fds_(false), reset_signals_(false), set_umask_(false)
+    : close_fds_(false)
+    , reset_signals_(false)
+    , set_umask_(false)
+    , ready_timeout_(0)
+    , ready_fd_(-1)
+    , set_nice_(false)
+    , nice_(0)
+    , ioprio_(-1)
+    , set_oom_score_adj_(false)
+    , oom_score_adj_(0)
+    , lock_memory_(false)
+    , pin_workers_(false)
+    , restart_delay_(100)
+    , max_restart_delay_(30000)
+{
+}
+
+DaemonImpl::~DaemonImpl()
 {
+    if (ready_fd_ != -1)
+    {
+        close(ready_fd_);
+    }
 }
 
 // LCOV_EXCL_START
@@ -59,6 +347,19 @@ void DaemonImpl::close_fds() noexcept
 
 // LCOV_EXCL_STOP
 
+void DaemonImpl::keep_fd(int fd)
+{
+    if (fd <= 2)
+    {
+        throw InvalidArgumentException("Daemon::keep_fd(): invalid file descriptor: " + to_string(fd));
+    }
+    auto it = lower_bound(keep_fds_.begin(), keep_fds_.end(), fd);
+    if (it == keep_fds_.end() || *it != fd)
+    {
+        keep_fds_.insert(it, fd);
+    }
+}
+
 void DaemonImpl::reset_signals() noexcept
 {
     reset_signals_ = true;
@@ -75,6 +376,15 @@ void DaemonImpl::set_working_directory(string const& working_directory)
     working_directory_ = working_directory;
 }
 
+void DaemonImpl::wait_for_ready(chrono::milliseconds timeout)
+{
+    if (timeout.count() <= 0)
+    {
+        throw InvalidArgumentException("Daemon::wait_for_ready(): timeout must be positive");
+    }
+    ready_timeout_ = timeout;
+}
+
 // Turn this process into a proper daemon in its own session and without a control terminal.
 // Whether to close open file descriptors, reset signals to their defaults, change the umask,
 // or change the working directory is determined by the setters above.
@@ -85,17 +395,7 @@ void DaemonImpl::daemonize_me()
     // fail, we have not modified any other properties of the calling process.
     // We save the current working dir in case we need to restore it if a fork fails.
 
-    ResourcePtr<int, std::function<void(int)>> old_working_dir(
-        [](int fd)
-        {
-            if (fd != -1)
-            {
-                int rc __attribute__((unused))
-                    = fchdir(fd);
-                close(fd);
-            }
-        }
-    );
+    CompactResourcePtr<int, RestoreWorkingDir, ResourceTraits<int, -1>> old_working_dir;
 
     if (!working_directory_.empty())
     {
@@ -108,9 +408,34 @@ void DaemonImpl::daemonize_me()
         }
     }
 
-    // Fork and let the parent exit.
+    // If the original process is to wait until the daemon is ready, we create the channel for the
+    // daemon's status now, so it is inherited across both forks. We use a socket pair rather than a pipe
+    // so the daemon can send with MSG_NOSIGNAL and doesn't get SIGPIPE if the original process has timed out.
+    // Resource limits, scheduling, and OOM settings are applied by the first child, and memory locks by
+    // the daemon, so the calling process is never modified; we need the channel in that case, too, so the
+    // original process can report a failure.
+
+    bool const has_settings = !rlimits_.empty() || set_nice_ || ioprio_ != -1 || !cpus_.empty()
+                              || set_oom_score_adj_ || lock_memory_;
+    UniqueFd ready_read;
+    UniqueFd ready_write;
+    vector<int> keep = keep_fds_;                           // Allocate now, not after forking
+    if (ready_timeout_.count() > 0 || has_settings)
+    {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+        {
+            throw SyscallException("socketpair() failed", errno); // LCOV_EXCL_LINE
+        }
+        ready_read.reset(sv[0]);
+        ready_write.reset(sv[1]);
+        keep.insert(lower_bound(keep.begin(), keep.end(), sv[1]), sv[1]);
+    }
+
+    // Fork and let the parent exit, once the daemon is ready if so requested.
 
-    switch (fork())
+    pid_t const pid = fork();
+    switch (pid)
     {
         case -1:
         {
@@ -122,11 +447,39 @@ void DaemonImpl::daemonize_me()
         }
         case 0:
         {
-            break;                                          // Child process
+            // Child process. Settings applied here are inherited by the daemon.
+
+            int resource = 0;
+            int setting = apply_settings(resource);
+            if (setting != no_setting)
+            {
+                send_message(ready_write.get(), setup_failed, errno, setting, resource);
+                _exit(EXIT_FAILURE);                        // Original process throws.
+            }
+            break;
         }
         default:
         {
-            exit(EXIT_SUCCESS);                             // Parent process, we are done.
+            if (!ready_read.has_resource())
+            {
+                exit(EXIT_SUCCESS);                         // Parent process, we are done.
+            }
+
+            // Parent process, wait for the daemon's status.
+
+            ready_write.dealloc();
+            ReadyMessage msg;
+            if (!receive_message(ready_read.get(), ready_timeout_, msg))
+            {
+                exit(EXIT_FAILURE);
+            }
+            if (msg.kind == setup_failed)
+            {
+                // The first child has exited, or is about to. We continue running, so we reap it.
+                reap(pid);
+                throw SyscallException(setting_error(msg.setting, msg.resource), msg.value);
+            }
+            exit(msg.kind == ready ? msg.value : EXIT_FAILURE);
         }
     }
 
@@ -179,8 +532,25 @@ void DaemonImpl::daemonize_me()
         {
             if (old_working_dir.has_resource())
             {
-                close(old_working_dir.get());                // Reclaim file descriptor straight away
-                old_working_dir.release();                   // Don't restore previous working dir once we are done
+                close(old_working_dir.release());            // Don't restore previous working dir once we are done
+            }
+            if (ready_write.has_resource())
+            {
+                ready_read.dealloc();
+                if (ready_fd_ != -1)
+                {
+                    close(ready_fd_);                        // Left over from a previous daemonize_me()
+                }
+                ready_fd_ = ready_write.release();
+            }
+            if (lock_memory_ && mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+            {
+                send_message(ready_fd_, setup_failed, errno, mlockall_setting);
+                _exit(EXIT_FAILURE);                         // Original process throws.
+            }
+            if (has_settings && ready_timeout_.count() == 0)
+            {
+                notify_parent(EXIT_SUCCESS);                 // Original process isn't waiting for notify_ready().
             }
             break;                                           // Child process
         }
@@ -214,7 +584,7 @@ void DaemonImpl::daemonize_me()
     // Close standard descriptors plus, if the caller asked for that, all others, and
     // connect the standard file descriptors to /dev/null.
 
-    close_open_files();
+    close_open_files(keep);
 
     int fd = open("/dev/null", O_RDWR);
     assert(fd == 0);
@@ -224,11 +594,177 @@ void DaemonImpl::daemonize_me()
     assert(fd == 2);
 }
 
+// Applies the resource limits, scheduling, and OOM settings to the calling process. This runs in the first
+// child after fork(), so the original process is never modified, and it doesn't allocate because the original
+// process may have had other threads. Returns no_setting on success. Otherwise, returns the setting that failed,
+// with errno set, and sets resource for a failed rlimit.
+
+int DaemonImpl::apply_settings(int& resource) const noexcept
+{
+    for (auto const& l : rlimits_)
+    {
+        if (setrlimit(l.first, &l.second) == -1)
+        {
+            resource = l.first;
+            return rlimit_setting;
+        }
+    }
+    if (set_nice_ && setpriority(PRIO_PROCESS, 0, nice_) == -1)
+    {
+        return nice_setting;
+    }
+    int const who_process = 1;  // IOPRIO_WHO_PROCESS, glibc has no header for this.
+    if (ioprio_ != -1 && syscall(SYS_ioprio_set, who_process, 0, ioprio_) == -1)
+    {
+        return ioprio_setting;
+    }
+    if (!cpus_.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus_)
+        {
+            CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        {
+            return affinity_setting;
+        }
+    }
+    if (set_oom_score_adj_ && !write_oom_score_adj(oom_score_adj_))
+    {
+        return oom_score_adj_setting;
+    }
+    return no_setting;
+}
+
+void DaemonImpl::notify_parent(int status) noexcept
+{
+    if (ready_fd_ != -1)
+    {
+        send_message(ready_fd_, ready, status);
+        close(ready_fd_);
+        ready_fd_ = -1;
+    }
+}
+
+// Report the daemon's status to the original process (if it is waiting) and to the service manager.
+// The original process exits with the status as soon as it receives it.
+
+void DaemonImpl::notify_ready(int status) noexcept
+{
+    notify_parent(status);
+    if (status == EXIT_SUCCESS)
+    {
+        sd_notify_ready();
+    }
+}
+
+void DaemonImpl::set_rlimit(int resource, rlim_t soft, rlim_t hard)
+{
+    if (resource < 0 || resource >= RLIMIT_NLIMITS || soft > hard)
+    {
+        throw InvalidArgumentException("Daemon::set_rlimit(): invalid limit for resource " + to_string(resource));
+    }
+    struct rlimit limit = { soft, hard };
+    for (auto& l : rlimits_)
+    {
+        if (l.first == resource)
+        {
+            l.second = limit;
+            return;
+        }
+    }
+    rlimits_.emplace_back(resource, limit);
+}
+
+void DaemonImpl::set_nice(int nice)
+{
+    if (nice < -20 || nice > 19)
+    {
+        throw InvalidArgumentException("Daemon::set_nice(): invalid nice value: " + to_string(nice));
+    }
+    set_nice_ = true;
+    nice_ = nice;
+}
+
+void DaemonImpl::set_io_priority(int io_class, int level)
+{
+    int const class_shift = 13;     // IOPRIO_CLASS_SHIFT
+    int const idle_class = 3;       // IOPRIO_CLASS_IDLE
+    if (io_class < 1 || io_class > idle_class || level < 0 || level > 7)
+    {
+        throw InvalidArgumentException("Daemon::set_io_priority(): invalid I/O priority: class = "
+                                       + to_string(io_class) + ", level = " + to_string(level));
+    }
+    ioprio_ = (io_class << class_shift) | (io_class == idle_class ? 0 : level);
+}
+
+void DaemonImpl::set_cpu_affinity(vector<int> const& cpus)
+{
+    if (cpus.empty())
+    {
+        throw InvalidArgumentException("Daemon::set_cpu_affinity(): CPU set must not be empty");
+    }
+    for (auto cpu : cpus)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            throw InvalidArgumentException("Daemon::set_cpu_affinity(): invalid CPU: " + to_string(cpu));
+        }
+    }
+    cpus_ = cpus;
+}
+
+void DaemonImpl::set_oom_score_adj(int adj)
+{
+    if (adj < -1000 || adj > 1000)
+    {
+        throw InvalidArgumentException("Daemon::set_oom_score_adj(): invalid value: " + to_string(adj));
+    }
+    set_oom_score_adj_ = true;
+    oom_score_adj_ = adj;
+}
+
+void DaemonImpl::lock_memory() noexcept
+{
+    lock_memory_ = true;
+}
+
+void DaemonImpl::pin_workers() noexcept
+{
+    pin_workers_ = true;
+}
+
+void DaemonImpl::set_restart_delay(chrono::milliseconds initial, chrono::milliseconds max)
+{
+    if (initial.count() <= 0 || max < initial)
+    {
+        throw InvalidArgumentException("Daemon::set_restart_delay(): invalid delay: initial = "
+                                       + to_string(initial.count()) + " ms, max = " + to_string(max.count()) + " ms");
+    }
+    restart_delay_ = initial;
+    max_restart_delay_ = max;
+}
+
+void DaemonImpl::run_workers(unsigned count, function<int(unsigned)> const& worker)
+{
+    if (count == 0)
+    {
+        throw InvalidArgumentException("Daemon::run_workers(): count must be greater than zero");
+    }
+    if (!worker)
+    {
+        throw InvalidArgumentException("Daemon::run_workers(): worker function must not be empty");
+    }
+    WorkerSupervisor(count, worker, pin_workers_, restart_delay_, max_restart_delay_).run();
+}
+
 // Close all open file descriptors
 
-void DaemonImpl::close_open_files() noexcept
+void DaemonImpl::close_open_files(vector<int> const& keep) noexcept
 {
-    // We close the standard file descriptors first. This allows opendir() to work if we need to close
+    // We close the standard file descriptors first. This allows us to open /proc/self/fd if we need to close
     // other files and are at the descriptor limit already.
 
     close(0);
@@ -238,45 +774,108 @@ void DaemonImpl::close_open_files() noexcept
     // LCOV_EXCL_START  // Closing file descriptors interferes with coverage reporting
     if (close_fds_)
     {
-        // Close all open files. We use /proc to figure out what files are open.
-        // That's more efficient than calling close() potentially tens of thousands of times,
-        // once for each possible descriptor up to the process limit.
+        close_fds_from(3, keep);
+    }
+    // LCOV_EXCL_STOP
+}
+
+// LCOV_EXCL_START  // Closing file descriptors interferes with coverage reporting
 
-        char const* proc_self_fd = "/proc/self/fd";
+void close_fds_from(int first, vector<int> const& keep) noexcept
+{
+    // With close_range(), each run of descriptors between the ones to keep takes a single system call,
+    // no matter how many descriptors are open.
 
-        DIR* dirp;
-        if ((dirp = opendir(proc_self_fd)) == nullptr)
+    unsigned lo = first;
+    bool ok = true;
+    for (auto fd : keep)
+    {
+        if (fd < first)
+        {
+            continue;
+        }
+        if (static_cast<unsigned>(fd) > lo && sys_close_range(lo, fd - 1) == -1)
         {
-            return;     // This should never happen but, for diligence, we handle it anyway.
+            ok = false;
+            break;
         }
-        ResourcePtr<DIR*, decltype(&closedir)> dir(dirp, closedir);
+        lo = fd + 1;
+    }
+    if (ok && sys_close_range(lo, ~0U) == 0)
+    {
+        return;
+    }
 
-        vector<int> descriptors; // We collect the file descriptors to close here
+    // The kernel does not have close_range() (added in Linux 5.9). If /proc isn't mounted either,
+    // we have no choice but to try every possible descriptor.
 
-        struct dirent* result_p;
-        while ((result_p = readdir(dir.get())) != nullptr)
+    if (!close_fds_by_scan(first, keep))
+    {
+        struct rlimit rl;
+        int max_fd = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+                         ? static_cast<int>(min<rlim_t>(rl.rlim_cur, INT_MAX))
+                         : 65536;
+        for (int fd = first; fd < max_fd; ++fd)
         {
-            // Try to treat the file name as a number. If it doesn't look like a number, we are looking at "." or ".." or,
-            // otherwise, something is seriously wrong because /proc/self/fd is supposed to contain only open file
-            // descriptor numbers. Rather than giving up in that case, we keep going, closing as many file descriptors as we can.
-            size_t pos;
-            int fd = std::stoi(result_p->d_name, &pos);
-            if (result_p->d_name[pos] == '\0')              // The file name did parse as a number
+            if (must_close(fd, first, keep))
             {
-                // We can't call close() here because that would modify the directory while we are iterating
-                // over it, which has undefined behavior.
-                descriptors.push_back(fd);
+                close(fd);
             }
         }
+    }
+}
 
-        for (auto fd : descriptors)
+bool close_fds_by_scan(int first, vector<int> const& keep) noexcept
+{
+    int dir_fd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+    {
+        return false;
+    }
+
+    // We read the directory with getdents64() into a buffer on the stack, so we don't allocate.
+    // Closing descriptors while we read the directory may cause entries to be skipped, so we
+    // rewind and read it again until a pass finds nothing left to close.
+
+    union
+    {
+        linux_dirent64 align;
+        char buf[8192];
+    } u;
+
+    bool closed_any;
+    do
+    {
+        closed_any = false;
+        long n;
+        while ((n = syscall(SYS_getdents64, dir_fd, u.buf, sizeof(u.buf))) > 0)
         {
-            close(fd);
+            for (long pos = 0; pos < n; )
+            {
+                auto const d = reinterpret_cast<linux_dirent64 const*>(&u.buf[pos]);
+                pos += d->d_reclen;
+
+                int fd;
+                if (parse_fd(d->d_name, fd) && fd != dir_fd && must_close(fd, first, keep))
+                {
+                    close(fd);
+                    closed_any = true;
+                }
+            }
+        }
+        if (closed_any)
+        {
+            lseek(dir_fd, 0, SEEK_SET);
         }
     }
-    // LCOV_EXCL_STOP
+    while (closed_any);
+
+    close(dir_fd);
+    return true;
 }
 
+// LCOV_EXCL_STOP
+
 } // namespace internal
 
 } // namespace util
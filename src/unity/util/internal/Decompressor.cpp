@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/internal/Decompressor.h>
+#include <unity/util/ReadaheadProfile.h>
+#include <unity/util/CompactResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+namespace
+{
+
+uint8_t const gzip_magic[] = { 0x1f, 0x8b };
+uint8_t const zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+// zlib counts in uInt, so we hand it at most this much input or output at a time.
+size_t const max_zlib_chunk = 1 << 30;
+
+// Upper bound for size_hint(), so a corrupt header cannot make the caller allocate a huge buffer up-front.
+uint64_t const max_size_hint = 1 << 30;
+
+bool has_magic(uint8_t const* data, size_t size, uint8_t const* magic, size_t magic_size)
+{
+    return size >= magic_size && memcmp(data, magic, magic_size) == 0;
+}
+
+} // namespace
+
+struct DecompressorPrivate
+{
+    string filename;
+    Decompressor::Format format = Decompressor::Format::plain;
+    uint8_t const* data = nullptr;      // Mapped file contents
+    size_t size = 0;
+    size_t pos = 0;                     // Input consumed so far (plain and zstd)
+    bool eof = false;
+
+    z_stream zs;
+    bool zs_initialized = false;
+    ZSTD_DStream* zds = nullptr;
+
+    ~DecompressorPrivate()
+    {
+        if (zs_initialized)
+        {
+            inflateEnd(&zs);
+        }
+        if (zds)
+        {
+            ZSTD_freeDStream(zds);
+        }
+        if (data)
+        {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+
+    void throw_error(string const& msg)
+    {
+        throw FileException("cannot decompress \"" + filename + "\": " + msg, 0);
+    }
+
+    size_t read_plain(char* buf, size_t len);
+    size_t read_gzip(char* buf, size_t len);
+    size_t read_zstd(char* buf, size_t len);
+};
+
+size_t DecompressorPrivate::read_plain(char* buf, size_t len)
+{
+    size_t n = min(len, size - pos);
+    memcpy(buf, data + pos, n);
+    pos += n;
+    return n;
+}
+
+size_t DecompressorPrivate::read_gzip(char* buf, size_t len)
+{
+    zs.next_out = reinterpret_cast<Bytef*>(buf);
+    zs.avail_out = static_cast<uInt>(min(len, max_zlib_chunk));
+    while (zs.avail_out > 0 && !eof)
+    {
+        size_t consumed = zs.next_in - data;
+        if (zs.avail_in == 0)
+        {
+            if (consumed == size)
+            {
+                throw_error("unexpected end of compressed data");
+            }
+            zs.avail_in = static_cast<uInt>(min(size - consumed, max_zlib_chunk));
+        }
+
+        int rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END)
+        {
+            // gzip allows several members to be concatenated. Anything else after the end
+            // of a member (such as padding) is ignored, the same way gunzip does it.
+            consumed = zs.next_in - data;
+            if (has_magic(data + consumed, size - consumed, gzip_magic, sizeof(gzip_magic)))
+            {
+                inflateReset(&zs);
+            }
+            else
+            {
+                eof = true;
+            }
+        }
+        else if (rc != Z_OK && !(rc == Z_BUF_ERROR && zs.avail_in == 0))
+        {
+            throw_error(zs.msg ? zs.msg : "inflate() failed: " + to_string(rc));
+        }
+    }
+    return min(len, max_zlib_chunk) - zs.avail_out;
+}
+
+size_t DecompressorPrivate::read_zstd(char* buf, size_t len)
+{
+    ZSTD_inBuffer in = { data, size, pos };
+    ZSTD_outBuffer out = { buf, len, 0 };
+    while (out.pos < out.size && !eof)
+    {
+        size_t rc = ZSTD_decompressStream(zds, &out, &in);
+        if (ZSTD_isError(rc))
+        {
+            throw_error(ZSTD_getErrorName(rc));
+        }
+        if (in.pos == in.size)
+        {
+            if (rc == 0)
+            {
+                eof = true;     // All frames are complete and there is no more input.
+            }
+            else if (out.pos < out.size)
+            {
+                // The decoder stops short of filling the output only if it needs more input.
+                throw_error("unexpected end of compressed data");
+            }
+        }
+    }
+    pos = in.pos;
+    return out.pos;
+}
+
+Decompressor::Decompressor(string const& filename)
+    : p_(new DecompressorPrivate)
+{
+    p_->filename = filename;
+
+    util::UniqueFd fd(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd)
+    {
+        int const err = errno;
+        throw FileException("cannot open \"" + filename + "\": " + strerror(err), err);
+    }
+
+    struct stat st;
+    if (fstat(fd.get(), &st) == -1)
+    {
+        throw FileException("cannot fstat \"" + filename + "\": " + strerror(errno), errno); // LCOV_EXCL_LINE
+    }
+
+    if (!S_ISREG(st.st_mode))
+    {
+        throw FileException("\"" + filename + "\" is not a regular file", 0);
+    }
+
+    ReadaheadProfile::record(filename, 0, st.st_size);
+
+    if (st.st_size == 0)
+    {
+        p_->eof = true;
+        return;
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd.get(), 0);
+    if (addr == MAP_FAILED)
+    {
+        throw FileException("cannot mmap \"" + filename + "\": " + strerror(errno), errno); // LCOV_EXCL_LINE
+    }
+    p_->data = static_cast<uint8_t const*>(addr);
+    p_->size = st.st_size;
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+    if (has_magic(p_->data, p_->size, gzip_magic, sizeof(gzip_magic)))
+    {
+        p_->format = Format::gzip;
+        memset(&p_->zs, 0, sizeof(p_->zs));
+        p_->zs.next_in = const_cast<Bytef*>(p_->data);
+        if (inflateInit2(&p_->zs, 16 + MAX_WBITS) != Z_OK)  // 16: expect a gzip header
+        {
+            throw ResourceException("cannot initialize zlib"); // LCOV_EXCL_LINE
+        }
+        p_->zs_initialized = true;
+    }
+    else if (has_magic(p_->data, p_->size, zstd_magic, sizeof(zstd_magic)))
+    {
+        p_->format = Format::zstd;
+        p_->zds = ZSTD_createDStream();
+        if (!p_->zds || ZSTD_isError(ZSTD_initDStream(p_->zds)))
+        {
+            throw ResourceException("cannot initialize zstd"); // LCOV_EXCL_LINE
+        }
+    }
+}
+
+Decompressor::~Decompressor() noexcept = default;
+
+Decompressor::Format Decompressor::format() const noexcept
+{
+    return p_->format;
+}
+
+uint64_t Decompressor::size_hint() const noexcept
+{
+    uint64_t hint = 0;
+    switch (p_->format)
+    {
+        case Format::plain:
+        {
+            hint = p_->size;
+            break;
+        }
+        case Format::gzip:
+        {
+            // The gzip trailer stores the uncompressed size modulo 2^32 in the last four bytes, little-endian.
+            if (p_->size >= 18)
+            {
+                uint8_t const* t = p_->data + p_->size - 4;
+                hint = uint32_t(t[0]) | uint32_t(t[1]) << 8 | uint32_t(t[2]) << 16 | uint32_t(t[3]) << 24;
+            }
+            break;
+        }
+        case Format::zstd:
+        {
+            unsigned long long s = ZSTD_getFrameContentSize(p_->data, p_->size);
+            if (s != ZSTD_CONTENTSIZE_UNKNOWN && s != ZSTD_CONTENTSIZE_ERROR)
+            {
+                hint = s;
+            }
+            break;
+        }
+    }
+    return min(hint, max_size_hint);
+}
+
+size_t Decompressor::read(char* buf, size_t len)
+{
+    if (p_->eof || len == 0)
+    {
+        return 0;
+    }
+    switch (p_->format)
+    {
+        case Format::gzip:
+        {
+            return p_->read_gzip(buf, len);
+        }
+        case Format::zstd:
+        {
+            return p_->read_zstd(buf, len);
+        }
+        default:
+        {
+            return p_->read_plain(buf, len);
+        }
+    }
+}
+
+} // namespace internal
+
+} // namespace util
+
+} // namespace unity
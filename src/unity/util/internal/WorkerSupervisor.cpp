@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/internal/WorkerSupervisor.h>
+#include <unity/util/CompactResourcePtr.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+namespace unity
+{
+
+namespace util
+{
+
+namespace internal
+{
+
+namespace
+{
+
+// Workers that don't exit within this time after SIGTERM are killed.
+
+chrono::milliseconds const kill_timeout(10000);
+
+} // namespace
+
+WorkerSupervisor::WorkerSupervisor(unsigned count,
+                                   WorkerFunction const& func,
+                                   bool pin,
+                                   chrono::milliseconds min_delay,
+                                   chrono::milliseconds max_delay)
+    : func_(func)
+    , pin_(pin)
+    , min_delay_(min_delay)
+    , max_delay_(max_delay)
+    , workers_(count)
+    , signal_fd_(-1)
+    , stopping_(false)
+{
+    assert(count > 0);
+    assert(func);
+
+    if (pin_)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus_.push_back(cpu);
+                }
+            }
+        }
+    }
+}
+
+void WorkerSupervisor::run()
+{
+    // We block the signals we are interested in, so they are delivered only via the signalfd.
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask_);
+    ResourcePtr<sigset_t*, std::function<void(sigset_t*)>> restore_mask(
+        &old_mask_, [](sigset_t* m) { sigprocmask(SIG_SETMASK, m, nullptr); });
+
+    UniqueFd sfd(signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC));
+    if (!sfd)
+    {
+        throw SyscallException("signalfd() failed", errno);  // LCOV_EXCL_LINE
+    }
+    signal_fd_ = sfd.get();
+
+    for (unsigned i = 0; i < workers_.size(); ++i)
+    {
+        start(i);
+    }
+
+    Clock::time_point kill_at;
+    for (;;)
+    {
+        bool any_running = false;
+        bool any_pending = false;
+        auto next = Clock::time_point::max();
+        for (auto const& w : workers_)
+        {
+            if (w.pid != -1)
+            {
+                any_running = true;
+            }
+            else if (!w.done && !stopping_)
+            {
+                any_pending = true;
+                next = min(next, w.restart_at);
+            }
+        }
+        if (!any_running && !any_pending)
+        {
+            break;
+        }
+        if (stopping_)
+        {
+            next = kill_at;
+        }
+
+        int timeout = -1;
+        if (next != Clock::time_point::max())
+        {
+            auto ms = chrono::duration_cast<chrono::milliseconds>(next - Clock::now()).count();
+            timeout = static_cast<int>(max<decltype(ms)>(0, min<decltype(ms)>(ms + 1, 60000)));
+        }
+        struct pollfd pfd = { signal_fd_, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout) == -1 && errno != EINTR)
+        {
+            throw SyscallException("poll() failed", errno);  // LCOV_EXCL_LINE
+        }
+
+        struct signalfd_siginfo si;
+        while (read(signal_fd_, &si, sizeof(si)) == sizeof(si))
+        {
+            if (si.ssi_signo == SIGCHLD)
+            {
+                reap();
+            }
+            else if (!stopping_)
+            {
+                stopping_ = true;
+                kill_at = Clock::now() + kill_timeout;
+                stop(SIGTERM);
+            }
+        }
+        reap();     // SIGCHLD signals can be merged, so we always check.
+
+        auto const now = Clock::now();
+        if (stopping_)
+        {
+            if (now >= kill_at)
+            {
+                // LCOV_EXCL_START
+                // SIGKILL is sent only once; after that, we wait for SIGCHLD without a timeout.
+                stop(SIGKILL);
+                kill_at = Clock::time_point::max();
+                // LCOV_EXCL_STOP
+            }
+            continue;
+        }
+        for (unsigned i = 0; i < workers_.size(); ++i)
+        {
+            auto const& w = workers_[i];
+            if (w.pid == -1 && !w.done && w.restart_at <= now)
+            {
+                start(i);
+            }
+        }
+    }
+    signal_fd_ = -1;
+}
+
+// Fork a worker. If the fork fails, we try again later, as if the worker had failed.
+
+void WorkerSupervisor::start(unsigned index)
+{
+    Worker& w = workers_[index];
+    w.started = Clock::now();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        // LCOV_EXCL_START
+        ++w.failures;
+        w.restart_at = w.started + restart_delay(w.failures);
+        return;
+        // LCOV_EXCL_STOP
+    }
+    if (pid != 0)
+    {
+        w.pid = pid;
+        return;
+    }
+
+    // Worker process. It gets the signal mask the supervisor was called with,
+    // so SIGTERM terminates it unless the worker function decides otherwise.
+
+    close(signal_fd_);
+    sigprocmask(SIG_SETMASK, &old_mask_, nullptr);
+    if (pin_ && !cpus_.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus_[index % cpus_.size()], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    int status = EXIT_FAILURE;
+    try
+    {
+        status = func_(index);
+    }
+    catch (...)
+    {
+    }
+    fflush(nullptr);
+    _exit(status);  // Don't run the parent's atexit handlers and static destructors.
+}
+
+void WorkerSupervisor::reap()
+{
+    for (auto& w : workers_)
+    {
+        if (w.pid == -1)
+        {
+            continue;
+        }
+        int status;
+        pid_t pid = waitpid(w.pid, &status, WNOHANG);
+        if (pid != w.pid)
+        {
+            continue;
+        }
+        w.pid = -1;
+        if (stopping_)
+        {
+            continue;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            w.done = true;
+            continue;
+        }
+
+        // A worker that ran for longer than the maximum delay is considered to have been healthy,
+        // so its failure count starts again from the beginning.
+
+        auto const now = Clock::now();
+        if (now - w.started > max_delay_)
+        {
+            w.failures = 0;
+        }
+        ++w.failures;
+        w.restart_at = now + restart_delay(w.failures);
+    }
+}
+
+void WorkerSupervisor::stop(int sig) noexcept
+{
+    for (auto const& w : workers_)
+    {
+        if (w.pid != -1)
+        {
+            kill(w.pid, sig);
+        }
+    }
+}
+
+chrono::milliseconds WorkerSupervisor::restart_delay(unsigned failures) const noexcept
+{
+    auto delay = min_delay_;
+    for (unsigned i = 1; i < failures && delay < max_delay_; ++i)
+    {
+        delay *= 2;
+    }
+    return min(delay, max_delay_);
+}
+
+} // namespace internal
+
+} // namespace util
+
+} // namespace unity
@@ -20,6 +20,11 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
 using namespace std;
 using namespace unity;
 
@@ -394,6 +399,171 @@ TEST(Exception, history)
     }
 }
 
+//
+// Check that what() is formatted once and that the history is not rethrown each time it is formatted.
+//
+
+TEST(Exception, cached_what)
+{
+    try
+    {
+        c();
+    }
+    catch (Exception const& e)
+    {
+        char const* w = e.what();
+        EXPECT_EQ(w, e.what());
+        EXPECT_EQ(e.to_string(), w);
+
+        // Copies share the string.
+        InvalidArgumentException copy(dynamic_cast<InvalidArgumentException const&>(e));
+        EXPECT_EQ(w, copy.what());
+    }
+
+    // Concurrent calls return the same string.
+    {
+        InvalidArgumentException e("concurrent");
+        vector<char const*> results(8);
+        vector<thread> threads;
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            threads.emplace_back([&e, &results, i]{ results[i] = e.what(); });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        for (auto r : results)
+        {
+            EXPECT_EQ(results[0], r);
+        }
+        EXPECT_STREQ("unity::InvalidArgumentException: concurrent", results[0]);
+    }
+
+    // Changing the history changes what().
+    {
+        InvalidArgumentException e("Step 2");
+        EXPECT_STREQ("unity::InvalidArgumentException: Step 2", e.what());
+        e.remember(make_exception_ptr(InvalidArgumentException("Step 1")));
+        EXPECT_STREQ("unity::InvalidArgumentException: Step 2\n"
+                     "    Exception history:\n"
+                     "        Exception #1:\n"
+                     "            unity::InvalidArgumentException: Step 1", e.what());
+    }
+}
+
+struct Counted : public std::exception
+{
+    char const* what() const noexcept override
+    {
+        ++count;
+        return "Counted";
+    }
+
+    static int count;
+};
+
+int Counted::count = 0;
+
+TEST(Exception, history_resolved_once)
+{
+    exception_ptr ep;
+    try
+    {
+        try
+        {
+            throw Counted();
+        }
+        catch (...)
+        {
+            throw LogicException("nested");
+        }
+    }
+    catch (Exception& e)
+    {
+        ep = e.remember(nullptr);
+    }
+
+    ShutdownException e("shutdown");
+    e.remember(ep);
+    string expected = "unity::ShutdownException: shutdown\n"
+                      "    Exception history:\n"
+                      "        Exception #1:\n"
+                      "            unity::LogicException: nested:\n"
+                      "                Counted";
+    EXPECT_EQ(expected, e.to_string());
+    EXPECT_EQ(1, Counted::count);
+    EXPECT_EQ(expected, e.to_string());
+    EXPECT_STREQ(expected.c_str(), e.what());
+    EXPECT_EQ(1, Counted::count);
+
+    // A later exception that remembers this one reuses the resolved history.
+    ShutdownException e2("again");
+    e2.remember(make_exception_ptr(e));
+    e2.to_string();
+    EXPECT_EQ(1, Counted::count);
+
+    // Exceptions that are not unity exceptions are shown with what().
+    LogicException e3("logic");
+    e3.remember(make_exception_ptr(Counted()));
+    EXPECT_EQ("unity::LogicException: logic\n"
+              "    Exception history:\n"
+              "        Exception #1:\n"
+              "            Counted", e3.to_string());
+}
+
+// Measures formatting an exception that nests a chain of ten exceptions.
+
+void throw_nested(int depth)
+{
+    try
+    {
+        if (depth > 1)
+        {
+            throw_nested(depth - 1);
+        }
+        throw bad_alloc();
+    }
+    catch (...)
+    {
+        throw InvalidArgumentException("depth " + to_string(depth));
+    }
+}
+
+TEST(Exception, DISABLED_benchmark_to_string)
+{
+    int const iterations = 100000;
+
+    try
+    {
+        throw_nested(10);
+    }
+    catch (Exception const& e)
+    {
+        auto start = chrono::steady_clock::now();
+        string first = e.to_string();
+        chrono::duration<double, micro> first_time = chrono::steady_clock::now() - start;
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            ASSERT_EQ(first.size(), e.to_string().size());
+        }
+        chrono::duration<double, micro> to_string_time = chrono::steady_clock::now() - start;
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            ASSERT_NE(nullptr, e.what());
+        }
+        chrono::duration<double, micro> what_time = chrono::steady_clock::now() - start;
+
+        cout << "first to_string(): " << first_time.count() << " us" << endl;
+        cout << "to_string():       " << to_string_time.count() / iterations << " us" << endl;
+        cout << "what():            " << what_time.count() / iterations << " us" << endl;
+    }
+}
+
 //
 // Tests for the state of concrete derived exceptions follow.
 //
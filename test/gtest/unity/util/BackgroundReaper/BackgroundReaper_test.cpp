@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/BackgroundReaper.h>
+#include <unity/util/ResourcePtr.h>
+#include <unity/UnityExceptions.h>
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+bool is_open(int fd)
+{
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+} // namespace
+
+TEST(BackgroundReaper, basic)
+{
+    auto reaper = make_shared<BackgroundReaper>();
+    auto s = reaper->stats();
+    EXPECT_EQ(0u, s.queue_depth);
+    EXPECT_EQ(0u, s.completed);
+
+    thread::id deleter_thread;
+    reaper->defer([&deleter_thread]{ deleter_thread = this_thread::get_id(); });
+    reaper->flush();
+    EXPECT_NE(thread::id(), deleter_thread);
+    EXPECT_NE(this_thread::get_id(), deleter_thread);
+
+    s = reaper->stats();
+    EXPECT_EQ(0u, s.queue_depth);
+    EXPECT_EQ(1u, s.max_queue_depth);
+    EXPECT_EQ(1u, s.completed);
+    EXPECT_EQ(0u, s.failed);
+}
+
+TEST(BackgroundReaper, order)
+{
+    vector<int> order;
+    {
+        BackgroundReaper reaper;
+        for (int i = 0; i < 1000; ++i)
+        {
+            reaper.defer([&order, i]{ order.push_back(i); });
+        }
+    }   // Destructor runs the remaining deleters.
+    ASSERT_EQ(1000u, order.size());
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST(BackgroundReaper, stats)
+{
+    BackgroundReaper reaper;
+
+    // Block the reaper, so the queue fills up.
+    mutex m;
+    m.lock();
+    reaper.defer([&m]{ lock_guard<mutex> lock(m); });
+    for (int i = 0; i < 9; ++i)
+    {
+        reaper.defer([]{ this_thread::sleep_for(chrono::milliseconds(1)); });
+    }
+    reaper.defer([]{ throw 42; });
+    EXPECT_EQ(11u, reaper.stats().queue_depth);
+    m.unlock();
+    reaper.flush();
+
+    auto s = reaper.stats();
+    EXPECT_EQ(0u, s.queue_depth);
+    EXPECT_EQ(11u, s.max_queue_depth);
+    EXPECT_EQ(11u, s.completed);
+    EXPECT_EQ(1u, s.failed);
+    EXPECT_GE(s.total_delete_time, chrono::milliseconds(9));
+    EXPECT_GE(s.max_delete_time, chrono::milliseconds(1));
+    EXPECT_LE(s.max_delete_time, s.total_delete_time);
+}
+
+TEST(BackgroundReaper, flush_from_deleter)
+{
+    BackgroundReaper reaper;
+    bool thrown = false;
+    reaper.defer([&]
+    {
+        try
+        {
+            reaper.flush();
+        }
+        catch (LogicException const& e)
+        {
+            EXPECT_STREQ("unity::LogicException: BackgroundReaper::flush(): cannot be called from a deleter", e.what());
+            thrown = true;
+        }
+    });
+    reaper.flush();
+    EXPECT_TRUE(thrown);
+}
+
+TEST(BackgroundReaper, last_reference_in_deleter)
+{
+    // The first deleter holds the last reference to the reaper, so the reaper is destroyed on its own thread.
+    // The deleter queued after it must still run.
+
+    promise<thread::id> done;
+    auto f = done.get_future();
+    {
+        auto reaper = make_shared<BackgroundReaper>();
+        mutex m;
+        m.lock();
+        reaper->defer([&m]{ lock_guard<mutex> lock(m); });   // Keeps the reaper busy until we have let go.
+        reaper->defer([reaper]{});
+        reaper->defer([&done]{ done.set_value(this_thread::get_id()); });
+        reaper.reset();
+        m.unlock();
+    }
+    ASSERT_EQ(future_status::ready, f.wait_for(chrono::seconds(5)));
+    EXPECT_NE(this_thread::get_id(), f.get());
+}
+
+TEST(BackgroundReaper, threads)
+{
+    BackgroundReaper reaper;
+    atomic<int> count{ 0 };
+
+    int const thread_count = 8;
+    int const iterations = 10000;
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            for (int i = 0; i < iterations; ++i)
+            {
+                reaper.defer([&count]{ ++count; });
+                if (i % 1000 == 0)
+                {
+                    reaper.flush();
+                }
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    reaper.flush();
+    EXPECT_EQ(thread_count * iterations, count);
+    EXPECT_EQ(uint64_t(thread_count * iterations), reaper.stats().completed);
+}
+
+TEST(DeferredDeleter, resource_ptr)
+{
+    auto reaper = make_shared<BackgroundReaper>();
+    int raw;
+    {
+        ResourcePtr<int, DeferredDeleter<decltype(&::close)>> fd(::open("/dev/null", O_RDONLY | O_CLOEXEC),
+                                                                 make_deferred_deleter(reaper, ::close));
+        raw = fd.get();
+        EXPECT_EQ(reaper, fd.get_deleter().reaper());
+    }
+    reaper->flush();
+    EXPECT_FALSE(is_open(raw));
+    EXPECT_EQ(1u, reaper->stats().completed);
+
+    // The deleter keeps the reaper alive.
+    weak_ptr<BackgroundReaper> weak(reaper);
+    bool deleted = false;
+    {
+        auto d = make_deferred_deleter(reaper, [&deleted](int) { deleted = true; });
+        reaper.reset();
+        EXPECT_FALSE(weak.expired());
+        d(1);
+    }
+    EXPECT_TRUE(weak.expired());
+    EXPECT_TRUE(deleted);
+}
+
+// Compares the time taken on the calling thread to release 100 resources whose deleter blocks for 1 ms.
+
+TEST(DeferredDeleter, DISABLED_benchmark_slow_deleter)
+{
+    auto slow_delete = [](int) { this_thread::sleep_for(chrono::milliseconds(1)); };
+    int const count = 100;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        ResourcePtr<int, decltype(slow_delete)> p(i, slow_delete);
+    }
+    chrono::duration<double, milli> inline_time = chrono::steady_clock::now() - start;
+
+    auto reaper = make_shared<BackgroundReaper>();
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        ResourcePtr<int, DeferredDeleter<decltype(slow_delete)>> p(i, make_deferred_deleter(reaper, slow_delete));
+    }
+    chrono::duration<double, milli> deferred_time = chrono::steady_clock::now() - start;
+    reaper->flush();
+
+    auto s = reaper->stats();
+    cout << "inline:   " << inline_time.count() << " ms" << endl;
+    cout << "deferred: " << deferred_time.count() << " ms (max queue depth " << s.max_queue_depth
+         << ", mean deleter time " << chrono::duration<double, milli>(s.total_delete_time).count() / s.completed
+         << " ms)" << endl;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/CompactResourcePtr.h>
+#include <unity/util/ResourcePtr.h>
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <set>
+
+using namespace std;
+using namespace unity::util;
+
+namespace
+{
+
+bool is_open(int fd)
+{
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+set<int> deleted;   // Resources passed to CountingDeleter
+
+struct CountingDeleter
+{
+    void operator()(int r) const
+    {
+        EXPECT_TRUE(deleted.insert(r).second);
+    }
+};
+
+typedef CompactResourcePtr<int, CountingDeleter, ResourceTraits<int, 0>> CountingPtr;
+
+} // namespace
+
+TEST(CompactResourcePtr, size)
+{
+    EXPECT_EQ(sizeof(int), sizeof(UniqueFd));
+    EXPECT_EQ(sizeof(DIR*), sizeof(UniqueDir));
+    EXPECT_EQ(sizeof(int), sizeof(CountingPtr));
+
+    typedef CompactResourcePtr<int, void(*)(int), ResourceTraits<int, -1>> FunctionPtr;
+    EXPECT_EQ(sizeof(void(*)(int)) + sizeof(void*), sizeof(FunctionPtr));
+}
+
+TEST(CompactResourcePtr, unique_fd)
+{
+    int raw;
+    {
+        UniqueFd fd(::open("/dev/null", O_RDONLY | O_CLOEXEC));
+        ASSERT_TRUE(fd.has_resource());
+        raw = fd.get();
+        EXPECT_TRUE(is_open(raw));
+    }
+    EXPECT_FALSE(is_open(raw));
+
+    UniqueFd none;
+    EXPECT_FALSE(none);
+    EXPECT_EQ(-1, none.get());
+    EXPECT_EQ(-1, none.release());
+    none.dealloc();
+
+    UniqueFd failed(::open("/no/such/file", O_RDONLY));
+    EXPECT_FALSE(failed.has_resource());
+}
+
+TEST(CompactResourcePtr, unique_dir)
+{
+    DIR* raw;
+    {
+        UniqueDir dir(opendir("/"));
+        ASSERT_TRUE(dir);
+        raw = dir.get();
+        EXPECT_TRUE(is_open(dirfd(raw)));
+    }
+
+    UniqueDir none;
+    EXPECT_EQ(nullptr, none.get());
+}
+
+TEST(CompactResourcePtr, reset_release_dealloc)
+{
+    deleted.clear();
+    {
+        CountingPtr p(1);
+        p.reset(2);
+        EXPECT_EQ(set<int>({ 1 }), deleted);
+        EXPECT_EQ(2, p.get());
+
+        EXPECT_EQ(2, p.release());
+        EXPECT_FALSE(p);
+        p.dealloc();
+        EXPECT_EQ(set<int>({ 1 }), deleted);
+
+        p.reset(3);
+        p.dealloc();
+        EXPECT_EQ(set<int>({ 1, 3 }), deleted);
+        p.reset(4);
+    }
+    EXPECT_EQ(set<int>({ 1, 3, 4 }), deleted);
+}
+
+TEST(CompactResourcePtr, move_swap_compare)
+{
+    deleted.clear();
+    {
+        CountingPtr p(1);
+        CountingPtr q(move(p));
+        EXPECT_FALSE(p);
+        EXPECT_EQ(1, q.get());
+
+        CountingPtr r(2);
+        r = move(q);
+        EXPECT_EQ(set<int>({ 2 }), deleted);
+        EXPECT_EQ(1, r.get());
+        EXPECT_FALSE(q);
+
+        CountingPtr s(5);
+        swap(r, s);
+        EXPECT_EQ(5, r.get());
+        EXPECT_EQ(1, s.get());
+        EXPECT_TRUE(s < r);
+        EXPECT_TRUE(s != r);
+        EXPECT_TRUE(p == q);
+    }
+    EXPECT_EQ(set<int>({ 1, 2, 5 }), deleted);
+}
+
+TEST(CompactResourcePtr, stateful_deleter)
+{
+    int count = 0;
+    {
+        CompactResourcePtr<int, function<void(int)>, ResourceTraits<int, -1>> p(7, [&count](int r)
+        {
+            EXPECT_EQ(7, r);
+            ++count;
+        });
+        p.get_deleter()(7);
+        EXPECT_EQ(1, count);
+    }
+    EXPECT_EQ(2, count);
+}
+
+TEST(CompactResourcePtr, throwing_deleter)
+{
+    auto thrower = [](int) { throw 42; };
+    {
+        CompactResourcePtr<int, function<void(int)>, ResourceTraits<int, -1>> p(1, thrower);
+        EXPECT_THROW(p.reset(2), int);
+        EXPECT_EQ(2, p.get());
+        EXPECT_THROW(p.dealloc(), int);
+        EXPECT_FALSE(p);
+        p.reset(3);
+    }   // Exception from the destructor is ignored.
+}
+
+// Compares creating and destroying a ResourcePtr with a std::function deleter and a UniqueFd.
+// We use -1, so we measure the overhead of the wrapper rather than that of close().
+
+TEST(CompactResourcePtr, DISABLED_benchmark_create_destroy)
+{
+    int const iterations = 10000000;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        ResourcePtr<int, function<void(int)>> fd(-1, [](int fd) { if (fd != -1) ::close(fd); });
+    }
+    chrono::duration<double, nano> resource_ptr = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        UniqueFd fd(-1);
+    }
+    chrono::duration<double, nano> unique_fd = chrono::steady_clock::now() - start;
+
+    cout << "ResourcePtr<int, std::function<void(int)>>: sizeof = "
+         << sizeof(ResourcePtr<int, function<void(int)>>) << ", "
+         << resource_ptr.count() / iterations << " ns" << endl;
+    cout << "UniqueFd:                                   sizeof = " << sizeof(UniqueFd) << ", "
+         << unique_fd.count() / iterations << " ns" << endl;
+}
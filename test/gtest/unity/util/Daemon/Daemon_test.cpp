@@ -17,12 +17,22 @@
  */
 
 #include <unity/util/Daemon.h>
+#include <unity/util/internal/DaemonImpl.h>
 #include <unity/UnityExceptions.h>
 
+#include <dirent.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <gtest/gtest.h>
 
+#include <chrono>
+
 using namespace std;
 using namespace unity;
 using namespace unity::util;
@@ -321,6 +331,11 @@ TEST(Daemon, dir)
             error(__FILE__, __LINE__, "wrong message for SyscallException");
         }
     }
+
+    // Go back to the original directory, so the remaining tests report errors in the right place.
+
+    d->set_working_directory(old_wd);
+    d->daemonize_me();
 }
 
 TEST(Daemon, tty)
@@ -338,6 +353,620 @@ TEST(Daemon, tty)
     }
 }
 
+// Runs a process that daemonizes itself with wait_for_ready() and then calls daemon_func in the daemon.
+// Returns the exit status of the original process and the time it took to exit.
+
+int run_ready_daemon(chrono::milliseconds timeout, function<void(Daemon&)> const& daemon_func, double& ms)
+{
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        abort();
+    }
+    if (pid == 0)
+    {
+        Daemon::UPtr d = Daemon::create();
+        d->wait_for_ready(timeout);
+        d->daemonize_me();
+        daemon_func(*d);
+        _exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status))
+    {
+        error(__FILE__, __LINE__, "original process did not exit normally");
+        return -1;
+    }
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return WEXITSTATUS(status);
+}
+
+TEST(Daemon, ready)
+{
+    try
+    {
+        Daemon::create()->wait_for_ready(chrono::milliseconds(0));
+        error(__FILE__, __LINE__, "wait_for_ready(0) should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        if (e.to_string() != "unity::InvalidArgumentException: Daemon::wait_for_ready(): timeout must be positive")
+        {
+            error(__FILE__, __LINE__, "wrong message for InvalidArgumentException");
+        }
+    }
+
+    double ms;
+
+    // The original process waits until the daemon is ready.
+    int status = run_ready_daemon(chrono::seconds(10), [](Daemon& d)
+    {
+        usleep(200000);
+        d.notify_ready();
+    }, ms);
+    if (status != 0)
+    {
+        error(__FILE__, __LINE__, "wrong exit status: " + to_string(status));
+    }
+    if (ms < 200)
+    {
+        error(__FILE__, __LINE__, "original process did not wait for daemon");
+    }
+
+    // The status passed to notify_ready() becomes the exit status.
+    status = run_ready_daemon(chrono::seconds(10), [](Daemon& d) { d.notify_ready(42); }, ms);
+    if (status != 42)
+    {
+        error(__FILE__, __LINE__, "wrong exit status: " + to_string(status));
+    }
+
+    // If the daemon exits without calling notify_ready(), the original process fails immediately.
+    status = run_ready_daemon(chrono::seconds(10), [](Daemon&) {}, ms);
+    if (status != EXIT_FAILURE)
+    {
+        error(__FILE__, __LINE__, "wrong exit status: " + to_string(status));
+    }
+    if (ms > 5000)
+    {
+        error(__FILE__, __LINE__, "original process did not notice that daemon exited");
+    }
+
+    // If the daemon is too slow, the original process fails after the timeout.
+    status = run_ready_daemon(chrono::milliseconds(100), [](Daemon& d)
+    {
+        usleep(1000000);
+        d.notify_ready();   // Must not die from SIGPIPE
+    }, ms);
+    if (status != EXIT_FAILURE)
+    {
+        error(__FILE__, __LINE__, "wrong exit status: " + to_string(status));
+    }
+    if (ms > 900)
+    {
+        error(__FILE__, __LINE__, "original process did not time out");
+    }
+}
+
+// Returns the message received on fd, or the empty string if there is none.
+
+string receive(int fd)
+{
+    char buf[256];
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    return n > 0 ? string(buf, n) : string();
+}
+
+TEST(Daemon, sd_notify)
+{
+    string const expected = "READY=1\nMAINPID=" + to_string(getpid());
+
+    // Socket in the file system
+
+    string path = "/tmp/Daemon_test.notify." + to_string(getpid());
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1)
+    {
+        error(__FILE__, __LINE__, "cannot bind notify socket");
+    }
+    setenv("NOTIFY_SOCKET", path.c_str(), 1);
+
+    Daemon::UPtr d = Daemon::create();
+    d->notify_ready();
+    if (receive(fd) != expected)
+    {
+        error(__FILE__, __LINE__, "wrong or missing notification");
+    }
+    d->notify_ready(EXIT_FAILURE);
+    if (!receive(fd).empty())
+    {
+        error(__FILE__, __LINE__, "unexpected notification for failure");
+    }
+    close(fd);
+    unlink(path.c_str());
+
+    // Socket in the abstract namespace
+
+    string name = "Daemon_test.notify." + to_string(getpid());
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path + 1, name.data(), name.size());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), offsetof(struct sockaddr_un, sun_path) + 1 + name.size()) == -1)
+    {
+        error(__FILE__, __LINE__, "cannot bind abstract notify socket");
+    }
+    setenv("NOTIFY_SOCKET", ("@" + name).c_str(), 1);
+
+    d->notify_ready();
+    if (receive(fd) != expected)
+    {
+        error(__FILE__, __LINE__, "wrong or missing notification for abstract socket");
+    }
+    close(fd);
+    unsetenv("NOTIFY_SOCKET");
+}
+
+// Runs func in a child process and returns its exit status, so settings applied by the test
+// don't affect the other tests.
+
+int run_in_child(function<int()> const& func)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        abort();
+    }
+    if (pid == 0)
+    {
+        _exit(func());
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+    {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+TEST(Daemon, settings)
+{
+    Daemon::UPtr d = Daemon::create();
+    try
+    {
+        d->set_rlimit(RLIMIT_NOFILE, 100, 10);
+        error(__FILE__, __LINE__, "set_rlimit() should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        if (e.to_string() != "unity::InvalidArgumentException: Daemon::set_rlimit(): invalid limit for resource "
+                             + to_string(RLIMIT_NOFILE))
+        {
+            error(__FILE__, __LINE__, "wrong message for InvalidArgumentException");
+        }
+    }
+    try
+    {
+        d->set_nice(20);
+        error(__FILE__, __LINE__, "set_nice() should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const&)
+    {
+    }
+    try
+    {
+        d->set_io_priority(Daemon::IoPriorityClass::best_effort, 8);
+        error(__FILE__, __LINE__, "set_io_priority() should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const&)
+    {
+    }
+    try
+    {
+        d->set_cpu_affinity({});
+        error(__FILE__, __LINE__, "set_cpu_affinity() should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const&)
+    {
+    }
+    try
+    {
+        d->set_oom_score_adj(1001);
+        error(__FILE__, __LINE__, "set_oom_score_adj() should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const&)
+    {
+    }
+
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    int first_cpu = 0;
+    while (!CPU_ISSET(first_cpu, &allowed))
+    {
+        ++first_cpu;
+    }
+
+    // The daemon reports through its exit status whether it got all settings.
+
+    int status = run_in_child([first_cpu]
+    {
+        struct rlimit nofile;
+        getrlimit(RLIMIT_NOFILE, &nofile);
+
+        Daemon::UPtr d = Daemon::create();
+        d->set_rlimit(RLIMIT_NOFILE, 512, nofile.rlim_max);
+        d->set_rlimit(RLIMIT_CORE, 0, 0);
+        d->set_nice(10);
+        d->set_io_priority(Daemon::IoPriorityClass::idle);
+        d->set_cpu_affinity({ first_cpu });
+        d->set_oom_score_adj(500);
+        d->wait_for_ready(chrono::seconds(10));
+        d->daemonize_me();
+
+        int ok = 1;
+        struct rlimit rl;
+        getrlimit(RLIMIT_NOFILE, &rl);
+        ok &= rl.rlim_cur == 512;
+        getrlimit(RLIMIT_CORE, &rl);
+        ok &= rl.rlim_cur == 0 && rl.rlim_max == 0;
+        ok &= getpriority(PRIO_PROCESS, 0) == 10;
+        ok &= syscall(SYS_ioprio_get, 1, 0) == (3 << 13);
+        cpu_set_t set;
+        sched_getaffinity(0, sizeof(set), &set);
+        ok &= CPU_COUNT(&set) == 1 && CPU_ISSET(first_cpu, &set);
+        FILE* f = fopen("/proc/self/oom_score_adj", "r");
+        int adj = 0;
+        ok &= f && fscanf(f, "%d", &adj) == 1 && adj == 500;
+        if (f)
+        {
+            fclose(f);
+        }
+        d->notify_ready(ok ? 0 : 1);
+        return 0;
+    });
+    if (status != 0)
+    {
+        error(__FILE__, __LINE__, "daemon did not get the requested settings");
+    }
+}
+
+TEST(Daemon, settings_strong_guarantee)
+{
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    if (CPU_ISSET(CPU_SETSIZE - 1, &allowed))
+    {
+        return;     // Can't provoke a failure.
+    }
+
+    // Setting the affinity to a CPU we can't use fails after the rlimit and nice value have been set.
+    // The calling process must be unchanged afterwards, and must not be left with a zombie child.
+
+    int status = run_in_child([]
+    {
+        struct rlimit before;
+        getrlimit(RLIMIT_NOFILE, &before);
+        int nice_before = getpriority(PRIO_PROCESS, 0);
+
+        Daemon::UPtr d = Daemon::create();
+        d->set_rlimit(RLIMIT_NOFILE, 256, before.rlim_max);
+        d->set_nice(nice_before + 1);
+        d->set_cpu_affinity({ CPU_SETSIZE - 1 });
+        try
+        {
+            d->daemonize_me();
+            _exit(1);   // Only reached in the daemon, which shouldn't exist.
+        }
+        catch (SyscallException const& e)
+        {
+            if (e.to_string() != "unity::SyscallException: sched_setaffinity() failed (errno = 22)")
+            {
+                return 2;
+            }
+        }
+        struct rlimit after;
+        getrlimit(RLIMIT_NOFILE, &after);
+        if (after.rlim_cur != before.rlim_cur || getpriority(PRIO_PROCESS, 0) != nice_before)
+        {
+            return 3;
+        }
+        if (waitpid(-1, nullptr, WNOHANG) != -1 || errno != ECHILD)
+        {
+            return 4;
+        }
+        return 0;
+    });
+    if (status != 0)
+    {
+        error(__FILE__, __LINE__, "strong exception guarantee violated: " + to_string(status));
+    }
+}
+
+TEST(Daemon, lock_memory)
+{
+    // Unprivileged processes can't lock memory if RLIMIT_MEMLOCK is zero, and the failure
+    // in the daemon is reported by daemonize_me() in the calling process.
+
+    bool const privileged = geteuid() == 0;
+    int status = run_in_child([privileged]
+    {
+        Daemon::UPtr d = Daemon::create();
+        d->lock_memory();
+        if (!privileged)
+        {
+            d->set_rlimit(RLIMIT_MEMLOCK, 0, 0);
+        }
+        try
+        {
+            d->daemonize_me();
+        }
+        catch (SyscallException const& e)
+        {
+            if (privileged || e.to_string().find("mlockall() failed") == string::npos)
+            {
+                return 1;
+            }
+            return waitpid(-1, nullptr, WNOHANG) == -1 && errno == ECHILD ? 0 : 2;
+        }
+
+        // This is the daemon; the original process has exited with EXIT_SUCCESS by now.
+        // Any problem is reported via the error file.
+        FILE* f = fopen("/proc/self/status", "r");
+        char line[256];
+        long locked = 0;
+        while (f && fgets(line, sizeof(line), f))
+        {
+            sscanf(line, "VmLck: %ld", &locked);
+        }
+        if (f)
+        {
+            fclose(f);
+        }
+        if (locked == 0)
+        {
+            error(__FILE__, __LINE__, "daemon memory not locked");
+        }
+        return 0;
+    });
+    if (status != 0)
+    {
+        error(__FILE__, __LINE__, "lock_memory() failed: " + to_string(status));
+    }
+}
+
+// Appends a line to the file for the specified worker, so the test can see how often it was started.
+
+string worker_file(unsigned index)
+{
+    return "Daemon_test.worker." + to_string(index);
+}
+
+int worker_starts(unsigned index)
+{
+    int count = 0;
+    FILE* f = fopen(worker_file(index).c_str(), "r");
+    if (f)
+    {
+        int c;
+        while ((c = fgetc(f)) != EOF)
+        {
+            count += c == '\n';
+        }
+        fclose(f);
+    }
+    return count;
+}
+
+void record_start(unsigned index, string const& line = "started")
+{
+    int fd = open(worker_file(index).c_str(), O_CREAT | O_APPEND | O_WRONLY, 0666);
+    string l = line + "\n";
+    int bytes __attribute__((unused)) = write(fd, l.c_str(), l.size());
+    close(fd);
+}
+
+void remove_worker_files(unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+    {
+        unlink(worker_file(i).c_str());
+    }
+}
+
+// Forks a process that calls run_workers() and exits with status 0 once that returns.
+
+pid_t start_supervisor(unsigned count, Daemon::WorkerFunction const& worker, function<void(Daemon&)> const& setup = nullptr)
+{
+    remove_worker_files(count);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        abort();
+    }
+    if (pid == 0)
+    {
+        Daemon::UPtr d = Daemon::create();
+        if (setup)
+        {
+            setup(*d);
+        }
+        d->run_workers(count, worker);
+        _exit(0);
+    }
+    return pid;
+}
+
+bool wait_for_supervisor(pid_t pid)
+{
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+TEST(Daemon, run_workers)
+{
+    Daemon::UPtr d = Daemon::create();
+    try
+    {
+        d->run_workers(0, [](unsigned) { return 0; });
+        error(__FILE__, __LINE__, "run_workers(0) should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        if (e.to_string() != "unity::InvalidArgumentException: Daemon::run_workers(): count must be greater than zero")
+        {
+            error(__FILE__, __LINE__, "wrong message for InvalidArgumentException");
+        }
+    }
+    try
+    {
+        d->run_workers(1, nullptr);
+        error(__FILE__, __LINE__, "run_workers(nullptr) should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const&)
+    {
+    }
+    try
+    {
+        d->set_restart_delay(chrono::milliseconds(100), chrono::milliseconds(10));
+        error(__FILE__, __LINE__, "set_restart_delay() should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        if (e.to_string() != "unity::InvalidArgumentException: Daemon::set_restart_delay(): invalid delay: "
+                             "initial = 100 ms, max = 10 ms")
+        {
+            error(__FILE__, __LINE__, "wrong message for InvalidArgumentException");
+        }
+    }
+
+    // Workers that return zero are not restarted, and run_workers() returns once all of them are done.
+
+    pid_t pid = start_supervisor(4, [](unsigned index) { record_start(index); return 0; });
+    if (!wait_for_supervisor(pid))
+    {
+        error(__FILE__, __LINE__, "supervisor failed");
+    }
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        if (worker_starts(i) != 1)
+        {
+            error(__FILE__, __LINE__, "worker " + to_string(i) + " started " + to_string(worker_starts(i)) + " times");
+        }
+    }
+    remove_worker_files(4);
+}
+
+TEST(Daemon, run_workers_restart)
+{
+    // Worker 0 crashes twice and then succeeds, worker 1 throws once.
+
+    auto worker = [](unsigned index)
+    {
+        record_start(index);
+        int starts = worker_starts(index);
+        if (index == 0 && starts <= 2)
+        {
+            raise(SIGKILL);
+        }
+        if (index == 1 && starts == 1)
+        {
+            throw std::runtime_error("worker failed");
+        }
+        return 0;
+    };
+    auto setup = [](Daemon& d) { d.set_restart_delay(chrono::milliseconds(50), chrono::milliseconds(1000)); };
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = start_supervisor(2, worker, setup);
+    if (!wait_for_supervisor(pid))
+    {
+        error(__FILE__, __LINE__, "supervisor failed");
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    if (worker_starts(0) != 3)
+    {
+        error(__FILE__, __LINE__, "worker 0 started " + to_string(worker_starts(0)) + " times");
+    }
+    if (worker_starts(1) != 2)
+    {
+        error(__FILE__, __LINE__, "worker 1 started " + to_string(worker_starts(1)) + " times");
+    }
+    if (ms < 50 + 100)
+    {
+        error(__FILE__, __LINE__, "no backoff between restarts: " + to_string(ms) + " ms");
+    }
+    remove_worker_files(2);
+}
+
+TEST(Daemon, run_workers_terminate)
+{
+    pid_t pid = start_supervisor(3, [](unsigned index)
+    {
+        record_start(index);
+        for (;;)
+        {
+            pause();
+        }
+        return 0;
+    });
+
+    // Wait for the workers to start, then ask the supervisor to terminate.
+
+    for (int i = 0; i < 500 && (worker_starts(0) == 0 || worker_starts(1) == 0 || worker_starts(2) == 0); ++i)
+    {
+        usleep(10000);
+    }
+    kill(pid, SIGTERM);
+    if (!wait_for_supervisor(pid))
+    {
+        error(__FILE__, __LINE__, "supervisor did not exit cleanly after SIGTERM");
+    }
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        if (worker_starts(i) != 1)
+        {
+            error(__FILE__, __LINE__, "worker " + to_string(i) + " started " + to_string(worker_starts(i)) + " times");
+        }
+    }
+    remove_worker_files(3);
+}
+
+TEST(Daemon, run_workers_pinned)
+{
+    pid_t pid = start_supervisor(2, [](unsigned index)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        sched_getaffinity(0, sizeof(set), &set);
+        record_start(index, to_string(CPU_COUNT(&set)));
+        return 0;
+    }, [](Daemon& d) { d.pin_workers(); });
+    if (!wait_for_supervisor(pid))
+    {
+        error(__FILE__, __LINE__, "supervisor failed");
+    }
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        FILE* f = fopen(worker_file(i).c_str(), "r");
+        int cpus = 0;
+        if (!f || fscanf(f, "%d", &cpus) != 1 || cpus != 1)
+        {
+            error(__FILE__, __LINE__, "worker " + to_string(i) + " not pinned to a single CPU");
+        }
+        if (f)
+        {
+            fclose(f);
+        }
+    }
+    remove_worker_files(2);
+}
+
 // Test that file descriptors are closed.
 // We test this only when coverage is disabled because
 // closing descriptors interferes with coverage reporting.
@@ -376,4 +1005,159 @@ TEST(Daemon, file_close)
     }
 }
 
+TEST(Daemon, keep_fd)
+{
+    Daemon::UPtr d = Daemon::create();
+
+    int fd = open(".", O_RDONLY);
+    int keep = open(".", O_RDONLY);
+    int fd2 = open(".", O_RDONLY);
+    if (fd == -1 || keep == -1 || fd2 == -1)
+    {
+        abort();
+    }
+
+    try
+    {
+        d->keep_fd(2);
+        error(__FILE__, __LINE__, "keep_fd(2) should have thrown, but didn't");
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        if (e.to_string() != "unity::InvalidArgumentException: Daemon::keep_fd(): invalid file descriptor: 2")
+        {
+            error(__FILE__, __LINE__, "wrong message for InvalidArgumentException");
+        }
+    }
+
+    d->close_fds();
+    d->keep_fd(keep);
+    d->keep_fd(keep);
+    d->daemonize_me();
+    check_std_descriptors();
+
+    if (is_open(fd))
+    {
+        error(__FILE__, __LINE__, "fd open, should be closed");
+    }
+    if (!is_open(keep))
+    {
+        error(__FILE__, __LINE__, "keep closed, should be open");
+    }
+    if (is_open(fd2))
+    {
+        error(__FILE__, __LINE__, "fd2 open, should be closed");
+    }
+    close(keep);
+}
+
+TEST(Daemon, close_fds_by_scan)
+{
+    // Exercise the fallback for kernels without close_range(), using descriptors well
+    // above any that are in use, so nothing else is affected.
+
+    int fd = open(".", O_RDONLY);
+    if (fd == -1)
+    {
+        abort();
+    }
+    for (int i = 500; i < 510; ++i)
+    {
+        dup2(fd, i);
+    }
+    close(fd);
+
+    if (!internal::close_fds_by_scan(500, { 503, 507 }))
+    {
+        error(__FILE__, __LINE__, "close_fds_by_scan() failed");
+    }
+    for (int i = 500; i < 510; ++i)
+    {
+        bool expect_open = i == 503 || i == 507;
+        if (is_open(i) != expect_open)
+        {
+            error(__FILE__, __LINE__, "wrong state for descriptor " + to_string(i));
+        }
+    }
+    close(503);
+    close(507);
+}
+
 #endif
+
+// Compares closing 100,000 descriptors with close_range(), with a getdents64() scan of /proc/self/fd,
+// and with the previous implementation (readdir() into a vector, then close()).
+// Run this on its own, because the other tests turn the test into a daemon without stdout.
+
+TEST(Daemon, DISABLED_benchmark_close_fds)
+{
+    int count = 100000;
+
+    // Raising the hard limit needs privileges; if we can't, we use as many descriptors as we may.
+    struct rlimit rl;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &rl));
+    if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < rlim_t(count + 100))
+    {
+        struct rlimit raised = { rlim_t(count + 100), rlim_t(count + 100) };
+        if (setrlimit(RLIMIT_NOFILE, &raised) == -1)
+        {
+            count = int(rl.rlim_max) - 100;
+            cout << "cannot raise RLIMIT_NOFILE, using " << count << " descriptors" << endl;
+        }
+        ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &rl));
+    }
+    rl.rlim_cur = count + 100;
+    ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &rl));
+
+    int const first = 50;
+    auto open_fds = [&]
+    {
+        int fd = open("/dev/null", O_RDONLY);
+        ASSERT_NE(-1, fd);
+        for (int i = first; i < first + count; ++i)
+        {
+            ASSERT_EQ(i, dup2(fd, i));
+        }
+        close(fd);
+    };
+
+    auto legacy = [&]
+    {
+        DIR* dir = opendir("/proc/self/fd");
+        vector<int> descriptors;
+        struct dirent* e;
+        while ((e = readdir(dir)) != nullptr)
+        {
+            if (e->d_name[0] == '.')
+            {
+                continue;
+            }
+            size_t pos;
+            int fd = std::stoi(e->d_name, &pos);
+            if (e->d_name[pos] == '\0' && fd >= first && fd != dirfd(dir))
+            {
+                descriptors.push_back(fd);
+            }
+        }
+        closedir(dir);
+        for (auto fd : descriptors)
+        {
+            close(fd);
+        }
+    };
+
+    auto measure = [&](string const& name, function<void()> const& f)
+    {
+        open_fds();
+        auto start = chrono::steady_clock::now();
+        f();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << name << ": " << ms << " ms" << endl;
+        EXPECT_FALSE(is_open(first));
+        EXPECT_FALSE(is_open(first + count - 1));
+    };
+
+    measure("readdir + vector + close", legacy);
+    measure("getdents64 scan of /proc/self/fd", [&]{ internal::close_fds_by_scan(first, {}); });
+    measure("close_fds_from (close_range)", [&]{ internal::close_fds_from(first, {}); });
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/Directory.h>
+#include <unity/util/FileIO.h>
+#include <test/gtest/unity/util/TestDir.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+void write_file(string const& filename, string const& contents)
+{
+    ofstream f(filename, ios::binary);
+    f << contents;
+}
+
+} // namespace
+
+TEST(Directory, basic)
+{
+    TestDir tmp;
+    write_file(tmp.path() + "/file", "hello");
+    mkdir((tmp.path() + "/sub").c_str(), 0700);
+    write_file(tmp.path() + "/sub/nested", "world");
+
+    Directory dir(tmp.path());
+    EXPECT_EQ(tmp.path(), dir.path());
+    EXPECT_GE(dir.fd(), 0);
+
+    EXPECT_EQ("hello", dir.read_text_file("file"));
+    EXPECT_EQ((vector<uint8_t>{ 'h', 'e', 'l', 'l', 'o' }), dir.read_binary_file("file"));
+    EXPECT_EQ("world", dir.read_text_file("sub/nested"));
+
+    auto sub = dir.open_directory("sub");
+    EXPECT_EQ(tmp.path() + "/sub", sub->path());
+    EXPECT_EQ("world", sub->read_text_file("nested"));
+
+    EXPECT_EQ(tmp.path() + "/sub/nested", sub->path_of("nested"));
+    EXPECT_EQ("/etc/passwd", sub->path_of("/etc/passwd"));
+    EXPECT_EQ("/x", Directory("/").path_of("x"));
+}
+
+TEST(Directory, stat)
+{
+    TestDir tmp;
+    write_file(tmp.path() + "/file", "hello");
+    ASSERT_EQ(0, symlink("file", (tmp.path() + "/link").c_str()));
+
+    Directory dir(tmp.path());
+    auto st = dir.stat("file");
+    EXPECT_TRUE(S_ISREG(st.st_mode));
+    EXPECT_EQ(5, st.st_size);
+
+    EXPECT_TRUE(S_ISREG(dir.stat("link").st_mode));
+    EXPECT_TRUE(S_ISLNK(dir.stat("link", false).st_mode));
+}
+
+TEST(Directory, renamed)
+{
+    TestDir tmp;
+    mkdir((tmp.path() + "/old").c_str(), 0700);
+    write_file(tmp.path() + "/old/file", "hello");
+
+    // The handle refers to the directory, not to its path.
+    Directory dir(tmp.path() + "/old");
+    ASSERT_EQ(0, rename((tmp.path() + "/old").c_str(), (tmp.path() + "/new").c_str()));
+    EXPECT_EQ("hello", dir.read_text_file("file"));
+}
+
+TEST(Directory, exceptions)
+{
+    try
+    {
+        Directory dir("no_such_dir");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot open directory \"no_such_dir\": No such file or directory "
+                     "(errno = 2)",
+                     e.what());
+    }
+
+    TestDir tmp;
+    write_file(tmp.path() + "/file", "hello");
+    Directory dir(tmp.path());
+
+    try
+    {
+        dir.open_directory("file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot open directory \"" + tmp.path() + "/file\": Not a directory "
+                  "(errno = 20)",
+                  e.to_string());
+    }
+
+    try
+    {
+        dir.read_text_file("no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot open \"" + tmp.path() + "/no_such_file\": No such file or directory "
+                  "(errno = 2)",
+                  e.to_string());
+    }
+
+    try
+    {
+        dir.stat("no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot stat \"" + tmp.path() + "/no_such_file\": No such file or directory "
+                  "(errno = 2)",
+                  e.to_string());
+        EXPECT_EQ(ENOENT, e.error());
+    }
+}
+
+// Compares reading many files from a deeply nested directory by absolute path
+// with reading them relative to a Directory.
+
+TEST(Directory, DISABLED_benchmark_read)
+{
+    TestDir tmp;
+    char buf[PATH_MAX];
+    ASSERT_NE(nullptr, realpath(tmp.path().c_str(), buf));
+    string deep = buf;
+    for (int i = 0; i < 10; ++i)
+    {
+        deep += "/level" + to_string(i);
+        mkdir(deep.c_str(), 0700);
+    }
+    int const files = 2000;
+    for (int i = 0; i < files; ++i)
+    {
+        write_file(deep + "/file" + to_string(i) + ".desktop", "[Desktop Entry]\nName=App\n");
+    }
+
+    auto measure = [](string const& name, function<size_t()> const& f)
+    {
+        auto start = chrono::steady_clock::now();
+        size_t bytes = f();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << name << ": " << bytes << " bytes in " << ms << " ms" << endl;
+    };
+
+    measure("read_binary_file(absolute path)", [&]
+    {
+        size_t bytes = 0;
+        for (int i = 0; i < files; ++i)
+        {
+            bytes += read_binary_file(deep + "/file" + to_string(i) + ".desktop").size();
+        }
+        return bytes;
+    });
+    measure("Directory::read_binary_file()", [&]
+    {
+        size_t bytes = 0;
+        Directory dir(deep);
+        for (int i = 0; i < files; ++i)
+        {
+            bytes += dir.read_binary_file("file" + to_string(i) + ".desktop").size();
+        }
+        return bytes;
+    });
+}
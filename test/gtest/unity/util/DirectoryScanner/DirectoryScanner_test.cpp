@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/Directory.h>
+#include <unity/util/DirectoryScanner.h>
+#include <test/gtest/unity/util/TestDir.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+void write_file(string const& filename, string const& contents)
+{
+    ofstream f(filename, ios::binary);
+    f << contents;
+}
+
+// A temporary directory tree that is removed again on destruction.
+
+class TestTree : public TestDir
+{
+public:
+    void mkdir(string const& dir) const
+    {
+        ::mkdir((path() + "/" + dir).c_str(), 0700);
+    }
+
+    void create(string const& file) const
+    {
+        write_file(path() + "/" + file, "");
+    }
+};
+
+vector<string> paths(DirectoryListing listing)
+{
+    listing.sort();
+    vector<string> result;
+    for (auto const& e : listing)
+    {
+        result.push_back(e.path.str());
+        EXPECT_EQ('\0', e.path.data()[e.path.size()]);
+    }
+    return result;
+}
+
+} // namespace
+
+TEST(DirectoryScanner, basic)
+{
+    TestTree tree;
+    tree.create("b.desktop");
+    tree.create("a.png");
+    tree.create("c.desktop");
+    tree.mkdir("sub");
+    tree.create("sub/d.desktop");
+    ASSERT_EQ(0, symlink("a.png", (tree.path() + "/link").c_str()));
+
+    auto listing = scan_directory(tree.path());
+    EXPECT_EQ((vector<string>{ "a.png", "b.desktop", "c.desktop", "link" }), paths(listing));
+
+    listing.sort();
+    EXPECT_EQ(4u, listing.size());
+    EXPECT_FALSE(listing.empty());
+    EXPECT_EQ(DirectoryListing::Type::regular, listing[0].type);
+    EXPECT_EQ(DirectoryListing::Type::symlink, listing[3].type);
+
+    ScanOptions options;
+    options.include_directories = true;
+    listing = scan_directory(tree.path(), options);
+    listing.sort();
+    ASSERT_EQ(5u, listing.size());
+    EXPECT_EQ("sub", listing[4].path.str());
+    EXPECT_EQ(DirectoryListing::Type::directory, listing[4].type);
+
+    EXPECT_TRUE(scan_directory(tree.path() + "/sub/", ScanOptions()).size() == 1);
+
+    tree.mkdir("empty");
+    EXPECT_TRUE(scan_directory(tree.path() + "/empty").empty());
+}
+
+TEST(DirectoryScanner, suffixes)
+{
+    TestTree tree;
+    tree.create("b.desktop");
+    tree.create("a.png");
+    tree.create("c.svg");
+    tree.create("desktop");
+    tree.mkdir("dir.desktop");
+
+    ScanOptions options;
+    options.suffixes = { ".desktop", ".svg" };
+    EXPECT_EQ((vector<string>{ "b.desktop", "c.svg" }), paths(scan_directory(tree.path(), options)));
+
+    options.include_directories = true;
+    EXPECT_EQ((vector<string>{ "b.desktop", "c.svg", "dir.desktop" }), paths(scan_directory(tree.path(), options)));
+}
+
+TEST(DirectoryScanner, recursive)
+{
+    TestTree tree;
+    vector<string> expected;
+    for (int i = 0; i < 20; ++i)
+    {
+        string dir = "dir" + to_string(i);
+        tree.mkdir(dir);
+        for (int j = 0; j < 5; ++j)
+        {
+            string sub = dir + "/sub" + to_string(j);
+            tree.mkdir(sub);
+            tree.create(sub + "/file.desktop");
+            tree.create(sub + "/file.png");
+            expected.push_back(sub + "/file.desktop");
+        }
+    }
+    tree.create("top.desktop");
+    expected.push_back("top.desktop");
+    ASSERT_EQ(0, symlink(".", (tree.path() + "/loop").c_str()));   // Not followed
+    std::sort(expected.begin(), expected.end());
+
+    ScanOptions options;
+    options.recursive = true;
+    options.suffixes = { ".desktop" };
+
+    for (unsigned concurrency : { 0, 1, 2, 8 })
+    {
+        options.concurrency = concurrency;
+        EXPECT_EQ(expected, paths(scan_directory(tree.path(), options))) << concurrency;
+    }
+
+    // A small buffer needs many getdents64() calls, with the same result.
+    options.buffer_size = 1;
+    EXPECT_EQ(expected, paths(scan_directory(tree.path(), options)));
+
+    options.suffixes.clear();
+    options.include_directories = true;
+    EXPECT_EQ(1u + 20 + 100 + 200 + 1, scan_directory(tree.path(), options).size());
+}
+
+TEST(DirectoryScanner, directory)
+{
+    TestTree tree;
+    tree.create("a.desktop");
+    tree.mkdir("sub");
+    tree.create("sub/b.desktop");
+
+    Directory dir(tree.path());
+    ScanOptions options;
+    options.recursive = true;
+    EXPECT_EQ((vector<string>{ "a.desktop", "sub/b.desktop" }), paths(scan_directory(dir, options)));
+
+    auto sub = dir.open_directory("sub");
+    EXPECT_EQ((vector<string>{ "b.desktop" }), paths(scan_directory(*sub)));
+}
+
+TEST(DirectoryScanner, unreadable_subdirectory)
+{
+    if (geteuid() == 0)
+    {
+        return;     // Permissions don't apply to root.
+    }
+
+    TestTree tree;
+    tree.mkdir("ok");
+    tree.create("ok/file");
+    tree.mkdir("secret");
+    tree.create("secret/file");
+    chmod((tree.path() + "/secret").c_str(), 0);
+
+    ScanOptions options;
+    options.recursive = true;
+    EXPECT_EQ((vector<string>{ "ok/file" }), paths(scan_directory(tree.path(), options)));
+
+    chmod((tree.path() + "/secret").c_str(), 0700);
+}
+
+TEST(DirectoryScanner, exceptions)
+{
+    try
+    {
+        scan_directory("no_such_dir");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot open directory \"no_such_dir\": No such file or directory "
+                     "(errno = 2)",
+                     e.what());
+    }
+
+    write_file("not_a_dir", "");
+    try
+    {
+        scan_directory("not_a_dir");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot open directory \"not_a_dir\": Not a directory (errno = 20)",
+                     e.what());
+    }
+    ::unlink("not_a_dir");
+}
+
+// Compares scan_directory() with opendir()/readdir() plus stat() for each entry.
+// Set UNITY_BENCH_DIR to scan an existing directory (such as /usr/share) instead
+// of a generated tree.
+
+TEST(DirectoryScanner, DISABLED_benchmark_scan)
+{
+    TestTree tree;
+    string root = tree.path();
+    char const* env = getenv("UNITY_BENCH_DIR");
+    if (env)
+    {
+        root = env;
+    }
+    else
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            string dir = "apps" + to_string(i);
+            tree.mkdir(dir);
+            for (int j = 0; j < 100; ++j)
+            {
+                tree.create(dir + "/app" + to_string(j) + ".desktop");
+                tree.create(dir + "/app" + to_string(j) + ".png");
+            }
+        }
+    }
+
+    function<size_t(string const&)> readdir_scan = [&](string const& dir) -> size_t
+    {
+        size_t count = 0;
+        DIR* d = opendir(dir.c_str());
+        if (!d)
+        {
+            return 0;
+        }
+        struct dirent* e;
+        while ((e = readdir(d)) != nullptr)
+        {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            {
+                continue;
+            }
+            string path = dir + "/" + e->d_name;
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0)
+            {
+                if (S_ISDIR(st.st_mode))
+                {
+                    count += readdir_scan(path);
+                }
+                else if (path.size() >= 8 && path.compare(path.size() - 8, 8, ".desktop") == 0)
+                {
+                    ++count;
+                }
+            }
+        }
+        closedir(d);
+        return count;
+    };
+
+    auto measure = [](string const& name, function<size_t()> const& f)
+    {
+        auto start = chrono::steady_clock::now();
+        size_t count = f();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << name << ": " << count << " entries in " << ms << " ms" << endl;
+    };
+
+    measure("readdir + lstat", [&]{ return readdir_scan(root); });
+    for (unsigned concurrency : { 1, 2, 4, 8 })
+    {
+        ScanOptions options;
+        options.recursive = true;
+        options.suffixes = { ".desktop" };
+        options.concurrency = concurrency;
+        measure("scan_directory, concurrency " + to_string(concurrency),
+                [&]{ return scan_directory(root, options).size(); });
+    }
+}
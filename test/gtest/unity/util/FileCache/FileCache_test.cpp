@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/Directory.h>
+#include <unity/util/FileCache.h>
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+void write_file(string const& filename, string const& contents)
+{
+    FILE* f = fopen(filename.c_str(), "w");
+    ASSERT_NE(nullptr, f);
+    fputs(contents.c_str(), f);
+    fclose(f);
+}
+
+vector<uint8_t> bytes(string const& s)
+{
+    return vector<uint8_t>(s.begin(), s.end());
+}
+
+} // namespace
+
+TEST(FileCache, hit)
+{
+    write_file("cachefile", "some chars\n");
+
+    FileCache cache(1024);
+    EXPECT_EQ(1024u, cache.max_bytes());
+
+    auto b1 = cache.read_binary_file("cachefile");
+    EXPECT_EQ(bytes("some chars\n"), *b1);
+
+    auto b2 = cache.read_binary_file("cachefile");
+    EXPECT_EQ(b1.get(), b2.get());          // Same buffer, no copy
+
+    auto s = cache.stats();
+    EXPECT_EQ(1u, s.hits);
+    EXPECT_EQ(1u, s.misses);
+    EXPECT_EQ(0u, s.evictions);
+    EXPECT_EQ(1u, s.entries);
+    EXPECT_EQ(11u, s.bytes);
+}
+
+TEST(FileCache, modified)
+{
+    write_file("cachefile", "some chars\n");
+
+    FileCache cache(1024);
+    auto b1 = cache.read_binary_file("cachefile");
+
+    write_file("cachefile", "other chars\n");
+    auto b2 = cache.read_binary_file("cachefile");
+    EXPECT_NE(b1.get(), b2.get());
+    EXPECT_EQ(bytes("some chars\n"), *b1);  // Old buffer is unaffected
+    EXPECT_EQ(bytes("other chars\n"), *b2);
+
+    // Same size, different modification time.
+
+    write_file("cachefile", "OTHER CHARS\n");
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000, 0 } };
+    ASSERT_EQ(0, utimensat(AT_FDCWD, "cachefile", times, 0));
+    auto b3 = cache.read_binary_file("cachefile");
+    EXPECT_EQ(bytes("OTHER CHARS\n"), *b3);
+
+    auto s = cache.stats();
+    EXPECT_EQ(0u, s.hits);
+    EXPECT_EQ(3u, s.misses);
+    EXPECT_EQ(1u, s.entries);
+    EXPECT_EQ(12u, s.bytes);
+}
+
+TEST(FileCache, eviction)
+{
+    write_file("cachefile1", "1234");
+    write_file("cachefile2", "5678");
+    write_file("cachefile3", "90");
+    write_file("cachefile4", "123456789");
+
+    FileCache cache(10);
+
+    cache.read_binary_file("cachefile1");
+    cache.read_binary_file("cachefile2");
+    cache.read_binary_file("cachefile1");   // cachefile2 is now least-recently used
+    cache.read_binary_file("cachefile3");
+    EXPECT_EQ(0u, cache.stats().evictions);
+    EXPECT_EQ(10u, cache.stats().bytes);
+
+    write_file("cachefile5", "x");
+    cache.read_binary_file("cachefile5");
+    auto s = cache.stats();
+    EXPECT_EQ(1u, s.evictions);
+    EXPECT_EQ(3u, s.entries);
+    EXPECT_EQ(7u, s.bytes);
+
+    cache.read_binary_file("cachefile1");   // Still cached
+    EXPECT_EQ(2u, cache.stats().hits);
+    cache.read_binary_file("cachefile2");   // Was evicted
+    EXPECT_EQ(2u, cache.stats().hits);
+
+    // A file that is larger than the cache is returned, but not cached.
+
+    FileCache small(5);
+    auto b = small.read_binary_file("cachefile4");
+    EXPECT_EQ(bytes("123456789"), *b);
+    EXPECT_EQ(0u, small.stats().entries);
+    EXPECT_EQ(0u, small.stats().bytes);
+}
+
+TEST(FileCache, invalidate)
+{
+    write_file("cachefile", "abc");
+
+    FileCache cache(100);
+    cache.read_binary_file("cachefile");
+    cache.invalidate("cachefile");
+    cache.invalidate("no_such_file");
+    EXPECT_EQ(0u, cache.stats().entries);
+    cache.read_binary_file("cachefile");
+    EXPECT_EQ(2u, cache.stats().misses);
+
+    cache.clear();
+    auto s = cache.stats();
+    EXPECT_EQ(0u, s.entries);
+    EXPECT_EQ(0u, s.bytes);
+    EXPECT_EQ(2u, s.misses);
+}
+
+TEST(FileCache, directory)
+{
+    mkdir("cachedir", 0700);
+    write_file("cachedir/file", "abc");
+
+    Directory dir("cachedir");
+    FileCache cache(100);
+
+    auto b1 = cache.read_binary_file(dir, "file");
+    EXPECT_EQ(bytes("abc"), *b1);
+
+    // The entry is shared with reads by path.
+    auto b2 = cache.read_binary_file("cachedir/file");
+    EXPECT_EQ(b1.get(), b2.get());
+    EXPECT_EQ(1u, cache.stats().hits);
+
+    write_file("cachedir/file", "abcd");
+    auto b3 = cache.read_binary_file(dir, "file");
+    EXPECT_EQ(bytes("abcd"), *b3);
+    EXPECT_EQ(2u, cache.stats().misses);
+
+    cache.invalidate("cachedir/file");
+    EXPECT_EQ(0u, cache.stats().entries);
+
+    try
+    {
+        cache.read_binary_file(dir, "no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot open \"cachedir/no_such_file\": No such file or directory (errno = 2)",
+                  e.to_string());
+    }
+
+    remove("cachedir/file");
+    rmdir("cachedir");
+}
+
+TEST(FileCache, exceptions)
+{
+    FileCache cache(100);
+
+    remove("no_such_file");
+    try
+    {
+        cache.read_binary_file("no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot open \"no_such_file\": No such file or directory (errno = 2)",
+                  e.to_string());
+    }
+
+    // A file that was cached and then removed must not be returned from the cache.
+
+    write_file("cachefile", "abc");
+    cache.read_binary_file("cachefile");
+    remove("cachefile");
+    EXPECT_THROW(cache.read_binary_file("cachefile"), FileException);
+    EXPECT_EQ(0u, cache.stats().entries);
+}
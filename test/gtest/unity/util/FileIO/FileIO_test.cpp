@@ -21,7 +21,16 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <functional>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <zstd.h>
 
 using namespace std;
 using namespace unity;
@@ -79,3 +88,409 @@ TEST(FileIO, exceptions)
         EXPECT_EQ("unity::FileException: \"testdir\" is not a regular file (errno = 0)", e.to_string());
     }
 }
+
+TEST(FileIO, copy_file)
+{
+    // Big enough to need several chunks for the read/write fallback.
+    string contents;
+    for (int i = 0; i < 100000; ++i)
+    {
+        contents += to_string(i) + "\n";
+    }
+
+    remove("copysrc");
+    remove("copydst");
+    {
+        ofstream f("copysrc");
+        f << contents;
+    }
+    chmod("copysrc", 0640);
+
+    EXPECT_EQ(contents.size(), copy_file("copysrc", "copydst"));
+    EXPECT_EQ(contents, read_text_file("copydst"));
+
+    struct stat st;
+    ASSERT_EQ(0, stat("copydst", &st));
+    EXPECT_EQ(0640u, st.st_mode & 0777);
+
+    // Copying over an existing file truncates it.
+
+    {
+        ofstream f("copysrc");
+        f << "short";
+    }
+    EXPECT_EQ(5u, copy_file("copysrc", "copydst"));
+    EXPECT_EQ("short", read_text_file("copydst"));
+
+    // Empty file
+
+    remove("empty");
+    {
+        ofstream f("empty");
+    }
+    EXPECT_EQ(0u, copy_file("empty", "copydst"));
+    EXPECT_TRUE(read_text_file("copydst").empty());
+}
+
+TEST(FileIO, copy_file_exceptions)
+{
+    try
+    {
+        copy_file("no_such_file", "copydst");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot open \"no_such_file\": No such file or directory (errno = 2)",
+                  e.to_string());
+    }
+
+    {
+        ofstream f("copysrc");
+        f << "hello";
+    }
+    try
+    {
+        copy_file("copysrc", "copysrc");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot copy \"copysrc\" to \"copysrc\": "
+                  "source and destination are the same file (errno = 0)",
+                  e.to_string());
+    }
+    EXPECT_EQ("hello", read_text_file("copysrc"));
+
+    // A cancelled copy throws and removes the destination.
+
+    remove("copydst");
+    atomic<bool> cancel(true);
+    try
+    {
+        copy_file("copysrc", "copydst", &cancel);
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ(ECANCELED, e.error());
+    }
+    EXPECT_EQ(0, access("copysrc", F_OK));
+    EXPECT_EQ(-1, access("copydst", F_OK));
+}
+
+TEST(FileIO, transfer_fd)
+{
+    {
+        ofstream f("copysrc");
+        f << "0123456789";
+    }
+
+    // File to pipe, limited to a number of bytes.
+
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    int src = open("copysrc", O_RDONLY);
+    ASSERT_NE(-1, src);
+    EXPECT_EQ(4u, transfer_fd(src, fds[1], 4));
+    EXPECT_EQ(6u, transfer_fd(src, fds[1]));    // Continues at the current offset
+    close(src);
+    close(fds[1]);
+
+    // Pipe to file
+
+    int dst = open("copydst", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(-1, dst);
+    EXPECT_EQ(10u, transfer_fd(fds[0], dst));
+    close(dst);
+    close(fds[0]);
+    EXPECT_EQ("0123456789", read_text_file("copydst"));
+
+    try
+    {
+        transfer_fd(-1, -1);
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ(EBADF, e.error());
+    }
+}
+
+TEST(FileIO, read_large_binary_file)
+{
+    // A file that doesn't end on a chunk boundary.
+
+    vector<uint8_t> contents(3 * 4096 * 5 + 123);
+    for (size_t i = 0; i < contents.size(); ++i)
+    {
+        contents[i] = static_cast<uint8_t>(i * 7 + i / 251);
+    }
+    {
+        ofstream f("largefile", ios::binary);
+        f.write(reinterpret_cast<char const*>(contents.data()), contents.size());
+    }
+
+    LargeFileReadOptions options;
+    options.chunk_size = 1;             // Rounded up to the page size
+    options.concurrency = 4;
+    vector<uint32_t> checksums;
+    auto buf = read_large_binary_file("largefile", options, &checksums);
+    EXPECT_EQ(contents, vector<uint8_t>(buf.begin(), buf.end()));
+    EXPECT_EQ(contents.size(), buf.size());
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    EXPECT_EQ((contents.size() + page_size - 1) / page_size, checksums.size());
+
+    buf = read_large_binary_file("largefile");
+    EXPECT_EQ(contents, vector<uint8_t>(buf.begin(), buf.end()));
+
+    // Moving a buffer leaves the source empty.
+
+    LargeFileBuffer moved(move(buf));
+    EXPECT_EQ(contents.size(), moved.size());
+    EXPECT_TRUE(buf.empty());
+
+    // Check value for the standard CRC-32.
+
+    {
+        ofstream f("largefile");
+        f << "123456789";
+    }
+    buf = read_large_binary_file("largefile", LargeFileReadOptions(), &checksums);
+    EXPECT_EQ(vector<uint8_t>({ '1', '2', '3', '4', '5', '6', '7', '8', '9' }),
+              vector<uint8_t>(buf.begin(), buf.end()));
+    ASSERT_EQ(1u, checksums.size());
+    EXPECT_EQ(0xCBF43926u, checksums[0]);
+
+    remove("empty");
+    {
+        ofstream f("empty");
+    }
+    EXPECT_TRUE(read_large_binary_file("empty", options, &checksums).empty());
+    EXPECT_TRUE(checksums.empty());
+
+    EXPECT_THROW(read_large_binary_file("no_such_file"), FileException);
+    EXPECT_THROW(read_large_binary_file("."), FileException);
+}
+
+namespace
+{
+
+void write_gzip(string const& filename, string const& contents)
+{
+    gzFile f = gzopen(filename.c_str(), "wb");
+    ASSERT_NE(nullptr, f);
+    if (!contents.empty())
+    {
+        ASSERT_EQ(int(contents.size()), gzwrite(f, contents.data(), contents.size()));
+    }
+    gzclose(f);
+}
+
+string zstd_compress(string const& contents)
+{
+    string compressed(ZSTD_compressBound(contents.size()), '\0');
+    size_t n = ZSTD_compress(&compressed[0], compressed.size(), contents.data(), contents.size(), 3);
+    EXPECT_FALSE(ZSTD_isError(n));
+    compressed.resize(n);
+    return compressed;
+}
+
+void write_raw(string const& filename, string const& contents)
+{
+    ofstream f(filename, ios::binary);
+    f << contents;
+}
+
+string test_data(size_t size)
+{
+    string data;
+    data.reserve(size);
+    for (size_t i = 0; data.size() < size; ++i)
+    {
+        data += "line " + to_string(i) + "\n";
+    }
+    data.resize(size);
+    return data;
+}
+
+} // namespace
+
+TEST(FileIO, read_decompressed_file)
+{
+    for (size_t size : { 0, 1, 100, 65535, 65536, 1000000 })
+    {
+        string data = test_data(size);
+
+        write_gzip("testfile.gz", data);
+        EXPECT_EQ(data, read_decompressed_text_file("testfile.gz")) << size;
+        EXPECT_EQ(vector<uint8_t>(data.begin(), data.end()), read_decompressed_binary_file("testfile.gz"));
+
+        write_raw("testfile.zst", zstd_compress(data));
+        EXPECT_EQ(data, read_decompressed_text_file("testfile.zst")) << size;
+
+        write_raw("testfile", data);
+        EXPECT_EQ(data, read_decompressed_text_file("testfile")) << size;
+    }
+
+    // Concatenated gzip members, followed by padding.
+    write_gzip("part1.gz", "hello ");
+    write_gzip("part2.gz", "world");
+    write_raw("testfile.gz", read_text_file("part1.gz") + read_text_file("part2.gz") + string(10, '\0'));
+    EXPECT_EQ("hello world", read_decompressed_text_file("testfile.gz"));
+
+    // Concatenated zstd frames.
+    write_raw("testfile.zst", zstd_compress("hello ") + zstd_compress("world"));
+    EXPECT_EQ("hello world", read_decompressed_text_file("testfile.zst"));
+
+    // The size in the trailer of the last member is too small, so the buffer must grow.
+    string big = test_data(500000);
+    write_gzip("part2.gz", big);
+    write_raw("testfile.gz", read_text_file("part2.gz") + read_text_file("part1.gz"));
+    EXPECT_EQ(big + "hello ", read_decompressed_text_file("testfile.gz"));
+
+    remove("part1.gz");
+    remove("part2.gz");
+    remove("testfile");
+    remove("testfile.gz");
+    remove("testfile.zst");
+}
+
+TEST(FileIO, decompress_file_into)
+{
+    string data1 = test_data(300000);
+    string data2 = test_data(1234);
+    write_gzip("testfile.gz", data1);
+    write_raw("testfile.zst", zstd_compress(data2));
+
+    vector<uint8_t> arena;
+    EXPECT_EQ(data1.size(), decompress_file_into("testfile.gz", arena));
+    EXPECT_EQ(data2.size(), decompress_file_into("testfile.zst", arena));
+    EXPECT_EQ(data1 + data2, string(arena.begin(), arena.end()));
+
+    // On error, the arena is unchanged.
+    string bad = read_text_file("testfile.gz");
+    bad.resize(bad.size() / 2);
+    write_raw("bad.gz", bad);
+    EXPECT_THROW(decompress_file_into("bad.gz", arena), FileException);
+    EXPECT_EQ(data1.size() + data2.size(), arena.size());
+
+    remove("bad.gz");
+    remove("testfile.gz");
+    remove("testfile.zst");
+}
+
+TEST(FileIO, read_decompressed_file_exceptions)
+{
+    try
+    {
+        read_decompressed_text_file("no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot open \"no_such_file\": No such file or directory (errno = 2)",
+                     e.what());
+    }
+
+    // Truncated gzip file
+    write_gzip("testfile.gz", test_data(100000));
+    string compressed = read_text_file("testfile.gz");
+    write_raw("bad.gz", compressed.substr(0, compressed.size() - 100));
+    try
+    {
+        read_decompressed_text_file("bad.gz");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot decompress \"bad.gz\": unexpected end of compressed data "
+                     "(errno = 0)",
+                     e.what());
+    }
+
+    // Corrupt gzip file
+    compressed[3] = '\xff';     // Reserved flag bits
+    write_raw("bad.gz", compressed);
+    try
+    {
+        read_decompressed_binary_file("bad.gz");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot decompress \"bad.gz\": unknown header flags set (errno = 0)",
+                     e.what());
+    }
+
+    // Truncated zstd file
+    compressed = zstd_compress(test_data(100000));
+    write_raw("bad.zst", compressed.substr(0, compressed.size() - 10));
+    try
+    {
+        read_decompressed_text_file("bad.zst");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot decompress \"bad.zst\": unexpected end of compressed data "
+                     "(errno = 0)",
+                     e.what());
+    }
+
+    // Corrupt zstd file
+    write_raw("bad.zst", compressed.substr(0, 4) + string(100, 'x'));
+    EXPECT_THROW(read_decompressed_text_file("bad.zst"), FileException);
+
+    remove("bad.gz");
+    remove("bad.zst");
+    remove("testfile.gz");
+}
+
+// Compares the throughput of read_binary_file() and read_large_binary_file().
+// The page cache for the file is dropped before each read, so this measures the device.
+// Run with --gtest_also_run_disabled_tests. UNITY_BENCH_FILE_MB sets the file size (default 512).
+
+TEST(FileIO, DISABLED_benchmark_read_large_binary_file)
+{
+    char const* env = getenv("UNITY_BENCH_FILE_MB");
+    size_t const mb = env ? atoi(env) : 512;
+
+    {
+        vector<char> block(1024 * 1024, 'x');
+        ofstream f("benchfile", ios::binary);
+        for (size_t i = 0; i < mb; ++i)
+        {
+            f.write(block.data(), block.size());
+        }
+    }
+
+    auto drop_cache = []
+    {
+        int fd = open("benchfile", O_RDONLY);
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    };
+
+    auto measure = [&](string const& name, function<size_t()> const& read)
+    {
+        drop_cache();
+        auto start = chrono::steady_clock::now();
+        size_t bytes = read();
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << name << ": " << bytes / secs / (1024 * 1024) << " MB/s" << endl;
+    };
+
+    measure("read_binary_file", []{ return read_binary_file("benchfile").size(); });
+    for (unsigned concurrency : { 1, 2, 4, 8, 16 })
+    {
+        LargeFileReadOptions options;
+        options.concurrency = concurrency;
+        measure("read_large_binary_file, concurrency " + to_string(concurrency),
+                [&]{ return read_large_binary_file("benchfile", options).size(); });
+    }
+
+    remove("benchfile");
+}
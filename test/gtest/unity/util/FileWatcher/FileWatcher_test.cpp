@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/FileWatcher.h>
+#include <test/gtest/unity/util/TestDir.h>
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+chrono::milliseconds const window(100);
+
+void write_file(string const& filename, string const& contents)
+{
+    ofstream f(filename, ios::binary);
+    f << contents;
+}
+
+// Collects the notifications that were delivered.
+
+class Collector
+{
+public:
+    FileWatcher::Callback callback()
+    {
+        return [this](FileWatcher::Change const& change)
+        {
+            lock_guard<mutex> lock(mutex_);
+            changes_[change.path] |= change.events;
+            ++count_[change.path];
+            thread_ = this_thread::get_id();
+            cond_.notify_all();
+        };
+    }
+
+    // Waits until a notification for path arrives, and then for another coalescing window
+    // to make sure that no further notifications follow.
+    bool wait_for(string const& path)
+    {
+        unique_lock<mutex> lock(mutex_);
+        bool found = cond_.wait_for(lock, chrono::seconds(5), [&]{ return changes_.count(path) != 0; });
+        lock.unlock();
+        this_thread::sleep_for(window * 3);
+        return found;
+    }
+
+    unsigned events(string const& path)
+    {
+        lock_guard<mutex> lock(mutex_);
+        return changes_.count(path) ? changes_[path] : 0;
+    }
+
+    int count(string const& path)
+    {
+        lock_guard<mutex> lock(mutex_);
+        return count_.count(path) ? count_[path] : 0;
+    }
+
+    size_t size()
+    {
+        lock_guard<mutex> lock(mutex_);
+        return changes_.size();
+    }
+
+    thread::id thread_id()
+    {
+        lock_guard<mutex> lock(mutex_);
+        return thread_;
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cond_;
+    map<string, unsigned> changes_;
+    map<string, int> count_;
+    thread::id thread_;
+};
+
+} // namespace
+
+TEST(FileWatcher, file)
+{
+    TestDir dir;
+    string const file = dir.path() + "/file";
+
+    Collector c;
+    FileWatcher watcher(c.callback(), window);
+    watcher.add_file(file);     // Doesn't exist yet
+
+    write_file(dir.path() + "/other", "x");
+    write_file(file, "hello");
+    chmod(file.c_str(), 0600);
+
+    ASSERT_TRUE(c.wait_for(file));
+    EXPECT_EQ(FileWatcher::created | FileWatcher::modified | FileWatcher::attributes, c.events(file));
+    EXPECT_EQ(1, c.count(file));
+    EXPECT_EQ(1u, c.size());    // Nothing for "other"
+
+    ::unlink(file.c_str());
+    this_thread::sleep_for(window * 3);
+    EXPECT_EQ(FileWatcher::created | FileWatcher::modified | FileWatcher::attributes | FileWatcher::removed,
+              c.events(file));
+    EXPECT_EQ(2, c.count(file));
+}
+
+TEST(FileWatcher, editor_save)
+{
+    TestDir dir;
+    string const file = dir.path() + "/file";
+    string const tmp = dir.path() + "/.file.swp";
+    write_file(file, "old");
+
+    Collector c;
+    FileWatcher watcher(c.callback(), window);
+    watcher.add_file(file);
+
+    // Write a new version, rename it over the original, and fix the permissions.
+    write_file(tmp, "new");
+    ASSERT_EQ(0, rename(tmp.c_str(), file.c_str()));
+    chmod(file.c_str(), 0644);
+
+    ASSERT_TRUE(c.wait_for(file));
+    EXPECT_EQ(FileWatcher::created | FileWatcher::attributes, c.events(file));
+    EXPECT_EQ(1, c.count(file));
+    EXPECT_EQ(1u, c.size());
+
+    // The file is still watched after being replaced.
+    write_file(file, "newer");
+    this_thread::sleep_for(window * 3);
+    EXPECT_EQ(2, c.count(file));
+}
+
+TEST(FileWatcher, directory)
+{
+    TestDir dir;
+    mkdir((dir.path() + "/sub").c_str(), 0700);
+
+    Collector c;
+    FileWatcher watcher(c.callback(), window);
+    watcher.add_directory(dir.path() + "/");    // Trailing slash is ignored
+
+    write_file(dir.path() + "/a", "a");
+    write_file(dir.path() + "/sub/b", "b");     // Not recursive, so not reported
+    ASSERT_TRUE(c.wait_for(dir.path() + "/a"));
+    EXPECT_EQ(FileWatcher::created | FileWatcher::modified, c.events(dir.path() + "/a"));
+    EXPECT_EQ(0u, c.events(dir.path() + "/sub/b"));
+
+    // Removing the directory reports it as removed.
+    ASSERT_EQ(0, system(("rm -rf " + dir.path() + "/*").c_str()));
+    ASSERT_EQ(0, rmdir(dir.path().c_str()));
+    ASSERT_TRUE(c.wait_for(dir.path()));
+    EXPECT_TRUE(c.events(dir.path()) & FileWatcher::removed);
+    EXPECT_TRUE(c.events(dir.path() + "/a") & FileWatcher::removed);
+}
+
+TEST(FileWatcher, recursive)
+{
+    TestDir dir;
+    mkdir((dir.path() + "/sub").c_str(), 0700);
+
+    Collector c;
+    FileWatcher watcher(c.callback(), window);
+    watcher.add_directory(dir.path(), true);
+
+    write_file(dir.path() + "/sub/a", "a");
+    ASSERT_TRUE(c.wait_for(dir.path() + "/sub/a"));
+
+    // A new sub-directory is watched, and files created in it before its watch is in place are reported.
+    string const newdir = dir.path() + "/new";
+    mkdir(newdir.c_str(), 0700);
+    mkdir((newdir + "/deeper").c_str(), 0700);
+    write_file(newdir + "/deeper/b", "b");
+    ASSERT_TRUE(c.wait_for(newdir + "/deeper/b"));
+    EXPECT_TRUE(c.events(newdir) & FileWatcher::created);
+    EXPECT_TRUE(c.events(newdir + "/deeper") & FileWatcher::created);
+
+    write_file(newdir + "/deeper/c", "c");
+    ASSERT_TRUE(c.wait_for(newdir + "/deeper/c"));
+    EXPECT_EQ(FileWatcher::created | FileWatcher::modified, c.events(newdir + "/deeper/c"));
+}
+
+TEST(FileWatcher, remove)
+{
+    TestDir dir;
+    string const file = dir.path() + "/file";
+
+    Collector c;
+    FileWatcher watcher(c.callback(), window);
+    watcher.add_file(file);
+    watcher.add_directory(dir.path());
+    watcher.remove(dir.path());
+    watcher.remove("not_watched");
+
+    write_file(file, "x");
+    ASSERT_TRUE(c.wait_for(file));
+    EXPECT_EQ(1u, c.size());
+
+    watcher.remove(file);
+    write_file(file, "y");
+    this_thread::sleep_for(window * 3);
+    EXPECT_EQ(1, c.count(file));
+}
+
+TEST(FileWatcher, several_watchers)
+{
+    TestDir dir;
+    string const file = dir.path() + "/file";
+
+    Collector c1;
+    Collector c2;
+    FileWatcher w1(c1.callback(), window);
+    unique_ptr<FileWatcher> w2(new FileWatcher(c2.callback(), chrono::milliseconds(0)));
+    w1.add_file(file);
+    w2->add_directory(dir.path());
+
+    write_file(file, "x");
+    ASSERT_TRUE(c1.wait_for(file));
+    ASSERT_TRUE(c2.wait_for(file));
+
+    // Destroying one watcher does not affect the other, even though both use the same inotify watch.
+    w2.reset();
+    write_file(file, "y");
+    this_thread::sleep_for(window * 3);
+    EXPECT_EQ(2, c1.count(file));
+}
+
+TEST(FileWatcher, executor)
+{
+    TestDir dir;
+    string const file = dir.path() + "/file";
+
+    mutex m;
+    condition_variable cond;
+    deque<function<void()>> tasks;
+    auto executor = [&](function<void()> const& task)
+    {
+        lock_guard<mutex> lock(m);
+        tasks.push_back(task);
+        cond.notify_all();
+    };
+
+    Collector c;
+    FileWatcher watcher(c.callback(), window, executor);
+    watcher.add_file(file);
+    write_file(file, "x");
+
+    function<void()> task;
+    {
+        unique_lock<mutex> lock(m);
+        ASSERT_TRUE(cond.wait_for(lock, chrono::seconds(5), [&]{ return !tasks.empty(); }));
+        task = tasks.front();
+        tasks.pop_front();
+    }
+    EXPECT_EQ(0u, c.size());
+    task();
+    EXPECT_EQ(FileWatcher::created | FileWatcher::modified, c.events(file));
+    EXPECT_EQ(this_thread::get_id(), c.thread_id());
+}
+
+TEST(FileWatcher, destroy_in_callback)
+{
+    TestDir dir;
+    string const file = dir.path() + "/file";
+
+    mutex m;
+    condition_variable cond;
+    bool called = false;
+    FileWatcher* watcher = nullptr;
+    watcher = new FileWatcher([&](FileWatcher::Change const&)
+    {
+        delete watcher;     // Last watcher, so this also shuts down the service thread.
+        lock_guard<mutex> lock(m);
+        called = true;
+        cond.notify_all();
+    }, chrono::milliseconds(0));
+    watcher->add_file(file);
+    write_file(file, "x");
+
+    unique_lock<mutex> lock(m);
+    ASSERT_TRUE(cond.wait_for(lock, chrono::seconds(5), [&]{ return called; }));
+    lock.unlock();
+
+    // A new watcher starts a new service.
+    Collector c;
+    FileWatcher w(c.callback(), window);
+    w.add_file(file);
+    write_file(file, "y");
+    EXPECT_TRUE(c.wait_for(file));
+}
+
+TEST(FileWatcher, exceptions)
+{
+    try
+    {
+        FileWatcher w(nullptr);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: FileWatcher(): callback must not be empty", e.what());
+    }
+
+    Collector c;
+    FileWatcher watcher(c.callback());
+    try
+    {
+        watcher.add_directory("no_such_dir");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot watch \"no_such_dir\": No such file or directory (errno = 2)",
+                     e.what());
+    }
+    try
+    {
+        watcher.add_file("no_such_dir/file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot watch \"no_such_dir\": No such file or directory (errno = 2)",
+                     e.what());
+    }
+    write_file("not_a_dir", "");
+    try
+    {
+        watcher.add_directory("not_a_dir");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot watch \"not_a_dir\": Not a directory (errno = 20)", e.what());
+    }
+    ::unlink("not_a_dir");
+}
+
+// Compares the CPU time needed to detect a change among many files with FileWatcher
+// and by polling stat(). Set UNITY_BENCH_FILES to change the number of files.
+
+TEST(FileWatcher, DISABLED_benchmark_cpu)
+{
+    char const* env = getenv("UNITY_BENCH_FILES");
+    int const num_files = env ? atoi(env) : 10000;
+    chrono::seconds const duration(5);
+    chrono::milliseconds const poll_interval(100);
+
+    TestDir dir;
+    vector<string> files;
+    for (int i = 0; i < num_files; ++i)
+    {
+        files.push_back(dir.path() + "/file" + to_string(i));
+        write_file(files.back(), "x");
+    }
+
+    auto cpu_time = []
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return chrono::seconds(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+               + chrono::microseconds(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+    };
+
+    // Touch one file every second while measuring.
+    auto touch_files = [&](function<void()> const& idle)
+    {
+        auto const end = chrono::steady_clock::now() + duration;
+        int i = 0;
+        while (chrono::steady_clock::now() < end)
+        {
+            write_file(files[i++ % files.size()], "y");
+            idle();
+        }
+    };
+
+    {
+        Collector c;
+        auto start = cpu_time();
+        FileWatcher watcher(c.callback(), window);
+        watcher.add_directory(dir.path());
+        touch_files([]{ this_thread::sleep_for(chrono::seconds(1)); });
+        auto cpu = chrono::duration_cast<chrono::milliseconds>(cpu_time() - start);
+        cout << "FileWatcher, " << num_files << " files: " << cpu.count() << " ms CPU in " << duration.count()
+             << " s, " << c.size() << " changes seen" << endl;
+    }
+
+    {
+        map<string, struct timespec> mtimes;
+        for (auto const& f : files)
+        {
+            struct stat st;
+            stat(f.c_str(), &st);
+            mtimes[f] = st.st_mtim;
+        }
+        int changes = 0;
+        auto start = cpu_time();
+        touch_files([&]
+        {
+            auto const end = chrono::steady_clock::now() + chrono::seconds(1);
+            while (chrono::steady_clock::now() < end)
+            {
+                for (auto const& f : files)
+                {
+                    struct stat st;
+                    if (stat(f.c_str(), &st) == 0)
+                    {
+                        auto& t = mtimes[f];
+                        if (t.tv_sec != st.st_mtim.tv_sec || t.tv_nsec != st.st_mtim.tv_nsec)
+                        {
+                            t = st.st_mtim;
+                            ++changes;
+                        }
+                    }
+                }
+                this_thread::sleep_for(poll_interval);
+            }
+        });
+        auto cpu = chrono::duration_cast<chrono::milliseconds>(cpu_time() - start);
+        cout << "stat() polling every " << poll_interval.count() << " ms, " << num_files << " files: "
+             << cpu.count() << " ms CPU in " << duration.count() << " s, " << changes << " changes seen" << endl;
+    }
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/GDBusCaller.h>
+#include <libqtdbustest/DBusTestRunner.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+using namespace QtDBusTest;
+
+namespace
+{
+
+char const* const DBUS_NAME = "org.freedesktop.DBus";
+char const* const DBUS_PATH = "/org/freedesktop/DBus";
+
+GDBusMethodCall get_name_owner(char const* name)
+{
+    return GDBusMethodCall{ DBUS_NAME, DBUS_PATH, DBUS_NAME, "GetNameOwner",
+                            share_glib(g_variant_ref_sink(g_variant_new("(s)", name))), "(s)" };
+}
+
+string reply_string(GVariantSPtr const& reply)
+{
+    gchar const* s = nullptr;
+    g_variant_get(reply.get(), "(&s)", &s);
+    return s;
+}
+
+class GDBusCallerTest: public testing::Test
+{
+protected:
+    static void SetUpTestCase()
+    {
+        g_log_set_always_fatal((GLogLevelFlags) (G_LOG_LEVEL_CRITICAL | G_LOG_FLAG_FATAL));
+    }
+
+    void SetUp() override
+    {
+        bus_ = getSessionBus();
+        ASSERT_TRUE(bool(bus_));
+        executor_ = make_shared<GlibExecutor>();
+    }
+
+    static GObjectSPtr<GDBusConnection> getSessionBus()
+    {
+        auto address = unique_glib(g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, nullptr, nullptr));
+
+        auto bus = unique_gobject(
+                g_dbus_connection_new_for_address_sync(address.get(), (GDBusConnectionFlags) (G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION), nullptr,
+                        nullptr, nullptr));
+
+        g_dbus_connection_set_exit_on_close(bus.get(), FALSE);
+
+        return bus;
+    }
+
+    // The method handler runs in the default main context, which this test never iterates,
+    // so calls to the method never receive a reply.
+
+    static void on_method_call(GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*,
+                               GVariant*, GDBusMethodInvocation*, gpointer)
+    {
+    }
+
+    guint registerHangingObject(GDBusConnection* bus)
+    {
+        GDBusNodeInfo* node = g_dbus_node_info_new_for_xml(
+                "<node><interface name='com.canonical.Test'><method name='Hang'/></interface></node>", nullptr);
+        GDBusInterfaceVTable vtable{};
+        vtable.method_call = on_method_call;
+        guint id = g_dbus_connection_register_object(bus, "/hang", node->interfaces[0], &vtable, nullptr, nullptr, nullptr);
+        g_dbus_node_info_unref(node);
+        return id;
+    }
+
+    DBusTestRunner dbusTestRunner;
+
+    GObjectSPtr<GDBusConnection> bus_;
+
+    GlibExecutor::SPtr executor_;
+};
+
+TEST_F(GDBusCallerTest, call)
+{
+    GDBusCaller caller(bus_, executor_);
+
+    auto f = caller.call(DBUS_NAME, DBUS_PATH, DBUS_NAME, "GetId", nullptr, "(s)");
+    EXPECT_FALSE(reply_string(f.get()).empty());
+
+    f = caller.call(DBUS_NAME, DBUS_PATH, DBUS_NAME, "NameHasOwner",
+                    g_variant_new("(s)", g_dbus_connection_get_unique_name(bus_.get())));
+    gboolean has_owner = FALSE;
+    g_variant_get(f.get().get(), "(b)", &has_owner);
+    EXPECT_TRUE(has_owner);
+}
+
+TEST_F(GDBusCallerTest, call_all)
+{
+    GDBusCaller caller(bus_, executor_);
+
+    vector<GDBusMethodCall> calls;
+    for (int i = 0; i < 50; ++i)
+    {
+        calls.push_back(get_name_owner(DBUS_NAME));
+    }
+    calls.push_back(get_name_owner(g_dbus_connection_get_unique_name(bus_.get())));
+
+    auto replies = GDBusCaller::join(caller.call_all(calls));
+    ASSERT_EQ(51u, replies.size());
+    for (int i = 0; i < 50; ++i)
+    {
+        EXPECT_EQ(DBUS_NAME, reply_string(replies[i]));
+    }
+    EXPECT_EQ(g_dbus_connection_get_unique_name(bus_.get()), reply_string(replies[50]));
+
+    EXPECT_TRUE(GDBusCaller::join(caller.call_all({})).empty());
+}
+
+TEST_F(GDBusCallerTest, errors)
+{
+    GDBusCaller caller(bus_, executor_);
+
+    auto f = caller.call(DBUS_NAME, DBUS_PATH, DBUS_NAME, "NoSuchMethod");
+    try
+    {
+        f.get();
+        FAIL();
+    }
+    catch (ResourceException const& e)
+    {
+        EXPECT_NE(string::npos, e.reason().find("org.freedesktop.DBus.NoSuchMethod: "));
+    }
+
+    // join() waits for all calls and throws the first error.
+    auto futures = caller.call_all({ get_name_owner("com.canonical.NoSuchName"),
+                                     get_name_owner(DBUS_NAME),
+                                     get_name_owner("com.canonical.NoSuchName2") });
+    try
+    {
+        GDBusCaller::join(move(futures));
+        FAIL();
+    }
+    catch (ResourceException const& e)
+    {
+        EXPECT_NE(string::npos, e.reason().find("com.canonical.NoSuchName"));
+        EXPECT_EQ(string::npos, e.reason().find("com.canonical.NoSuchName2"));
+    }
+
+    try
+    {
+        GDBusCaller(nullptr, executor_);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GDBusCaller(): bus must not be null", e.what());
+    }
+    try
+    {
+        GDBusCaller(bus_, nullptr);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GDBusCaller(): executor must not be null", e.what());
+    }
+
+    executor_->shutdown();
+    EXPECT_THROW(caller.call(DBUS_NAME, DBUS_PATH, DBUS_NAME, "GetId"), LogicException);
+}
+
+TEST_F(GDBusCallerTest, cancel)
+{
+    auto server = getSessionBus();
+    guint id = registerHangingObject(server.get());
+    string server_name = g_dbus_connection_get_unique_name(server.get());
+
+    future<GVariantSPtr> hanging;
+    {
+        GDBusCaller caller(bus_, executor_);
+        hanging = caller.call(server_name, "/hang", "com.canonical.Test", "Hang");
+        EXPECT_EQ(future_status::timeout, hanging.wait_for(chrono::milliseconds(200)));
+
+        // cancel() affects only the calls made before it.
+        caller.cancel();
+        EXPECT_THROW(hanging.get(), ResourceException);
+
+        hanging = caller.call(server_name, "/hang", "com.canonical.Test", "Hang");
+        auto f = caller.call(DBUS_NAME, DBUS_PATH, DBUS_NAME, "GetId");
+        f.get();
+        EXPECT_EQ(future_status::timeout, hanging.wait_for(chrono::milliseconds(0)));
+    }   // Destructor cancels the pending call.
+    try
+    {
+        hanging.get();
+        FAIL();
+    }
+    catch (ResourceException const& e)
+    {
+        EXPECT_NE(string::npos, e.reason().find("com.canonical.Test.Hang: "));
+    }
+
+    g_dbus_connection_unregister_object(server.get(), id);
+}
+
+// Compares reading 100 values with g_dbus_connection_call_sync() one after the other
+// and with pipelined calls through GDBusCaller.
+
+TEST_F(GDBusCallerTest, DISABLED_benchmark_pipelined)
+{
+    int const count = 100;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        auto reply = share_glib(g_dbus_connection_call_sync(bus_.get(), DBUS_NAME, DBUS_PATH, DBUS_NAME, "GetNameOwner",
+                                                            g_variant_new("(s)", DBUS_NAME), G_VARIANT_TYPE("(s)"),
+                                                            G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr));
+        ASSERT_TRUE(bool(reply));
+    }
+    chrono::duration<double, milli> serial = chrono::steady_clock::now() - start;
+
+    GDBusCaller caller(bus_, executor_);
+    vector<GDBusMethodCall> calls(count, get_name_owner(DBUS_NAME));
+    start = chrono::steady_clock::now();
+    auto replies = GDBusCaller::join(caller.call_all(calls));
+    chrono::duration<double, milli> pipelined = chrono::steady_clock::now() - start;
+    ASSERT_EQ(size_t(count), replies.size());
+
+    cout << "serial:    " << serial.count() << " ms for " << count << " calls" << endl;
+    cout << "pipelined: " << pipelined.count() << " ms for " << count << " calls" << endl;
+}
+
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/GDBusSignalManager.h>
+#include <unity/util/GlibMemory.h>
+#include <libqtdbustest/DBusTestRunner.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+using namespace QtDBusTest;
+
+namespace
+{
+
+char const* const IFACE = "com.canonical.Test";
+char const* const OTHER_IFACE = "com.canonical.Other";
+
+class GDBusSignalManagerTest: public testing::Test
+{
+protected:
+    static void SetUpTestCase()
+    {
+        g_log_set_always_fatal((GLogLevelFlags) (G_LOG_LEVEL_CRITICAL | G_LOG_FLAG_FATAL));
+    }
+
+    void SetUp() override
+    {
+        bus_ = getSessionBus();
+        emitter_ = getSessionBus();
+        ASSERT_TRUE(bool(bus_));
+        ASSERT_TRUE(bool(emitter_));
+        emitter_name_ = g_dbus_connection_get_unique_name(emitter_.get());
+    }
+
+    static GObjectSPtr<GDBusConnection> getSessionBus()
+    {
+        auto address = unique_glib(g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, nullptr, nullptr));
+
+        auto bus = unique_gobject(
+                g_dbus_connection_new_for_address_sync(address.get(), (GDBusConnectionFlags) (G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION), nullptr,
+                        nullptr, nullptr));
+
+        g_dbus_connection_set_exit_on_close(bus.get(), FALSE);
+
+        return bus;
+    }
+
+    void emit(string const& path, char const* iface, char const* signal, int value)
+    {
+        g_dbus_connection_emit_signal(emitter_.get(), nullptr, path.c_str(), iface, signal,
+                                      g_variant_new("(i)", value), nullptr);
+    }
+
+    // Makes sure that the match rules are in place before we emit signals.
+    void sync()
+    {
+        auto reply = share_glib(g_dbus_connection_call_sync(bus_.get(), "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                            "org.freedesktop.DBus", "GetId", nullptr, nullptr,
+                                                            G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr));
+    }
+
+    // Iterates the default main context until count signals have arrived, or five seconds have passed.
+    void wait_for(size_t const& received, size_t count)
+    {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (received < count && chrono::steady_clock::now() < deadline)
+        {
+            g_main_context_iteration(nullptr, FALSE);
+        }
+    }
+
+    DBusTestRunner dbusTestRunner;
+
+    GObjectSPtr<GDBusConnection> bus_;
+
+    GObjectSPtr<GDBusConnection> emitter_;
+
+    string emitter_name_;
+};
+
+TEST_F(GDBusSignalManagerTest, dispatch)
+{
+    GDBusSignalManager manager(bus_);
+
+    list<string> received;
+    auto handler = [&received](const gchar* path, const gchar* signal, GVariant* params)
+    {
+        gint32 value;
+        g_variant_get(params, "(i)", &value);
+        received.push_back(string(path) + " " + signal + " " + to_string(value));
+    };
+
+    auto c1 = manager.subscribe(emitter_name_, IFACE, "/a", "Changed", handler);
+    auto c2 = manager.subscribe(emitter_name_, IFACE, "/b", "Changed", handler);
+    auto c3 = manager.subscribe(emitter_name_, IFACE, "/b", "", handler);  // All signals on /b
+    auto c4 = manager.subscribe(emitter_name_, OTHER_IFACE, "/a", "Changed", handler);
+    EXPECT_EQ(2u, manager.rule_count());
+    EXPECT_EQ(4u, manager.handler_count());
+    sync();
+
+    emit("/a", IFACE, "Changed", 1);
+    emit("/a", IFACE, "Removed", 2);        // No handler
+    emit("/c", IFACE, "Changed", 3);        // No handler
+    emit("/b", IFACE, "Removed", 4);
+    emit("/b", IFACE, "Changed", 5);        // Two handlers
+    emit("/a", OTHER_IFACE, "Changed", 6);
+
+    size_t count = 0;
+    auto counter = manager.subscribe(emitter_name_, OTHER_IFACE, "/a", "Done", [&count](const gchar*, const gchar*, GVariant*){ ++count; });
+    sync();
+    emit("/a", OTHER_IFACE, "Done", 0);
+    wait_for(count, 1);
+
+    EXPECT_EQ(list<string>({ "/a Changed 1", "/b Removed 4", "/b Changed 5", "/b Changed 5", "/a Changed 6" }), received);
+}
+
+TEST_F(GDBusSignalManagerTest, unsubscribe)
+{
+    GDBusSignalManager manager(bus_);
+
+    size_t count = 0;
+    auto handler = [&count](const gchar*, const gchar*, GVariant*){ ++count; };
+    vector<GDBusSharedSignalConnection> connections;
+    for (int i = 0; i < 10; ++i)
+    {
+        connections.push_back(manager.subscribe(emitter_name_, IFACE, "/obj" + to_string(i), "Changed", handler));
+    }
+    EXPECT_EQ(1u, manager.rule_count());
+    EXPECT_EQ(10u, manager.handler_count());
+    sync();
+
+    emit("/obj3", IFACE, "Changed", 0);
+    wait_for(count, 1);
+    EXPECT_EQ(1u, count);
+
+    connections[3].dealloc();
+    EXPECT_EQ(9u, manager.handler_count());
+    EXPECT_EQ(1u, manager.rule_count());
+    emit("/obj3", IFACE, "Changed", 0);
+    emit("/obj4", IFACE, "Changed", 0);
+    wait_for(count, 2);
+    EXPECT_EQ(2u, count);
+
+    // Removing the last handler removes the match rule.
+    connections.clear();
+    EXPECT_EQ(0u, manager.handler_count());
+    EXPECT_EQ(0u, manager.rule_count());
+
+    // A handler can remove itself.
+    GDBusSharedSignalConnection self;
+    self = manager.subscribe(emitter_name_, IFACE, "/self", "Changed", [&](const gchar*, const gchar*, GVariant*)
+    {
+        ++count;
+        self.dealloc();
+    });
+    sync();
+    emit("/self", IFACE, "Changed", 0);
+    wait_for(count, 3);
+    EXPECT_EQ(3u, count);
+    EXPECT_EQ(0u, manager.rule_count());
+}
+
+TEST_F(GDBusSignalManagerTest, lifetime)
+{
+    GDBusSharedSignalConnection c;
+    {
+        GDBusSignalManager manager(bus_);
+        c = manager.subscribe("", IFACE, "/a", "Changed", [](const gchar*, const gchar*, GVariant*){});
+    }
+    c.dealloc();    // No-op, the manager is gone.
+}
+
+TEST_F(GDBusSignalManagerTest, exceptions)
+{
+    try
+    {
+        GDBusSignalManager(nullptr);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GDBusSignalManager(): bus must not be null", e.what());
+    }
+
+    GDBusSignalManager manager(bus_);
+    auto handler = [](const gchar*, const gchar*, GVariant*){};
+    try
+    {
+        manager.subscribe("", "", "/a", "Changed", handler);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GDBusSignalManager::subscribe(): "
+                     "interface and object path must not be empty", e.what());
+    }
+    try
+    {
+        manager.subscribe("", IFACE, "/a", "Changed", nullptr);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GDBusSignalManager::subscribe(): "
+                     "handler must not be empty", e.what());
+    }
+    EXPECT_EQ(0u, manager.rule_count());
+}
+
+// Subscribes to a signal on 200 objects, once with a gdbus_signal_connection() per object and once
+// through a GDBusSignalManager, and measures the time to subscribe and to receive one signal per object.
+
+TEST_F(GDBusSignalManagerTest, DISABLED_benchmark_many_objects)
+{
+    size_t const objects = 200;
+    size_t count = 0;
+
+    auto start = chrono::steady_clock::now();
+    {
+        struct Counter
+        {
+            static void on_signal(GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*,
+                                  GVariant*, gpointer user_data)
+            {
+                ++*static_cast<size_t*>(user_data);
+            }
+        };
+        vector<GDBusSignalConnection> connections;
+        for (size_t i = 0; i < objects; ++i)
+        {
+            string path = "/obj" + to_string(i);
+            connections.push_back(gdbus_signal_connection(
+                    g_dbus_connection_signal_subscribe(bus_.get(), emitter_name_.c_str(), IFACE, "Changed", path.c_str(), nullptr,
+                                                       G_DBUS_SIGNAL_FLAGS_NONE, Counter::on_signal, &count, nullptr), bus_));
+        }
+        sync();
+        for (size_t i = 0; i < objects; ++i)
+        {
+            emit("/obj" + to_string(i), IFACE, "Changed", 0);
+        }
+        wait_for(count, objects);
+    }
+    chrono::duration<double, milli> individual = chrono::steady_clock::now() - start;
+    ASSERT_EQ(objects, count);
+
+    count = 0;
+    start = chrono::steady_clock::now();
+    {
+        GDBusSignalManager manager(bus_);
+        vector<GDBusSharedSignalConnection> connections;
+        for (size_t i = 0; i < objects; ++i)
+        {
+            connections.push_back(manager.subscribe(emitter_name_, IFACE, "/obj" + to_string(i), "Changed",
+                                                    [&count](const gchar*, const gchar*, GVariant*){ ++count; }));
+        }
+        sync();
+        for (size_t i = 0; i < objects; ++i)
+        {
+            emit("/obj" + to_string(i), IFACE, "Changed", 0);
+        }
+        wait_for(count, objects);
+    }
+    chrono::duration<double, milli> shared = chrono::steady_clock::now() - start;
+    ASSERT_EQ(objects, count);
+
+    cout << "individual match rules: " << individual.count() << " ms" << endl;
+    cout << "shared match rule:      " << shared.count() << " ms" << endl;
+}
+
+}
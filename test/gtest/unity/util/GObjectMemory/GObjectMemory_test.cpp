@@ -20,6 +20,8 @@
 #include <unity/util/GlibMemory.h>
 #include <unity/util/GObjectMemory.h>
 #include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
 #include <list>
 #include <string>
 #include <unordered_set>
@@ -530,6 +532,144 @@ TEST_F(GObjectMemoryTest, signals)
     EXPECT_EQ(list<string>{"change1"}, nameChanges_);
 }
 
+TEST_F(GObjectMemoryTest, intrusiveRefcount)
+{
+    GObject* o = G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr));
+    {
+        auto p1 = intrusive_gobject(o);
+        EXPECT_EQ(1, o->ref_count);
+        {
+            GObjectPtr<GObject> p2 = p1;
+            EXPECT_EQ(2, o->ref_count);
+            GObjectPtr<GObject> p3;
+            p3 = p2;
+            EXPECT_EQ(3, o->ref_count);
+            GObjectPtr<GObject> p4(std::move(p3));
+            EXPECT_EQ(3, o->ref_count);
+            EXPECT_TRUE(!p3);
+            EXPECT_TRUE(p4 == p1);
+        }
+        EXPECT_EQ(1, o->ref_count);
+        g_object_ref(o);
+    }
+    EXPECT_EQ(1, o->ref_count);
+    g_object_unref(o);
+}
+
+TEST_F(GObjectMemoryTest, intrusiveDeletesGObjects)
+{
+    {
+        auto a = intrusive_gobject(foo_bar_new_full("a", 1));
+        auto b = intrusive_gobject(foo_bar_new_full("b", 2));
+        auto c = a;
+        a = b;
+        EXPECT_TRUE(DELETED_OBJECTS.empty());
+        c = nullptr;
+        EXPECT_EQ(list<Deleted>({{"a", 1}}), DELETED_OBJECTS);
+        b.reset(foo_bar_new_full("c", 3));
+    }
+    EXPECT_EQ(list<Deleted>({{"a", 1}, {"c", 3}, {"b", 2}}), DELETED_OBJECTS);
+}
+
+TEST_F(GObjectMemoryTest, intrusiveReleaseSwapCompare)
+{
+    FooBar* o1 = foo_bar_new();
+    FooBar* o2 = foo_bar_new();
+    if (o1 > o2) {
+        std::swap(o1, o2);
+    }
+    auto p1 = intrusive_gobject(o1);
+    auto p2 = intrusive_gobject(o2);
+    EXPECT_TRUE(p1 < p2);
+    EXPECT_TRUE(p1 != p2);
+    EXPECT_TRUE(p1 != nullptr);
+
+    swap(p1, p2);
+    EXPECT_EQ(o2, p1.get());
+    EXPECT_EQ(o1, p2.get());
+
+    EXPECT_EQ(o2, p1.release());
+    EXPECT_TRUE(p1 == nullptr);
+    g_object_unref(o2);
+
+    unordered_set<GObjectPtr<FooBar>> s;
+    s.emplace(p2);
+    s.emplace(p2);
+    EXPECT_EQ(1, s.size());
+    EXPECT_EQ(2, G_OBJECT(o1)->ref_count);
+}
+
+TEST_F(GObjectMemoryTest, intrusiveFloating)
+{
+    auto o = G_INITIALLY_UNOWNED(g_object_new(G_TYPE_INITIALLY_UNOWNED, nullptr));
+    EXPECT_THROW(intrusive_gobject(o), invalid_argument);
+    g_object_ref_sink(G_OBJECT(o));
+    intrusive_gobject(o);
+}
+
+TEST_F(GObjectMemoryTest, intrusiveAssigner)
+{
+    {
+        GObjectPtr<FooBar> o;
+        foo_bar_assigner_full("o", 1, assign_gobject(o));
+        ASSERT_TRUE(bool(o));
+        EXPECT_EQ(1, G_OBJECT(o.get())->ref_count);
+        foo_bar_assigner_null(assign_gobject(o));
+        ASSERT_FALSE(bool(o));
+    }
+    EXPECT_EQ(list<Deleted>({{"o", 1}}), DELETED_OBJECTS);
+}
+
+TEST_F(GObjectMemoryTest, intrusiveSize)
+{
+    EXPECT_EQ(sizeof(FooBar*), sizeof(GObjectPtr<FooBar>));
+}
+
+// Compares the cost of copying and destroying a GObjectPtr and a GObjectSPtr, and of wrapping a new object.
+
+TEST_F(GObjectMemoryTest, DISABLED_benchmark_intrusive)
+{
+    int const iterations = 10000000;
+    auto shared = share_gobject(foo_bar_new());
+    auto intrusive = intrusive_gobject(foo_bar_new());
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        GObjectSPtr<FooBar> copy(shared);
+    }
+    chrono::duration<double, nano> shared_copy = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        GObjectPtr<FooBar> copy(intrusive);
+    }
+    chrono::duration<double, nano> intrusive_copy = chrono::steady_clock::now() - start;
+
+    int const wrap_iterations = 1000000;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < wrap_iterations; ++i)
+    {
+        auto p = share_gobject(G_OBJECT(g_object_ref(shared.get())));
+    }
+    chrono::duration<double, nano> shared_wrap = chrono::steady_clock::now() - start;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < wrap_iterations; ++i)
+    {
+        auto p = intrusive_gobject(G_OBJECT(g_object_ref(intrusive.get())));
+    }
+    chrono::duration<double, nano> intrusive_wrap = chrono::steady_clock::now() - start;
+
+    cout << "GObjectSPtr: sizeof = " << sizeof(GObjectSPtr<FooBar>)
+         << ", copy/destroy " << shared_copy.count() / iterations << " ns"
+         << ", wrap/destroy " << shared_wrap.count() / wrap_iterations << " ns" << endl;
+    cout << "GObjectPtr:  sizeof = " << sizeof(GObjectPtr<FooBar>)
+         << ", copy/destroy " << intrusive_copy.count() / iterations << " ns"
+         << ", wrap/destroy " << intrusive_wrap.count() / wrap_iterations << " ns" << endl;
+}
+
 typedef pair<const char*, guint> GObjectMemoryMakeSharedTestParam;
 
 class GObjectMemoryMakeHelperMethodsTest: public testing::TestWithParam<GObjectMemoryMakeSharedTestParam>
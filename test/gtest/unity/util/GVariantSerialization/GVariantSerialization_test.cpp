@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/GVariantSerialization.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+constexpr bool equal(char const* a, char const* b)
+{
+    return *a == *b && (*a == '\0' || equal(a + 1, b + 1));
+}
+
+// The type strings are compile-time constants.
+static_assert(equal("i", gvariant_type_string<int32_t>()), "int32_t");
+static_assert(equal("ay", gvariant_type_string<vector<uint8_t>>()), "vector<uint8_t>");
+static_assert(equal("a{sv}", gvariant_type_string<map<string, GVariantSPtr>>()), "map<string, GVariantSPtr>");
+static_assert(equal("(sa(ib)t)", gvariant_type_string<tuple<string, vector<pair<int32_t, bool>>, uint64_t>>()),
+              "tuple");
+static_assert(equal("()", gvariant_type_string<tuple<>>()), "tuple<>");
+
+string print(GVariantSPtr const& v)
+{
+    auto s = unique_glib(g_variant_print(v.get(), TRUE));
+    return s.get();
+}
+
+template<typename T>
+T round_trip(T const& value)
+{
+    auto v = to_gvariant(value);
+    EXPECT_FALSE(g_variant_is_floating(v.get()));
+    return from_gvariant<T>(v.get());
+}
+
+TEST(GVariantSerialization, basic)
+{
+    EXPECT_EQ("true", print(to_gvariant(true)));
+    EXPECT_EQ("byte 0xff", print(to_gvariant(uint8_t(255))));
+    EXPECT_EQ("int16 -3", print(to_gvariant(int16_t(-3))));
+    EXPECT_EQ("-7", print(to_gvariant(int32_t(-7))));
+    EXPECT_EQ("uint64 18446744073709551615", print(to_gvariant(UINT64_MAX)));
+    EXPECT_EQ("'hello'", print(to_gvariant(string("hello"))));
+
+    EXPECT_EQ(false, round_trip(false));
+    EXPECT_EQ(uint16_t(65535), round_trip(uint16_t(65535)));
+    EXPECT_EQ(INT32_MIN, round_trip(INT32_MIN));
+    EXPECT_EQ(UINT32_MAX, round_trip(UINT32_MAX));
+    EXPECT_EQ(INT64_MIN, round_trip(INT64_MIN));
+    EXPECT_EQ(1.5, round_trip(1.5));
+    EXPECT_EQ(string("a\xc3\xa4z"), round_trip(string("a\xc3\xa4z")));
+    EXPECT_EQ("", round_trip(string()));
+
+    auto boxed = round_trip(to_gvariant(int32_t(5)));
+    EXPECT_EQ(5, from_gvariant<int32_t>(boxed.get()));
+}
+
+TEST(GVariantSerialization, containers)
+{
+    vector<int32_t> ints{ 1, -2, 3 };
+    EXPECT_EQ("[1, -2, 3]", print(to_gvariant(ints)));
+    EXPECT_EQ(ints, round_trip(ints));
+    EXPECT_EQ(vector<int32_t>(), round_trip(vector<int32_t>()));
+    EXPECT_EQ("@ai []", print(to_gvariant(vector<int32_t>())));
+
+    vector<bool> bools{ true, false };
+    EXPECT_EQ(bools, round_trip(bools));
+
+    vector<string> strings{ "a", "", "c" };
+    EXPECT_EQ(strings, round_trip(strings));
+    EXPECT_EQ("@as []", print(to_gvariant(vector<string>())));
+
+    vector<vector<double>> nested{ { 1.0 }, {}, { 2.0, 3.0 } };
+    EXPECT_EQ(nested, round_trip(nested));
+
+    map<string, vector<int32_t>> m{ { "a", { 1, 2 } }, { "b", {} } };
+    EXPECT_EQ("{'a': [1, 2], 'b': []}", print(to_gvariant(m)));
+    EXPECT_EQ(m, round_trip(m));
+
+    unordered_map<uint32_t, string> um{ { 1, "one" }, { 2, "two" } };
+    EXPECT_EQ(um, round_trip(um));
+
+    auto t = make_tuple(string("x"), int64_t(-1), vector<pair<int32_t, bool>>{ { 1, true }, { 2, false } });
+    EXPECT_EQ("('x', int64 -1, [(1, true), (2, false)])", print(to_gvariant(t)));
+    EXPECT_EQ(t, round_trip(t));
+
+    EXPECT_EQ("()", print(to_gvariant(tuple<>())));
+    EXPECT_EQ(make_pair(string("k"), 1.0), round_trip(make_pair(string("k"), 1.0)));
+}
+
+TEST(GVariantSerialization, compatible_with_format_strings)
+{
+    auto v = share_glib(g_variant_ref_sink(g_variant_new("(sa{sv}ay)", "name", nullptr, nullptr)));
+    typedef tuple<string, map<string, GVariantSPtr>, vector<uint8_t>> T;
+    auto t = from_gvariant<T>(v.get());
+    EXPECT_EQ("name", get<0>(t));
+    EXPECT_TRUE(get<1>(t).empty());
+    EXPECT_TRUE(get<2>(t).empty());
+
+    map<string, GVariantSPtr> props{ { "size", to_gvariant(uint32_t(10)) } };
+    auto p = to_gvariant(props);
+    auto size = share_glib(g_variant_lookup_value(p.get(), "size", G_VARIANT_TYPE("u")));
+    ASSERT_TRUE(bool(size));
+    guint32 value = 0;
+    g_variant_get(size.get(), "u", &value);
+    EXPECT_EQ(10u, value);
+}
+
+TEST(GVariantSerialization, fixed_array)
+{
+    vector<uint8_t> bytes{ 0, 1, 2, 255 };
+    auto v = to_gvariant(bytes);
+
+    GVariantFixedArray<uint8_t> view(v.get());
+    ASSERT_EQ(4u, view.size());
+    EXPECT_FALSE(view.empty());
+    EXPECT_EQ(bytes, vector<uint8_t>(view.begin(), view.end()));
+    EXPECT_EQ(255, view[3]);
+
+    // The view points into the GVariant's data, and keeps the GVariant alive.
+    gsize n;
+    EXPECT_EQ(g_variant_get_fixed_array(v.get(), &n, 1), view.data());
+    v.reset();
+    EXPECT_EQ(2, view[2]);
+
+    GVariantFixedArray<double> empty(to_gvariant(vector<double>()).get());
+    EXPECT_TRUE(empty.empty());
+    EXPECT_EQ(empty.begin(), empty.end());
+}
+
+TEST(GVariantSerialization, exceptions)
+{
+    auto v = to_gvariant(int32_t(1));
+    try
+    {
+        from_gvariant<string>(v.get());
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: from_gvariant(): expected type 's', got 'i'", e.what());
+    }
+    try
+    {
+        from_gvariant<int32_t>(nullptr);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: from_gvariant(): variant must not be null", e.what());
+    }
+    try
+    {
+        GVariantFixedArray<uint8_t> view(v.get());
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GVariantFixedArray(): expected type 'ay', got 'i'", e.what());
+    }
+    try
+    {
+        GVariantFixedArray<uint8_t> view(nullptr);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: GVariantFixedArray(): expected type 'ay', got 'null'", e.what());
+    }
+
+    // Nested types are checked as well.
+    auto t = to_gvariant(make_tuple(string("a"), vector<int32_t>{ 1 }));
+    EXPECT_THROW((from_gvariant<tuple<string, vector<uint32_t>>>(t.get())), InvalidArgumentException);
+}
+
+// Compares building and reading a "(sua{si}ay)" value with format strings and with the typed helpers.
+
+TEST(GVariantSerialization, DISABLED_benchmark_round_trip)
+{
+    int const iterations = 100000;
+    map<string, int32_t> dict{ { "one", 1 }, { "two", 2 }, { "three", 3 } };
+    vector<uint8_t> bytes(256, 'x');
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        GVariantBuilder dict_builder;
+        g_variant_builder_init(&dict_builder, G_VARIANT_TYPE("a{si}"));
+        for (auto const& e : dict)
+        {
+            g_variant_builder_add(&dict_builder, "{si}", e.first.c_str(), e.second);
+        }
+        GVariantBuilder bytes_builder;
+        g_variant_builder_init(&bytes_builder, G_VARIANT_TYPE("ay"));
+        for (auto b : bytes)
+        {
+            g_variant_builder_add(&bytes_builder, "y", b);
+        }
+        auto v = share_glib(g_variant_ref_sink(g_variant_new("(sua{si}ay)", "name", guint32(i),
+                                                             &dict_builder, &bytes_builder)));
+
+        gchar* name;
+        guint32 n;
+        GVariantIter* dict_iter;
+        GVariantIter* bytes_iter;
+        g_variant_get(v.get(), "(sua{si}ay)", &name, &n, &dict_iter, &bytes_iter);
+        map<string, int32_t> d;
+        gchar* key;
+        gint32 value;
+        while (g_variant_iter_loop(dict_iter, "{si}", &key, &value))
+        {
+            d.emplace(key, value);
+        }
+        vector<uint8_t> b;
+        guchar byte;
+        while (g_variant_iter_loop(bytes_iter, "y", &byte))
+        {
+            b.push_back(byte);
+        }
+        g_variant_iter_free(dict_iter);
+        g_variant_iter_free(bytes_iter);
+        g_free(name);
+        ASSERT_EQ(bytes.size(), b.size());
+    }
+    chrono::duration<double, micro> format = chrono::steady_clock::now() - start;
+
+    typedef tuple<string, uint32_t, map<string, int32_t>, vector<uint8_t>> T;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto v = to_gvariant(T(string("name"), uint32_t(i), dict, bytes));
+        auto t = from_gvariant<T>(v.get());
+        ASSERT_EQ(bytes.size(), get<3>(t).size());
+    }
+    chrono::duration<double, micro> typed = chrono::steady_clock::now() - start;
+
+    cout << "format strings: " << format.count() / iterations << " us per round trip" << endl;
+    cout << "typed:          " << typed.count() / iterations << " us per round trip" << endl;
+}
+
+}
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/util/GlibExecutor.h>
+#include <unity/UnityExceptions.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+TEST(GlibExecutor, submit)
+{
+    GlibExecutor executor;
+    EXPECT_FALSE(executor.is_executor_thread());
+
+    auto f = executor.submit([&executor]
+    {
+        EXPECT_TRUE(executor.is_executor_thread());
+        EXPECT_EQ(executor.context(), g_main_context_get_thread_default());
+        return 42;
+    });
+    EXPECT_EQ(42, f.get());
+
+    auto v = executor.submit([]{});
+    v.get();
+
+    auto e = executor.submit([]() -> int { throw SyscallException("test", 99); });
+    try
+    {
+        e.get();
+        FAIL();
+    }
+    catch (SyscallException const& e)
+    {
+        EXPECT_EQ(99, e.error());
+    }
+}
+
+TEST(GlibExecutor, order)
+{
+    vector<int> order;
+    {
+        GlibExecutor executor;
+        for (int i = 0; i < 1000; ++i)
+        {
+            executor.post([&order, i]{ order.push_back(i); });
+        }
+        executor.post([]{ throw 42; });     // Ignored
+    }
+    ASSERT_EQ(1000u, order.size());
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST(GlibExecutor, callback)
+{
+    GMainContext* reply_context = g_main_context_new();
+    GlibExecutor executor;
+
+    thread::id task_thread;
+    thread::id callback_thread;
+    int result = 0;
+    executor.submit([&task_thread]{ task_thread = this_thread::get_id(); return 7; },
+                    reply_context,
+                    [&](future<int> f)
+                    {
+                        callback_thread = this_thread::get_id();
+                        result = f.get();
+                    });
+    while (result == 0)
+    {
+        g_main_context_iteration(reply_context, TRUE);
+    }
+    EXPECT_EQ(7, result);
+    EXPECT_EQ(this_thread::get_id(), callback_thread);
+    EXPECT_NE(this_thread::get_id(), task_thread);
+
+    executor.shutdown();
+    g_main_context_unref(reply_context);
+}
+
+TEST(GlibExecutor, gobjects)
+{
+    GObject* o = G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr));
+    g_object_ref(o);
+    EXPECT_EQ(2u, o->ref_count);
+    {
+        GlibExecutor executor;
+
+        // A GObject captured by a task is released on the executor thread once the task has run.
+        auto p = intrusive_gobject(G_OBJECT(g_object_ref(o)));
+        executor.submit([p]{}).get();
+        p = nullptr;
+        executor.submit([]{}).get();
+        EXPECT_EQ(2u, o->ref_count);
+
+        executor.hold(intrusive_gobject(G_OBJECT(g_object_ref(o))));
+        executor.hold(share_gobject(G_OBJECT(g_object_ref(o))));
+        EXPECT_EQ(4u, o->ref_count);
+
+        // Tasks can return GObjects.
+        auto f = executor.submit([o]{ return intrusive_gobject(G_OBJECT(g_object_ref(o))); });
+        EXPECT_EQ(o, f.get().get());
+        EXPECT_EQ(4u, o->ref_count);
+    }
+    EXPECT_EQ(2u, o->ref_count);
+    g_object_unref(o);
+    g_object_unref(o);
+}
+
+namespace
+{
+
+// Records the thread on which a GObject is finalized.
+
+void finalized(gpointer data, GObject*)
+{
+    auto p = static_cast<promise<thread::id>*>(data);
+    p->set_value(this_thread::get_id());
+}
+
+} // namespace
+
+TEST(GlibExecutor, task_releases_on_executor_thread)
+{
+    GMainContext* reply_context = g_main_context_new();
+    GlibExecutor executor;
+    auto executor_thread = executor.submit([]{ return this_thread::get_id(); }).get();
+
+    // The future stays alive after the task has run, but the task's captures are released anyway.
+    {
+        promise<thread::id> finalize_thread;
+        auto o = intrusive_gobject(G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr)));
+        g_object_weak_ref(o.get(), finalized, &finalize_thread);
+        auto f = executor.submit([o]{ return 1; });
+        o = nullptr;
+        EXPECT_EQ(1, f.get());
+        auto released = finalize_thread.get_future();
+        ASSERT_EQ(future_status::ready, released.wait_for(chrono::seconds(0)));
+        EXPECT_EQ(executor_thread, released.get());
+    }
+
+    // The same holds for the callback overload, where the future is destroyed on the reply context.
+    {
+        promise<thread::id> finalize_thread;
+        auto o = intrusive_gobject(G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr)));
+        g_object_weak_ref(o.get(), finalized, &finalize_thread);
+        future<void> result;
+        bool called = false;
+        executor.submit([o]{},
+                        reply_context,
+                        [&](future<void> f)
+                        {
+                            result = move(f);
+                            called = true;
+                        });
+        o = nullptr;
+        while (!called)
+        {
+            g_main_context_iteration(reply_context, TRUE);
+        }
+        auto released = finalize_thread.get_future();
+        ASSERT_EQ(future_status::ready, released.wait_for(chrono::seconds(0)));
+        EXPECT_EQ(executor_thread, released.get());
+    }
+
+    executor.shutdown();
+    g_main_context_unref(reply_context);
+}
+
+TEST(GlibExecutor, hold_releases_on_executor_thread)
+{
+    GlibExecutor executor;
+    auto executor_thread = executor.submit([]{ return this_thread::get_id(); }).get();
+
+    atomic<bool> released(false);
+    thread::id release_thread;
+    executor.hold(shared_ptr<void>(nullptr, [&](void*)
+    {
+        release_thread = this_thread::get_id();
+        released = true;
+    }));
+    EXPECT_FALSE(released);
+    executor.shutdown();
+    EXPECT_TRUE(released);
+    EXPECT_EQ(executor_thread, release_thread);
+}
+
+TEST(GlibExecutor, shutdown)
+{
+    GlibExecutor executor;
+    atomic<int> count(0);
+
+    // Tasks queued before shutdown, and tasks they queue, still run.
+    executor.post([&executor, &count]
+    {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        ++count;
+        executor.post([&count]{ ++count; });
+    });
+    executor.shutdown();
+    EXPECT_EQ(2, count);
+    executor.shutdown();
+
+    try
+    {
+        executor.post([]{});
+        FAIL();
+    }
+    catch (LogicException const& e)
+    {
+        EXPECT_STREQ("unity::LogicException: GlibExecutor::post(): executor has been shut down", e.what());
+    }
+    try
+    {
+        executor.hold(make_shared<int>(1));
+        FAIL();
+    }
+    catch (LogicException const& e)
+    {
+        EXPECT_STREQ("unity::LogicException: GlibExecutor::hold(): executor has been shut down", e.what());
+    }
+    EXPECT_THROW(executor.submit([]{ return 1; }), LogicException);
+}
+
+TEST(GlibExecutor, shutdown_from_task)
+{
+    GlibExecutor executor;
+    auto f = executor.submit([&executor]{ executor.shutdown(); });
+    try
+    {
+        f.get();
+        FAIL();
+    }
+    catch (LogicException const& e)
+    {
+        EXPECT_STREQ("unity::LogicException: GlibExecutor::shutdown(): cannot be called from the executor thread",
+                     e.what());
+    }
+}
+
+TEST(GlibExecutor, threads)
+{
+    GlibExecutor executor;
+    atomic<int> count(0);
+
+    vector<thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&]
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                executor.post([&count]{ ++count; });
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    executor.shutdown();
+    EXPECT_EQ(8000, count);
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/HotRestart.h>
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+void stop_successor(pid_t pid)
+{
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+}
+
+bool exists(pid_t pid)
+{
+    return waitpid(pid, nullptr, WNOHANG) == 0;
+}
+
+} // namespace
+
+TEST(HotRestart, add_fd)
+{
+    HotRestart r;
+    r.add_fd("stdin", 0);
+
+    try
+    {
+        r.add_fd("stdin", 1);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: HotRestart::add_fd(): duplicate name: \"stdin\"", e.what());
+    }
+
+    try
+    {
+        r.add_fd("", 1);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: HotRestart::add_fd(): invalid name: \"\"", e.what());
+    }
+    EXPECT_THROW(r.add_fd(string(256, 'x'), 1), InvalidArgumentException);
+
+    try
+    {
+        r.add_fd("bad", 9999);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: HotRestart::add_fd(): invalid file descriptor: 9999", e.what());
+    }
+}
+
+TEST(HotRestart, not_a_successor)
+{
+    unsetenv("UNITY_HOT_RESTART_FD");
+    EXPECT_EQ(nullptr, HotRestart::Successor::attach());
+
+    setenv("UNITY_HOT_RESTART_FD", "abc", 1);
+    try
+    {
+        HotRestart::Successor::attach();
+        FAIL();
+    }
+    catch (SyscallException const& e)
+    {
+        EXPECT_STREQ("unity::SyscallException: HotRestart: invalid value for UNITY_HOT_RESTART_FD: \"abc\" "
+                     "(errno = 9)",
+                     e.what());
+    }
+    EXPECT_EQ(nullptr, getenv("UNITY_HOT_RESTART_FD"));
+}
+
+TEST(HotRestart, many_fds)
+{
+    // More descriptors than fit into a single message.
+
+    int report[2];
+    ASSERT_EQ(0, pipe(report));
+
+    HotRestart r;
+    r.add_fd("report", report[1]);
+    for (int i = 0; i < 150; ++i)
+    {
+        r.add_fd("fd" + to_string(i), report[0]);
+    }
+    pid_t pid = r.start_successor({ SUCCESSOR_PATH, "report" }, chrono::seconds(10));
+    close(report[1]);
+
+    char buf[16] = {};
+    ASSERT_GT(read(report[0], buf, sizeof(buf) - 1), 0);
+    EXPECT_STREQ("151", buf);
+    close(report[0]);
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+TEST(HotRestart, exceptions)
+{
+    HotRestart r;
+
+    EXPECT_THROW(r.start_successor({}, chrono::seconds(1)), InvalidArgumentException);
+
+    try
+    {
+        r.start_successor({ "no_such_program" }, chrono::seconds(10));
+        FAIL();
+    }
+    catch (SyscallException const& e)
+    {
+        EXPECT_STREQ("unity::SyscallException: HotRestart: cannot execute \"no_such_program\" (errno = 2)",
+                     e.what());
+    }
+
+    try
+    {
+        r.start_successor({ SUCCESSOR_PATH, "exit" }, chrono::seconds(10));
+        FAIL();
+    }
+    catch (ResourceException const& e)
+    {
+        EXPECT_EQ("unity::ResourceException: HotRestart: successor \"" SUCCESSOR_PATH "\" exited before it became ready",
+                  e.to_string());
+    }
+
+    auto start = chrono::steady_clock::now();
+    try
+    {
+        r.start_successor({ SUCCESSOR_PATH, "hang" }, chrono::milliseconds(200));
+        FAIL();
+    }
+    catch (ResourceException const& e)
+    {
+        EXPECT_EQ("unity::ResourceException: HotRestart: successor \"" SUCCESSOR_PATH "\" did not become ready "
+                  "within 200 ms",
+                  e.to_string());
+    }
+    EXPECT_LT(chrono::steady_clock::now() - start, chrono::seconds(5));
+}
+
+// Clients connect to a listening socket in a tight loop while the server is replaced by its successor.
+// Every connection must be answered (first by the old server with 'O', then by the successor with 'N'),
+// and we report the longest time between two answered connections.
+
+TEST(HotRestart, handoff)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_NE(-1, listen_fd);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, ::bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)));
+    ASSERT_EQ(0, listen(listen_fd, 128));
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &len));
+
+    // The old server.
+
+    atomic<bool> stop_old(false);
+    thread old_server([&]
+    {
+        while (!stop_old)
+        {
+            struct pollfd pfd = { listen_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 10) == 1)
+            {
+                int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+                if (fd != -1)
+                {
+                    char const c = 'O';
+                    if (write(fd, &c, 1)) {}
+                    close(fd);
+                }
+            }
+        }
+    });
+
+    // The client.
+
+    atomic<bool> stop_client(false);
+    int old_answers = 0;
+    int new_answers = 0;
+    int failures = 0;
+    chrono::steady_clock::duration max_gap(0);
+    thread client([&]
+    {
+        auto last = chrono::steady_clock::now();
+        while (!stop_client || new_answers == 0)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            char c = 0;
+            if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0 && read(fd, &c, 1) == 1)
+            {
+                auto now = chrono::steady_clock::now();
+                max_gap = max(max_gap, now - last);
+                last = now;
+                (c == 'O' ? old_answers : new_answers)++;
+            }
+            else
+            {
+                ++failures;
+            }
+            close(fd);
+        }
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    HotRestart r;
+    r.add_fd("listen", listen_fd);
+    pid_t pid = r.start_successor({ SUCCESSOR_PATH, "serve" }, chrono::seconds(10));
+
+    // Stop accepting and let the successor take over.
+
+    stop_old = true;
+    old_server.join();
+    close(listen_fd);
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    stop_client = true;
+    client.join();
+    EXPECT_TRUE(exists(pid));
+    stop_successor(pid);
+
+    EXPECT_EQ(0, failures);
+    EXPECT_GT(old_answers, 0);
+    EXPECT_GT(new_answers, 0);
+    cout << "old server: " << old_answers << " connections, successor: " << new_answers << " connections, "
+         << "longest gap: " << chrono::duration<double, milli>(max_gap).count() << " ms" << endl;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//
+// Successor process for HotRestart_test. The first argument selects the behavior:
+//
+// serve:  Takes the "listen" socket, notifies the old process, and answers each connection with 'N'
+//         until it is killed.
+// report: Writes the number of received descriptors to the "report" descriptor and notifies.
+// exit:   Exits without notifying.
+// hang:   Attaches, but never notifies.
+//
+
+#include <unity/util/HotRestart.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+using namespace std;
+using namespace unity::util;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        return 2;
+    }
+    string const mode = argv[1];
+
+    auto handoff = HotRestart::Successor::attach();
+    if (!handoff)
+    {
+        return 3;
+    }
+
+    if (mode == "serve")
+    {
+        int listen_fd = handoff->take_fd("listen");
+        if (listen_fd == -1)
+        {
+            return 4;
+        }
+        handoff->notify_ready();
+        for (;;)
+        {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd != -1)
+            {
+                char const c = 'N';
+                if (write(fd, &c, 1)) {}
+                close(fd);
+            }
+        }
+    }
+    if (mode == "report")
+    {
+        size_t const count = handoff->names().size();
+        int fd = handoff->take_fd("report");
+        if (fd == -1 || handoff->take_fd("report") != -1)
+        {
+            return 4;
+        }
+        string const msg = to_string(count);
+        if (write(fd, msg.data(), msg.size())) {}
+        close(fd);
+        handoff->notify_ready();
+        return 0;
+    }
+    if (mode == "hang")
+    {
+        for (;;)
+        {
+            pause();
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/LineReader.h>
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+#include <zlib.h>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+void write_file(string const& filename, string const& contents)
+{
+    ofstream f(filename, ios::binary);
+    f << contents;
+}
+
+vector<string> read_lines(LineReader& reader)
+{
+    vector<string> lines;
+    for (auto line : reader)
+    {
+        lines.push_back(line.str());
+    }
+    return lines;
+}
+
+} // namespace
+
+TEST(LineReader, memory)
+{
+    string data = "one\ntwo\n\nfour\r\nfive";
+    auto reader_ptr = LineReader::from_buffer(data.data(), data.size());
+    auto& reader = *reader_ptr;
+
+    StringView line;
+    ASSERT_TRUE(reader.next(line));
+    EXPECT_EQ(StringView("one"), line);
+    EXPECT_EQ(data.data(), line.data());    // No copy
+    ASSERT_TRUE(reader.next(line));
+    EXPECT_EQ("two", line.str());
+    ASSERT_TRUE(reader.next(line));
+    EXPECT_TRUE(line.empty());
+    ASSERT_TRUE(reader.next(line));
+    EXPECT_EQ("four\r", line.str());
+    ASSERT_TRUE(reader.next(line));
+    EXPECT_EQ("five", line.str());
+    EXPECT_FALSE(reader.next(line));
+    EXPECT_FALSE(reader.next(line));
+
+    auto empty = LineReader::from_buffer(nullptr, 0);
+    EXPECT_TRUE(read_lines(*empty).empty());
+
+    string newline = "\n";
+    auto one_empty_line = LineReader::from_buffer(newline.data(), newline.size());
+    EXPECT_EQ(vector<string>{ "" }, read_lines(*one_empty_line));
+}
+
+TEST(LineReader, string_view)
+{
+    StringView s("key=value");
+    EXPECT_TRUE(s.starts_with("key"));
+    EXPECT_TRUE(s.ends_with("value"));
+    EXPECT_FALSE(s.starts_with("value"));
+    EXPECT_FALSE(s.ends_with("key=value!"));
+
+    // A default-constructed view has a null data pointer.
+    StringView empty;
+    EXPECT_TRUE(empty.starts_with(StringView()));
+    EXPECT_TRUE(empty.ends_with(""));
+    EXPECT_FALSE(empty.starts_with("k"));
+    EXPECT_TRUE(s.starts_with(StringView()));
+    EXPECT_TRUE(s.ends_with(StringView()));
+}
+
+TEST(LineReader, file)
+{
+    vector<string> expected;
+    string contents;
+    for (int i = 0; i < 10000; ++i)
+    {
+        expected.push_back(string(i % 97, 'a' + i % 26));
+        contents += expected.back() + "\n";
+    }
+    write_file("lines", contents);
+
+    // A window size of 1 forces the window to grow; a window size of 100 forces
+    // lots of sliding, with lines that straddle window boundaries.
+
+    for (size_t window_size : { 1, 7, 100, 4096, 0 })
+    {
+        LineReader reader("lines", window_size);
+        EXPECT_EQ(expected, read_lines(reader)) << "window_size: " << window_size;
+    }
+
+    // Last line without terminating newline
+
+    write_file("lines", "abc\ndef");
+    LineReader reader("lines", 2);
+    EXPECT_EQ((vector<string>{ "abc", "def" }), read_lines(reader));
+
+    write_file("lines", "");
+    LineReader empty("lines");
+    EXPECT_TRUE(read_lines(empty).empty());
+}
+
+TEST(LineReader, long_line)
+{
+    string long_line(100000, 'x');
+    write_file("lines", "short\n" + long_line + "\nshort\n");
+
+    LineReader reader("lines", 16);
+    EXPECT_EQ((vector<string>{ "short", long_line, "short" }), read_lines(reader));
+}
+
+TEST(LineReader, compressed_file)
+{
+    string data;
+    for (int i = 0; i < 10000; ++i)
+    {
+        data += "line " + to_string(i) + "\n";
+    }
+    data += "last";
+
+    gzFile f = gzopen("lines.gz", "wb");
+    ASSERT_NE(nullptr, f);
+    gzwrite(f, data.data(), data.size());
+    gzclose(f);
+
+    auto reader = LineReader::from_compressed_file("lines.gz", 100);
+    auto lines = read_lines(*reader);
+    ASSERT_EQ(10001u, lines.size());
+    EXPECT_EQ("line 0", lines[0]);
+    EXPECT_EQ("line 9999", lines[9999]);
+    EXPECT_EQ("last", lines[10000]);
+
+    // Uncompressed files are read as is.
+    write_file("lines", "one\ntwo\n");
+    reader = LineReader::from_compressed_file("lines");
+    EXPECT_EQ((vector<string>{ "one", "two" }), read_lines(*reader));
+
+    remove("lines.gz");
+    remove("lines");
+}
+
+TEST(LineReader, exceptions)
+{
+    try
+    {
+        LineReader reader("no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot open \"no_such_file\": No such file or directory (errno = 2)",
+                  e.to_string());
+    }
+
+    LineReader reader(".");
+    StringView line;
+    try
+    {
+        reader.next(line);
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_EQ("unity::FileException: cannot read from \".\": Is a directory (errno = 21)", e.to_string());
+    }
+}
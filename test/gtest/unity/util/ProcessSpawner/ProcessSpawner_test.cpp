@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/ProcessSpawner.h>
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+int wait_for(pid_t pid)
+{
+    int status;
+    EXPECT_EQ(pid, waitpid(pid, &status, 0));
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+string read_all(int fd)
+{
+    string s;
+    char buf[256];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        s.append(buf, n);
+    }
+    return s;
+}
+
+// Runs the spawner with the child's stdout connected to a pipe and returns the output.
+
+string run(ProcessSpawner& spawner)
+{
+    int fds[2];
+    EXPECT_EQ(0, pipe2(fds, O_CLOEXEC));
+    spawner.map_fd(fds[1], 1);
+    pid_t pid = spawner.spawn();
+    close(fds[1]);
+    string output = read_all(fds[0]);
+    close(fds[0]);
+    EXPECT_EQ(0, wait_for(pid));
+    return output;
+}
+
+} // namespace
+
+TEST(ProcessSpawner, basic)
+{
+    ProcessSpawner spawner({ "true" });
+    EXPECT_EQ(0, wait_for(spawner.spawn()));
+    EXPECT_EQ(0, wait_for(spawner.spawn()));
+
+    ProcessSpawner echo({ "/bin/echo", "hello", "world" });
+    EXPECT_EQ("hello world\n", run(echo));
+
+    ProcessSpawner fail({ "/bin/sh", "-c", "exit 42" });
+    EXPECT_EQ(42, wait_for(fail.spawn()));
+}
+
+TEST(ProcessSpawner, map_fd)
+{
+    // Descriptors 7 and 8 are swapped in the child.
+
+    int p7[2];
+    int p8[2];
+    ASSERT_EQ(0, pipe2(p7, O_CLOEXEC));
+    ASSERT_EQ(0, pipe2(p8, O_CLOEXEC));
+    ASSERT_EQ(7, dup3(p7[1], 7, O_CLOEXEC));
+    ASSERT_EQ(8, dup3(p8[1], 8, O_CLOEXEC));
+    close(p7[1]);
+    close(p8[1]);
+
+    ProcessSpawner spawner({ "/bin/sh", "-c", "echo seven >&8; echo eight >&7" });
+    spawner.map_fd(7, 8);
+    spawner.map_fd(8, 7);
+    pid_t pid = spawner.spawn();
+    close(7);
+    close(8);
+    EXPECT_EQ("seven\n", read_all(p7[0]));
+    EXPECT_EQ("eight\n", read_all(p8[0]));
+    EXPECT_EQ(0, wait_for(pid));
+    close(p7[0]);
+    close(p8[0]);
+}
+
+TEST(ProcessSpawner, close_other_fds)
+{
+    int fd = dup2(0, 20);   // Not close-on-exec
+    ASSERT_EQ(20, fd);
+
+    {
+        ProcessSpawner spawner({ "/bin/sh", "-c", "[ -e /dev/fd/20 ] && echo open || echo closed" });
+        EXPECT_EQ("open\n", run(spawner));
+    }
+    {
+        ProcessSpawner spawner({ "/bin/sh", "-c", "[ -e /dev/fd/20 ] && echo open || echo closed" });
+        spawner.close_other_fds();
+        EXPECT_EQ("closed\n", run(spawner));
+    }
+    {
+        ProcessSpawner spawner({ "/bin/sh", "-c", "[ -e /dev/fd/21 ] && echo open || echo closed" });
+        spawner.map_fd(20, 21);
+        spawner.close_other_fds();
+        EXPECT_EQ("open\n", run(spawner));
+    }
+    close(fd);
+}
+
+TEST(ProcessSpawner, env)
+{
+    setenv("PROCESS_SPAWNER_TEST", "parent", 1);
+
+    ProcessSpawner spawner({ "/bin/sh", "-c", "echo \"$PROCESS_SPAWNER_TEST:${HOME-unset}:$FOO\"" });
+    spawner.set_env("FOO", "a=b");
+    spawner.unset_env("HOME");
+    EXPECT_EQ("parent:unset:a=b\n", run(spawner));
+
+    ProcessSpawner env({ "env" });
+    env.clear_env();
+    env.set_env("A", "1");
+    env.set_env("B", "2");
+    env.unset_env("B");
+    EXPECT_EQ("A=1\n", run(env));
+
+    unsetenv("PROCESS_SPAWNER_TEST");
+}
+
+TEST(ProcessSpawner, working_directory)
+{
+    ProcessSpawner spawner({ "pwd" });
+    spawner.set_working_directory("/");
+    EXPECT_EQ("/\n", run(spawner));
+
+    char buf[PATH_MAX];
+    ASSERT_NE(nullptr, getcwd(buf, sizeof(buf)));
+    ProcessSpawner inherited({ "pwd" });
+    EXPECT_EQ(string(buf) + "\n", run(inherited));
+}
+
+TEST(ProcessSpawner, process_group)
+{
+    ProcessSpawner spawner({ "sleep", "10" });
+    spawner.set_process_group(0);
+    pid_t pid = spawner.spawn();
+    EXPECT_EQ(pid, getpgid(pid));
+    kill(pid, SIGKILL);
+    EXPECT_EQ(-1, wait_for(pid));
+
+    ProcessSpawner inherited({ "sleep", "10" });
+    pid = inherited.spawn();
+    EXPECT_EQ(getpgrp(), getpgid(pid));
+    kill(pid, SIGKILL);
+    EXPECT_EQ(-1, wait_for(pid));
+}
+
+TEST(ProcessSpawner, rlimit)
+{
+    ProcessSpawner spawner({ "/bin/sh", "-c", "ulimit -n; ulimit -c" });
+    spawner.set_rlimit(RLIMIT_NOFILE, 200, 500);
+    spawner.set_rlimit(RLIMIT_NOFILE, 100, 200);
+    spawner.set_rlimit(RLIMIT_CORE, 0, 0);
+    EXPECT_EQ("100\n0\n", run(spawner));
+}
+
+TEST(ProcessSpawner, signals)
+{
+    // A handler installed in the parent is reset in the child, and the signal mask is inherited.
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = [](int){};
+    struct sigaction old_sa;
+    ASSERT_EQ(0, sigaction(SIGUSR1, &sa, &old_sa));
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR2);
+    sigset_t old_mask;
+    ASSERT_EQ(0, pthread_sigmask(SIG_BLOCK, &mask, &old_mask));
+
+    ProcessSpawner spawner({ "/bin/sh", "-c", "kill -USR2 $$; kill -USR1 $$; echo survived" });
+    int fds[2];
+    ASSERT_EQ(0, pipe2(fds, O_CLOEXEC));
+    spawner.map_fd(fds[1], 1);
+    pid_t pid = spawner.spawn();
+    close(fds[1]);
+    EXPECT_EQ("", read_all(fds[0]));
+    close(fds[0]);
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_TRUE(WIFSIGNALED(status));
+    EXPECT_EQ(SIGUSR1, WTERMSIG(status));
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+    sigaction(SIGUSR1, &old_sa, nullptr);
+}
+
+TEST(ProcessSpawner, exceptions)
+{
+    try
+    {
+        ProcessSpawner spawner({});
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ProcessSpawner(): args must not be empty", e.what());
+    }
+
+    ProcessSpawner spawner({ "true" });
+    try
+    {
+        spawner.map_fd(-1, 3);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ProcessSpawner::map_fd(): invalid file descriptor: "
+                     "parent_fd = -1, child_fd = 3",
+                     e.what());
+    }
+    spawner.map_fd(0, 3);
+    try
+    {
+        spawner.map_fd(1, 3);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ProcessSpawner::map_fd(): child_fd 3 is mapped already",
+                     e.what());
+    }
+    try
+    {
+        spawner.set_env("A=B", "x");
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ProcessSpawner::set_env(): invalid variable name: \"A=B\"",
+                     e.what());
+    }
+    EXPECT_THROW(spawner.unset_env(""), InvalidArgumentException);
+    try
+    {
+        spawner.set_process_group(-1);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ProcessSpawner::set_process_group(): "
+                     "invalid process group: -1",
+                     e.what());
+    }
+    try
+    {
+        spawner.set_rlimit(RLIMIT_NOFILE, 2, 1);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ProcessSpawner::set_rlimit(): invalid limit for resource 7",
+                     e.what());
+    }
+    EXPECT_THROW(spawner.set_rlimit(-1, 1, 1), InvalidArgumentException);
+    EXPECT_THROW(spawner.set_rlimit(RLIMIT_NLIMITS, 1, 1), InvalidArgumentException);
+}
+
+TEST(ProcessSpawner, spawn_errors)
+{
+    {
+        ProcessSpawner spawner({ "no_such_program" });
+        try
+        {
+            spawner.spawn();
+            FAIL();
+        }
+        catch (SyscallException const& e)
+        {
+            EXPECT_STREQ("unity::SyscallException: ProcessSpawner: cannot execute \"no_such_program\" (errno = 2)",
+                         e.what());
+        }
+    }
+    {
+        ProcessSpawner spawner({ "/no/such/program" });
+        EXPECT_THROW(spawner.spawn(), SyscallException);
+    }
+    {
+        ProcessSpawner spawner({ "true" });
+        spawner.map_fd(999, 3);
+        try
+        {
+            spawner.spawn();
+            FAIL();
+        }
+        catch (SyscallException const& e)
+        {
+            EXPECT_STREQ("unity::SyscallException: ProcessSpawner: cannot map file descriptor 999 to 3 (errno = 9)",
+                         e.what());
+        }
+    }
+    {
+        ProcessSpawner spawner({ "true" });
+        spawner.set_working_directory("/no/such/dir");
+        try
+        {
+            spawner.spawn();
+            FAIL();
+        }
+        catch (SyscallException const& e)
+        {
+            EXPECT_STREQ("unity::SyscallException: ProcessSpawner: cannot change working directory to "
+                         "\"/no/such/dir\" (errno = 2)",
+                         e.what());
+        }
+    }
+    {
+        // The pid of a child that was just reaped is not a process group in our session.
+        // (Process group 1 is not a safe choice: in a container, we may well be in init's session.)
+
+        pid_t gone = fork();
+        ASSERT_NE(-1, gone);
+        if (gone == 0)
+        {
+            _exit(0);
+        }
+        ASSERT_EQ(0, wait_for(gone));
+
+        ProcessSpawner spawner({ "true" });
+        spawner.set_process_group(gone);
+        EXPECT_THROW(spawner.spawn(), SyscallException);
+    }
+    {
+        // Raising the hard limit above the system maximum fails even with privileges.
+
+        ProcessSpawner spawner({ "true" });
+        spawner.set_rlimit(RLIMIT_NOFILE, RLIM_INFINITY, RLIM_INFINITY);
+        try
+        {
+            spawner.spawn();
+            FAIL();
+        }
+        catch (SyscallException const& e)
+        {
+            EXPECT_STREQ("unity::SyscallException: ProcessSpawner: cannot set limit for resource 7 (errno = 1)",
+                         e.what());
+        }
+    }
+
+    // No zombies are left behind.
+
+    EXPECT_EQ(-1, waitpid(-1, nullptr, WNOHANG));
+    EXPECT_EQ(ECHILD, errno);
+}
+
+// Compares the time to start a process with fork() and with ProcessSpawner from a process with a 1 GB heap.
+
+TEST(ProcessSpawner, DISABLED_benchmark_spawn)
+{
+    size_t const heap_size = 1024 * 1024 * 1024;
+    unique_ptr<char[]> heap(new char[heap_size]);
+    memset(heap.get(), 1, heap_size);
+
+    int const iterations = 200;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        pid_t pid = fork();
+        ASSERT_NE(-1, pid);
+        if (pid == 0)
+        {
+            execl("/bin/true", "true", nullptr);
+            _exit(127);
+        }
+        ASSERT_EQ(0, wait_for(pid));
+    }
+    chrono::duration<double, milli> fork_time = chrono::steady_clock::now() - start;
+
+    ProcessSpawner spawner({ "/bin/true" });
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        ASSERT_EQ(0, wait_for(spawner.spawn()));
+    }
+    chrono::duration<double, milli> spawn_time = chrono::steady_clock::now() - start;
+
+    cout << "fork() + exec(): " << fork_time.count() / iterations << " ms per process" << endl;
+    cout << "ProcessSpawner:  " << spawn_time.count() / iterations << " ms per process" << endl;
+}
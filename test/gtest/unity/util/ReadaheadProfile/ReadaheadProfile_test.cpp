@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/FileIO.h>
+#include <unity/util/LineReader.h>
+#include <unity/util/ReadaheadProfile.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+void write_file(string const& filename, string const& contents)
+{
+    ofstream f(filename, ios::binary);
+    f << contents;
+}
+
+string cwd()
+{
+    char buf[PATH_MAX];
+    return getcwd(buf, sizeof(buf));
+}
+
+vector<ReadaheadProfile::Range> ranges_for(ReadaheadProfile const& profile, string const& path)
+{
+    vector<ReadaheadProfile::Range> ranges;
+    for (auto const& r : profile.ranges())
+    {
+        if (r.path == path)
+        {
+            ranges.push_back(r);
+        }
+    }
+    return ranges;
+}
+
+} // namespace
+
+TEST(ReadaheadProfile, record)
+{
+    write_file("file1", "hello");
+    write_file("file2", "one\ntwo\n");
+
+    EXPECT_FALSE(ReadaheadProfile::is_recording());
+    read_text_file("file1");    // Not recorded
+
+    ReadaheadProfile::start_recording();
+    EXPECT_TRUE(ReadaheadProfile::is_recording());
+    read_text_file("file1");
+    read_binary_file(cwd() + "/file1");
+    LineReader reader("file2");
+    ReadaheadProfile::record("/some/other/file", 100, 50);
+    ReadaheadProfile::record("/some/other/file", 120, 100);
+    ReadaheadProfile::record("/some/other/file", 400, 10);
+    auto profile = ReadaheadProfile::stop_recording();
+    EXPECT_FALSE(ReadaheadProfile::is_recording());
+
+    read_text_file("file2");    // Not recorded
+
+    EXPECT_EQ(4u, profile->ranges().size());
+
+    auto ranges = ranges_for(*profile, "/some/other/file");
+    ASSERT_EQ(2u, ranges.size());
+    EXPECT_EQ(100u, ranges[0].offset);
+    EXPECT_EQ(120u, ranges[0].length);
+    EXPECT_EQ(400u, ranges[1].offset);
+    EXPECT_EQ(10u, ranges[1].length);
+
+    ranges = ranges_for(*profile, cwd() + "/file1");
+    ASSERT_EQ(1u, ranges.size());
+    EXPECT_EQ(0u, ranges[0].offset);
+    EXPECT_EQ(5u, ranges[0].length);
+
+    ranges = ranges_for(*profile, cwd() + "/file2");
+    ASSERT_EQ(1u, ranges.size());
+    EXPECT_EQ(0u, ranges[0].offset);
+    EXPECT_EQ(0u, ranges[0].length);
+
+    // A stopped recording produces an empty profile.
+    EXPECT_TRUE(ReadaheadProfile::stop_recording()->ranges().empty());
+}
+
+TEST(ReadaheadProfile, merge_to_eof)
+{
+    ReadaheadProfile::start_recording();
+    ReadaheadProfile::record("/f", 10, 10);
+    ReadaheadProfile::record("/f", 15, 0);
+    ReadaheadProfile::record("/f", 1000, 10);
+    ReadaheadProfile::record("/f", 0, 10);    // Adjacent to the first range
+    auto ranges = ReadaheadProfile::stop_recording()->ranges();
+
+    ASSERT_EQ(1u, ranges.size());
+    EXPECT_EQ(0u, ranges[0].offset);
+    EXPECT_EQ(0u, ranges[0].length);
+}
+
+TEST(ReadaheadProfile, save_load)
+{
+    ReadaheadProfile::start_recording();
+    ReadaheadProfile::record("/a", 0, 0);
+    ReadaheadProfile::record("/b/c", 4096, 8192);
+    ReadaheadProfile::record("/b/c", 0, 100);
+    auto profile = ReadaheadProfile::stop_recording();
+    profile->save("profile");
+
+    auto loaded = ReadaheadProfile::load("profile");
+    auto ranges = loaded->ranges();
+    ASSERT_EQ(3u, ranges.size());
+    EXPECT_EQ("/a", ranges[0].path);
+    EXPECT_EQ(0u, ranges[0].length);
+    EXPECT_EQ("/b/c", ranges[1].path);
+    EXPECT_EQ(0u, ranges[1].offset);
+    EXPECT_EQ(100u, ranges[1].length);
+    EXPECT_EQ("/b/c", ranges[2].path);
+    EXPECT_EQ(4096u, ranges[2].offset);
+    EXPECT_EQ(8192u, ranges[2].length);
+}
+
+TEST(ReadaheadProfile, exceptions)
+{
+    try
+    {
+        ReadaheadProfile::load("no_such_file");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot open \"no_such_file\": No such file or directory (errno = 2)",
+                     e.what());
+    }
+
+    write_file("bad_profile", "URAP");
+    try
+    {
+        ReadaheadProfile::load("bad_profile");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: \"bad_profile\" is not a valid readahead profile (errno = 0)",
+                     e.what());
+    }
+
+    ReadaheadProfile::start_recording();
+    auto profile = ReadaheadProfile::stop_recording();
+    try
+    {
+        profile->save("no_such_dir/profile");
+        FAIL();
+    }
+    catch (FileException const& e)
+    {
+        EXPECT_STREQ("unity::FileException: cannot open \"no_such_dir/profile.tmp\": "
+                     "No such file or directory (errno = 2)",
+                     e.what());
+    }
+}
+
+TEST(ReadaheadProfile, replay)
+{
+    write_file("file1", "hello");
+    write_file("file2", string(100000, 'x'));
+
+    ReadaheadProfile::start_recording();
+    read_text_file("file1");
+    read_text_file("file2");
+    ReadaheadProfile::record("/no/such/file", 0, 0);
+    ReadaheadProfile::record(cwd(), 0, 0);        // Directory, skipped
+    ReadaheadProfile::record("file1", 1000, 0);   // Beyond the end of the file
+    auto profile = ReadaheadProfile::stop_recording();
+
+    EXPECT_EQ(2u, profile->replay());
+    EXPECT_EQ(2u, profile->replay(1));
+    EXPECT_EQ(2u, profile->replay(100));
+}
+
+// Measures the time to read a set of files with a cold page cache, without and with
+// replaying a profile first. Set UNITY_BENCH_FILES to change the number of files.
+
+TEST(ReadaheadProfile, DISABLED_benchmark_replay)
+{
+    char const* env = getenv("UNITY_BENCH_FILES");
+    int const num_files = env ? atoi(env) : 500;
+
+    mkdir("benchdir", 0700);
+    vector<string> files;
+    for (int i = 0; i < num_files; ++i)
+    {
+        files.push_back("benchdir/file" + to_string(i));
+        write_file(files.back(), string(64 * 1024 + i * 97, 'x'));
+    }
+
+    auto drop_cache = [&]
+    {
+        for (auto const& f : files)
+        {
+            int fd = open(f.c_str(), O_RDONLY);
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    };
+
+    auto read_all = [&]
+    {
+        for (auto const& f : files)
+        {
+            read_binary_file(f);
+        }
+    };
+
+    auto measure = [&](string const& name, function<void()> const& f)
+    {
+        drop_cache();
+        auto start = chrono::steady_clock::now();
+        f();
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << name << ": " << secs * 1000 << " ms" << endl;
+    };
+
+    ReadaheadProfile::start_recording();
+    read_all();
+    auto profile = ReadaheadProfile::stop_recording();
+
+    measure("cold read", read_all);
+    measure("cold read with replay", [&]
+    {
+        thread preload([&]{ profile->replay(); });
+        read_all();
+        preload.join();
+    });
+    measure("replay, then read", [&]
+    {
+        profile->replay();
+        read_all();
+    });
+
+    for (auto const& f : files)
+    {
+        remove(f.c_str());
+    }
+    rmdir("benchdir");
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/ResourcePool.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace std;
+using namespace unity;
+using namespace unity::util;
+
+namespace
+{
+
+// Resources are numbered in the order they are created. We count how many were created and deleted.
+
+struct Tracker
+{
+    atomic<int> created{ 0 };
+    atomic<int> deleted{ 0 };
+
+    int create()
+    {
+        return ++created;
+    }
+
+    void destroy(int)
+    {
+        ++deleted;
+    }
+};
+
+Tracker tracker;
+
+int create_resource()
+{
+    return tracker.create();
+}
+
+void delete_resource(int r)
+{
+    tracker.destroy(r);
+}
+
+typedef ResourcePool<int, decltype(&delete_resource)> Pool;
+
+void reset_tracker()
+{
+    tracker.created = 0;
+    tracker.deleted = 0;
+}
+
+} // namespace
+
+TEST(ResourcePool, reuse)
+{
+    reset_tracker();
+    {
+        Pool pool(create_resource, delete_resource, 2);
+        EXPECT_EQ(0, pool.idle_count());
+        {
+            auto a = pool.acquire();
+            EXPECT_EQ(1, a.get());
+        }
+        EXPECT_EQ(1, pool.idle_count());
+        {
+            auto a = pool.acquire();
+            EXPECT_EQ(1, a.get());      // Reused
+            auto b = pool.acquire();
+            EXPECT_EQ(2, b.get());      // New
+        }
+        EXPECT_EQ(2, pool.idle_count());
+        EXPECT_EQ(2, tracker.created);
+        EXPECT_EQ(0, tracker.deleted);
+    }
+    EXPECT_EQ(2, tracker.deleted);  // Idle resources are deallocated with the pool.
+}
+
+TEST(ResourcePool, max_idle)
+{
+    reset_tracker();
+    {
+        Pool pool(create_resource, delete_resource, 6);
+        {
+            vector<Pool::Lease> leases;
+            for (int i = 0; i < 10; ++i)
+            {
+                leases.push_back(pool.acquire());
+            }
+        }
+        EXPECT_EQ(6, pool.idle_count());    // Some in slots, some in the list
+        EXPECT_EQ(4, tracker.deleted);
+
+        // All idle resources are handed out again before any new ones are created.
+
+        vector<Pool::Lease> leases;
+        for (int i = 0; i < 6; ++i)
+        {
+            leases.push_back(pool.acquire());
+        }
+        EXPECT_EQ(10, tracker.created);
+        EXPECT_EQ(0, pool.idle_count());
+    }
+    EXPECT_EQ(10, tracker.deleted);
+
+    reset_tracker();
+    {
+        Pool pool(create_resource, delete_resource, 0);
+        pool.acquire();
+        pool.acquire();
+        EXPECT_EQ(2, tracker.created);
+        EXPECT_EQ(2, tracker.deleted);
+    }
+}
+
+TEST(ResourcePool, idle_timeout)
+{
+    reset_tracker();
+    Pool pool(create_resource, delete_resource, 10, chrono::milliseconds(100));
+    {
+        vector<Pool::Lease> leases;
+        for (int i = 0; i < 6; ++i)
+        {
+            leases.push_back(pool.acquire());
+        }
+    }
+    EXPECT_EQ(6, pool.idle_count());
+    pool.evict_idle();
+    EXPECT_EQ(6, pool.idle_count());
+
+    this_thread::sleep_for(chrono::milliseconds(200));
+    {
+        auto a = pool.acquire();     // Must not be one of the expired ones.
+        EXPECT_EQ(7, a.get());
+    }
+    EXPECT_EQ(1, pool.idle_count());
+    EXPECT_EQ(6, tracker.deleted);
+
+    this_thread::sleep_for(chrono::milliseconds(200));
+    pool.evict_idle();
+    EXPECT_EQ(0, pool.idle_count());
+    EXPECT_EQ(7, tracker.deleted);
+}
+
+TEST(ResourcePool, reset)
+{
+    reset_tracker();
+    int resets = 0;
+    Pool pool(create_resource, delete_resource, 2, chrono::milliseconds::zero(), [&resets](int& r)
+    {
+        ++resets;
+        if (r == 2)
+        {
+            throw 99;
+        }
+        r += 100;
+    });
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+    }
+    EXPECT_EQ(2, resets);
+    EXPECT_EQ(1, tracker.deleted);      // The reset function threw for resource 2.
+    EXPECT_EQ(1, pool.idle_count());
+    auto a = pool.acquire();
+    EXPECT_EQ(101, a.get());
+}
+
+TEST(ResourcePool, lease)
+{
+    reset_tracker();
+    Pool pool(create_resource, delete_resource, 2);
+
+    auto a = pool.acquire();
+    auto b(move(a));
+    EXPECT_FALSE(a);
+    EXPECT_TRUE(b);
+    EXPECT_EQ(1, b.get());
+    try
+    {
+        a.get();
+        FAIL();
+    }
+    catch (LogicException const& e)
+    {
+        EXPECT_STREQ("unity::LogicException: ResourcePool::Lease::get(): lease does not hold a resource", e.what());
+    }
+
+    auto c = pool.acquire();
+    c = move(b);                        // Resource 2 goes back to the pool.
+    EXPECT_EQ(1, c.get());
+    EXPECT_EQ(1, pool.idle_count());
+
+    c.discard();
+    EXPECT_FALSE(c);
+    EXPECT_EQ(1, tracker.deleted);
+    EXPECT_EQ(1, pool.idle_count());
+}
+
+TEST(ResourcePool, exceptions)
+{
+    try
+    {
+        Pool pool(nullptr, delete_resource, 1);
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ResourcePool(): factory must not be empty", e.what());
+    }
+    try
+    {
+        Pool pool(create_resource, delete_resource, 1, chrono::milliseconds(-1));
+        FAIL();
+    }
+    catch (InvalidArgumentException const& e)
+    {
+        EXPECT_STREQ("unity::InvalidArgumentException: ResourcePool(): invalid idle timeout: -1 ms", e.what());
+    }
+
+    reset_tracker();
+    Pool pool([]() -> int { throw 42; }, delete_resource, 1);
+    EXPECT_THROW(pool.acquire(), int);
+}
+
+TEST(ResourcePool, threads)
+{
+    reset_tracker();
+    {
+        mutex m;
+        set<int> in_use;
+        Pool pool(create_resource, delete_resource, 8);
+
+        vector<thread> threads;
+        for (int t = 0; t < 8; ++t)
+        {
+            threads.emplace_back([&]
+            {
+                for (int i = 0; i < 20000; ++i)
+                {
+                    auto lease = pool.acquire();
+                    {
+                        lock_guard<mutex> lock(m);
+                        EXPECT_TRUE(in_use.insert(lease.get()).second);     // No resource is handed out twice.
+                    }
+                    {
+                        lock_guard<mutex> lock(m);
+                        in_use.erase(lease.get());
+                    }
+                }
+            });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        EXPECT_EQ(tracker.created - tracker.deleted, static_cast<int>(pool.idle_count()));
+        EXPECT_LE(tracker.created, 8 * 20000);
+    }
+    EXPECT_EQ(tracker.created, tracker.deleted);
+}
+
+// Measures acquire() and return of a lease with and without contention.
+
+TEST(ResourcePool, DISABLED_benchmark_acquire)
+{
+    Pool pool(create_resource, delete_resource, 8);
+    int const iterations = 10000000;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto lease = pool.acquire();
+    }
+    chrono::duration<double, nano> single = chrono::steady_clock::now() - start;
+    cout << "1 thread:  " << single.count() / iterations << " ns per acquire/release" << endl;
+
+    int const thread_count = 4;
+    start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&pool]
+        {
+            for (int i = 0; i < iterations / thread_count; ++i)
+            {
+                auto lease = pool.acquire();
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    chrono::duration<double, nano> multi = chrono::steady_clock::now() - start;
+    cout << thread_count << " threads: " << multi.count() / iterations << " ns per acquire/release" << endl;
+}
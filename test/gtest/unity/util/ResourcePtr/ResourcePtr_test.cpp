@@ -20,7 +20,11 @@
 #include <unity/UnityExceptions.h>
 #include <unity/util/ResourcePtr.h>
 
+#include <chrono>
+#include <iostream>
 #include <set>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace unity;
@@ -527,3 +531,108 @@ TEST(ResourcePtr, std_specializations)
     EXPECT_FALSE(greater_equal.operator()(zero, one));
     EXPECT_TRUE(greater_equal.operator()(one, zero));
 }
+
+//
+// The same operations must work with every locking policy.
+//
+
+void no_op_int(int) {}
+
+template<typename L>
+void check_policy()
+{
+    {
+        ResourcePtr<int*, decltype(&dealloc_int), L> rp(alloc_int(1), dealloc_int);
+        EXPECT_TRUE(rp.has_resource());
+        rp.reset(alloc_int(2));
+        EXPECT_EQ(reinterpret_cast<int*>(2), rp.get());
+        EXPECT_EQ(1, allocated.size());
+
+        ResourcePtr<int*, decltype(&dealloc_int), L> other(alloc_int(3), dealloc_int);
+        rp.swap(other);
+        EXPECT_EQ(reinterpret_cast<int*>(3), rp.get());
+        EXPECT_TRUE(other < rp);
+        EXPECT_TRUE(other != rp);
+        EXPECT_TRUE(rp == rp);
+
+        ResourcePtr<int*, decltype(&dealloc_int), L> moved(move(other));
+        EXPECT_FALSE(other.has_resource());
+        EXPECT_EQ(reinterpret_cast<int*>(2), moved.get());
+        dealloc_int(moved.release());
+        EXPECT_FALSE(moved);
+    }
+    EXPECT_TRUE(allocated.empty());
+}
+
+TEST(ResourcePtr, lock_policies)
+{
+    check_policy<MutexLockPolicy>();
+    check_policy<SpinLockPolicy>();
+    check_policy<NoLockPolicy>();
+
+    EXPECT_TRUE((is_same<MutexLockPolicy, ResourcePtr<int, decltype(&no_op_int)>::lock_policy_type>::value));
+
+    // Without a lock, a ResourcePtr is no larger than its members.
+
+    struct Members
+    {
+        int resource;
+        decltype(&no_op_int) deleter;
+        bool initialized;
+    };
+    EXPECT_EQ(sizeof(Members), (sizeof(ResourcePtr<int, decltype(&no_op_int), NoLockPolicy>)));
+    EXPECT_EQ(sizeof(Members), (sizeof(ResourcePtr<int, decltype(&no_op_int), SpinLockPolicy>)));
+    EXPECT_LT(sizeof(Members), (sizeof(ResourcePtr<int, decltype(&no_op_int), MutexLockPolicy>)));
+}
+
+TEST(ResourcePtr, spin_lock_threads)
+{
+    int count = 0;
+    ResourcePtr<int, function<void(int)>, SpinLockPolicy> rp(0, [&count](int){ ++count; });
+
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&rp]
+        {
+            for (int i = 0; i < 10000; ++i)
+            {
+                rp.reset(rp.get() + 1);     // Not atomic as a whole, but each call is.
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    EXPECT_EQ(40000, count);    // Every reset() deallocated exactly one resource.
+    EXPECT_GT(rp.get(), 0);
+}
+
+//
+// Measures get() throughput and size with each locking policy.
+//
+
+template<typename L>
+void benchmark_policy(char const* name)
+{
+    int const iterations = 100000000;
+    ResourcePtr<int, decltype(&no_op_int), L> rp(1, no_op_int);
+
+    auto start = chrono::steady_clock::now();
+    long sum = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        sum += rp.get();
+    }
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    EXPECT_EQ(iterations, sum);
+    cout << name << ": sizeof = " << sizeof(rp) << ", get(): " << elapsed.count() / iterations << " ns" << endl;
+}
+
+TEST(ResourcePtr, DISABLED_benchmark_lock_policies)
+{
+    benchmark_policy<MutexLockPolicy>("MutexLockPolicy");
+    benchmark_policy<SpinLockPolicy>("SpinLockPolicy ");
+    benchmark_policy<NoLockPolicy>("NoLockPolicy   ");
+}
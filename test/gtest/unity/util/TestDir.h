@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 Canonical Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNITY_TEST_UTIL_TESTDIR_H
+#define UNITY_TEST_UTIL_TESTDIR_H
+
+#include <unity/UnityExceptions.h>
+#include <unity/util/NonCopyable.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdlib.h>
+
+// Creates an empty temporary directory in the current directory and removes it again on destruction.
+// The directory is named after the running test case.
+
+class TestDir
+{
+public:
+    NONCOPYABLE(TestDir);
+
+    TestDir()
+    {
+        auto info = ::testing::UnitTest::GetInstance()->current_test_info();
+        std::string const tmpl = std::string(info ? info->test_case_name() : "unity") + "_test.XXXXXX";
+        std::vector<char> buf(tmpl.begin(), tmpl.end());
+        buf.push_back('\0');
+        if (!mkdtemp(buf.data()))
+        {
+            int const err = errno;
+            throw unity::SyscallException("TestDir(): cannot create temporary directory \"" + tmpl + "\"", err);
+        }
+        path_ = buf.data();
+    }
+
+    ~TestDir()
+    {
+        if (system(("rm -rf " + path_).c_str())) {}
+    }
+
+    std::string const& path() const
+    {
+        return path_;
+    }
+
+private:
+    std::string path_;
+};
+
+#endif